@@ -18,6 +18,7 @@
 #endif
 
 #if HAVE_ZSTD
+#include <zdict.h>
 #include <zstd.h>
 #include <zstd_errors.h>
 #endif
@@ -56,6 +57,18 @@ static int zstd_ret_to_errno(size_t ret) {
 
 #define ALIGN_8(l) ALIGN_TO(l, sizeof(size_t))
 
+struct CompressDictionary {
+        void *data;
+        size_t size;
+        uint32_t id;
+#if HAVE_ZSTD
+        ZSTD_DDict *ddict;
+        /* Only created when compressing, readers never need them */
+        ZSTD_CDict *cdict;
+        ZSTD_CCtx *cctx;
+#endif
+};
+
 static const char* const compression_table[_COMPRESSION_MAX] = {
         [COMPRESSION_NONE] = "NONE",
         [COMPRESSION_XZ]   = "XZ",
@@ -166,6 +179,135 @@ int compress_blob_zstd(
 #endif
 }
 
+int compress_dictionary_train(
+                const void *samples,
+                const size_t *sample_sizes,
+                size_t n_samples,
+                size_t max_size,
+                void **ret,
+                size_t *ret_size) {
+#if HAVE_ZSTD
+        _cleanup_free_ void *buf = NULL;
+        size_t k;
+
+        assert(samples || n_samples == 0);
+        assert(sample_sizes || n_samples == 0);
+        assert(max_size > 0);
+        assert(ret);
+        assert(ret_size);
+
+        if (n_samples > UINT_MAX)
+                return -E2BIG;
+
+        buf = malloc(max_size);
+        if (!buf)
+                return -ENOMEM;
+
+        /* This fails if there are too few samples, or if they are too similar to make a dictionary of. */
+        k = ZDICT_trainFromBuffer(buf, max_size, samples, sample_sizes, n_samples);
+        if (ZDICT_isError(k))
+                return log_debug_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "Failed to train ZSTD dictionary from %zu samples: %s",
+                                       n_samples, ZDICT_getErrorName(k));
+
+        *ret = TAKE_PTR(buf);
+        *ret_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int compress_dictionary_new(const void *data, size_t size, CompressDictionary **ret) {
+#if HAVE_ZSTD
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+
+        assert(data || size == 0);
+        assert(ret);
+
+        d = new0(CompressDictionary, 1);
+        if (!d)
+                return -ENOMEM;
+
+        /* Raw content dictionaries have no ID, but we need one to tell which frames to use it for. */
+        d->id = ZSTD_getDictID_fromDict(data, size);
+        if (d->id == 0)
+                return -EBADMSG;
+
+        d->data = memdup(data, size);
+        if (!d->data)
+                return -ENOMEM;
+        d->size = size;
+
+        d->ddict = ZSTD_createDDict(d->data, d->size);
+        if (!d->ddict)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(d);
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+CompressDictionary* compress_dictionary_free(CompressDictionary *d) {
+        if (!d)
+                return NULL;
+
+#if HAVE_ZSTD
+        ZSTD_freeDDict(d->ddict);
+        ZSTD_freeCDict(d->cdict);
+        ZSTD_freeCCtx(d->cctx);
+#endif
+
+        free(d->data);
+        return mfree(d);
+}
+
+uint32_t compress_dictionary_id(const CompressDictionary *d) {
+        assert(d);
+
+        return d->id;
+}
+
+int compress_blob_zstd_with_dictionary(
+                CompressDictionary *d,
+                const void *src, uint64_t src_size,
+                void *dst, size_t dst_alloc_size, size_t *dst_size) {
+#if HAVE_ZSTD
+        size_t k;
+
+        assert(d);
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size > 0);
+        assert(dst_size);
+
+        if (!d->cdict) {
+                d->cdict = ZSTD_createCDict(d->data, d->size, 0);
+                if (!d->cdict)
+                        return -ENOMEM;
+        }
+
+        if (!d->cctx) {
+                d->cctx = ZSTD_createCCtx();
+                if (!d->cctx)
+                        return -ENOMEM;
+        }
+
+        /* The dictionary ID is written into the frame header, see zstd_dctx_ref_dictionary() */
+        k = ZSTD_compress_usingCDict(d->cctx, dst, dst_alloc_size, src, src_size, d->cdict);
+        if (ZSTD_isError(k))
+                return zstd_ret_to_errno(k);
+
+        *dst_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_blob_xz(
                 const void *src,
                 uint64_t src_size,
@@ -265,6 +407,31 @@ int decompress_blob_lz4(
 #endif
 }
 
+#if HAVE_ZSTD
+static int zstd_dctx_ref_dictionary(ZSTD_DCtx *dctx, const CompressDictionary *d, const void *src, size_t src_size) {
+        unsigned id;
+        size_t k;
+
+        assert(dctx);
+
+        /* A dictionary also changes the initial state of the decoder, hence only use it for frames that
+         * were compressed with it. */
+        id = ZSTD_getDictID_fromFrame(src, src_size);
+        if (id == 0)
+                return 0;
+
+        if (!d || d->id != id)
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                       "ZSTD frame was compressed with unavailable dictionary %u.", id);
+
+        k = ZSTD_DCtx_refDDict(dctx, d->ddict);
+        if (ZSTD_isError(k))
+                return zstd_ret_to_errno(k);
+
+        return 0;
+}
+#endif
+
 int decompress_blob_zstd(
                 const void *src,
                 uint64_t src_size,
@@ -272,8 +439,20 @@ int decompress_blob_zstd(
                 size_t *dst_size,
                 size_t dst_max) {
 
+        return decompress_blob_zstd_with_dictionary(NULL, src, src_size, dst, dst_size, dst_max);
+}
+
+int decompress_blob_zstd_with_dictionary(
+                const CompressDictionary *d,
+                const void *src,
+                uint64_t src_size,
+                void **dst,
+                size_t *dst_size,
+                size_t dst_max) {
+
 #if HAVE_ZSTD
         uint64_t size;
+        int r;
 
         assert(src);
         assert(src_size > 0);
@@ -296,6 +475,10 @@ int decompress_blob_zstd(
         if (!dctx)
                 return -ENOMEM;
 
+        r = zstd_dctx_ref_dictionary(dctx, d, src, src_size);
+        if (r < 0)
+                return r;
+
         ZSTD_inBuffer input = {
                 .src = src,
                 .size = src_size,
@@ -482,7 +665,21 @@ int decompress_startswith_zstd(
                 const void *prefix,
                 size_t prefix_len,
                 uint8_t extra) {
+
+        return decompress_startswith_zstd_with_dictionary(NULL, src, src_size, buffer, prefix, prefix_len, extra);
+}
+
+int decompress_startswith_zstd_with_dictionary(
+                const CompressDictionary *d,
+                const void *src,
+                uint64_t src_size,
+                void **buffer,
+                const void *prefix,
+                size_t prefix_len,
+                uint8_t extra) {
 #if HAVE_ZSTD
+        int r;
+
         assert(src);
         assert(src_size > 0);
         assert(buffer);
@@ -499,6 +696,10 @@ int decompress_startswith_zstd(
         if (!dctx)
                 return -ENOMEM;
 
+        r = zstd_dctx_ref_dictionary(dctx, d, src, src_size);
+        if (r < 0)
+                return r;
+
         if (!(greedy_realloc(buffer, MAX(ZSTD_DStreamOutSize(), prefix_len + 1), 1)))
                 return -ENOMEM;
 
@@ -6,6 +6,8 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "macro.h"
+
 typedef enum Compression {
         COMPRESSION_NONE,
         COMPRESSION_XZ,
@@ -27,12 +29,31 @@ int compress_blob_lz4(const void *src, uint64_t src_size,
 int compress_blob_zstd(const void *src, uint64_t src_size,
                        void *dst, size_t dst_alloc_size, size_t *dst_size);
 
+/* A trained ZSTD dictionary. Frames compressed with it carry its ID, frames compressed without a dictionary
+ * can be decompressed with or without one. Compressing via a dictionary object is not thread-safe, as the
+ * compression context is cached in it, decompressing is. */
+typedef struct CompressDictionary CompressDictionary;
+
+int compress_dictionary_train(const void *samples, const size_t *sample_sizes, size_t n_samples,
+                              size_t max_size, void **ret, size_t *ret_size);
+int compress_dictionary_new(const void *data, size_t size, CompressDictionary **ret);
+CompressDictionary* compress_dictionary_free(CompressDictionary *d);
+DEFINE_TRIVIAL_CLEANUP_FUNC(CompressDictionary*, compress_dictionary_free);
+uint32_t compress_dictionary_id(const CompressDictionary *d);
+
+int compress_blob_zstd_with_dictionary(CompressDictionary *d,
+                                       const void *src, uint64_t src_size,
+                                       void *dst, size_t dst_alloc_size, size_t *dst_size);
+
 int decompress_blob_xz(const void *src, uint64_t src_size,
                        void **dst, size_t* dst_size, size_t dst_max);
 int decompress_blob_lz4(const void *src, uint64_t src_size,
                         void **dst, size_t* dst_size, size_t dst_max);
 int decompress_blob_zstd(const void *src, uint64_t src_size,
                         void **dst, size_t* dst_size, size_t dst_max);
+int decompress_blob_zstd_with_dictionary(const CompressDictionary *d,
+                                         const void *src, uint64_t src_size,
+                                         void **dst, size_t* dst_size, size_t dst_max);
 int decompress_blob(Compression compression,
                     const void *src, uint64_t src_size,
                     void **dst, size_t* dst_size, size_t dst_max);
@@ -49,6 +70,11 @@ int decompress_startswith_zstd(const void *src, uint64_t src_size,
                                void **buffer,
                                const void *prefix, size_t prefix_len,
                                uint8_t extra);
+int decompress_startswith_zstd_with_dictionary(const CompressDictionary *d,
+                                               const void *src, uint64_t src_size,
+                                               void **buffer,
+                                               const void *prefix, size_t prefix_len,
+                                               uint8_t extra);
 int decompress_startswith(Compression compression,
                           const void *src, uint64_t src_size,
                           void **buffer,
@@ -657,6 +657,39 @@ static inline ssize_t missing_getdents64(int fd, void *buffer, size_t length) {
 
 /* ======================================================================= */
 
+#if !HAVE_IO_URING_SETUP
+
+struct io_uring_params;
+
+static inline int missing_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+#  if defined __NR_io_uring_setup && __NR_io_uring_setup >= 0
+        return syscall(__NR_io_uring_setup, entries, p);
+#  else
+        errno = ENOSYS;
+        return -1;
+#  endif
+}
+
+#  define io_uring_setup missing_io_uring_setup
+#endif
+
+/* ======================================================================= */
+
+#if !HAVE_IO_URING_ENTER
+static inline int missing_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t argsz) {
+#  if defined __NR_io_uring_enter && __NR_io_uring_enter >= 0
+        return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+#  else
+        errno = ENOSYS;
+        return -1;
+#  endif
+}
+
+#  define io_uring_enter missing_io_uring_enter
+#endif
+
+/* ======================================================================= */
+
 /* glibc does not provide clone() on ia64, only clone2(). Not only that, but it also doesn't provide a
  * prototype, only the symbol in the shared library (it provides a prototype for clone(), but not the
  * symbol in the shared library). */
@@ -24,6 +24,8 @@ struct prioq_item {
 
 struct Prioq {
         compare_func_t compare_func;
+        comparison_userdata_fn_t compare_func_r;
+        void *userdata;
         unsigned n_items, n_allocated;
 
         struct prioq_item *items;
@@ -43,6 +45,21 @@ Prioq *prioq_new(compare_func_t compare_func) {
         return q;
 }
 
+Prioq *prioq_new_r(comparison_userdata_fn_t compare_func, void *userdata) {
+        Prioq *q;
+
+        q = new(Prioq, 1);
+        if (!q)
+                return q;
+
+        *q = (Prioq) {
+                .compare_func_r = compare_func,
+                .userdata = userdata,
+        };
+
+        return q;
+}
+
 Prioq* prioq_free(Prioq *q) {
         if (!q)
                 return NULL;
@@ -64,6 +81,15 @@ int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func) {
         return 0;
 }
 
+static int compare(Prioq *q, unsigned j, unsigned k) {
+        assert(q);
+
+        if (q->compare_func_r)
+                return q->compare_func_r(q->items[j].data, q->items[k].data, q->userdata);
+
+        return q->compare_func(q->items[j].data, q->items[k].data);
+}
+
 static void swap(Prioq *q, unsigned j, unsigned k) {
         assert(q);
         assert(j < q->n_items);
@@ -91,7 +117,7 @@ static unsigned shuffle_up(Prioq *q, unsigned idx) {
 
                 k = (idx-1)/2;
 
-                if (q->compare_func(q->items[k].data, q->items[idx].data) <= 0)
+                if (compare(q, k, idx) <= 0)
                         break;
 
                 swap(q, idx, k);
@@ -113,7 +139,7 @@ static unsigned shuffle_down(Prioq *q, unsigned idx) {
                 if (j >= q->n_items)
                         break;
 
-                if (q->compare_func(q->items[j].data, q->items[idx].data) < 0)
+                if (compare(q, j, idx) < 0)
 
                         /* So our left child is smaller than we are, let's
                          * remember this fact */
@@ -122,7 +148,7 @@ static unsigned shuffle_down(Prioq *q, unsigned idx) {
                         s = idx;
 
                 if (k < q->n_items &&
-                    q->compare_func(q->items[k].data, q->items[s].data) < 0)
+                    compare(q, k, s) < 0)
 
                         /* So our right child is smaller than we are, let's
                          * remember this fact */
@@ -141,23 +167,37 @@ static unsigned shuffle_down(Prioq *q, unsigned idx) {
         return idx;
 }
 
+int prioq_reserve(Prioq *q, unsigned n) {
+        struct prioq_item *j;
+
+        assert(q);
+
+        /* Makes sure that the queue can hold n items in total, so that prioq_put() cannot fail until then */
+
+        if (n <= q->n_allocated)
+                return 0;
+
+        n = MAX(n, MAX(q->n_allocated * 2, 16u));
+        j = reallocarray(q->items, n, sizeof(struct prioq_item));
+        if (!j)
+                return -ENOMEM;
+
+        q->items = j;
+        q->n_allocated = n;
+        return 0;
+}
+
 int prioq_put(Prioq *q, void *data, unsigned *idx) {
         struct prioq_item *i;
         unsigned k;
+        int r;
 
         assert(q);
 
         if (q->n_items >= q->n_allocated) {
-                unsigned n;
-                struct prioq_item *j;
-
-                n = MAX((q->n_items+1) * 2, 16u);
-                j = reallocarray(q->items, n, sizeof(struct prioq_item));
-                if (!j)
-                        return -ENOMEM;
-
-                q->items = j;
-                q->n_allocated = n;
+                r = prioq_reserve(q, (q->n_items+1) * 2);
+                if (r < 0)
+                        return r;
         }
 
         k = q->n_items++;
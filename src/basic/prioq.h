@@ -5,16 +5,19 @@
 
 #include "hashmap.h"
 #include "macro.h"
+#include "sort-util.h"
 
 typedef struct Prioq Prioq;
 
 #define PRIOQ_IDX_NULL (UINT_MAX)
 
 Prioq *prioq_new(compare_func_t compare);
+Prioq *prioq_new_r(comparison_userdata_fn_t compare, void *userdata);
 Prioq *prioq_free(Prioq *q);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Prioq*, prioq_free);
 int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func);
 
+int prioq_reserve(Prioq *q, unsigned n);
 int prioq_put(Prioq *q, void *data, unsigned *idx);
 int prioq_ensure_put(Prioq **q, compare_func_t compare_func, void *data, unsigned *idx);
 int prioq_remove(Prioq *q, void *data, unsigned *idx);
@@ -602,6 +602,64 @@ int get_process_ppid(pid_t pid, pid_t *ret) {
         return 0;
 }
 
+int get_process_start_time(pid_t pid, uint64_t *ret) {
+        _cleanup_free_ char *line = NULL;
+        unsigned long long start_time;
+        const char *p;
+        int r;
+
+        assert(pid >= 0);
+
+        /* Returns the time the process started after system boot, in clock ticks. Together with the PID
+         * this identifies a process well enough, as a PID is practically never reused within the same
+         * clock tick. */
+
+        p = procfs_file_alloca(pid, "stat");
+        r = read_one_line_file(p, &line);
+        if (r == -ENOENT)
+                return -ESRCH;
+        if (r < 0)
+                return r;
+
+        /* Let's skip the pid and comm fields. The latter is enclosed in () but does not escape any () in its
+         * value, so let's skip over it manually */
+
+        p = strrchr(line, ')');
+        if (!p)
+                return -EIO;
+
+        p++;
+
+        if (sscanf(p, " "
+                   "%*c "   /* state */
+                   "%*u "   /* ppid */
+                   "%*u "   /* pgrp */
+                   "%*u "   /* session */
+                   "%*u "   /* tty_nr */
+                   "%*u "   /* tpgid */
+                   "%*u "   /* flags */
+                   "%*u "   /* minflt */
+                   "%*u "   /* cminflt */
+                   "%*u "   /* majflt */
+                   "%*u "   /* cmajflt */
+                   "%*u "   /* utime */
+                   "%*u "   /* stime */
+                   "%*u "   /* cutime */
+                   "%*u "   /* cstime */
+                   "%*i "   /* priority */
+                   "%*i "   /* nice */
+                   "%*u "   /* num_threads */
+                   "%*u "   /* itrealvalue */
+                   "%llu ", /* starttime */
+                   &start_time) != 1)
+                return -EIO;
+
+        if (ret)
+                *ret = start_time;
+
+        return 0;
+}
+
 int get_process_umask(pid_t pid, mode_t *ret) {
         _cleanup_free_ char *m = NULL;
         const char *p;
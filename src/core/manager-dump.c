@@ -90,6 +90,9 @@ void manager_dump(Manager *m, FILE *f, char **patterns, const char *prefix) {
 
         manager_dump_units(m, f, patterns, prefix);
         manager_dump_jobs(m, f, patterns, prefix);
+
+        if (!patterns)
+                (void) sd_event_dump_statistics(m->event, f);
 }
 
 int manager_get_dump_string(Manager *m, char **patterns, char **ret) {
@@ -17,6 +17,7 @@
 #include "memory-util.h"
 #include "parse-argument.h"
 #include "parse-helpers.h"
+#include "parse-util.h"
 #include "pretty-print.h"
 #include "process-util.h"
 #include "rlimit-util.h"
@@ -31,6 +32,8 @@
 #define CERT_FILE     CERTIFICATE_ROOT "/certs/journal-remote.pem"
 #define TRUST_FILE    CERTIFICATE_ROOT "/ca/trusted.pem"
 
+#define WRITER_THREADS_MAX 256U
+
 static const char* arg_url = NULL;
 static const char* arg_getter = NULL;
 static const char* arg_listen_raw = NULL;
@@ -58,6 +61,7 @@ static uint64_t arg_max_use = UINT64_MAX;
 static uint64_t arg_max_size = UINT64_MAX;
 static uint64_t arg_n_max_files = UINT64_MAX;
 static uint64_t arg_keep_free = UINT64_MAX;
+static unsigned arg_writer_threads = 0;
 
 STATIC_DESTRUCTOR_REGISTER(arg_gnutls_log, strv_freep);
 STATIC_DESTRUCTOR_REGISTER(arg_key, freep);
@@ -154,7 +158,7 @@ static int dispatch_http_event(sd_event_source *event,
                                uint32_t revents,
                                void *userdata);
 
-static int request_meta(void **connection_cls, int fd, char *hostname) {
+static int request_meta(void **connection_cls, int fd, char *hostname, bool framed) {
         RemoteSource *source;
         Writer *writer;
         int r;
@@ -174,6 +178,9 @@ static int request_meta(void **connection_cls, int fd, char *hostname) {
                 return log_oom();
         }
 
+        if (framed)
+                journal_importer_set_framed(&source->importer);
+
         log_debug("Added RemoteSource as connection metadata %p", source);
 
         *connection_cls = source;
@@ -271,7 +278,7 @@ static mhd_result request_handler(
         const char *header;
         int r, code, fd;
         _cleanup_free_ char *hostname = NULL;
-        bool chunked = false;
+        bool chunked = false, framed;
 
         assert(connection);
         assert(connection_cls);
@@ -291,10 +298,15 @@ static mhd_result request_handler(
         if (!streq(url, "/upload"))
                 return mhd_respond(connection, MHD_HTTP_NOT_FOUND, "Not found.");
 
+        /* Uploaders that speak the framed format fall back to the export format if we refuse it */
         header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Content-Type");
-        if (!header || !streq(header, "application/vnd.fdo.journal"))
+        if (streq_ptr(header, "application/vnd.fdo.journal"))
+                framed = false;
+        else if (streq_ptr(header, "application/vnd.fdo.journal.framed"))
+                framed = true;
+        else
                 return mhd_respond(connection, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
-                                   "Content-Type: application/vnd.fdo.journal is required.");
+                                   "Content-Type: application/vnd.fdo.journal or application/vnd.fdo.journal.framed is required.");
 
         header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Transfer-Encoding");
         if (header) {
@@ -354,7 +366,7 @@ static mhd_result request_handler(
 
         assert(hostname);
 
-        r = request_meta(connection_cls, fd, hostname);
+        r = request_meta(connection_cls, fd, hostname, framed);
         if (r == -ENOMEM)
                 return respond_oom(connection);
         else if (r < 0)
@@ -742,6 +754,7 @@ static int parse_config(void) {
                 { "Remote",  "MaxFileSize",            config_parse_iec_uint64,       0, &arg_max_size    },
                 { "Remote",  "MaxFiles",               config_parse_uint64,           0, &arg_n_max_files },
                 { "Remote",  "KeepFree",               config_parse_iec_uint64,       0, &arg_keep_free   },
+                { "Remote",  "WriterThreads",          config_parse_unsigned,         0, &arg_writer_threads },
                 {}
         };
 
@@ -779,6 +792,7 @@ static int help(void) {
                "     --gnutls-log=CATEGORY...\n"
                "                            Specify a list of gnutls logging categories\n"
                "     --split-mode=none|host How many output files to create\n"
+               "     --writer-threads=N     Write output files from N threads (default: 0)\n"
                "\nNote: file descriptors from sd_listen_fds() will be consumed, too.\n"
                "\nSee the %s for details.\n",
                program_invocation_short_name,
@@ -802,6 +816,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_CERT,
                 ARG_TRUST,
                 ARG_GNUTLS_LOG,
+                ARG_WRITER_THREADS,
         };
 
         static const struct option options[] = {
@@ -820,6 +835,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "cert",         required_argument, NULL, ARG_CERT         },
                 { "trust",        required_argument, NULL, ARG_TRUST        },
                 { "gnutls-log",   required_argument, NULL, ARG_GNUTLS_LOG   },
+                { "writer-threads", required_argument, NULL, ARG_WRITER_THREADS },
                 {}
         };
 
@@ -952,6 +968,12 @@ static int parse_argv(int argc, char *argv[]) {
                                 return r;
                         break;
 
+                case ARG_WRITER_THREADS:
+                        r = safe_atou(optarg, &arg_writer_threads);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --writer-threads= argument: %s", optarg);
+                        break;
+
                 case ARG_GNUTLS_LOG:
 #if HAVE_GNUTLS
                         for (const char* p = optarg;;) {
@@ -1117,6 +1139,7 @@ static int run(int argc, char **argv) {
         s.metrics.max_size = arg_max_size;
         s.metrics.keep_free = arg_keep_free;
         s.metrics.n_max_files = arg_n_max_files;
+        s.n_writer_threads = MIN(arg_writer_threads, WRITER_THREADS_MAX);
 
         r = create_remoteserver(&s, key, cert, trust);
         if (r < 0)
@@ -1145,6 +1168,8 @@ static int run(int argc, char **argv) {
                         return log_error_errno(r, "Failed to run event loop: %m");
         }
 
+        journal_remote_server_sync_workers(&s);
+
         notify_message = NULL;
         (void) sd_notifyf(false,
                           "STOPPING=1\n"
@@ -0,0 +1,278 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "alloc-util.h"
+#include "journal-remote-worker.h"
+#include "journal-remote-write.h"
+
+/* How many entries the worker takes off the queue at once at most */
+#define WORKER_BATCH_MAX 64U
+
+typedef struct RemoteWorkerEntry {
+        Writer *writer;
+        dual_timestamp ts;
+        sd_id128_t boot_id;
+        bool has_boot_id;
+        JournalFileFlags file_flags;
+        size_t n_iovec;
+        struct iovec iovec[];
+} RemoteWorkerEntry;
+
+struct RemoteWorker {
+        pthread_mutex_t mutex;
+        pthread_cond_t work_cond;  /* event loop thread → worker: entries were queued, or we shall exit */
+        pthread_cond_t idle_cond;  /* worker → event loop thread: entries were written */
+
+        pthread_t thread;
+        bool thread_started;
+
+        /* Ring buffer of queued entries */
+        RemoteWorkerEntry **queue;
+        size_t size;
+        size_t head;
+        size_t n_queued;
+
+        size_t n_writing; /* Entries taken off the queue by the worker, but not written yet */
+
+        bool exit;
+};
+
+static RemoteWorkerEntry* remote_worker_entry_new(
+                Writer *writer,
+                const struct iovec_wrapper *iovw,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                JournalFileFlags file_flags) {
+
+        RemoteWorkerEntry *e;
+        size_t sz;
+        uint8_t *p;
+
+        assert(writer);
+        assert(iovw);
+        assert(ts);
+
+        /* The importer reuses its buffer for the next entry, hence copy everything into one allocation */
+
+        sz = offsetof(RemoteWorkerEntry, iovec) + iovw->count * sizeof(struct iovec);
+        for (size_t i = 0; i < iovw->count; i++)
+                sz += iovw->iovec[i].iov_len;
+
+        e = malloc(sz);
+        if (!e)
+                return NULL;
+
+        *e = (RemoteWorkerEntry) {
+                .writer = writer,
+                .ts = *ts,
+                .boot_id = boot_id ? *boot_id : SD_ID128_NULL,
+                .has_boot_id = boot_id,
+                .file_flags = file_flags,
+                .n_iovec = iovw->count,
+        };
+
+        p = (uint8_t*) (e->iovec + iovw->count);
+        for (size_t i = 0; i < iovw->count; i++) {
+                e->iovec[i] = IOVEC_MAKE(p, iovw->iovec[i].iov_len);
+                p = mempcpy_safe(p, iovw->iovec[i].iov_base, iovw->iovec[i].iov_len);
+        }
+
+        return e;
+}
+
+static void remote_worker_entry_write(RemoteWorkerEntry *e) {
+        struct iovec_wrapper iovw;
+        int r;
+
+        assert(e);
+
+        iovw = (struct iovec_wrapper) {
+                .iovec = e->iovec,
+                .count = e->n_iovec,
+        };
+
+        r = writer_append(e->writer, &iovw, &e->ts, e->has_boot_id ? &e->boot_id : NULL, e->file_flags);
+        if (IN_SET(r, -EBADMSG, -EADDRNOTAVAIL))
+                log_warning_errno(r, "Entry is invalid, ignoring.");
+        else if (r < 0)
+                /* There's nobody to return the error to anymore, the source might be gone already */
+                log_error_errno(r, "Failed to write entry of %zu bytes: %m", iovw_size(&iovw));
+}
+
+static void* remote_worker_thread(void *userdata) {
+        RemoteWorker *w = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "journal-remote");
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        for (;;) {
+                RemoteWorkerEntry *batch[WORKER_BATCH_MAX];
+                size_t n;
+
+                while (!w->exit && w->n_queued == 0)
+                        assert_se(pthread_cond_wait(&w->work_cond, &w->mutex) == 0);
+
+                /* Write out everything that is queued before exiting */
+                if (w->n_queued == 0)
+                        break;
+
+                n = MIN(w->n_queued, (size_t) WORKER_BATCH_MAX);
+                for (size_t i = 0; i < n; i++) {
+                        batch[i] = w->queue[w->head];
+                        w->head = (w->head + 1) % w->size;
+                }
+                w->n_queued -= n;
+                w->n_writing = n;
+
+                /* There's space in the queue again */
+                assert_se(pthread_cond_broadcast(&w->idle_cond) == 0);
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+                for (size_t i = 0; i < n; i++) {
+                        remote_worker_entry_write(batch[i]);
+                        free(batch[i]);
+                }
+
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+                w->n_writing = 0;
+                assert_se(pthread_cond_broadcast(&w->idle_cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return NULL;
+}
+
+static int remote_worker_start_thread(RemoteWorker *w) {
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(w);
+        assert(!w->thread_started);
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        /* No signals in the worker threads, please */
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&w->thread, NULL, remote_worker_thread, w);
+        if (r == 0)
+                w->thread_started = true;
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+        if (k > 0)
+                return -k;
+
+        return 0;
+}
+
+int remote_worker_new(size_t queue_size, RemoteWorker **ret) {
+        _cleanup_(remote_worker_freep) RemoteWorker *w = NULL;
+        int r;
+
+        assert(queue_size > 0);
+        assert(ret);
+
+        w = new(RemoteWorker, 1);
+        if (!w)
+                return -ENOMEM;
+
+        /* Initialize the synchronization primitives statically, so that remote_worker_free() may destroy
+         * them on any of the failure paths below */
+        *w = (RemoteWorker) {
+                .size = queue_size,
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .work_cond = PTHREAD_COND_INITIALIZER,
+                .idle_cond = PTHREAD_COND_INITIALIZER,
+        };
+
+        w->queue = new(RemoteWorkerEntry*, queue_size);
+        if (!w->queue)
+                return -ENOMEM;
+
+        r = remote_worker_start_thread(w);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
+
+RemoteWorker* remote_worker_free(RemoteWorker *w) {
+        if (!w)
+                return NULL;
+
+        if (w->thread_started) {
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+                w->exit = true;
+                assert_se(pthread_cond_signal(&w->work_cond) == 0);
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+                (void) pthread_join(w->thread, NULL);
+        }
+
+        /* The worker thread writes out all queued entries before exiting, hence only if it never started
+         * there might be entries left. */
+        for (size_t i = 0; i < w->n_queued; i++)
+                free(w->queue[(w->head + i) % w->size]);
+        free(w->queue);
+
+        (void) pthread_cond_destroy(&w->idle_cond);
+        (void) pthread_cond_destroy(&w->work_cond);
+        (void) pthread_mutex_destroy(&w->mutex);
+
+        return mfree(w);
+}
+
+int remote_worker_enqueue(
+                RemoteWorker *w,
+                Writer *writer,
+                const struct iovec_wrapper *iovw,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                JournalFileFlags file_flags) {
+
+        RemoteWorkerEntry *e;
+
+        assert(w);
+        assert(w->thread_started);
+        assert(writer);
+        assert(!iovw_isempty(iovw));
+        assert(ts);
+
+        e = remote_worker_entry_new(writer, iovw, ts, boot_id, file_flags);
+        if (!e)
+                return -ENOMEM;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        /* If the worker can't keep up, slow down the reading side rather than buffering without bounds */
+        while (w->n_queued >= w->size)
+                assert_se(pthread_cond_wait(&w->idle_cond, &w->mutex) == 0);
+
+        w->queue[(w->head + w->n_queued) % w->size] = e;
+        w->n_queued++;
+
+        assert_se(pthread_cond_signal(&w->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return 0;
+}
+
+void remote_worker_sync(RemoteWorker *w) {
+        assert(w);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        while (w->n_queued > 0 || w->n_writing > 0)
+                assert_se(pthread_cond_wait(&w->idle_cond, &w->mutex) == 0);
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+}
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "journal-file.h"
+#include "journal-importer.h"
+#include "macro.h"
+
+/* Helper threads that append to the output files of systemd-journal-remote. Every Writer may be owned by one
+ * worker. The event loop thread keeps receiving and parsing the incoming streams, and hands the complete
+ * entries for such writers to their worker through a bounded queue, so that the appending of entries for
+ * many hosts is spread over several CPUs.
+ *
+ * Once a writer is owned by a worker, only that worker touches its journal file, until the event loop
+ * thread waits for the worker to become idle with remote_worker_sync(), which it has to do before it may
+ * close the writer. */
+
+typedef struct Writer Writer;
+typedef struct RemoteWorker RemoteWorker;
+
+#define REMOTE_WORKER_QUEUE_SIZE_DEFAULT 1024U
+
+int remote_worker_new(size_t queue_size, RemoteWorker **ret);
+RemoteWorker* remote_worker_free(RemoteWorker *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(RemoteWorker*, remote_worker_free);
+
+int remote_worker_enqueue(
+                RemoteWorker *w,
+                Writer *writer,
+                const struct iovec_wrapper *iovw,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                JournalFileFlags file_flags);
+
+void remote_worker_sync(RemoteWorker *w);
@@ -1,12 +1,17 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <libgen.h>
+#include <pthread.h>
 
 #include "alloc-util.h"
 #include "journal-remote.h"
 #include "path-util.h"
+#include "pthread-util.h"
 #include "stat-util.h"
 
+/* With worker threads, several writers might want to vacuum the same directory at the same time */
+static pthread_mutex_t vacuum_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static int do_rotate(ManagedJournalFile **f, MMapCache *m, JournalFileFlags file_flags) {
         int r;
 
@@ -21,6 +26,14 @@ static int do_rotate(ManagedJournalFile **f, MMapCache *m, JournalFileFlags file
         return r;
 }
 
+static int do_vacuum(Writer *w) {
+        _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_l = pthread_mutex_lock_assert(&vacuum_mutex);
+
+        assert(w);
+
+        return journal_directory_vacuum(w->output, w->metrics.max_use, w->metrics.n_max_files, 0, NULL, /* verbose = */ true);
+}
+
 int writer_new(RemoteServer *server, Writer **ret) {
         _cleanup_(writer_unrefp) Writer *w = NULL;
         int r;
@@ -60,6 +73,10 @@ static Writer* writer_free(Writer *w) {
         if (!w)
                 return NULL;
 
+        /* Let the worker thread finish with the entries it still has for us */
+        if (w->worker)
+                remote_worker_sync(w->worker);
+
         if (w->journal) {
                 log_debug("Closing journal file %s.", w->journal->file->path);
                 managed_journal_file_close(w->journal);
@@ -85,6 +102,21 @@ int writer_write(Writer *w,
                  const dual_timestamp *ts,
                  const sd_id128_t *boot_id,
                  JournalFileFlags file_flags) {
+
+        assert(w);
+        assert(!iovw_isempty(iovw));
+
+        if (w->worker)
+                return remote_worker_enqueue(w->worker, w, iovw, ts, boot_id, file_flags);
+
+        return writer_append(w, iovw, ts, boot_id, file_flags);
+}
+
+int writer_append(Writer *w,
+                  const struct iovec_wrapper *iovw,
+                  const dual_timestamp *ts,
+                  const sd_id128_t *boot_id,
+                  JournalFileFlags file_flags) {
         int r;
 
         assert(w);
@@ -96,7 +128,7 @@ int writer_write(Writer *w,
                 r = do_rotate(&w->journal, w->mmap, file_flags);
                 if (r < 0)
                         return r;
-                r = journal_directory_vacuum(w->output, w->metrics.max_use, w->metrics.n_max_files, 0, NULL, /* verbose = */ true);
+                r = do_vacuum(w);
                 if (r < 0)
                         return r;
         }
@@ -113,7 +145,7 @@ int writer_write(Writer *w,
                         /* ret_offset= */ NULL);
         if (r >= 0) {
                 if (w->server)
-                        w->server->event_count += 1;
+                        __atomic_add_fetch(&w->server->event_count, 1, __ATOMIC_RELAXED);
                 return 0;
         } else if (r == -EBADMSG)
                 return r;
@@ -124,7 +156,7 @@ int writer_write(Writer *w,
                 return r;
         else
                 log_debug("%s: Successfully rotated journal", w->journal->file->path);
-        r = journal_directory_vacuum(w->output, w->metrics.max_use, w->metrics.n_max_files, 0, NULL, /* verbose = */ true);
+        r = do_vacuum(w);
         if (r < 0)
                 return r;
 
@@ -142,6 +174,6 @@ int writer_write(Writer *w,
                 return r;
 
         if (w->server)
-                w->server->event_count += 1;
+                __atomic_add_fetch(&w->server->event_count, 1, __ATOMIC_RELAXED);
         return 0;
 }
@@ -2,6 +2,7 @@
 #pragma once
 
 #include "journal-importer.h"
+#include "journal-remote-worker.h"
 #include "managed-journal-file.h"
 
 typedef struct RemoteServer RemoteServer;
@@ -17,6 +18,8 @@ typedef struct Writer {
 
         uint64_t seqnum;
 
+        RemoteWorker *worker;  /* If set, the entries are appended by this worker thread */
+
         unsigned n_ref;
 } Writer;
 
@@ -31,6 +34,11 @@ int writer_write(Writer *s,
                  const dual_timestamp *ts,
                  const sd_id128_t *boot_id,
                  JournalFileFlags file_flags);
+int writer_append(Writer *w,
+                  const struct iovec_wrapper *iovw,
+                  const dual_timestamp *ts,
+                  const sd_id128_t *boot_id,
+                  JournalFileFlags file_flags);
 
 typedef enum JournalWriteSplitMode {
         JOURNAL_WRITE_SPLIT_NONE,
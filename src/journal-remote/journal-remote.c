@@ -117,6 +117,28 @@ static int init_writer_hashmap(RemoteServer *s) {
         return 0;
 }
 
+static int init_workers(RemoteServer *s) {
+        int r;
+
+        assert(s);
+
+        if (s->n_writer_threads == 0)
+                return 0;
+
+        s->workers = new0(RemoteWorker*, s->n_writer_threads);
+        if (!s->workers)
+                return log_oom();
+
+        for (; s->n_workers < s->n_writer_threads; s->n_workers++) {
+                r = remote_worker_new(REMOTE_WORKER_QUEUE_SIZE_DEFAULT, s->workers + s->n_workers);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to start writer thread: %m");
+        }
+
+        log_debug("Started %zu writer threads.", s->n_workers);
+        return 0;
+}
+
 int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer) {
         _cleanup_(writer_unrefp) Writer *w = NULL;
         const void *key;
@@ -147,6 +169,9 @@ int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer
                 if (r < 0)
                         return r;
 
+                if (s->n_workers > 0)
+                        w->worker = s->workers[s->next_worker++ % s->n_workers];
+
                 if (s->split_mode == JOURNAL_WRITE_SPLIT_HOST) {
                         w->hashmap_key = strdup(key);
                         if (!w->hashmap_key)
@@ -358,9 +383,22 @@ int journal_remote_server_init(
         if (r < 0)
                 return r;
 
+        r = init_workers(s);
+        if (r < 0)
+                return r;
+
         return 0;
 }
 
+void journal_remote_server_sync_workers(RemoteServer *s) {
+        assert(s);
+
+        /* Waits until the worker threads wrote out everything queued so far, so that event_count is
+         * complete */
+        FOREACH_ARRAY(w, s->workers, s->n_workers)
+                remote_worker_sync(*w);
+}
+
 void journal_remote_server_destroy(RemoteServer *s) {
         size_t i;
 
@@ -378,6 +416,11 @@ void journal_remote_server_destroy(RemoteServer *s) {
         writer_unref(s->_single_writer);
         hashmap_free(s->writers);
 
+        /* Only after all writers are gone, they might still have entries queued up to then */
+        FOREACH_ARRAY(w, s->workers, s->n_workers)
+                remote_worker_free(*w);
+        free(s->workers);
+
         sd_event_source_unref(s->sigterm_event);
         sd_event_source_unref(s->sigint_event);
         sd_event_source_unref(s->listen_event);
@@ -36,6 +36,12 @@ struct RemoteServer {
         Writer *_single_writer;
         uint64_t event_count;
 
+        /* Writers are assigned to the worker threads in turn, if there are any */
+        unsigned n_writer_threads;
+        RemoteWorker **workers;
+        size_t n_workers;
+        size_t next_worker;
+
 #if HAVE_MICROHTTPD
         Hashmap *daemons;
 #endif
@@ -64,4 +70,5 @@ int journal_remote_handle_raw_source(
                 uint32_t revents,
                 RemoteServer *s);
 
+void journal_remote_server_sync_workers(RemoteServer *s);
 void journal_remote_server_destroy(RemoteServer *s);
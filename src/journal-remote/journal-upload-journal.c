@@ -6,9 +6,11 @@
 #include "sd-daemon.h"
 
 #include "alloc-util.h"
+#include "journal-importer.h"
 #include "journal-upload.h"
 #include "log.h"
 #include "string-util.h"
+#include "unaligned.h"
 #include "utf8.h"
 
 /**
@@ -233,6 +235,135 @@ static ssize_t write_entry(char *buf, size_t size, Uploader *u) {
         assert_not_reached();
 }
 
+/**
+ * Same as write_entry(), but in the framed format: a fixed header with the timestamps and the boot ID,
+ * followed by each field with its size in front, and a zero size at the end. Nothing is formatted or
+ * escaped, the field data is copied as it is.
+ */
+static ssize_t write_framed_entry(char *buf, size_t size, Uploader *u) {
+        int r;
+        size_t pos = 0;
+
+        assert(size <= SSIZE_MAX);
+
+        for (;;) {
+
+                switch (u->entry_state) {
+                case ENTRY_CURSOR: {
+                        usec_t realtime, monotonic;
+                        sd_id128_t boot_id;
+
+                        /* need space for the whole header */
+                        if (size - pos < JOURNAL_FRAME_HEADER_SIZE)
+                                return pos;
+
+                        /* The cursor isn't sent, but we need it for the state file */
+                        u->current_cursor = mfree(u->current_cursor);
+
+                        r = sd_journal_get_cursor(u->journal, &u->current_cursor);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to get cursor: %m");
+
+                        r = sd_journal_get_realtime_usec(u->journal, &realtime);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to get realtime timestamp: %m");
+
+                        r = sd_journal_get_monotonic_usec(u->journal, &monotonic, &boot_id);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to get monotonic timestamp: %m");
+
+                        unaligned_write_le64(buf + pos, realtime);
+                        unaligned_write_le64(buf + pos + 8, monotonic);
+                        memcpy(buf + pos + 16, boot_id.bytes, sizeof(boot_id.bytes));
+                        pos += JOURNAL_FRAME_HEADER_SIZE;
+
+                        u->entry_state = ENTRY_BOOT_ID;
+                }
+                        _fallthrough_;
+                case ENTRY_BOOT_ID: {
+                        const size_t len = STRLEN("_BOOT_ID=") + SD_ID128_STRING_MAX - 1;
+                        sd_id128_t boot_id;
+
+                        /* need space for size + field */
+                        if (size - pos < 8 + len)
+                                return pos;
+
+                        r = sd_journal_get_monotonic_usec(u->journal, NULL, &boot_id);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to get monotonic timestamp: %m");
+
+                        /* As in the export format, the field is generated from the boot ID in the header */
+                        unaligned_write_le64(buf + pos, len);
+                        memcpy(buf + pos + 8, "_BOOT_ID=", STRLEN("_BOOT_ID="));
+                        memcpy(buf + pos + 8 + STRLEN("_BOOT_ID="), SD_ID128_TO_STRING(boot_id), SD_ID128_STRING_MAX - 1);
+                        pos += 8 + len;
+
+                        u->entry_state = ENTRY_NEW_FIELD;
+                }
+                        _fallthrough_;
+                case ENTRY_NEW_FIELD:
+                        u->field_pos = 0;
+
+                        r = sd_journal_enumerate_data(u->journal,
+                                                      &u->field_data,
+                                                      &u->field_length);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to move to next field in entry: %m");
+                        else if (r == 0) {
+                                u->entry_state = ENTRY_OUTRO;
+                                continue;
+                        }
+
+                        if (memory_startswith(u->field_data, u->field_length, "_BOOT_ID="))
+                                continue;
+
+                        u->entry_state = ENTRY_BINARY_FIELD_SIZE;
+                        _fallthrough_;
+                case ENTRY_BINARY_FIELD_SIZE:
+                        /* need space for uint64_t */
+                        if (size - pos < 8)
+                                return pos;
+
+                        unaligned_write_le64(buf + pos, u->field_length);
+                        pos += 8;
+
+                        u->entry_state = ENTRY_BINARY_FIELD;
+                        _fallthrough_;
+                case ENTRY_BINARY_FIELD: {
+                        size_t tocopy;
+
+                        tocopy = MIN(size - pos, u->field_length - u->field_pos);
+                        memcpy(buf + pos, (const char*) u->field_data + u->field_pos, tocopy);
+                        pos += tocopy;
+                        u->field_pos += tocopy;
+
+                        if (u->field_pos < u->field_length)
+                                return pos;
+
+                        u->entry_state = ENTRY_NEW_FIELD;
+                        continue;
+                }
+
+                case ENTRY_OUTRO:
+                        /* need space for the terminating zero size */
+                        if (size - pos < 8)
+                                return pos;
+
+                        unaligned_write_le64(buf + pos, 0);
+                        pos += 8;
+
+                        u->entry_state = ENTRY_DONE;
+                        u->entries_sent++;
+
+                        return pos;
+
+                default:
+                        assert_not_reached();
+                }
+        }
+        assert_not_reached();
+}
+
 static void check_update_watchdog(Uploader *u) {
         usec_t after;
         usec_t elapsed_time;
@@ -271,6 +402,10 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
                         } else if (r == 0) {
                                 if (u->input_event)
                                         log_debug("No more entries, waiting for journal.");
+                                else if (u->retry_cursor)
+                                        /* The entries might have to be sent again, hence keep the journal
+                                         * open until the server accepted them. */
+                                        log_debug("No more entries, waiting for the server to accept the upload.");
                                 else {
                                         log_info("No more entries, closing journal.");
                                         close_journal_input(u);
@@ -284,7 +419,10 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
                         u->entry_state = ENTRY_CURSOR;
                 }
 
-                w = write_entry((char*)buf + filled, size * nmemb - filled, u);
+                if (u->format == UPLOAD_FORMAT_FRAMED)
+                        w = write_framed_entry((char*)buf + filled, size * nmemb - filled, u);
+                else
+                        w = write_entry((char*)buf + filled, size * nmemb - filled, u);
                 if (w < 0)
                         return CURL_READFUNC_ABORT;
                 filled += w;
@@ -327,11 +465,36 @@ static int process_journal_input(Uploader *u, int skip) {
         else if (r < skip)
                 return 0;
 
+        /* Remember where this upload starts, so that it can be sent again in the export format if the
+         * server doesn't know the framed format */
+        if (u->format != UPLOAD_FORMAT_EXPORT && !u->format_accepted) {
+                u->retry_cursor = mfree(u->retry_cursor);
+
+                r = sd_journal_get_cursor(u->journal, &u->retry_cursor);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to get cursor: %m");
+        }
+
         /* have data */
         u->entry_state = ENTRY_CURSOR;
         return start_upload(u, journal_input_callback, u);
 }
 
+int retry_journal_upload(Uploader *u) {
+        int r;
+
+        assert(u);
+        assert(u->journal);
+        assert(u->retry_cursor);
+
+        r = sd_journal_seek_cursor(u->journal, u->retry_cursor);
+        if (r < 0)
+                return log_error_errno(r, "Failed to seek to cursor %s: %m", u->retry_cursor);
+
+        u->uploading = false;
+        return process_journal_input(u, 0);
+}
+
 int check_journal_input(Uploader *u) {
         if (u->input_event) {
                 int r;
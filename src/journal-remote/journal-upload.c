@@ -32,6 +32,7 @@
 #include "rlimit-util.h"
 #include "sigbus.h"
 #include "signal-util.h"
+#include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
 #include "tmpfile-util.h"
@@ -57,7 +58,22 @@ static const char *arg_namespace = NULL;
 static bool arg_merge = false;
 static int arg_follow = -1;
 static const char *arg_save_state = NULL;
+static char **arg_output_fields = NULL;
 static usec_t arg_network_timeout_usec = USEC_INFINITY;
+static UploadFormat arg_format = UPLOAD_FORMAT_EXPORT;
+
+STATIC_DESTRUCTOR_REGISTER(arg_output_fields, strv_freep);
+
+static const char* const upload_format_table[_UPLOAD_FORMAT_MAX] = {
+        [UPLOAD_FORMAT_EXPORT] = "export",
+        [UPLOAD_FORMAT_FRAMED] = "framed",
+};
+
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP_FROM_STRING(upload_format, UploadFormat);
+static DEFINE_CONFIG_PARSE_ENUM(config_parse_upload_format,
+                                upload_format,
+                                UploadFormat,
+                                "Failed to parse upload format setting");
 
 static void close_fd_input(Uploader *u);
 
@@ -187,7 +203,10 @@ int start_upload(Uploader *u,
                 _cleanup_(curl_slist_free_allp) struct curl_slist *h = NULL;
                 struct curl_slist *l;
 
-                h = curl_slist_append(NULL, "Content-Type: application/vnd.fdo.journal");
+                h = curl_slist_append(NULL,
+                                      u->format == UPLOAD_FORMAT_FRAMED ?
+                                      "Content-Type: application/vnd.fdo.journal.framed" :
+                                      "Content-Type: application/vnd.fdo.journal");
                 if (!h)
                         return log_oom();
 
@@ -467,6 +486,7 @@ static void destroy_uploader(Uploader *u) {
 
         free(u->last_cursor);
         free(u->current_cursor);
+        free(u->retry_cursor);
 
         free(u->url);
 
@@ -480,9 +500,16 @@ static void destroy_uploader(Uploader *u) {
         sd_event_unref(u->events);
 }
 
+static int dispatch_retry(sd_event_source *event, void *userdata) {
+        /* Nothing to do here, this only makes sure that the event loop doesn't wait for new input before the
+         * upload is retried, see run(). */
+        return 0;
+}
+
 static int perform_upload(Uploader *u) {
         CURLcode code;
         long status;
+        int r;
 
         assert(u);
 
@@ -504,6 +531,29 @@ static int perform_upload(Uploader *u) {
                                        "Failed to retrieve response code: %s",
                                        curl_easy_strerror(code));
 
+        /* 415 Unsupported Media Type: the server predates the framed format */
+        if (status == 415 && u->format == UPLOAD_FORMAT_FRAMED && u->retry_cursor) {
+                log_notice("%s does not accept the framed format, uploading in the export format instead.", u->url);
+
+                u->format = UPLOAD_FORMAT_EXPORT;
+                /* Both are set up again with the other Content-Type by start_upload() */
+                curl_easy_cleanup(u->easy);
+                u->easy = NULL;
+                curl_slist_free_all(u->header);
+                u->header = NULL;
+
+                r = retry_journal_upload(u);
+                if (r < 0)
+                        return r;
+
+                /* With --follow, the event loop would otherwise only return once new entries show up */
+                r = sd_event_add_defer(u->events, NULL, dispatch_retry, u);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to schedule retrying the upload: %m");
+
+                return 0;
+        }
+
         if (status >= 300)
                 return log_error_errno(SYNTHETIC_ERRNO(EIO),
                                        "Upload to %s failed with code %ld: %s",
@@ -516,6 +566,18 @@ static int perform_upload(Uploader *u) {
                 log_debug("Upload finished successfully with code %ld: %s",
                           status, strna(u->answer));
 
+        if (u->retry_cursor) {
+                /* The server accepted the format, no need to be able to resend anything anymore */
+                u->format_accepted = true;
+                u->retry_cursor = mfree(u->retry_cursor);
+
+                /* Without --follow the journal is at its end once an upload finished */
+                if (u->journal && !u->input_event) {
+                        log_info("No more entries, closing journal.");
+                        close_journal_input(u);
+                }
+        }
+
         free_and_replace(u->last_cursor, u->current_cursor);
 
         return update_cursor_state(u);
@@ -528,6 +590,7 @@ static int parse_config(void) {
                 { "Upload",  "ServerCertificateFile",  config_parse_path_or_ignore, 0,                        &arg_cert                 },
                 { "Upload",  "TrustedCertificateFile", config_parse_path_or_ignore, 0,                        &arg_trust                },
                 { "Upload",  "NetworkTimeoutSec",      config_parse_sec,            0,                        &arg_network_timeout_usec },
+                { "Upload",  "Format",                 config_parse_upload_format,  0,                        &arg_format               },
                 {}
         };
 
@@ -568,6 +631,8 @@ static int help(void) {
                "     --follow[=BOOL]        Do [not] wait for input\n"
                "     --save-state[=FILE]    Save uploaded cursors (default \n"
                "                            " STATE_FILE ")\n"
+               "     --output-fields=LIST   Upload only the specified fields\n"
+               "     --format=FORMAT        Upload in the \"export\" or the \"framed\" format\n"
                "\nSee the %s for details.\n",
                program_invocation_short_name,
                link);
@@ -589,6 +654,8 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_FOLLOW,
                 ARG_SAVE_STATE,
                 ARG_NAMESPACE,
+                ARG_OUTPUT_FIELDS,
+                ARG_FORMAT,
         };
 
         static const struct option options[] = {
@@ -609,6 +676,8 @@ static int parse_argv(int argc, char *argv[]) {
                 { "after-cursor", required_argument, NULL, ARG_AFTER_CURSOR   },
                 { "follow",       optional_argument, NULL, ARG_FOLLOW         },
                 { "save-state",   optional_argument, NULL, ARG_SAVE_STATE     },
+                { "output-fields", required_argument, NULL, ARG_OUTPUT_FIELDS },
+                { "format",       required_argument, NULL, ARG_FORMAT         },
                 {}
         };
 
@@ -738,6 +807,26 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_save_state = optarg ?: STATE_FILE;
                         break;
 
+                case ARG_OUTPUT_FIELDS: {
+                        _cleanup_strv_free_ char **v = NULL;
+
+                        v = strv_split(optarg, ",");
+                        if (!v)
+                                return log_oom();
+
+                        r = strv_extend_strv(&arg_output_fields, v, true);
+                        if (r < 0)
+                                return log_oom();
+
+                        break;
+                }
+
+                case ARG_FORMAT:
+                        arg_format = upload_format_from_string(optarg);
+                        if (arg_format < 0)
+                                return log_error_errno(arg_format, "Invalid upload format: %s", optarg);
+                        break;
+
                 case '?':
                         return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                                "Unknown option %s.",
@@ -764,27 +853,43 @@ static int parse_argv(int argc, char *argv[]) {
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "Input arguments make no sense with journal input.");
 
+        if (optind < argc && arg_output_fields)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "Option --output-fields= is only supported with journal input.");
+
+        if (optind < argc && arg_format != UPLOAD_FORMAT_EXPORT)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "Option --format= is only supported with journal input.");
+
         return 1;
 }
 
-static int open_journal(sd_journal **j) {
+static int open_journal(sd_journal **ret) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
         int r;
 
-        assert(j);
+        assert(ret);
 
         if (arg_directory)
-                r = sd_journal_open_directory(j, arg_directory, arg_journal_type);
+                r = sd_journal_open_directory(&j, arg_directory, arg_journal_type);
         else if (arg_file)
-                r = sd_journal_open_files(j, (const char**) arg_file, 0);
+                r = sd_journal_open_files(&j, (const char**) arg_file, 0);
         else if (arg_machine)
-                r = journal_open_machine(j, arg_machine);
+                r = journal_open_machine(&j, arg_machine);
         else
-                r = sd_journal_open_namespace(j, arg_namespace,
+                r = sd_journal_open_namespace(&j, arg_namespace,
                                               (arg_merge ? 0 : SD_JOURNAL_LOCAL_ONLY) | arg_namespace_flags | arg_journal_type);
         if (r < 0)
-                log_error_errno(r, "Failed to open %s: %m",
-                                arg_directory ?: (arg_file ? "files" : "journal"));
-        return r;
+                return log_error_errno(r, "Failed to open %s: %m",
+                                       arg_directory ?: (arg_file ? "files" : "journal"));
+
+        /* Let sd-journal skip the fields we don't upload, rather than reading them just to drop them */
+        r = sd_journal_set_data_fields(j, arg_output_fields);
+        if (r < 0)
+                return log_error_errno(r, "Failed to set journal data fields: %m");
+
+        *ret = TAKE_PTR(j);
+        return 0;
 }
 
 static int run(int argc, char **argv) {
@@ -813,6 +918,8 @@ static int run(int argc, char **argv) {
         if (r < 0)
                 return r;
 
+        u.format = arg_format;
+
         sd_event_set_watchdog(u.events, true);
 
         r = check_cursor_updating(&u);
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <errno.h>
 #include <inttypes.h>
 
 #include "sd-event.h"
@@ -23,6 +24,13 @@ typedef enum {
         ENTRY_DONE,                 /* Need to move to a new field. */
 } entry_state;
 
+typedef enum UploadFormat {
+        UPLOAD_FORMAT_EXPORT,       /* The Journal Export Format */
+        UPLOAD_FORMAT_FRAMED,       /* The framed binary format, if the server accepts it */
+        _UPLOAD_FORMAT_MAX,
+        _UPLOAD_FORMAT_INVALID = -EINVAL,
+} UploadFormat;
+
 typedef struct Uploader {
         sd_event *events;
         sd_event_source *sigint_event, *sigterm_event;
@@ -43,6 +51,10 @@ typedef struct Uploader {
         /* journal stuff */
         sd_journal* journal;
 
+        UploadFormat format;
+        bool format_accepted;       /* The server acknowledged an upload in this format already */
+        char *retry_cursor;         /* The first entry of the current upload, while the format is not accepted yet */
+
         entry_state entry_state;
         const void *field_data;
         size_t field_pos, field_length;
@@ -72,3 +84,4 @@ int open_journal_for_upload(Uploader *u,
                             bool follow);
 void close_journal_input(Uploader *u);
 int check_journal_input(Uploader *u);
+int retry_journal_upload(Uploader *u);
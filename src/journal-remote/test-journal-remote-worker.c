@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "chattr-util.h"
+#include "journal-remote.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+#define N_HOSTS 7U
+#define N_ENTRIES 3000U
+
+static void check_host(const char *dn, unsigned host) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ char *fn = NULL;
+        unsigned n = 0;
+
+        assert_se(asprintf(&fn, "%s/remote-host%u.journal", dn, host) >= 0);
+        assert_se(sd_journal_open_files(&j, (const char**) STRV_MAKE(fn), 0) >= 0);
+
+        /* Each file got exactly the entries of its host, in the order they were received */
+        SD_JOURNAL_FOREACH(j) {
+                const void *d;
+                size_t l;
+                unsigned i, h;
+
+                assert_se(sd_journal_get_data(j, "HOST", &d, &l) >= 0);
+                assert_se(safe_atou(strndupa_safe((const char*) d + STRLEN("HOST="), l - STRLEN("HOST=")), &h) >= 0);
+                assert_se(h == host);
+
+                assert_se(sd_journal_get_data(j, "NUMBER", &d, &l) >= 0);
+                assert_se(safe_atou(strndupa_safe((const char*) d + STRLEN("NUMBER="), l - STRLEN("NUMBER=")), &i) >= 0);
+                assert_se(i == host + n * N_HOSTS);
+
+                n++;
+        }
+
+        assert_se(n == (N_ENTRIES - host + N_HOSTS - 1) / N_HOSTS);
+}
+
+static void test_writer_threads_one(unsigned n_threads) {
+        _cleanup_(rm_rf_physical_and_freep) char *dn = NULL;
+        Writer *writers[N_HOSTS] = {};
+        RemoteServer s = {
+                .n_writer_threads = n_threads,
+        };
+
+        log_info("/* %s(%u) */", __func__, n_threads);
+
+        assert_se(mkdtemp_malloc("/var/tmp/test-journal-remote-worker.XXXXXX", &dn) >= 0);
+        (void) chattr_path(dn, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        journal_reset_metrics(&s.metrics);
+        assert_se(journal_remote_server_init(&s, dn, JOURNAL_WRITE_SPLIT_HOST, 0) >= 0);
+        assert_se(s.n_workers == n_threads);
+
+        for (unsigned h = 0; h < N_HOSTS; h++) {
+                _cleanup_free_ char *host = NULL;
+
+                assert_se(asprintf(&host, "host%u", h) >= 0);
+                assert_se(journal_remote_get_writer(&s, host, writers + h) >= 0);
+                assert_se(!!writers[h]->worker == (n_threads > 0));
+        }
+
+        for (unsigned i = 0; i < N_ENTRIES; i++) {
+                _cleanup_free_ char *number = NULL, *host = NULL;
+                struct iovec iovec[3];
+                struct iovec_wrapper iovw = {
+                        .iovec = iovec,
+                        .count = ELEMENTSOF(iovec),
+                };
+                dual_timestamp ts;
+
+                assert_se(asprintf(&number, "NUMBER=%u", i) >= 0);
+                assert_se(asprintf(&host, "HOST=%u", i % N_HOSTS) >= 0);
+
+                iovec[0] = IOVEC_MAKE_STRING("MESSAGE=hello");
+                iovec[1] = IOVEC_MAKE_STRING(number);
+                iovec[2] = IOVEC_MAKE_STRING(host);
+
+                ts = (dual_timestamp) {
+                        .realtime = 1000000 + i,
+                        .monotonic = 1000000 + i,
+                };
+
+                assert_se(writer_write(writers[i % N_HOSTS], &iovw, &ts, NULL, 0) >= 0);
+        }
+
+        /* Closing the writers waits for the worker threads to catch up */
+        FOREACH_ARRAY(w, writers, N_HOSTS)
+                writer_unref(*w);
+
+        assert_se(s.event_count == N_ENTRIES);
+
+        journal_remote_server_destroy(&s);
+
+        for (unsigned h = 0; h < N_HOSTS; h++)
+                check_host(dn, h);
+}
+
+TEST(writer_threads) {
+        test_writer_threads_one(0);
+        test_writer_threads_one(1);
+        test_writer_threads_one(3);
+}
+
+static int intro(void) {
+        /* managed_journal_file_open requires a valid machine id */
+        if (access("/etc/machine-id", F_OK) != 0)
+                return log_tests_skipped("/etc/machine-id not found");
+
+        return EXIT_SUCCESS;
+}
+
+DEFINE_TEST_MAIN_WITH_INTRO(LOG_INFO, intro);
@@ -39,6 +39,8 @@
 #include "hostname-util.h"
 #include "id128-print.h"
 #include "io-util.h"
+#include "journal-aggregate.h"
+#include "journal-columnar.h"
 #include "journal-def.h"
 #include "journal-internal.h"
 #include "journal-util.h"
@@ -88,6 +90,7 @@ enum {
 };
 
 static OutputMode arg_output = OUTPUT_SHORT;
+static bool arg_output_set = false;
 static JsonFormatFlags arg_json_format_flags = JSON_FORMAT_OFF;
 static bool arg_utc = false;
 static bool arg_follow = false;
@@ -105,6 +108,10 @@ static sd_id128_t arg_boot_id = {};
 static int arg_boot_offset = 0;
 static bool arg_dmesg = false;
 static bool arg_no_hostname = false;
+static bool arg_export_columnar = false;
+static bool arg_aggregate = false;
+static char **arg_aggregate_fields = NULL;
+static usec_t arg_aggregate_interval = 0;
 static const char *arg_cursor = NULL;
 static const char *arg_cursor_file = NULL;
 static const char *arg_after_cursor = NULL;
@@ -115,6 +122,8 @@ static bool arg_file_stdin = false;
 static int arg_priorities = 0xFF;
 static Set *arg_facilities = NULL;
 static char *arg_verify_key = NULL;
+static unsigned arg_verify_threads = 0;
+static bool arg_verify_checkpoint = false;
 #if HAVE_GCRYPT
 static usec_t arg_interval = DEFAULT_FSS_INTERVAL_USEC;
 static bool arg_force = false;
@@ -151,6 +160,7 @@ STATIC_DESTRUCTOR_REGISTER(arg_user_units, strv_freep);
 STATIC_DESTRUCTOR_REGISTER(arg_root, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_image, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_output_fields, set_freep);
+STATIC_DESTRUCTOR_REGISTER(arg_aggregate_fields, strv_freep);
 STATIC_DESTRUCTOR_REGISTER(arg_compiled_pattern, pattern_freep);
 STATIC_DESTRUCTOR_REGISTER(arg_image_policy, image_policy_freep);
 
@@ -175,12 +185,6 @@ static enum {
         ACTION_LIST_FIELD_NAMES,
 } arg_action = ACTION_SHOW;
 
-typedef struct BootId {
-        sd_id128_t id;
-        usec_t first_usec;
-        usec_t last_usec;
-} BootId;
-
 static int add_matches_for_device(sd_journal *j, const char *devpath) {
         _cleanup_(sd_device_unrefp) sd_device *device = NULL;
         sd_device *d = NULL;
@@ -398,6 +402,10 @@ static int help(void) {
                "                               json, json-pretty, json-sse, json-seq, cat,\n"
                "                               with-unit)\n"
                "     --output-fields=LIST    Select fields to print in verbose/export/json modes\n"
+               "     --export-columnar       Write entries in the binary Journal Columnar Format\n"
+               "     --aggregate=FIELDS      Count entries by the values of the specified fields\n"
+               "     --aggregate-interval=TIME\n"
+               "                             Count entries in time intervals of the specified length\n"
                "  -n --lines[=[+]INTEGER]    Number of journal entries to show\n"
                "  -r --reverse               Show the newest entries first\n"
                "     --show-cursor           Print the cursor after all the entries\n"
@@ -416,6 +424,8 @@ static int help(void) {
                "\n%3$sForward Secure Sealing (FSS) Options:%4$s\n"
                "     --interval=TIME         Time interval for changing the FSS sealing key\n"
                "     --verify-key=KEY        Specify FSS verification key\n"
+               "     --verify-checkpoint     Skip data hashes of sealed files verified before\n"
+               "     --verify-threads=N      Check data hashes with N threads while verifying\n"
                "     --force                 Override of the FSS key pair with --setup-keys\n"
                "\n%3$sCommands:%4$s\n"
                "  -h --help                  Show this help text\n"
@@ -471,6 +481,8 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_INTERVAL,
                 ARG_VERIFY,
                 ARG_VERIFY_KEY,
+                ARG_VERIFY_CHECKPOINT,
+                ARG_VERIFY_THREADS,
                 ARG_DISK_USAGE,
                 ARG_AFTER_CURSOR,
                 ARG_CURSOR_FILE,
@@ -493,6 +505,9 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_VACUUM_TIME,
                 ARG_NO_HOSTNAME,
                 ARG_OUTPUT_FIELDS,
+                ARG_EXPORT_COLUMNAR,
+                ARG_AGGREGATE,
+                ARG_AGGREGATE_INTERVAL,
                 ARG_NAMESPACE,
         };
 
@@ -534,6 +549,8 @@ static int parse_argv(int argc, char *argv[]) {
                 { "interval",             required_argument, NULL, ARG_INTERVAL             },
                 { "verify",               no_argument,       NULL, ARG_VERIFY               },
                 { "verify-key",           required_argument, NULL, ARG_VERIFY_KEY           },
+                { "verify-checkpoint",    no_argument,       NULL, ARG_VERIFY_CHECKPOINT    },
+                { "verify-threads",       required_argument, NULL, ARG_VERIFY_THREADS       },
                 { "disk-usage",           no_argument,       NULL, ARG_DISK_USAGE           },
                 { "cursor",               required_argument, NULL, 'c'                      },
                 { "cursor-file",          required_argument, NULL, ARG_CURSOR_FILE          },
@@ -562,6 +579,9 @@ static int parse_argv(int argc, char *argv[]) {
                 { "vacuum-time",          required_argument, NULL, ARG_VACUUM_TIME          },
                 { "no-hostname",          no_argument,       NULL, ARG_NO_HOSTNAME          },
                 { "output-fields",        required_argument, NULL, ARG_OUTPUT_FIELDS        },
+                { "export-columnar",      no_argument,       NULL, ARG_EXPORT_COLUMNAR      },
+                { "aggregate",            required_argument, NULL, ARG_AGGREGATE            },
+                { "aggregate-interval",   required_argument, NULL, ARG_AGGREGATE_INTERVAL   },
                 { "namespace",            required_argument, NULL, ARG_NAMESPACE            },
                 {}
         };
@@ -609,6 +629,8 @@ static int parse_argv(int argc, char *argv[]) {
                         if (arg_output < 0)
                                 return log_error_errno(arg_output, "Unknown output format '%s'.", optarg);
 
+                        arg_output_set = true;
+
                         if (IN_SET(arg_output, OUTPUT_EXPORT, OUTPUT_JSON, OUTPUT_JSON_PRETTY, OUTPUT_JSON_SSE, OUTPUT_JSON_SEQ, OUTPUT_CAT))
                                 arg_quiet = true;
 
@@ -789,6 +811,17 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_action = ACTION_VERIFY;
                         break;
 
+                case ARG_VERIFY_THREADS:
+                        r = safe_atou(optarg, &arg_verify_threads);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse number of verification threads: %s", optarg);
+                        if (arg_verify_threads > JOURNAL_VERIFY_THREADS_MAX)
+                                return log_error_errno(SYNTHETIC_ERRNO(ERANGE),
+                                                       "Number of verification threads too large, refusing: %s", optarg);
+
+                        arg_action = ACTION_VERIFY;
+                        break;
+
                 case ARG_DISK_USAGE:
                         arg_action = ACTION_DISK_USAGE;
                         break;
@@ -838,6 +871,11 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_merge = false;
                         break;
 
+                case ARG_VERIFY_CHECKPOINT:
+                        arg_verify_checkpoint = true;
+                        arg_action = ACTION_VERIFY;
+                        break;
+
                 case ARG_INTERVAL:
                         r = parse_sec(optarg, &arg_interval);
                         if (r < 0 || arg_interval <= 0)
@@ -847,6 +885,7 @@ static int parse_argv(int argc, char *argv[]) {
 #else
                 case ARG_SETUP_KEYS:
                 case ARG_VERIFY_KEY:
+                case ARG_VERIFY_CHECKPOINT:
                 case ARG_INTERVAL:
                 case ARG_FORCE:
                         return log_error_errno(SYNTHETIC_ERRNO(EOPNOTSUPP),
@@ -1068,6 +1107,42 @@ static int parse_argv(int argc, char *argv[]) {
 
                         break;
                 }
+
+                case ARG_EXPORT_COLUMNAR:
+                        arg_export_columnar = true;
+                        arg_quiet = true;
+                        break;
+
+                case ARG_AGGREGATE: {
+                        _cleanup_strv_free_ char **v = NULL;
+
+                        v = strv_split(optarg, ",");
+                        if (!v)
+                                return log_oom();
+
+                        STRV_FOREACH(f, v)
+                                if (!journal_field_valid(*f, SIZE_MAX, /* allow_protected= */ true))
+                                        return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                                               "Invalid field name: %s", *f);
+
+                        r = strv_extend_strv(&arg_aggregate_fields, v, /* filter_duplicates= */ true);
+                        if (r < 0)
+                                return log_oom();
+
+                        arg_aggregate = true;
+                        break;
+                }
+
+                case ARG_AGGREGATE_INTERVAL:
+                        r = parse_sec(optarg, &arg_aggregate_interval);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse aggregation interval: %s", optarg);
+                        if (arg_aggregate_interval == USEC_INFINITY)
+                                arg_aggregate_interval = 0;
+
+                        arg_aggregate = true;
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -1103,6 +1178,22 @@ static int parse_argv(int argc, char *argv[]) {
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "Please specify either --reverse or --follow, not both.");
 
+        if (arg_export_columnar && arg_follow)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "--export-columnar cannot be combined with --follow.");
+
+        if (arg_export_columnar && (arg_output_set || arg_output_fields || arg_show_cursor))
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "--export-columnar cannot be combined with --output=, --output-fields= or --show-cursor.");
+
+        if (arg_aggregate && (arg_follow || arg_export_columnar))
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "--aggregate= and --aggregate-interval= cannot be combined with --follow or --export-columnar.");
+
+        if (arg_export_columnar && arg_action == ACTION_SHOW && isatty(STDOUT_FILENO))
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "Refusing to write binary columnar data to a terminal.");
+
         if (arg_lines >= 0 && arg_lines_oldest && (arg_reverse || arg_follow))
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "--lines=+N is unsupported when --reverse or --follow is specified.");
@@ -1336,10 +1427,36 @@ static int find_boot_by_id(sd_journal *j) {
         return r > 0;
 }
 
+static int find_boot_by_offset_fast(sd_journal *j) {
+        _cleanup_free_ BootId *boots = NULL;
+        size_t n_boots;
+        int r, i;
+
+        assert(j);
+
+        r = journal_get_boots(j, &boots, &n_boots);
+        if (r < 0)
+                return r;
+
+        /* Offset 0 is the last boot, 1 the first one */
+        i = arg_boot_offset <= 0 ? (int) n_boots - 1 + arg_boot_offset : arg_boot_offset - 1;
+        if (i < 0 || (size_t) i >= n_boots)
+                return 0;
+
+        arg_boot_id = boots[i].id;
+        return 1;
+}
+
 static int find_boot_by_offset(sd_journal *j) {
         bool advance_older, skip_once;
         int r;
 
+        r = find_boot_by_offset_fast(j);
+        if (r >= 0)
+                return r;
+
+        log_debug_errno(r, "Failed to enumerate boots quickly, looking at the entries instead: %m");
+
         /* Adjust for the asymmetry that offset 0 is the last (and current) boot, while 1 is considered the
          * (chronological) first boot in the journal. */
         advance_older = skip_once = arg_boot_offset <= 0;
@@ -1388,6 +1505,15 @@ static int get_boots(sd_journal *j, BootId **ret_boots, size_t *ret_n_boots) {
         assert(ret_boots);
         assert(ret_n_boots);
 
+        r = journal_get_boots(j, &boots, &n_boots);
+        if (r >= 0) {
+                *ret_boots = TAKE_PTR(boots);
+                *ret_n_boots = n_boots;
+                return n_boots > 0;
+        }
+
+        log_debug_errno(r, "Failed to enumerate boots quickly, looking at the entries instead: %m");
+
         r = sd_journal_seek_head(j); /* seek to oldest */
         if (r < 0)
                 return r;
@@ -2002,7 +2128,13 @@ static int verify(sd_journal *j, bool verbose) {
                         log_notice("Journal file %s has sealing enabled but verification key has not been passed using --verify-key=.", f->path);
 #endif
 
-                k = journal_file_verify(f, arg_verify_key, &first, &validated, &last, verbose);
+                k = journal_file_verify_full(
+                                f,
+                                arg_verify_key,
+                                (verbose ? JOURNAL_VERIFY_SHOW_PROGRESS : 0) |
+                                (arg_verify_checkpoint ? JOURNAL_VERIFY_CHECKPOINT : 0),
+                                arg_verify_threads,
+                                &first, &validated, &last);
                 if (k == -EINVAL)
                         /* If the key was invalid give up right-away. */
                         return k;
@@ -2152,6 +2284,8 @@ typedef struct Context {
         sd_id128_t previous_boot_id;
         sd_id128_t previous_boot_id_output;
         dual_timestamp previous_ts_output;
+        JournalColumnarWriter *columnar;
+        JournalAggregate *aggregate;
 } Context;
 
 static int show(Context *c) {
@@ -2213,7 +2347,7 @@ static int show(Context *c) {
                         c->since_seeked = true; /* We're surely within the range of --since now */
                 }
 
-                if (!arg_merge && !arg_quiet) {
+                if (!arg_merge && !arg_quiet && !c->aggregate) {
                         sd_id128_t boot_id;
 
                         r = sd_journal_get_monotonic_usec(j, NULL, &boot_id);
@@ -2263,9 +2397,18 @@ static int show(Context *c) {
                         arg_truncate_newline * OUTPUT_TRUNCATE_NEWLINE |
                         arg_no_hostname * OUTPUT_NO_HOSTNAME;
 
-                r = show_journal_entry(stdout, j, arg_output, 0, flags,
-                                       arg_output_fields, highlight, &c->ellipsized,
-                                       &c->previous_ts_output, &c->previous_boot_id_output);
+                if (c->aggregate) {
+                        r = journal_aggregate_add(c->aggregate, j);
+                        if (r < 0 && r != -EADDRNOTAVAIL)
+                                return log_error_errno(r, "Failed to add journal entry to aggregation: %m");
+                } else if (c->columnar) {
+                        r = journal_columnar_writer_add(c->columnar, j);
+                        if (r < 0 && r != -EADDRNOTAVAIL)
+                                return log_error_errno(r, "Failed to add journal entry to columnar output: %m");
+                } else
+                        r = show_journal_entry(stdout, j, arg_output, 0, flags,
+                                               arg_output_fields, highlight, &c->ellipsized,
+                                               &c->previous_ts_output, &c->previous_boot_id_output);
                 c->need_seek = true;
                 if (r == -EADDRNOTAVAIL)
                         break;
@@ -2290,6 +2433,72 @@ static int show(Context *c) {
         return n_shown;
 }
 
+static int show_aggregate(JournalAggregate *a) {
+        _cleanup_free_ JournalAggregateGroup **groups = NULL;
+        _cleanup_(table_unrefp) Table *table = NULL;
+        size_t n_groups;
+        int r;
+
+        assert(a);
+
+        r = journal_aggregate_get_groups(a, &groups, &n_groups);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get aggregated entries: %m");
+
+        table = table_new_raw((arg_aggregate_interval > 0) + strv_length(arg_aggregate_fields) + 1);
+        if (!table)
+                return log_oom();
+
+        if (arg_aggregate_interval > 0) {
+                r = table_add_cell(table, NULL, TABLE_HEADER, "time");
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+
+        STRV_FOREACH(f, arg_aggregate_fields) {
+                r = table_add_cell(table, NULL, TABLE_HEADER, *f);
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+
+        r = table_add_cell(table, NULL, TABLE_HEADER, "count");
+        if (r < 0)
+                return table_log_add_error(r);
+
+        if (arg_full)
+                table_set_width(table, 0);
+
+        table_set_ersatz_string(table, TABLE_ERSATZ_DASH);
+
+        for (size_t k = 0; k < n_groups; k++) {
+                JournalAggregateGroup *g = groups[arg_reverse ? n_groups - k - 1 : k];
+
+                if (arg_aggregate_interval > 0) {
+                        r = table_add_cell(table, NULL, arg_utc ? TABLE_TIMESTAMP_UTC : TABLE_TIMESTAMP, &g->bucket);
+                        if (r < 0)
+                                return table_log_add_error(r);
+                }
+
+                for (size_t i = 0; i < g->n_values; i++) {
+                        r = table_add_cell(table, NULL, TABLE_STRING, g->values[i]);
+                        if (r < 0)
+                                return table_log_add_error(r);
+                }
+
+                r = table_add_many(table,
+                                   TABLE_UINT64, g->count,
+                                   TABLE_SET_ALIGN_PERCENT, 100);
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+
+        r = table_print_with_pager(table, arg_json_format_flags, arg_pager_flags, !arg_quiet);
+        if (r < 0)
+                return table_log_print_error(r);
+
+        return 0;
+}
+
 static int show_and_fflush(Context *c, sd_event_source *s) {
         int r;
 
@@ -2376,7 +2585,9 @@ static int run(int argc, char *argv[]) {
         _cleanup_(loop_device_unrefp) LoopDevice *loop_device = NULL;
         _cleanup_(umount_and_freep) char *mounted_dir = NULL;
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
-        int n_shown, r, poll_fd = -EBADF;
+        _cleanup_(journal_columnar_writer_freep) JournalColumnarWriter *columnar = NULL;
+        _cleanup_(journal_aggregate_freep) JournalAggregate *aggregate = NULL;
+        int n_shown, open_flags, r, poll_fd = -EBADF;
 
         setlocale(LC_ALL, "");
         log_setup();
@@ -2486,14 +2697,18 @@ static int run(int argc, char *argv[]) {
                 assert_not_reached();
         }
 
+        /* When dumping the journal we'll likely go through a lot of cold data, hence let the helper threads
+         * read ahead. When following, we spend most of the time waiting at the end of the journal anyway. */
+        open_flags = arg_follow ? 0 : SD_JOURNAL_PARALLEL;
+
         if (arg_directory)
-                r = sd_journal_open_directory(&j, arg_directory, arg_journal_type);
+                r = sd_journal_open_directory(&j, arg_directory, arg_journal_type | open_flags);
         else if (arg_root)
-                r = sd_journal_open_directory(&j, arg_root, arg_journal_type | SD_JOURNAL_OS_ROOT);
+                r = sd_journal_open_directory(&j, arg_root, arg_journal_type | SD_JOURNAL_OS_ROOT | open_flags);
         else if (arg_file_stdin)
-                r = sd_journal_open_files_fd(&j, (int[]) { STDIN_FILENO }, 1, 0);
+                r = sd_journal_open_files_fd(&j, (int[]) { STDIN_FILENO }, 1, open_flags);
         else if (arg_file)
-                r = sd_journal_open_files(&j, (const char**) arg_file, 0);
+                r = sd_journal_open_files(&j, (const char**) arg_file, open_flags);
         else if (arg_machine)
                 r = journal_open_machine(&j, arg_machine);
         else
@@ -2501,7 +2716,7 @@ static int run(int argc, char *argv[]) {
                                 &j,
                                 arg_namespace,
                                 (arg_merge ? 0 : SD_JOURNAL_LOCAL_ONLY) |
-                                arg_namespace_flags | arg_journal_type);
+                                arg_namespace_flags | arg_journal_type | open_flags);
         if (r < 0)
                 return log_error_errno(r, "Failed to open %s: %m", arg_directory ?: arg_file ? "files" : "journal");
 
@@ -2766,10 +2981,33 @@ static int run(int argc, char *argv[]) {
                 }
         }
 
+        if (arg_aggregate) {
+                /* Only the data objects of the grouping fields are looked at, and not through the regular
+                 * data enumeration, hence no need to set up the data fields for output */
+                r = journal_aggregate_new(arg_aggregate_fields, arg_aggregate_interval, &aggregate);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to allocate aggregation: %m");
+        } else if (arg_export_columnar) {
+                /* Analytics want the full data, don't truncate large fields */
+                r = sd_journal_set_data_threshold(j, 0);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to unset data size threshold: %m");
+
+                r = journal_columnar_writer_new(stdout, 0, &columnar);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to allocate columnar writer: %m");
+        } else {
+                r = journal_set_data_fields_for_output(j, arg_output, arg_output_fields);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to set journal data fields: %m");
+        }
+
         Context c = {
                 .journal = j,
                 .need_seek = need_seek,
                 .since_seeked = since_seeked,
+                .columnar = columnar,
+                .aggregate = aggregate,
         };
 
         if (arg_follow) {
@@ -2807,7 +3045,17 @@ static int run(int argc, char *argv[]) {
                 return r;
         n_shown = r;
 
-        if (n_shown == 0 && !arg_quiet)
+        if (columnar) {
+                r = journal_columnar_writer_flush(columnar);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to write columnar output: %m");
+        }
+
+        if (aggregate) {
+                r = show_aggregate(aggregate);
+                if (r < 0)
+                        return r;
+        } else if (n_shown == 0 && !arg_quiet)
                 printf("-- No entries --\n");
 
         r = update_cursor(j);
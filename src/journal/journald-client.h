@@ -3,5 +3,5 @@
 
 #include "journald-context.h"
 
-int client_context_read_log_filter_patterns(ClientContext *c, const char *cgroup);
+int client_unit_context_read_log_filter_patterns(ClientUnitContext *u, const char *cgroup);
 int client_context_check_keep_log(ClientContext *c, const char *message, size_t len);
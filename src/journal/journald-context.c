@@ -31,10 +31,19 @@
  * log entry was originally created. We hence just increase the "window of inaccuracy" a bit.
  *
  * The cache is indexed by the PID. Entries may be "pinned" in the cache, in which case the entries are not removed
- * until they are unpinned. Unpinned entries are kept around until cache pressure is seen. Cache entries older than 5s
- * are never used (a sad attempt to deal with the UNIX weakness of PIDs reuse), cache entries older than 1s are
- * refreshed in an incremental way (meaning: data is reread from /proc, but any old data we can't refresh is not
- * flushed out). Data newer than 1s is used immediately without refresh.
+ * until they are unpinned. Unpinned entries are kept around until cache pressure is seen. Cache entries older than 1s
+ * are refreshed in an incremental way (meaning: data is reread from /proc, but any old data we can't refresh is not
+ * flushed out). Data newer than 1s is used immediately without refresh. To deal with the UNIX weakness of PID reuse,
+ * we also remember the start time of the process: if it changed by the time we refresh an entry, the PID now refers
+ * to a different process, and the entry is flushed out entirely. If we can't determine the start time anymore (for
+ * example because the process is gone already), unpinned entries older than 5s are flushed out, too.
+ *
+ * Metadata that belongs to the unit rather than to the process (the invocation ID, the log level and rate limit
+ * settings, extra fields and log filter patterns) is kept in separate ClientUnitContext objects, which are shared by
+ * all cache entries of processes in the same cgroup. They are refreshed at most every 1s, too, no matter how many
+ * processes of the unit log, unless the invocation ID of the unit changed, i.e. the unit was restarted. This
+ * matters on systems with many short-lived processes, as each new process would otherwise require all of the
+ * unit's settings to be read again.
  *
  * Log stream clients (i.e. all clients using the AF_UNIX/SOCK_STREAM stdout/stderr transport) will pin a cache entry
  * as long as their socket is connected. Note that cache entries are shared between different transports. That means a
@@ -103,6 +112,77 @@ static int client_context_compare(const void *a, const void *b) {
         return CMP(x->pid, y->pid);
 }
 
+static ClientUnitContext* client_unit_context_free(Server *s, ClientUnitContext *u) {
+        assert(s);
+
+        if (!u)
+                return NULL;
+
+        assert_se(hashmap_remove(s->client_unit_contexts, u->id) == u);
+
+        free(u->id);
+
+        free(u->extra_fields_iovec);
+        free(u->extra_fields_data);
+
+        set_free_free(u->log_filter_allowed_patterns);
+        set_free_free(u->log_filter_denied_patterns);
+
+        return mfree(u);
+}
+
+static ClientUnitContext* client_unit_context_unref(Server *s, ClientUnitContext *u) {
+        assert(s);
+
+        if (!u)
+                return NULL;
+
+        assert(u->n_ref > 0);
+
+        u->n_ref--;
+        if (u->n_ref > 0)
+                return NULL;
+
+        return client_unit_context_free(s, u);
+}
+
+static int client_unit_context_new(Server *s, const char *id, ClientUnitContext **ret) {
+        _cleanup_free_ ClientUnitContext *u = NULL;
+        _cleanup_free_ char *copy = NULL;
+        int r;
+
+        assert(s);
+        assert(id);
+        assert(ret);
+
+        copy = strdup(id);
+        if (!copy)
+                return -ENOMEM;
+
+        u = new(ClientUnitContext, 1);
+        if (!u)
+                return -ENOMEM;
+
+        *u = (ClientUnitContext) {
+                .n_ref = 1,
+                .timestamp = USEC_INFINITY,
+                .id = TAKE_PTR(copy),
+                .extra_fields_mtime = NSEC_INFINITY,
+                .log_level_max = -1,
+                .log_ratelimit_interval = s->ratelimit_interval,
+                .log_ratelimit_burst = s->ratelimit_burst,
+        };
+
+        r = hashmap_ensure_put(&s->client_unit_contexts, &string_hash_ops, u->id, u);
+        if (r < 0) {
+                free(u->id);
+                return r;
+        }
+
+        *ret = TAKE_PTR(u);
+        return 0;
+}
+
 static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         _cleanup_free_ ClientContext *c = NULL;
         int r;
@@ -128,10 +208,7 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
                 .owner_uid = UID_INVALID,
                 .lru_index = PRIOQ_IDX_NULL,
                 .timestamp = USEC_INFINITY,
-                .extra_fields_mtime = NSEC_INFINITY,
-                .log_level_max = -1,
-                .log_ratelimit_interval = s->ratelimit_interval,
-                .log_ratelimit_burst = s->ratelimit_burst,
+                .start_time = UINT64_MAX,
         };
 
         r = hashmap_ensure_put(&s->client_contexts, NULL, PID_TO_PTR(pid), c);
@@ -167,23 +244,12 @@ static void client_context_reset(Server *s, ClientContext *c) {
         c->slice = mfree(c->slice);
         c->user_slice = mfree(c->user_slice);
 
-        c->invocation_id = SD_ID128_NULL;
-
         c->label = mfree(c->label);
         c->label_size = 0;
 
-        c->extra_fields_iovec = mfree(c->extra_fields_iovec);
-        c->extra_fields_n_iovec = 0;
-        c->extra_fields_data = mfree(c->extra_fields_data);
-        c->extra_fields_mtime = NSEC_INFINITY;
-
-        c->log_level_max = -1;
-
-        c->log_ratelimit_interval = s->ratelimit_interval;
-        c->log_ratelimit_burst = s->ratelimit_burst;
+        c->start_time = UINT64_MAX;
 
-        c->log_filter_allowed_patterns = set_free_free(c->log_filter_allowed_patterns);
-        c->log_filter_denied_patterns = set_free_free(c->log_filter_denied_patterns);
+        c->unit_context = client_unit_context_unref(s, c->unit_context);
 }
 
 static ClientContext* client_context_free(Server *s, ClientContext *c) {
@@ -294,8 +360,6 @@ static int client_context_read_cgroup(Server *s, ClientContext *c, const char *u
                 return r;
         }
 
-        (void) client_context_read_log_filter_patterns(c, t);
-
         /* Let's shortcut this if the cgroup path didn't change */
         if (streq_ptr(c->cgroup, t))
                 return 0;
@@ -324,21 +388,21 @@ static int client_context_read_cgroup(Server *s, ClientContext *c, const char *u
 }
 
 static int client_context_read_invocation_id(
-                Server *s,
-                ClientContext *c) {
+                const ClientContext *c,
+                sd_id128_t *ret) {
 
         _cleanup_free_ char *p = NULL, *value = NULL;
         int r;
 
-        assert(s);
         assert(c);
+        assert(ret);
 
         /* Read the invocation ID of a unit off a unit.
          * PID 1 stores it in a per-unit symlink in /run/systemd/units/
          * User managers store it in a per-unit symlink under /run/user/<uid>/systemd/units/ */
 
         if (!c->unit)
-                return 0;
+                return -ENODATA;
 
         if (c->user_unit) {
                 r = asprintf(&p, "/run/user/" UID_FMT "/systemd/units/invocation:%s", c->owner_uid, c->user_unit);
@@ -354,17 +418,20 @@ static int client_context_read_invocation_id(
         if (r < 0)
                 return r;
 
-        return sd_id128_from_string(value, &c->invocation_id);
+        return sd_id128_from_string(value, ret);
 }
 
-static int client_context_read_log_level_max(
-                Server *s,
-                ClientContext *c) {
+static int client_unit_context_read_log_level_max(
+                ClientUnitContext *u,
+                const ClientContext *c) {
 
         _cleanup_free_ char *value = NULL;
         const char *p;
         int r, ll;
 
+        assert(u);
+        assert(c);
+
         if (!c->unit)
                 return 0;
 
@@ -377,13 +444,13 @@ static int client_context_read_log_level_max(
         if (ll < 0)
                 return ll;
 
-        c->log_level_max = ll;
+        u->log_level_max = ll;
         return 0;
 }
 
-static int client_context_read_extra_fields(
-                Server *s,
-                ClientContext *c) {
+static int client_unit_context_read_extra_fields(
+                ClientUnitContext *u,
+                const ClientContext *c) {
 
         _cleanup_free_ struct iovec *iovec = NULL;
         size_t size = 0, n_iovec = 0, left;
@@ -394,12 +461,15 @@ static int client_context_read_extra_fields(
         uint8_t *q;
         int r;
 
+        assert(u);
+        assert(c);
+
         if (!c->unit)
                 return 0;
 
         p = strjoina("/run/systemd/units/log-extra-fields:", c->unit);
 
-        if (c->extra_fields_mtime != NSEC_INFINITY) {
+        if (u->extra_fields_mtime != NSEC_INFINITY) {
                 if (stat(p, &st) < 0) {
                         if (errno == ENOENT)
                                 return 0;
@@ -407,7 +477,7 @@ static int client_context_read_extra_fields(
                         return -errno;
                 }
 
-                if (timespec_load_nsec(&st.st_mtim) == c->extra_fields_mtime)
+                if (timespec_load_nsec(&st.st_mtim) == u->extra_fields_mtime)
                         return 0;
         }
 
@@ -460,22 +530,23 @@ static int client_context_read_extra_fields(
                 left -= n, q += n;
         }
 
-        free(c->extra_fields_iovec);
-        free(c->extra_fields_data);
+        free(u->extra_fields_iovec);
+        free(u->extra_fields_data);
 
-        c->extra_fields_iovec = TAKE_PTR(iovec);
-        c->extra_fields_n_iovec = n_iovec;
-        c->extra_fields_data = TAKE_PTR(data);
-        c->extra_fields_mtime = timespec_load_nsec(&st.st_mtim);
+        u->extra_fields_iovec = TAKE_PTR(iovec);
+        u->extra_fields_n_iovec = n_iovec;
+        u->extra_fields_data = TAKE_PTR(data);
+        u->extra_fields_mtime = timespec_load_nsec(&st.st_mtim);
 
         return 0;
 }
 
-static int client_context_read_log_ratelimit_interval(ClientContext *c) {
+static int client_unit_context_read_log_ratelimit_interval(ClientUnitContext *u, const ClientContext *c) {
         _cleanup_free_ char *value = NULL;
         const char *p;
         int r;
 
+        assert(u);
         assert(c);
 
         if (!c->unit)
@@ -486,14 +557,15 @@ static int client_context_read_log_ratelimit_interval(ClientContext *c) {
         if (r < 0)
                 return r;
 
-        return safe_atou64(value, &c->log_ratelimit_interval);
+        return safe_atou64(value, &u->log_ratelimit_interval);
 }
 
-static int client_context_read_log_ratelimit_burst(ClientContext *c) {
+static int client_unit_context_read_log_ratelimit_burst(ClientUnitContext *u, const ClientContext *c) {
         _cleanup_free_ char *value = NULL;
         const char *p;
         int r;
 
+        assert(u);
         assert(c);
 
         if (!c->unit)
@@ -504,7 +576,78 @@ static int client_context_read_log_ratelimit_burst(ClientContext *c) {
         if (r < 0)
                 return r;
 
-        return safe_atou(value, &c->log_ratelimit_burst);
+        return safe_atou(value, &u->log_ratelimit_burst);
+}
+
+static void client_unit_context_refresh(
+                ClientUnitContext *u,
+                const ClientContext *c,
+                sd_id128_t invocation_id,
+                usec_t timestamp) {
+
+        assert(u);
+        assert(c);
+
+        if (c->cgroup)
+                (void) client_unit_context_read_log_filter_patterns(u, c->cgroup);
+
+        if (!sd_id128_is_null(invocation_id))
+                u->invocation_id = invocation_id;
+
+        (void) client_unit_context_read_log_level_max(u, c);
+        (void) client_unit_context_read_extra_fields(u, c);
+        (void) client_unit_context_read_log_ratelimit_interval(u, c);
+        (void) client_unit_context_read_log_ratelimit_burst(u, c);
+
+        u->timestamp = timestamp;
+}
+
+static int client_context_attach_unit_context(Server *s, ClientContext *c, usec_t timestamp) {
+        sd_id128_t invocation_id = SD_ID128_NULL;
+        ClientUnitContext *u;
+        const char *id;
+        int r;
+
+        assert(s);
+        assert(c);
+
+        /* Cgroup paths always start with a slash, unit names never do, hence they can share the hashmap */
+        id = c->cgroup ?: c->unit;
+        if (!id) {
+                c->unit_context = client_unit_context_unref(s, c->unit_context);
+                return 0;
+        }
+
+        u = c->unit_context;
+        if (!u || !streq(u->id, id)) {
+                u = hashmap_get(s->client_unit_contexts, id);
+                if (u) {
+                        u->n_ref++;
+                        s->client_context_stats.n_unit_hits++;
+                } else {
+                        r = client_unit_context_new(s, id, &u);
+                        if (r < 0) {
+                                c->unit_context = client_unit_context_unref(s, c->unit_context);
+                                return r;
+                        }
+
+                        s->client_context_stats.n_unit_misses++;
+                }
+
+                client_unit_context_unref(s, c->unit_context);
+                c->unit_context = u;
+        }
+
+        /* If the unit was restarted in the same cgroup since we last looked, everything we know about it
+         * might be out of date, no matter how recently we looked. The invocation ID tells us about that. */
+        (void) client_context_read_invocation_id(c, &invocation_id);
+
+        if (u->timestamp == USEC_INFINITY ||
+            u->timestamp + REFRESH_USEC < timestamp ||
+            (!sd_id128_is_null(invocation_id) && !sd_id128_equal(invocation_id, u->invocation_id)))
+                client_unit_context_refresh(u, c, invocation_id, timestamp);
+
+        return 0;
 }
 
 static void client_context_really_refresh(
@@ -522,6 +665,9 @@ static void client_context_really_refresh(
         if (timestamp == USEC_INFINITY)
                 timestamp = now(CLOCK_MONOTONIC);
 
+        if (c->start_time == UINT64_MAX)
+                (void) get_process_start_time(c->pid, &c->start_time);
+
         client_context_read_uid_gid(c, ucred);
         client_context_read_basic(c);
         (void) client_context_read_label(c, label, label_size);
@@ -530,11 +676,7 @@ static void client_context_really_refresh(
         (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
 
         (void) client_context_read_cgroup(s, c, unit_id);
-        (void) client_context_read_invocation_id(s, c);
-        (void) client_context_read_log_level_max(s, c);
-        (void) client_context_read_extra_fields(s, c);
-        (void) client_context_read_log_ratelimit_interval(c);
-        (void) client_context_read_log_ratelimit_burst(c);
+        (void) client_context_attach_unit_context(s, c, timestamp);
 
         c->timestamp = timestamp;
 
@@ -562,16 +704,30 @@ void client_context_maybe_refresh(
         if (c->timestamp == USEC_INFINITY)
                 goto refresh;
 
-        /* If the data isn't pinned and if the cashed data is older than the upper limit, we flush it out
-         * entirely. This follows the logic that as long as an entry is pinned the PID reuse is unlikely. */
-        if (c->n_ref == 0 && c->timestamp + MAX_USEC < timestamp) {
-                client_context_reset(s, c);
-                goto refresh;
-        }
+        if (c->timestamp + REFRESH_USEC < timestamp) {
+                uint64_t start_time;
+
+                /* If the PID still refers to the process we cached the data for, we refresh, but keep the old
+                 * data for all we can't update. If the PID has been reused in the meantime, we flush out
+                 * everything. */
+                if (c->start_time != UINT64_MAX && get_process_start_time(c->pid, &start_time) >= 0) {
+                        if (start_time != c->start_time) {
+                                s->client_context_stats.n_pid_reuses++;
+                                client_context_reset(s, c);
+                                c->start_time = start_time;
+                        }
+
+                        goto refresh;
+                }
+
+                /* We can't tell whether the PID was reused. If the data isn't pinned and if the cached data is
+                 * older than the upper limit, we flush it out entirely. This follows the logic that as long as
+                 * an entry is pinned the PID reuse is unlikely. */
+                if (c->n_ref == 0 && c->timestamp + MAX_USEC < timestamp)
+                        client_context_reset(s, c);
 
-        /* If the data is older than the lower limit, we refresh, but keep the old data for all we can't update */
-        if (c->timestamp + REFRESH_USEC < timestamp)
                 goto refresh;
+        }
 
         /* If the data passed along doesn't match the cached data we also do a refresh */
         if (ucred && uid_is_valid(ucred->uid) && c->uid != ucred->uid)
@@ -652,9 +808,11 @@ void client_context_flush_all(Server *s) {
 
         assert(prioq_size(s->client_contexts_lru) == 0);
         assert(hashmap_size(s->client_contexts) == 0);
+        assert(hashmap_size(s->client_unit_contexts) == 0);
 
         s->client_contexts_lru = prioq_free(s->client_contexts_lru);
         s->client_contexts = hashmap_free(s->client_contexts);
+        s->client_unit_contexts = hashmap_free(s->client_unit_contexts);
 }
 
 static int client_context_get_internal(
@@ -677,6 +835,7 @@ static int client_context_get_internal(
 
         c = hashmap_get(s->client_contexts, PID_TO_PTR(pid));
         if (c) {
+                s->client_context_stats.n_hits++;
 
                 if (add_ref) {
                         if (c->in_lru) {
@@ -695,6 +854,8 @@ static int client_context_get_internal(
                 return 0;
         }
 
+        s->client_context_stats.n_misses++;
+
         client_context_try_shrink_to(s, cache_max()-1);
 
         r = client_context_new(s, pid, &c);
@@ -11,6 +11,15 @@
 #include "time-util.h"
 
 typedef struct ClientContext ClientContext;
+typedef struct ClientUnitContext ClientUnitContext;
+
+typedef struct ClientContextStats {
+        uint64_t n_hits;                /* Lookups answered from the cache */
+        uint64_t n_misses;              /* Lookups that required a new entry */
+        uint64_t n_pid_reuses;          /* Cached entries dropped since their PID was reused */
+        uint64_t n_unit_hits;           /* Per-unit metadata shared with other processes */
+        uint64_t n_unit_misses;         /* Per-unit metadata read from scratch */
+} ClientContextStats;
 
 #include "journald-server.h"
 
@@ -42,11 +51,27 @@ struct ClientContext {
         char *slice;
         char *user_slice;
 
-        sd_id128_t invocation_id;
-
         char *label;
         size_t label_size;
 
+        /* Process start time, in clock ticks since boot. Together with the PID this identifies the process,
+         * so that we notice when the PID got reused. UINT64_MAX if not known. */
+        uint64_t start_time;
+
+        ClientUnitContext *unit_context;
+};
+
+/* Metadata that is a property of the unit (or rather: the cgroup) a process belongs to, rather than of the
+ * process itself. It is shared between all ClientContext objects of processes in the same cgroup, so that
+ * it is read only once for all of them. */
+struct ClientUnitContext {
+        unsigned n_ref;
+        usec_t timestamp;
+
+        char *id; /* The cgroup path, or the unit name if we don't know the cgroup */
+
+        sd_id128_t invocation_id;
+
         int log_level_max;
 
         struct iovec *extra_fields_iovec;
@@ -92,15 +117,15 @@ void client_context_flush_all(Server *s);
 void client_context_flush_regular(Server *s);
 
 static inline size_t client_context_extra_fields_n_iovec(const ClientContext *c) {
-        return c ? c->extra_fields_n_iovec : 0;
+        return c && c->unit_context ? c->unit_context->extra_fields_n_iovec : 0;
 }
 
 static inline bool client_context_test_priority(const ClientContext *c, int priority) {
         if (!c)
                 return true;
 
-        if (c->log_level_max < 0)
+        if (!c->unit_context || c->unit_context->log_level_max < 0)
                 return true;
 
-        return LOG_PRI(priority) <= c->log_level_max;
+        return LOG_PRI(priority) <= c->unit_context->log_level_max;
 }
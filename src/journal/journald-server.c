@@ -85,20 +85,30 @@
 
 #define FAILED_TO_WRITE_ENTRY_RATELIMIT ((const RateLimit) { .interval = 1 * USEC_PER_SEC, .burst = 1 })
 
+/* The most log records we are willing to queue for the writer thread */
+#define WRITER_QUEUE_SIZE_MAX (64U*1024U)
+
+/* How often to grow journal files and create their successors ahead of time, at most */
+#define PREPARE_INTERVAL_USEC (1*USEC_PER_SEC)
+
 static int server_determine_path_usage(
                 Server *s,
-                const char *path,
+                JournalStorage *storage,
                 uint64_t *ret_used,
                 uint64_t *ret_free) {
 
         _cleanup_closedir_ DIR *d = NULL;
+        const char *path;
         struct statvfs ss;
 
         assert(s);
-        assert(path);
+        assert(storage);
+        assert(storage->path);
         assert(ret_used);
         assert(ret_free);
 
+        path = storage->path;
+
         d = opendir(path);
         if (!d)
                 return log_ratelimit_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR,
@@ -112,11 +122,18 @@ static int server_determine_path_usage(
         *ret_used = 0;
         FOREACH_DIRENT_ALL(de, d, break) {
                 struct stat st;
+                uint64_t usage;
 
                 if (!endswith(de->d_name, ".journal") &&
                     !endswith(de->d_name, ".journal~"))
                         continue;
 
+                /* Archived files don't change, no need to look at them again if the last vacuuming did */
+                if (journal_vacuum_state_get_usage(storage->vacuum_state, de->d_name, de->d_ino, &usage) > 0) {
+                        *ret_used += usage;
+                        continue;
+                }
+
                 if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
                         log_debug_errno(errno, "Failed to stat %s/%s, ignoring: %m", path, de->d_name);
                         continue;
@@ -152,7 +169,7 @@ static int cache_space_refresh(Server *s, JournalStorage *storage) {
         if (space->timestamp != 0 && usec_add(space->timestamp, RECHECK_SPACE_USEC) > ts)
                 return 0;
 
-        r = server_determine_path_usage(s, storage->path, &vfs_used, &vfs_avail);
+        r = server_determine_path_usage(s, storage, &vfs_used, &vfs_avail);
         if (r < 0)
                 return r;
 
@@ -254,6 +271,109 @@ static void server_add_acls(ManagedJournalFile *f, uid_t uid) {
 #endif
 }
 
+static void server_write_to_journal_now(
+                Server *s,
+                uid_t uid,
+                const dual_timestamp *ts,
+                const struct iovec *iovec,
+                size_t n,
+                int priority,
+                bool rotate);
+
+static int server_schedule_post_change(Server *s);
+
+static void server_drain_writer(Server *s, bool wait) {
+        JournalWriterEntry **entries = NULL;
+        JournalWriterStats stats;
+        JournalFile *f;
+        size_t n = 0;
+        bool stop = false;
+        int r, k, error = 0;
+
+        assert(s);
+
+        if (!s->writer)
+                return;
+
+        r = journal_writer_drain(s->writer, wait, &entries, &n, &error);
+        if (r < 0 && wait) {
+                /* Callers that wait rely on the writer thread leaving the journal files alone afterwards,
+                 * as they might rotate or close them. If we cannot wait for it, stop it for good and write
+                 * everything ourselves from now on. */
+                log_warning_errno(r, "Failed to wait for writer thread, stopping it and writing journal files directly: %m");
+
+                stop = true;
+                r = journal_writer_stop(s->writer, &entries, &n, &error);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to take over entries from writer thread, dropping them: %m");
+        } else if (r < 0)
+                log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT, "Failed to drain writer thread, ignoring: %m");
+
+        /* Post the changes the writer thread made, see server_open_journal(). Forget about the files only
+         * once everything queued for them is written or taken back, as writing the entries taken back
+         * below might rotate and hence free them. */
+        SET_FOREACH(f, s->writer_files)
+                f->post_change_pending = true;
+
+        if (!set_isempty(s->writer_files)) {
+                k = server_schedule_post_change(s);
+                if (k < 0)
+                        log_ratelimit_warning_errno(k, JOURNAL_LOG_RATELIMIT, "Failed to schedule posting changes, ignoring: %m");
+        }
+
+        journal_writer_get_stats(s->writer, &stats);
+        if (stats.queue_depth == 0)
+                set_clear(s->writer_files);
+
+        if (r > 0) {
+                /* The writer thread stopped, either because a file should be rotated, or because an entry
+                 * couldn't be written. Write the remaining entries ourselves, which takes care of rotating
+                 * and retrying like for any other entry. */
+                if (error < 0)
+                        log_debug_errno(error, "Writer thread failed to write entry, taking over %zu entries: %m", n);
+                else
+                        log_debug("Writer thread requested rotation, taking over %zu entries.", n);
+
+                s->writer_suspended++;
+
+                FOREACH_ARRAY(e, entries, n) {
+                        server_write_to_journal_now(s, (*e)->uid, &(*e)->ts, (*e)->iovec, (*e)->n_iovec, (*e)->priority, /* rotate= */ false);
+                        free(*e);
+                }
+
+                s->writer_suspended--;
+                free(entries);
+        }
+
+        if (stop) {
+                s->writer_event_source = sd_event_source_disable_unref(s->writer_event_source);
+                s->writer = journal_writer_free(s->writer);
+                set_clear(s->writer_files);
+        }
+}
+
+static Server* server_suspend_writer(Server *s) {
+        assert(s);
+
+        /* Makes sure the writer thread is done with all journal files, and doesn't get to write anything
+         * until we resume it again, so that we may do whatever we want with the files in the meantime. */
+        if (s->writer_suspended++ == 0)
+                server_drain_writer(s, /* wait= */ true);
+
+        return s;
+}
+
+static void server_resume_writerp(Server **s) {
+        assert(s);
+        assert(*s);
+        assert((*s)->writer_suspended > 0);
+
+        (*s)->writer_suspended--;
+}
+
+#define SERVER_SUSPEND_WRITER(s)                                        \
+        _unused_ _cleanup_(server_resume_writerp) Server *_writer_suspended_ = server_suspend_writer(s)
+
 static int server_open_journal(
                 Server *s,
                 bool reliably,
@@ -271,6 +391,8 @@ static int server_open_journal(
         assert(fname);
         assert(ret);
 
+        SERVER_SUSPEND_WRITER(s);
+
         file_flags =
                 (s->compress.enabled ? JOURNAL_COMPRESS : 0) |
                 (seal ? JOURNAL_SEAL : 0) |
@@ -304,9 +426,16 @@ static int server_open_journal(
         if (r < 0)
                 return r;
 
-        r = journal_file_enable_post_change_timer(f->file, s->event, POST_CHANGE_TIMER_INTERVAL_USEC);
-        if (r < 0)
-                return r;
+        if (s->writer)
+                /* journal_file_post_change() truncates the file to the size it had last time we looked,
+                 * hence it must not run while the writer thread might extend the file. We post the changes
+                 * ourselves while the writer thread is suspended instead, see server_post_changes(). */
+                f->file->defer_post_change = true;
+        else {
+                r = journal_file_enable_post_change_timer(f->file, s->event, POST_CHANGE_TIMER_INTERVAL_USEC);
+                if (r < 0)
+                        return r;
+        }
 
         *ret = TAKE_PTR(f);
         return r;
@@ -452,6 +581,7 @@ static int server_find_user_journal(Server *s, uid_t uid, ManagedJournalFile **r
         /* Too many open? Then let's close one (or more) */
         while (ordered_hashmap_size(s->user_journals) >= USER_JOURNALS_MAX) {
                 ManagedJournalFile *first;
+                SERVER_SUSPEND_WRITER(s);
 
                 assert_se(first = ordered_hashmap_steal_first(s->user_journals));
                 (void) managed_journal_file_close(first);
@@ -692,6 +822,8 @@ void server_rotate(Server *s) {
         void *k;
         int r;
 
+        SERVER_SUSPEND_WRITER(s);
+
         log_debug("Rotating...");
 
         /* First, rotate the system journal (either in its runtime flavour or in its runtime flavour) */
@@ -720,6 +852,8 @@ void server_sync(Server *s) {
         ManagedJournalFile *f;
         int r;
 
+        SERVER_SUSPEND_WRITER(s);
+
         if (s->system_journal) {
                 r = managed_journal_file_set_offline(s->system_journal, false);
                 if (r < 0)
@@ -756,9 +890,17 @@ static void server_do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
         if (verbose)
                 server_space_usage_message(s, storage);
 
-        r = journal_directory_vacuum(storage->path, storage->space.limit,
-                                     storage->metrics.n_max_files, s->max_retention_usec,
-                                     &s->oldest_file_usec, verbose);
+        if (!storage->vacuum_state) {
+                r = journal_vacuum_state_new(&storage->vacuum_state);
+                if (r < 0) {
+                        log_oom();
+                        return;
+                }
+        }
+
+        r = journal_directory_vacuum_full(storage->path, storage->space.limit,
+                                          storage->metrics.n_max_files, s->max_retention_usec,
+                                          storage->vacuum_state, &s->oldest_file_usec, verbose);
         if (r < 0 && r != -ENOENT)
                 log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
                                             "Failed to vacuum %s, ignoring: %m", storage->path);
@@ -893,38 +1035,202 @@ static bool shall_try_append_again(JournalFile *f, int r) {
         }
 }
 
-static void server_write_to_journal(
+static void server_prepare_journal(Server *s, ManagedJournalFile *f, bool seal) {
+        int r;
+
+        assert(s);
+
+        if (!f)
+                return;
+
+        if (s->preallocate_size > 0) {
+                r = journal_file_preallocate(f->file, s->preallocate_size);
+                if (r < 0)
+                        log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
+                                                    "Failed to preallocate space for %s, ignoring: %m", f->file->path);
+                else if (r > 0)
+                        log_debug("Preallocated space for %s.", f->file->path);
+        }
+
+        /* Tags for sealed files are appended from the event loop with the current epoch, hence don't let a
+         * sealed file sit around unused. */
+        if (!s->precreate_next_file || JOURNAL_HEADER_SEALED(f->file->header))
+                return;
+
+        r = managed_journal_file_prepare_next(
+                        f,
+                        s->mmap,
+                        (s->compress.enabled ? JOURNAL_COMPRESS : 0) |
+                        (seal ? JOURNAL_SEAL : 0) |
+                        JOURNAL_STRICT_ORDER,
+                        s->compress.threshold_bytes);
+        if (r < 0) {
+                log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
+                                            "Failed to create successor of %s, ignoring: %m", f->file->path);
+                return;
+        }
+
+        /* The successor is only ever appended to after rotation, give it the same headroom right away */
+        if (s->preallocate_size > 0)
+                (void) journal_file_preallocate(f->next, s->preallocate_size);
+}
+
+static int server_dispatch_prepare(sd_event_source *es, usec_t t, void *userdata) {
+        Server *s = ASSERT_PTR(userdata);
+        ManagedJournalFile *f;
+
+        SERVER_SUSPEND_WRITER(s);
+
+        server_prepare_journal(s, s->runtime_journal, /* seal= */ false);
+        server_prepare_journal(s, s->system_journal, s->seal);
+
+        ORDERED_HASHMAP_FOREACH(f, s->user_journals)
+                server_prepare_journal(s, f, s->seal);
+
+        return 0;
+}
+
+static int server_schedule_prepare(Server *s) {
+        int r;
+
+        assert(s);
+
+        /* Grows the journal files and creates their successors after entries have been written, but at most
+         * once per PREPARE_INTERVAL_USEC and only when nothing else is pending, so that neither the append
+         * path nor rotation have to do that while entries are waiting. */
+
+        if (s->preallocate_size == 0 && !s->precreate_next_file)
+                return 0;
+
+        if (s->prepare_event_source) {
+                r = sd_event_source_get_enabled(s->prepare_event_source, NULL);
+                if (r != 0)
+                        return r;
+
+                r = sd_event_source_set_time_relative(s->prepare_event_source, PREPARE_INTERVAL_USEC);
+                if (r < 0)
+                        return r;
+
+                return sd_event_source_set_enabled(s->prepare_event_source, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time_relative(
+                        s->event,
+                        &s->prepare_event_source,
+                        CLOCK_MONOTONIC,
+                        PREPARE_INTERVAL_USEC, 0,
+                        server_dispatch_prepare, s);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_priority(s->prepare_event_source, SD_EVENT_PRIORITY_IDLE);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(s->prepare_event_source, "prepare-journal");
+        return 0;
+}
+
+static void server_post_change(ManagedJournalFile *f) {
+        if (!f || !f->file->post_change_pending)
+                return;
+
+        f->file->post_change_pending = false;
+        journal_file_post_change(f->file);
+}
+
+static void server_post_changes(Server *s) {
+        ManagedJournalFile *f;
+
+        assert(s);
+        assert(s->writer_suspended > 0);
+
+        server_post_change(s->runtime_journal);
+        server_post_change(s->system_journal);
+
+        ORDERED_HASHMAP_FOREACH(f, s->user_journals)
+                server_post_change(f);
+}
+
+static int server_dispatch_post_change(sd_event_source *es, usec_t t, void *userdata) {
+        Server *s = ASSERT_PTR(userdata);
+
+        SERVER_SUSPEND_WRITER(s);
+        server_post_changes(s);
+
+        return 0;
+}
+
+static int server_schedule_post_change(Server *s) {
+        int r;
+
+        assert(s);
+
+        /* Coalesces posting the changes of the files the writer thread appends to, like the post change
+         * timer of each file does when there's no writer thread. */
+
+        if (s->post_change_event_source) {
+                r = sd_event_source_get_enabled(s->post_change_event_source, NULL);
+                if (r != 0)
+                        return r;
+
+                r = sd_event_source_set_time_relative(s->post_change_event_source, POST_CHANGE_TIMER_INTERVAL_USEC);
+                if (r < 0)
+                        return r;
+
+                return sd_event_source_set_enabled(s->post_change_event_source, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time_relative(
+                        s->event,
+                        &s->post_change_event_source,
+                        CLOCK_MONOTONIC,
+                        POST_CHANGE_TIMER_INTERVAL_USEC, 0,
+                        server_dispatch_post_change, s);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(s->post_change_event_source, "post-change");
+        return 0;
+}
+
+static void server_entry_written(Server *s, ManagedJournalFile *f, int priority) {
+        int r;
+
+        assert(s);
+        assert(f);
+
+        if (f->file->defer_post_change) {
+                f->file->post_change_pending = true;
+
+                r = server_schedule_post_change(s);
+                if (r < 0)
+                        log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT, "Failed to schedule posting changes, ignoring: %m");
+        }
+
+        server_schedule_sync(s, priority);
+        (void) server_schedule_prepare(s);
+}
+
+static void server_write_to_journal_now(
                 Server *s,
                 uid_t uid,
+                const dual_timestamp *ts,
                 const struct iovec *iovec,
                 size_t n,
-                int priority) {
+                int priority,
+                bool rotate) {
 
-        bool vacuumed = false, rotate = false;
-        struct dual_timestamp ts;
-        ManagedJournalFile *f;
+        ManagedJournalFile *f = NULL;
+        bool vacuumed = false;
         int r;
 
         assert(s);
+        assert(ts);
         assert(iovec);
         assert(n > 0);
 
-        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
-         * the source time, and not even the time the event was originally seen, but instead simply the time we started
-         * processing it, as we want strictly linear ordering in what we write out.) */
-        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
-        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
-
-        if (ts.realtime < s->last_realtime_clock) {
-                /* When the time jumps backwards, let's immediately rotate. Of course, this should not happen during
-                 * regular operation. However, when it does happen, then we should make sure that we start fresh files
-                 * to ensure that the entries in the journal files are strictly ordered by time, in order to ensure
-                 * bisection works correctly. */
-
-                log_ratelimit_info(JOURNAL_LOG_RATELIMIT, "Time jumped backwards, rotating.");
-                rotate = true;
-        } else {
-
+        if (!rotate) {
                 f = server_find_journal(s, uid);
                 if (!f)
                         return;
@@ -946,11 +1252,9 @@ static void server_write_to_journal(
                         return;
         }
 
-        s->last_realtime_clock = ts.realtime;
-
         r = journal_file_append_entry(
                         f->file,
-                        &ts,
+                        ts,
                         /* boot_id= */ NULL,
                         iovec, n,
                         &s->seqnum->seqnum,
@@ -958,7 +1262,7 @@ static void server_write_to_journal(
                         /* ret_object= */ NULL,
                         /* ret_offset= */ NULL);
         if (r >= 0) {
-                server_schedule_sync(s, priority);
+                server_entry_written(s, f, priority);
                 return;
         }
 
@@ -982,7 +1286,7 @@ static void server_write_to_journal(
         log_debug_errno(r, "Retrying write.");
         r = journal_file_append_entry(
                         f->file,
-                        &ts,
+                        ts,
                         /* boot_id= */ NULL,
                         iovec, n,
                         &s->seqnum->seqnum,
@@ -994,7 +1298,86 @@ static void server_write_to_journal(
                                           "Failed to write entry to %s (%zu items, %zu bytes) despite vacuuming, ignoring: %m",
                                           f->file->path, n, IOVEC_TOTAL_SIZE(iovec, n));
         else
-                server_schedule_sync(s, priority);
+                server_entry_written(s, f, priority);
+}
+
+static int server_queue_to_journal(
+                Server *s,
+                uid_t uid,
+                const dual_timestamp *ts,
+                const struct iovec *iovec,
+                size_t n,
+                int priority) {
+
+        ManagedJournalFile *f;
+        int r;
+
+        assert(s);
+        assert(s->writer);
+
+        f = server_find_journal(s, uid);
+        if (!f)
+                return 0;
+
+        /* Tags are appended to sealed files from the event loop thread, hence let's write them from there
+         * altogether. */
+        if (JOURNAL_HEADER_SEALED(f->file->header))
+                return -EOPNOTSUPP;
+
+        r = set_ensure_put(&s->writer_files, NULL, f->file);
+        if (r < 0)
+                return r;
+
+        r = journal_writer_enqueue(s->writer, f->file, uid, priority, ts, iovec, n);
+        if (r < 0)
+                return r;
+
+        server_schedule_sync(s, priority);
+        (void) server_schedule_prepare(s);
+        return 1;
+}
+
+static void server_write_to_journal(
+                Server *s,
+                uid_t uid,
+                const struct iovec *iovec,
+                size_t n,
+                int priority) {
+
+        struct dual_timestamp ts;
+        bool rotate;
+        int r;
+
+        assert(s);
+        assert(iovec);
+        assert(n > 0);
+
+        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
+         * the source time, and not even the time the event was originally seen, but instead simply the time we started
+         * processing it, as we want strictly linear ordering in what we write out.) */
+        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
+        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
+
+        /* When the time jumps backwards, let's immediately rotate. Of course, this should not happen during
+         * regular operation. However, when it does happen, then we should make sure that we start fresh files
+         * to ensure that the entries in the journal files are strictly ordered by time, in order to ensure
+         * bisection works correctly. */
+        rotate = ts.realtime < s->last_realtime_clock;
+        if (rotate)
+                log_ratelimit_info(JOURNAL_LOG_RATELIMIT, "Time jumped backwards, rotating.");
+
+        s->last_realtime_clock = ts.realtime;
+
+        if (s->writer && s->writer_suspended == 0 && !rotate) {
+                r = server_queue_to_journal(s, uid, &ts, iovec, n, priority);
+                if (r >= 0)
+                        return;
+
+                log_debug_errno(r, "Failed to queue entry for writer thread, writing it directly: %m");
+        }
+
+        SERVER_SUSPEND_WRITER(s);
+        server_write_to_journal_now(s, uid, &ts, iovec, n, priority, rotate);
 }
 
 #define IOVEC_ADD_NUMERIC_FIELD(iovec, n, value, type, isset, format, field)  \
@@ -1075,11 +1458,15 @@ static void server_dispatch_message_real(
                 IOVEC_ADD_STRING_FIELD(iovec, n, c->slice, "_SYSTEMD_SLICE");
                 IOVEC_ADD_STRING_FIELD(iovec, n, c->user_slice, "_SYSTEMD_USER_SLICE");
 
-                IOVEC_ADD_ID128_FIELD(iovec, n, c->invocation_id, "_SYSTEMD_INVOCATION_ID");
+                if (c->unit_context) {
+                        ClientUnitContext *u = c->unit_context;
+
+                        IOVEC_ADD_ID128_FIELD(iovec, n, u->invocation_id, "_SYSTEMD_INVOCATION_ID");
 
-                if (c->extra_fields_n_iovec > 0) {
-                        memcpy(iovec + n, c->extra_fields_iovec, c->extra_fields_n_iovec * sizeof(struct iovec));
-                        n += c->extra_fields_n_iovec;
+                        if (u->extra_fields_n_iovec > 0) {
+                                memcpy(iovec + n, u->extra_fields_iovec, u->extra_fields_n_iovec * sizeof(struct iovec));
+                                n += u->extra_fields_n_iovec;
+                        }
                 }
         }
 
@@ -1110,7 +1497,8 @@ static void server_dispatch_message_real(
                 IOVEC_ADD_STRING_FIELD(iovec, n, o->slice, "OBJECT_SYSTEMD_SLICE");
                 IOVEC_ADD_STRING_FIELD(iovec, n, o->user_slice, "OBJECT_SYSTEMD_USER_SLICE");
 
-                IOVEC_ADD_ID128_FIELD(iovec, n, o->invocation_id, "OBJECT_SYSTEMD_INVOCATION_ID=");
+                if (o->unit_context)
+                        IOVEC_ADD_ID128_FIELD(iovec, n, o->unit_context->invocation_id, "OBJECT_SYSTEMD_INVOCATION_ID=");
         }
 
         assert(n <= m);
@@ -1232,7 +1620,10 @@ void server_dispatch_message(
         if (c && c->unit) {
                 (void) server_determine_space(s, &available, /* limit= */ NULL);
 
-                rl = journal_ratelimit_test(s->ratelimit, c->unit, c->log_ratelimit_interval, c->log_ratelimit_burst, priority & LOG_PRIMASK, available);
+                rl = journal_ratelimit_test(s->ratelimit, c->unit,
+                                            c->unit_context ? c->unit_context->log_ratelimit_interval : s->ratelimit_interval,
+                                            c->unit_context ? c->unit_context->log_ratelimit_burst : s->ratelimit_burst,
+                                            priority & LOG_PRIMASK, available);
                 if (rl == 0)
                         return;
 
@@ -1269,6 +1660,8 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
         if (require_flag_file && !server_flushed_flag_is_set(s))
                 return 0;
 
+        SERVER_SUSPEND_WRITER(s);
+
         (void) server_system_journal_open(s, /* flush_requested=*/ true, /* relinquish_requested= */ false);
 
         if (!s->system_journal)
@@ -1386,12 +1779,17 @@ static int server_relinquish_var(Server *s) {
 
         log_debug("Relinquishing %s...", s->system_storage.path);
 
+        SERVER_SUSPEND_WRITER(s);
+
         (void) server_system_journal_open(s, /* flush_requested */ false, /* relinquish_requested=*/ true);
 
         s->system_journal = managed_journal_file_close(s->system_journal);
         ordered_hashmap_clear_with_destructor(s->user_journals, managed_journal_file_close);
         set_clear_with_destructor(s->deferred_closes, managed_journal_file_close);
 
+        /* Don't keep deleting files in the background once we promised to let go of /var */
+        s->system_storage.vacuum_state = journal_vacuum_state_free(s->system_storage.vacuum_state);
+
         fn = strjoina(s->runtime_directory, "/flushed");
         if (unlink(fn) < 0 && errno != ENOENT)
                 log_ratelimit_warning_errno(errno, JOURNAL_LOG_RATELIMIT,
@@ -1401,80 +1799,80 @@ static int server_relinquish_var(Server *s) {
         return 0;
 }
 
-int server_process_datagram(
-                sd_event_source *es,
-                int fd,
-                uint32_t revents,
-                void *userdata) {
-
-        size_t label_len = 0, m;
-        Server *s = ASSERT_PTR(userdata);
-        struct ucred *ucred = NULL;
-        struct timeval tv_buf, *tv = NULL;
-        struct cmsghdr *cmsg;
-        char *label = NULL;
-        struct iovec iovec;
-        ssize_t n;
-        int *fds = NULL, v = 0;
-        size_t n_fds = 0;
-
-        /* We use NAME_MAX space for the SELinux label here. The kernel currently enforces no limit, but
-         * according to suggestions from the SELinux people this will change and it will probably be
-         * identical to NAME_MAX. For now we use that, but this should be updated one day when the final
-         * limit is known.
-         *
-         * Here, we need to explicitly initialize the buffer with zero, as glibc has a bug in
-         * __convert_scm_timestamps(), which assumes the buffer is initialized. See #20741. */
-        CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct ucred)) +
+/* We use NAME_MAX space for the SELinux label here. The kernel currently enforces no limit, but according to
+ * suggestions from the SELinux people this will change and it will probably be identical to NAME_MAX. For now
+ * we use that, but this should be updated one day when the final limit is known. */
+typedef CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct ucred)) +
                          CMSG_SPACE_TIMEVAL +
                          CMSG_SPACE(sizeof(int)) + /* fd */
-                         CMSG_SPACE(NAME_MAX) /* selinux label */) control = {};
+                         CMSG_SPACE(NAME_MAX) /* selinux label */) DatagramControl;
 
-        union sockaddr_union sa = {};
+/* How many datagrams to receive with a single recvmmsg() call at most */
+#define DATAGRAM_BATCH_MAX 16U
 
-        struct msghdr msghdr = {
-                .msg_iov = &iovec,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-                .msg_name = &sa,
-                .msg_namelen = sizeof(sa),
-        };
+/* The largest AF_UNIX datagram the kernel can build: the linear part of the skb is limited by what kmalloc()
+ * can allocate at most (4 MiB), the rest by MAX_SKB_FRAGS pages. This holds for privileged senders too, that
+ * may raise their send buffer beyond net.core.wmem_max. */
+#define DATAGRAM_UNIX_MAX (8U*1024U*1024U)
 
-        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
+/* How much memory of a slot we keep around after a large datagram was received into it */
+#define DATAGRAM_SLOT_RESIDENT_MAX (64U*1024U)
 
-        if (revents != EPOLLIN)
-                return log_error_errno(SYNTHETIC_ERRNO(EIO),
-                                       "Got invalid event from epoll for datagram fd: %" PRIx32,
-                                       revents);
+struct DatagramBatch {
+        char *buffer;           /* DATAGRAM_BATCH_MAX slots of slot_size bytes each, mmap()ed */
+        size_t slot_size;
 
-        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
-         * it.) */
-        (void) ioctl(fd, SIOCINQ, &v);
+        /* Set once a datagram didn't fit into a slot nonetheless, after which we receive datagrams from
+         * that socket one by one, so that this cannot happen again */
+        bool syslog_unbatched;
+        bool audit_unbatched;
 
-        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
-        m = PAGE_ALIGN(MAX3((size_t) v + 1,
-                            (size_t) LINE_MAX,
-                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
+        struct mmsghdr msgs[DATAGRAM_BATCH_MAX];
+        struct iovec iovecs[DATAGRAM_BATCH_MAX];
+        union sockaddr_union addrs[DATAGRAM_BATCH_MAX];
+        DatagramControl controls[DATAGRAM_BATCH_MAX];
+};
 
-        if (!GREEDY_REALLOC(s->buffer, m))
-                return log_oom();
+static DatagramBatch* datagram_batch_free(DatagramBatch *b) {
+        if (!b)
+                return NULL;
 
-        iovec = IOVEC_MAKE(s->buffer, MALLOC_ELEMENTSOF(s->buffer) - 1); /* Leave room for trailing NUL we add later */
+        if (b->buffer)
+                (void) munmap(b->buffer, DATAGRAM_BATCH_MAX * b->slot_size);
 
-        n = recvmsg_safe(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
-        if (n < 0) {
-                if (ERRNO_IS_TRANSIENT(n))
-                        return 0;
-                if (n == -EXFULL) {
-                        log_ratelimit_warning(JOURNAL_LOG_RATELIMIT,
-                                              "Got message with truncated control data (too many fds sent?), ignoring.");
-                        return 0;
-                }
-                return log_ratelimit_error_errno(n, JOURNAL_LOG_RATELIMIT, "recvmsg() failed: %m");
-        }
+        return mfree(b);
+}
+
+static bool* datagram_batch_unbatched(Server *s, DatagramBatch *b, int fd) {
+        assert(s);
+        assert(b);
 
-        CMSG_FOREACH(cmsg, &msghdr)
+        return fd == s->audit_fd ? &b->audit_unbatched : &b->syslog_unbatched;
+}
+
+static size_t datagram_max_size(Server *s, int fd) {
+        assert(s);
+
+        if (fd == s->audit_fd)
+                return ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH);
+
+        return MAX3((size_t) LINE_MAX, s->line_max, (size_t) DATAGRAM_UNIX_MAX);
+}
+
+static void server_dispatch_datagram(Server *s, int fd, char *buffer, size_t n, struct msghdr *msghdr) {
+        struct ucred *ucred = NULL;
+        struct timeval tv_buf, *tv = NULL;
+        struct cmsghdr *cmsg;
+        char *label = NULL;
+        size_t label_len = 0;
+        int *fds = NULL;
+        size_t n_fds = 0;
+
+        assert(s);
+        assert(buffer);
+        assert(msghdr);
+
+        CMSG_FOREACH(cmsg, msghdr)
                 if (cmsg->cmsg_level == SOL_SOCKET &&
                     cmsg->cmsg_type == SCM_CREDENTIALS &&
                     cmsg->cmsg_len == CMSG_LEN(sizeof(struct ucred))) {
@@ -1498,18 +1896,18 @@ int server_process_datagram(
                 }
 
         /* And a trailing NUL, just in case */
-        s->buffer[n] = 0;
+        buffer[n] = 0;
 
         if (fd == s->syslog_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_syslog_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_syslog_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n_fds > 0)
                         log_ratelimit_warning(JOURNAL_LOG_RATELIMIT,
                                               "Got file descriptors via syslog socket. Ignoring.");
 
         } else if (fd == s->native_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_native_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_native_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n == 0 && n_fds == 1)
                         server_process_native_file(s, fds[0], ucred, tv, label, label_len);
                 else if (n_fds > 0)
@@ -1520,13 +1918,188 @@ int server_process_datagram(
                 assert(fd == s->audit_fd);
 
                 if (n > 0 && n_fds == 0)
-                        server_process_audit_message(s, s->buffer, n, ucred, &sa, msghdr.msg_namelen);
+                        server_process_audit_message(s, buffer, n, ucred, msghdr->msg_name, msghdr->msg_namelen);
                 else if (n_fds > 0)
                         log_ratelimit_warning(JOURNAL_LOG_RATELIMIT,
                                               "Got file descriptors via audit socket. Ignoring.");
         }
 
         close_many(fds, n_fds);
+}
+
+static int server_process_datagram_batch(Server *s, int fd, size_t first) {
+        DatagramBatch *b;
+        size_t slot_size;
+        int k;
+
+        assert(s);
+
+        /* Receives a batch of datagrams with a single recvmmsg(). This is only used for the syslog and audit
+         * sockets, where the size of datagrams is bounded: we have to pick the buffer size for each datagram
+         * before we know how large it is, and a datagram that doesn't fit would be truncated. Hence each
+         * slot is as large as the largest datagram the socket may get, see datagram_max_size(). The slots
+         * are mmap()ed, so that only the pages datagrams were actually received into are backed by memory,
+         * i.e. usually a page per slot. Returns 0 if the caller shall receive the next datagram on its own
+         * instead. */
+
+        if (!s->datagram_batch) {
+                s->datagram_batch = new0(DatagramBatch, 1);
+                if (!s->datagram_batch)
+                        return 0;
+        }
+
+        b = s->datagram_batch;
+
+        if (*datagram_batch_unbatched(s, b, fd))
+                return 0;
+
+        slot_size = PAGE_ALIGN(datagram_max_size(s, fd) + 1);
+
+        /* The next datagram is too large anyway? Then receive it into a buffer of the right size. */
+        if (first >= slot_size)
+                return 0;
+
+        if (b->slot_size < slot_size) {
+                void *p;
+
+                p = mmap(NULL, DATAGRAM_BATCH_MAX * slot_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+                if (p == MAP_FAILED)
+                        return 0;
+
+                /* No need to preserve anything */
+                if (b->buffer)
+                        (void) munmap(b->buffer, DATAGRAM_BATCH_MAX * b->slot_size);
+
+                b->buffer = p;
+                b->slot_size = slot_size;
+        }
+
+        for (size_t i = 0; i < DATAGRAM_BATCH_MAX; i++) {
+                b->iovecs[i] = IOVEC_MAKE(b->buffer + i * b->slot_size, b->slot_size - 1); /* Leave room for trailing NUL */
+
+                /* Initialize the control buffers for the same reason as in server_process_datagram() */
+                zero(b->controls[i]);
+
+                b->msgs[i] = (struct mmsghdr) {
+                        .msg_hdr = {
+                                .msg_iov = b->iovecs + i,
+                                .msg_iovlen = 1,
+                                .msg_control = b->controls + i,
+                                .msg_controllen = sizeof(b->controls[i]),
+                                .msg_name = b->addrs + i,
+                                .msg_namelen = sizeof(b->addrs[i]),
+                        },
+                };
+        }
+
+        k = recvmmsg(fd, b->msgs, DATAGRAM_BATCH_MAX, MSG_DONTWAIT|MSG_CMSG_CLOEXEC, NULL);
+        if (k < 0) {
+                if (ERRNO_IS_TRANSIENT(errno))
+                        return 1;
+
+                return log_ratelimit_error_errno(errno, JOURNAL_LOG_RATELIMIT, "recvmmsg() failed: %m");
+        }
+
+        for (int i = 0; i < k; i++) {
+                struct msghdr *mh = &b->msgs[i].msg_hdr;
+
+                if (FLAGS_SET(mh->msg_flags, MSG_CTRUNC)) {
+                        cmsg_close_all(mh);
+                        log_ratelimit_warning(JOURNAL_LOG_RATELIMIT,
+                                              "Got message with truncated control data (too many fds sent?), ignoring.");
+                        continue;
+                }
+
+                /* This shouldn't happen, see datagram_max_size(). But if it does, make sure it doesn't
+                 * happen again. */
+                if (FLAGS_SET(mh->msg_flags, MSG_TRUNC) && !*datagram_batch_unbatched(s, b, fd)) {
+                        log_error("Got datagram larger than %zu bytes, truncating. Receiving datagrams one by one from now on.",
+                                  b->slot_size - 1);
+                        *datagram_batch_unbatched(s, b, fd) = true;
+                }
+
+                server_dispatch_datagram(s, fd, mh->msg_iov->iov_base, b->msgs[i].msg_len, mh);
+
+                /* Don't keep the memory of large datagrams around */
+                if (b->msgs[i].msg_len >= DATAGRAM_SLOT_RESIDENT_MAX)
+                        (void) madvise((uint8_t*) mh->msg_iov->iov_base + DATAGRAM_SLOT_RESIDENT_MAX,
+                                       PAGE_ALIGN(b->msgs[i].msg_len + 1) - DATAGRAM_SLOT_RESIDENT_MAX,
+                                       MADV_DONTNEED);
+        }
+
+        return 1;
+}
+
+int server_process_datagram(
+                sd_event_source *es,
+                int fd,
+                uint32_t revents,
+                void *userdata) {
+
+        Server *s = ASSERT_PTR(userdata);
+        struct iovec iovec;
+        ssize_t n;
+        int v = 0, r;
+        size_t m;
+
+        /* Here, we need to explicitly initialize the buffer with zero, as glibc has a bug in
+         * __convert_scm_timestamps(), which assumes the buffer is initialized. See #20741. */
+        DatagramControl control = {};
+
+        union sockaddr_union sa = {};
+
+        struct msghdr msghdr = {
+                .msg_iov = &iovec,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+                .msg_name = &sa,
+                .msg_namelen = sizeof(sa),
+        };
+
+        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
+
+        if (revents != EPOLLIN)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO),
+                                       "Got invalid event from epoll for datagram fd: %" PRIx32,
+                                       revents);
+
+        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
+         * it.) */
+        (void) ioctl(fd, SIOCINQ, &v);
+
+        /* Native messages may be arbitrarily large, hence we receive them one by one, see above. */
+        if (fd != s->native_fd) {
+                r = server_process_datagram_batch(s, fd, v);
+                if (r != 0) {
+                        server_refresh_idle_timer(s);
+                        return r < 0 ? r : 0;
+                }
+        }
+
+        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
+        m = PAGE_ALIGN(MAX3((size_t) v + 1,
+                            (size_t) LINE_MAX,
+                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
+
+        if (!GREEDY_REALLOC(s->buffer, m))
+                return log_oom();
+
+        iovec = IOVEC_MAKE(s->buffer, MALLOC_ELEMENTSOF(s->buffer) - 1); /* Leave room for trailing NUL we add later */
+
+        n = recvmsg_safe(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+        if (n < 0) {
+                if (ERRNO_IS_TRANSIENT(n))
+                        return 0;
+                if (n == -EXFULL) {
+                        log_ratelimit_warning(JOURNAL_LOG_RATELIMIT,
+                                              "Got message with truncated control data (too many fds sent?), ignoring.");
+                        return 0;
+                }
+                return log_ratelimit_error_errno(n, JOURNAL_LOG_RATELIMIT, "recvmsg() failed: %m");
+        }
+
+        server_dispatch_datagram(s, fd, s->buffer, n, &msghdr);
 
         server_refresh_idle_timer(s);
         return 0;
@@ -2194,6 +2767,134 @@ static int vl_method_relinquish_var(Varlink *link, JsonVariant *parameters, Varl
         return varlink_reply(link, NULL);
 }
 
+static int vl_method_get_writer_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        Server *s = ASSERT_PTR(userdata);
+        JournalWriterStats stats = {};
+
+        assert(link);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        if (s->writer)
+                journal_writer_get_stats(s->writer, &stats);
+
+        return varlink_replyb(link,
+                              JSON_BUILD_OBJECT(
+                                              JSON_BUILD_PAIR_BOOLEAN("enabled", !!s->writer),
+                                              JSON_BUILD_PAIR_UNSIGNED("queueSize", stats.queue_size),
+                                              JSON_BUILD_PAIR_UNSIGNED("queueDepth", stats.queue_depth),
+                                              JSON_BUILD_PAIR_UNSIGNED("queueDepthMax", stats.queue_depth_max),
+                                              JSON_BUILD_PAIR_UNSIGNED("queued", stats.n_queued),
+                                              JSON_BUILD_PAIR_UNSIGNED("written", stats.n_written),
+                                              JSON_BUILD_PAIR_UNSIGNED("returned", stats.n_returned),
+                                              JSON_BUILD_PAIR_UNSIGNED("stopped", stats.n_stopped),
+                                              JSON_BUILD_PAIR_UNSIGNED("blocked", stats.n_blocked),
+                                              JSON_BUILD_PAIR_UNSIGNED("blockedUSec", stats.blocked_usec)));
+}
+
+static int vl_method_get_context_cache_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        Server *s = ASSERT_PTR(userdata);
+
+        assert(link);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        return varlink_replyb(link,
+                              JSON_BUILD_OBJECT(
+                                              JSON_BUILD_PAIR_UNSIGNED("entries", hashmap_size(s->client_contexts)),
+                                              JSON_BUILD_PAIR_UNSIGNED("unitEntries", hashmap_size(s->client_unit_contexts)),
+                                              JSON_BUILD_PAIR_UNSIGNED("hits", s->client_context_stats.n_hits),
+                                              JSON_BUILD_PAIR_UNSIGNED("misses", s->client_context_stats.n_misses),
+                                              JSON_BUILD_PAIR_UNSIGNED("pidReuses", s->client_context_stats.n_pid_reuses),
+                                              JSON_BUILD_PAIR_UNSIGNED("unitHits", s->client_context_stats.n_unit_hits),
+                                              JSON_BUILD_PAIR_UNSIGNED("unitMisses", s->client_context_stats.n_unit_misses)));
+}
+
+static int json_append_event_source_statistics(JsonVariant **array, const char *name, const EventSourceStatistics *stats) {
+        assert(array);
+        assert(name);
+        assert(stats);
+
+        return json_variant_append_arrayb(
+                        array,
+                        JSON_BUILD_OBJECT(
+                                        JSON_BUILD_PAIR_STRING("name", name),
+                                        JSON_BUILD_PAIR_UNSIGNED("dispatched", stats->n_dispatched),
+                                        JSON_BUILD_PAIR_UNSIGNED("dispatchUSec", stats->dispatch_usec),
+                                        JSON_BUILD_PAIR_UNSIGNED("dispatchMaxUSec", stats->dispatch_max_usec),
+                                        JSON_BUILD_PAIR_UNSIGNED("pendingUSec", stats->pending_usec),
+                                        JSON_BUILD_PAIR_UNSIGNED("pendingMaxUSec", stats->pending_max_usec)));
+}
+
+static int vl_method_get_event_loop_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        _cleanup_(json_variant_unrefp) JsonVariant *array = NULL;
+        Server *s = ASSERT_PTR(userdata);
+        EventSourceStatistics streams = {};
+        uint64_t iteration, budget;
+        int r;
+
+        assert(link);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        const struct {
+                const char *name;
+                sd_event_source *source;
+        } table[] = {
+                { "native",      s->native_event_source      },
+                { "syslog",      s->syslog_event_source      },
+                { "stdout",      s->stdout_event_source      },
+                { "kmsg",        s->dev_kmsg_event_source    },
+                { "audit",       s->audit_event_source       },
+                { "notify",      s->notify_event_source      },
+                { "sync",        s->sync_event_source        },
+                { "writer",      s->writer_event_source      },
+                { "prepare",     s->prepare_event_source     },
+                { "post-change", s->post_change_event_source },
+        };
+
+        FOREACH_ARRAY(i, table, ELEMENTSOF(table)) {
+                EventSourceStatistics stats = {};
+
+                if (!i->source)
+                        continue;
+
+                r = event_source_add_statistics(i->source, &stats);
+                if (r < 0)
+                        return r;
+
+                r = json_append_event_source_statistics(&array, i->name, &stats);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Connected stdout streams are summed up, there may be many of them */
+        r = stdout_streams_add_statistics(s, &streams);
+        if (r < 0)
+                return r;
+
+        r = json_append_event_source_statistics(&array, "stdout-streams", &streams);
+        if (r < 0)
+                return r;
+
+        r = sd_event_get_iteration(s->event, &iteration);
+        if (r < 0)
+                return r;
+
+        r = sd_event_get_dispatch_budget(s->event, &budget);
+        if (r < 0)
+                return r;
+
+        return varlink_replyb(link,
+                              JSON_BUILD_OBJECT(
+                                              JSON_BUILD_PAIR_UNSIGNED("iterations", iteration),
+                                              JSON_BUILD_PAIR_UNSIGNED("dispatchBudgetUSec", budget),
+                                              JSON_BUILD_PAIR_VARIANT("sources", array)));
+}
+
 static int vl_connect(VarlinkServer *server, Varlink *link, void *userdata) {
         Server *s = ASSERT_PTR(userdata);
 
@@ -2230,7 +2931,10 @@ static int server_open_varlink(Server *s, const char *socket, int fd) {
                         "io.systemd.Journal.Synchronize",   vl_method_synchronize,
                         "io.systemd.Journal.Rotate",        vl_method_rotate,
                         "io.systemd.Journal.FlushToVar",    vl_method_flush_to_var,
-                        "io.systemd.Journal.RelinquishVar", vl_method_relinquish_var);
+                        "io.systemd.Journal.RelinquishVar", vl_method_relinquish_var,
+                        "io.systemd.Journal.GetWriterStatistics", vl_method_get_writer_statistics,
+                        "io.systemd.Journal.GetContextCacheStatistics", vl_method_get_context_cache_statistics,
+                        "io.systemd.Journal.GetEventLoopStatistics", vl_method_get_event_loop_statistics);
         if (r < 0)
                 return r;
 
@@ -2406,6 +3110,7 @@ static int server_memory_pressure(sd_event_source *es, void *userdata) {
         client_context_flush_regular(s);
 
         /* Let's also close all user files (but keep the system/runtime one open) */
+        SERVER_SUSPEND_WRITER(s);
         for (;;) {
                 ManagedJournalFile *first = ordered_hashmap_steal_first(s->user_journals);
 
@@ -2433,6 +3138,47 @@ static int server_setup_memory_pressure(Server *s) {
         return 0;
 }
 
+static int dispatch_writer(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = ASSERT_PTR(userdata);
+
+        journal_writer_flush_fd(s->writer);
+        server_drain_writer(s, /* wait= */ false);
+
+        return 0;
+}
+
+static int server_open_writer(Server *s) {
+        int r;
+
+        assert(s);
+        assert(s->seqnum);
+
+        if (s->writer_queue_size == 0)
+                return 0;
+
+        if (s->writer_queue_size > WRITER_QUEUE_SIZE_MAX) {
+                log_warning("WriterQueueSize=%u is too large, using %u instead.", s->writer_queue_size, WRITER_QUEUE_SIZE_MAX);
+                s->writer_queue_size = WRITER_QUEUE_SIZE_MAX;
+        }
+
+        r = journal_writer_new(s->writer_queue_size, s->max_file_usec, &s->seqnum->seqnum, &s->seqnum->id, &s->writer);
+        if (r < 0)
+                return log_error_errno(r, "Failed to start writer thread: %m");
+
+        r = sd_event_add_io(s->event, &s->writer_event_source, journal_writer_get_fd(s->writer), EPOLLIN, dispatch_writer, s);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add writer thread event source: %m");
+
+        r = sd_event_source_set_priority(s->writer_event_source, SD_EVENT_PRIORITY_NORMAL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to adjust priority of writer thread event source: %m");
+
+        (void) sd_event_source_set_description(s->writer_event_source, "writer");
+
+        log_debug("Writing journal files from separate thread, with a queue of %u entries.", s->writer_queue_size);
+        return 0;
+}
+
 int server_init(Server *s, const char *namespace) {
         const char *native_socket, *syslog_socket, *stdout_socket, *varlink_socket, *e;
         _cleanup_fdset_free_ FDSet *fds = NULL;
@@ -2660,6 +3406,10 @@ int server_init(Server *s, const char *namespace) {
         if (r < 0)
                 return r;
 
+        r = server_open_writer(s);
+        if (r < 0)
+                return r;
+
         r = server_open_hostname(s);
         if (r < 0)
                 return r;
@@ -2713,6 +3463,22 @@ int server_init(Server *s, const char *namespace) {
         return 0;
 }
 
+#if HAVE_GCRYPT
+static void server_maybe_append_tag(Server *s, JournalFile *f, usec_t n) {
+        usec_t u;
+
+        assert(s);
+        assert(f);
+
+        /* Only wait for the writer thread if there's actually a tag to append */
+        if (s->writer && (!journal_file_next_evolve_usec(f, &u) || u > n))
+                return;
+
+        SERVER_SUSPEND_WRITER(s);
+        journal_file_maybe_append_tag(f, n);
+}
+#endif
+
 void server_maybe_append_tags(Server *s) {
 #if HAVE_GCRYPT
         ManagedJournalFile *f;
@@ -2721,16 +3487,22 @@ void server_maybe_append_tags(Server *s) {
         n = now(CLOCK_REALTIME);
 
         if (s->system_journal)
-                journal_file_maybe_append_tag(s->system_journal->file, n);
+                server_maybe_append_tag(s, s->system_journal->file, n);
 
         ORDERED_HASHMAP_FOREACH(f, s->user_journals)
-                journal_file_maybe_append_tag(f->file, n);
+                server_maybe_append_tag(s, f->file, n);
 #endif
 }
 
 void server_done(Server *s) {
         assert(s);
 
+        /* Write out whatever is still queued before the journal files are closed */
+        server_drain_writer(s, /* wait= */ true);
+        s->writer_event_source = sd_event_source_disable_unref(s->writer_event_source);
+        s->writer = journal_writer_free(s->writer);
+        set_free(s->writer_files);
+
         free(s->namespace);
         free(s->namespace_field);
 
@@ -2754,6 +3526,8 @@ void server_done(Server *s) {
         sd_event_source_unref(s->dev_kmsg_event_source);
         sd_event_source_unref(s->audit_event_source);
         sd_event_source_unref(s->sync_event_source);
+        sd_event_source_unref(s->prepare_event_source);
+        sd_event_source_unref(s->post_change_event_source);
         sd_event_source_unref(s->sigusr1_event_source);
         sd_event_source_unref(s->sigusr2_event_source);
         sd_event_source_unref(s->sigterm_event_source);
@@ -2780,9 +3554,12 @@ void server_done(Server *s) {
         server_unmap_seqnum_file(s->kernel_seqnum, sizeof(*s->kernel_seqnum));
 
         free(s->buffer);
+        datagram_batch_free(s->datagram_batch);
         free(s->tty_path);
         free(s->cgroup_root);
         free(s->hostname_field);
+        journal_vacuum_state_free(s->runtime_storage.vacuum_state);
+        journal_vacuum_state_free(s->system_storage.vacuum_state);
         free(s->runtime_storage.path);
         free(s->system_storage.path);
         free(s->runtime_directory);
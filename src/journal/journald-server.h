@@ -7,13 +7,16 @@
 #include "sd-event.h"
 
 typedef struct Server Server;
+typedef struct DatagramBatch DatagramBatch;
 
 #include "common-signal.h"
 #include "conf-parser.h"
 #include "hashmap.h"
+#include "journal-vacuum.h"
 #include "journald-context.h"
 #include "journald-rate-limit.h"
 #include "journald-stream.h"
+#include "journald-writer.h"
 #include "list.h"
 #include "managed-journal-file.h"
 #include "prioq.h"
@@ -59,6 +62,9 @@ typedef struct JournalStorage {
 
         JournalMetrics metrics;
         JournalStorageSpace space;
+
+        /* Remembers the archived files between vacuuming runs, and deletes them off the event loop */
+        JournalVacuumState *vacuum_state;
 } JournalStorage;
 
 /* This structure will be kept in $RUNTIME_DIRECTORY/seqnum and is mapped by journald, and is used to
@@ -105,6 +111,7 @@ struct Server {
         SeqnumData *seqnum;
 
         char *buffer;
+        DatagramBatch *datagram_batch;
 
         JournalRateLimit *ratelimit;
         usec_t sync_interval_usec;
@@ -176,6 +183,8 @@ struct Server {
         /* Caching of client metadata */
         Hashmap *client_contexts;
         Prioq *client_contexts_lru;
+        Hashmap *client_unit_contexts;
+        ClientContextStats client_context_stats;
 
         usec_t last_cache_pid_flush;
 
@@ -183,6 +192,19 @@ struct Server {
         ClientContext *pid1_context; /* the context of PID 1 */
 
         VarlinkServer *varlink_server;
+
+        /* The optional writer thread, see journald-writer.h */
+        unsigned writer_queue_size;
+        JournalWriter *writer;
+        sd_event_source *writer_event_source;
+        Set *writer_files;
+        unsigned writer_suspended;
+        sd_event_source *post_change_event_source;
+
+        /* Growing journal files and creating their successors ahead of time, from an idle timer */
+        uint64_t preallocate_size;
+        bool precreate_next_file;
+        sd_event_source *prepare_event_source;
 };
 
 #define SERVER_MACHINE_ID(s) ((s)->machine_id_field + STRLEN("_MACHINE_ID="))
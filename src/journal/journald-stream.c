@@ -48,6 +48,10 @@
  * let's enforce a line length matching the maximum unit name length (255) */
 #define STDOUT_STREAM_SETUP_PROTOCOL_LINE_MAX (UNIT_NAME_MAX-1U)
 
+/* Room we keep in front of the stream data in the buffer, so that there's always space to put the "MESSAGE="
+ * field name right before a line, see stdout_stream_log() */
+#define STDOUT_STREAM_HEADROOM STRLEN("MESSAGE=")
+
 typedef enum StdoutStreamState {
         STDOUT_STREAM_IDENTIFIER,
         STDOUT_STREAM_UNIT_ID,
@@ -81,6 +85,7 @@ struct StdoutStream {
         struct ucred ucred;
         char *label;
         char *identifier;
+        char *identifier_field;
         char *unit_id;
         int priority;
         bool level_prefix:1;
@@ -91,6 +96,8 @@ struct StdoutStream {
         bool fdstore:1;
         bool in_notify_queue:1;
 
+        /* The first STDOUT_STREAM_HEADROOM bytes are unused, the stream data starts after them. Of that,
+         * the first 'length' bytes are not processed yet, none of them is a line break. */
         char *buffer;
         size_t length;
 
@@ -128,6 +135,7 @@ StdoutStream* stdout_stream_free(StdoutStream *s) {
         safe_close(s->fd);
         free(s->label);
         free(s->identifier);
+        free(s->identifier_field);
         free(s->unit_id);
         free(s->state_file);
         free(s->buffer);
@@ -248,19 +256,20 @@ fail:
 
 static int stdout_stream_log(
                 StdoutStream *s,
-                const char *p,
+                char *line,
                 LineBreak line_break) {
 
         struct iovec *iovec;
         int priority;
         char syslog_priority[] = "PRIORITY=\0";
         char syslog_facility[STRLEN("SYSLOG_FACILITY=") + DECIMAL_STR_MAX(int) + 1];
-        _cleanup_free_ char *message = NULL, *syslog_identifier = NULL;
+        char saved[STDOUT_STREAM_HEADROOM], *message;
+        const char *p = line;
         size_t n = 0, m;
         int r;
 
         assert(s);
-        assert(p);
+        assert(line);
 
         assert(line_break >= 0);
         assert(line_break < _LINE_BREAK_MAX);
@@ -316,9 +325,10 @@ static int stdout_stream_log(
         }
 
         if (s->identifier) {
-                syslog_identifier = strjoin("SYSLOG_IDENTIFIER=", s->identifier);
-                if (syslog_identifier)
-                        iovec[n++] = IOVEC_MAKE_STRING(syslog_identifier);
+                if (!s->identifier_field)
+                        s->identifier_field = strjoin("SYSLOG_IDENTIFIER=", s->identifier);
+                if (s->identifier_field)
+                        iovec[n++] = IOVEC_MAKE_STRING(s->identifier_field);
         }
 
         static const char * const line_break_field_table[_LINE_BREAK_MAX] = {
@@ -336,11 +346,19 @@ static int stdout_stream_log(
         if (c)
                 iovec[n++] = IOVEC_MAKE_STRING(c);
 
-        message = strjoin("MESSAGE=", p);
-        if (message)
-                iovec[n++] = IOVEC_MAKE_STRING(message);
+        /* The line is located in our stream buffer, and everything in front of it is either the headroom,
+         * or belongs to lines that are processed already. Hence, instead of copying the line to prefix it
+         * with the field name, temporarily put the field name right in front of it, and revert afterwards. */
+        message = line + (p - line) - STDOUT_STREAM_HEADROOM;
+        assert(message >= s->buffer);
+
+        memcpy(saved, message, STDOUT_STREAM_HEADROOM);
+        memcpy(message, "MESSAGE=", STDOUT_STREAM_HEADROOM);
+        iovec[n++] = IOVEC_MAKE(message, STDOUT_STREAM_HEADROOM + strlen(p));
 
         server_dispatch_message(s->server, iovec, n, m, s->context, NULL, priority, 0);
+
+        memcpy(message, saved, STDOUT_STREAM_HEADROOM);
         return 0;
 }
 
@@ -499,36 +517,40 @@ static int stdout_stream_scan(
                 StdoutStream *s,
                 char *p,
                 size_t remaining,
+                size_t scanned,
                 LineBreak force_flush,
                 size_t *ret_consumed) {
 
         size_t consumed = 0, line_max;
-        int r;
+        char *end, saved;
+        int r = 0;
 
         assert(s);
         assert(p);
+        assert(scanned <= remaining);
 
         line_max = stdout_stream_line_max(s);
 
+        /* NUL terminate the data, so that we can look for both kinds of line breaks in a single pass with
+         * strchrnul(). There's always room for that, but the byte might be data that is to be processed
+         * later, hence restore it afterwards. */
+        end = p + remaining;
+        saved = *end;
+        *end = 0;
+
         for (;;) {
                 LineBreak line_break;
                 size_t skip, found;
-                char *end1, *end2;
-                size_t tmp_remaining = MIN(remaining, line_max);
 
-                end1 = memchr(p, '\n', tmp_remaining);
-                end2 = memchr(p, 0, end1 ? (size_t) (end1 - p) : tmp_remaining);
+                /* The first 'scanned' bytes are known to not contain any line break, don't look at them
+                 * again */
+                found = strchrnul(p + scanned, '\n') - p;
+                scanned = 0;
 
-                if (end2) {
-                        /* We found a NUL terminator */
-                        found = end2 - p;
+                if (found < MIN(remaining, line_max)) {
+                        /* We found a \n or NUL terminator */
                         skip = found + 1;
-                        line_break = LINE_BREAK_NUL;
-                } else if (end1) {
-                        /* We found a \n terminator */
-                        found = end1 - p;
-                        skip = found + 1;
-                        line_break = LINE_BREAK_NEWLINE;
+                        line_break = p[found] == '\n' ? LINE_BREAK_NEWLINE : LINE_BREAK_NUL;
                 } else if (remaining >= line_max) {
                         /* Force a line break after the maximum line length */
                         found = skip = line_max;
@@ -538,7 +560,7 @@ static int stdout_stream_scan(
 
                 r = stdout_stream_found(s, p, found, line_break);
                 if (r < 0)
-                        return r;
+                        goto finish;
 
                 p += skip;
                 consumed += skip;
@@ -548,7 +570,7 @@ static int stdout_stream_scan(
         if (force_flush >= 0 && remaining > 0) {
                 r = stdout_stream_found(s, p, remaining, force_flush);
                 if (r < 0)
-                        return r;
+                        goto finish;
 
                 consumed += remaining;
         }
@@ -556,17 +578,19 @@ static int stdout_stream_scan(
         if (ret_consumed)
                 *ret_consumed = consumed;
 
-        return 0;
+finish:
+        *end = saved;
+        return r < 0 ? r : 0;
 }
 
 static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct ucred))) control;
-        size_t limit, consumed, allocated;
+        size_t limit, consumed, allocated, scanned;
         StdoutStream *s = ASSERT_PTR(userdata);
         struct ucred *ucred;
         struct iovec iovec;
         ssize_t l;
-        char *p;
+        char *data, *p;
         int r;
 
         struct msghdr msghdr = {
@@ -582,21 +606,23 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
         }
 
         /* If the buffer is almost full, add room for another 1K */
-        allocated = MALLOC_ELEMENTSOF(s->buffer);
+        allocated = LESS_BY(MALLOC_ELEMENTSOF(s->buffer), STDOUT_STREAM_HEADROOM);
         if (s->length + 512 >= allocated) {
-                if (!GREEDY_REALLOC(s->buffer, s->length + 1 + 1024)) {
+                if (!GREEDY_REALLOC(s->buffer, STDOUT_STREAM_HEADROOM + s->length + 1 + 1024)) {
                         log_oom();
                         goto terminate;
                 }
 
-                allocated = MALLOC_ELEMENTSOF(s->buffer);
+                allocated = MALLOC_ELEMENTSOF(s->buffer) - STDOUT_STREAM_HEADROOM;
         }
 
+        data = s->buffer + STDOUT_STREAM_HEADROOM;
+
         /* Try to make use of the allocated buffer in full, but never read more than the configured line size. Also,
          * always leave room for a terminating NUL we might need to add. */
         limit = MIN(allocated - 1, MAX(s->server->line_max, STDOUT_STREAM_SETUP_PROTOCOL_LINE_MAX));
         assert(s->length <= limit);
-        iovec = IOVEC_MAKE(s->buffer + s->length, limit - s->length);
+        iovec = IOVEC_MAKE(data + s->length, limit - s->length);
 
         l = recvmsg(s->fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
         if (l < 0) {
@@ -609,7 +635,7 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
         cmsg_close_all(&msghdr);
 
         if (l == 0) {
-                (void) stdout_stream_scan(s, s->buffer, s->length, /* force_flush = */ LINE_BREAK_EOF, NULL);
+                (void) stdout_stream_scan(s, data, s->length, s->length, /* force_flush = */ LINE_BREAK_EOF, NULL);
                 goto terminate;
         }
 
@@ -620,30 +646,32 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
         if (ucred && ucred->pid != s->ucred.pid) {
                 /* Force out any previously half-written lines from a different process, before we switch to
                  * the new ucred structure for everything we just added */
-                r = stdout_stream_scan(s, s->buffer, s->length, /* force_flush = */ LINE_BREAK_PID_CHANGE, NULL);
+                r = stdout_stream_scan(s, data, s->length, s->length, /* force_flush = */ LINE_BREAK_PID_CHANGE, NULL);
                 if (r < 0)
                         goto terminate;
 
                 s->context = client_context_release(s->server, s->context);
 
-                p = s->buffer + s->length;
+                p = data + s->length;
+                scanned = 0;
         } else {
-                p = s->buffer;
+                p = data;
                 l += s->length;
+                scanned = s->length;
         }
 
         /* Always copy in the new credentials */
         if (ucred)
                 s->ucred = *ucred;
 
-        r = stdout_stream_scan(s, p, l, _LINE_BREAK_INVALID, &consumed);
+        r = stdout_stream_scan(s, p, l, scanned, _LINE_BREAK_INVALID, &consumed);
         if (r < 0)
                 goto terminate;
 
         /* Move what wasn't consumed to the front of the buffer */
         assert(consumed <= (size_t) l);
         s->length = l - consumed;
-        memmove(s->buffer, p + consumed, s->length);
+        memmove(data, p + consumed, s->length);
 
         return 1;
 
@@ -1000,3 +1028,21 @@ void stdout_stream_send_notify(StdoutStream *s) {
         s->in_notify_queue = false;
 
 }
+
+int stdout_streams_add_statistics(Server *s, EventSourceStatistics *stats) {
+        int r;
+
+        assert(s);
+        assert(stats);
+
+        LIST_FOREACH(stdout_stream, stream, s->stdout_streams) {
+                if (!stream->event_source)
+                        continue;
+
+                r = event_source_add_statistics(stream->event_source, stats);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
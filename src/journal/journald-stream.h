@@ -3,6 +3,7 @@
 
 typedef struct StdoutStream StdoutStream;
 
+#include "event-util.h"
 #include "fdset.h"
 #include "journald-server.h"
 
@@ -13,3 +14,5 @@ StdoutStream* stdout_stream_free(StdoutStream *s);
 int stdout_stream_install(Server *s, int fd, StdoutStream **ret);
 void stdout_stream_destroy(StdoutStream *s);
 void stdout_stream_send_notify(StdoutStream *s);
+
+int stdout_streams_add_statistics(Server *s, EventSourceStatistics *stats);
@@ -0,0 +1,533 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "journald-writer.h"
+#include "memory-util.h"
+
+/* How many entries the writer thread takes off the queue at once at most */
+#define WRITER_BATCH_MAX 64U
+
+struct JournalWriter {
+        pthread_t thread;
+        bool thread_started;
+
+        JournalWriterEntry **queue;
+        size_t size; /* always a power of two */
+
+        /* Free running counters, the slot in the queue is the counter modulo the queue size. 'head' is only
+         * written by the writer thread (and by the event loop thread while the writer thread is stopped),
+         * 'tail' only by the event loop thread. An entry is only removed from the queue after it has been
+         * written, hence head == tail means that the writer thread is done with all files. */
+        uint64_t head;
+        uint64_t tail;
+
+        int wakeup_fd;  /* event loop thread → writer thread: there are new entries */
+        int space_fd;   /* writer thread → event loop thread: entries have been written, or we stopped */
+        int notify_fd;  /* writer thread → event loop: the same, but to be polled on by the event loop */
+
+        bool writer_waiting;
+        bool producer_waiting;
+        bool notify_pending;
+
+        /* Set by the writer thread when it gave up on the entry at 'head', either because it couldn't be
+         * written, or because the file should be rotated first. */
+        bool stopped;
+        int error;
+
+        bool exit;
+
+        uint64_t *seqnum;
+        sd_id128_t *seqnum_id;
+        usec_t max_file_usec;
+
+        /* Updated by the writer thread */
+        uint64_t n_written;
+        uint64_t n_stopped;
+
+        /* Only accessed by the event loop thread */
+        uint64_t n_queued;
+        uint64_t n_returned;
+        uint64_t n_blocked;
+        usec_t blocked_usec;
+        size_t queue_depth_max;
+};
+
+static JournalWriterEntry** writer_slot(JournalWriter *w, uint64_t i) {
+        assert(w);
+
+        return w->queue + (i & (w->size - 1));
+}
+
+static void writer_wake(int fd) {
+        /* This only fails if the counter would overflow, in which case the other side is woken up anyway */
+        (void) eventfd_write(fd, 1);
+}
+
+static int writer_wait(int fd) {
+        eventfd_t v;
+        int r;
+
+        for (;;) {
+                if (eventfd_read(fd, &v) >= 0)
+                        return 0;
+                if (errno != EAGAIN)
+                        return -errno;
+
+                r = fd_wait_for_event(fd, POLLIN, USEC_INFINITY);
+                if (r < 0 && r != -EINTR)
+                        return r;
+        }
+}
+
+static bool writer_is_idle(JournalWriter *w, uint64_t head) {
+        assert(w);
+
+        return head == __atomic_load_n(&w->tail, __ATOMIC_SEQ_CST) ||
+                __atomic_load_n(&w->stopped, __ATOMIC_SEQ_CST);
+}
+
+static void writer_process(JournalWriter *w, uint64_t head, size_t n) {
+        JournalFileAppendEntry batch[WRITER_BATCH_MAX];
+        bool stop = false;
+        size_t i = 0;
+        int r = 0;
+
+        assert(w);
+        assert(n <= WRITER_BATCH_MAX);
+
+        while (i < n) {
+                JournalFile *f = (*writer_slot(w, head + i))->file;
+                size_t j, k = 0;
+
+                /* Append the run of entries for the same file in one go */
+                for (j = i; j < n; j++) {
+                        JournalWriterEntry *e = *writer_slot(w, head + j);
+
+                        if (e->file != f)
+                                break;
+
+                        batch[j - i] = (JournalFileAppendEntry) {
+                                .ts = &e->ts,
+                                .iovec = e->iovec,
+                                .n_iovec = e->n_iovec,
+                        };
+                }
+
+                /* Rotating is up to the event loop thread, let it take over */
+                if (journal_file_rotate_suggested(f, w->max_file_usec, LOG_DEBUG)) {
+                        stop = true;
+                        break;
+                }
+
+                r = journal_file_append_entries(f, batch, j - i, w->seqnum, w->seqnum_id, &k);
+
+                for (size_t l = i; l < i + k; l++)
+                        *writer_slot(w, head + l) = mfree(*writer_slot(w, head + l));
+
+                __atomic_add_fetch(&w->n_written, k, __ATOMIC_RELAXED);
+                i += k;
+
+                if (r < 0) {
+                        stop = true;
+                        break;
+                }
+        }
+
+        __atomic_store_n(&w->head, head + i, __ATOMIC_SEQ_CST);
+
+        if (stop) {
+                w->error = r;
+                __atomic_add_fetch(&w->n_stopped, 1, __ATOMIC_RELAXED);
+                __atomic_store_n(&w->stopped, true, __ATOMIC_SEQ_CST);
+        }
+
+        if (!__atomic_exchange_n(&w->notify_pending, true, __ATOMIC_SEQ_CST) || stop)
+                writer_wake(w->notify_fd);
+
+        if (__atomic_load_n(&w->producer_waiting, __ATOMIC_SEQ_CST))
+                writer_wake(w->space_fd);
+}
+
+static void* writer_thread(void *userdata) {
+        JournalWriter *w = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "journal-writer");
+
+        for (;;) {
+                uint64_t head;
+
+                head = __atomic_load_n(&w->head, __ATOMIC_SEQ_CST);
+
+                if (writer_is_idle(w, head)) {
+                        if (__atomic_load_n(&w->exit, __ATOMIC_SEQ_CST))
+                                break;
+
+                        /* Announce that we are going to sleep, and check again afterwards, so that either
+                         * the event loop thread sees the flag, or we see the new entry. */
+                        __atomic_store_n(&w->writer_waiting, true, __ATOMIC_SEQ_CST);
+                        if (writer_is_idle(w, head) && !__atomic_load_n(&w->exit, __ATOMIC_SEQ_CST))
+                                (void) writer_wait(w->wakeup_fd);
+                        __atomic_store_n(&w->writer_waiting, false, __ATOMIC_SEQ_CST);
+
+                        continue;
+                }
+
+                writer_process(w, head, MIN(__atomic_load_n(&w->tail, __ATOMIC_SEQ_CST) - head, (uint64_t) WRITER_BATCH_MAX));
+        }
+
+        return NULL;
+}
+
+static int writer_start_thread(JournalWriter *w) {
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(w);
+        assert(!w->thread_started);
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        /* No signals in the writer thread, please */
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&w->thread, NULL, writer_thread, w);
+        if (r == 0)
+                w->thread_started = true;
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+        if (k > 0)
+                return -k;
+
+        return 0;
+}
+
+int journal_writer_new(
+                size_t queue_size,
+                usec_t max_file_usec,
+                uint64_t *seqnum,
+                sd_id128_t *seqnum_id,
+                JournalWriter **ret) {
+
+        _cleanup_(journal_writer_freep) JournalWriter *w = NULL;
+        int r;
+
+        assert(queue_size > 0);
+        assert(ret);
+
+        w = new(JournalWriter, 1);
+        if (!w)
+                return -ENOMEM;
+
+        *w = (JournalWriter) {
+                .size = ALIGN_POWER2(queue_size),
+                .wakeup_fd = -EBADF,
+                .space_fd = -EBADF,
+                .notify_fd = -EBADF,
+                .seqnum = seqnum,
+                .seqnum_id = seqnum_id,
+                .max_file_usec = max_file_usec,
+        };
+
+        if (w->size == 0)
+                return -EINVAL;
+
+        w->queue = new0(JournalWriterEntry*, w->size);
+        if (!w->queue)
+                return -ENOMEM;
+
+        w->wakeup_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (w->wakeup_fd < 0)
+                return -errno;
+
+        w->space_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (w->space_fd < 0)
+                return -errno;
+
+        w->notify_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (w->notify_fd < 0)
+                return -errno;
+
+        r = writer_start_thread(w);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
+
+JournalWriter* journal_writer_free(JournalWriter *w) {
+        if (!w)
+                return NULL;
+
+        if (w->thread_started) {
+                /* The writer thread finishes what's queued before it exits, unless it is stopped */
+                __atomic_store_n(&w->exit, true, __ATOMIC_SEQ_CST);
+                writer_wake(w->wakeup_fd);
+
+                (void) pthread_join(w->thread, NULL);
+        }
+
+        if (w->queue)
+                for (uint64_t i = w->head; i != w->tail; i++)
+                        free(*writer_slot(w, i));
+
+        free(w->queue);
+
+        safe_close(w->wakeup_fd);
+        safe_close(w->space_fd);
+        safe_close(w->notify_fd);
+
+        return mfree(w);
+}
+
+int journal_writer_get_fd(JournalWriter *w) {
+        assert(w);
+
+        /* Becomes readable whenever the writer thread wrote some entries or stopped. Call
+         * journal_writer_flush_fd() and then journal_writer_drain() when that happens. */
+        return w->notify_fd;
+}
+
+void journal_writer_flush_fd(JournalWriter *w) {
+        eventfd_t v;
+
+        assert(w);
+
+        /* Reset the flag first, so that anything the writer thread does from now on results in another
+         * wakeup, if we don't catch it here already. */
+        __atomic_store_n(&w->notify_pending, false, __ATOMIC_SEQ_CST);
+        (void) eventfd_read(w->notify_fd, &v);
+}
+
+static int writer_wait_for_progress(JournalWriter *w, uint64_t head) {
+        int r = 0;
+
+        assert(w);
+
+        __atomic_store_n(&w->producer_waiting, true, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&w->head, __ATOMIC_SEQ_CST) == head && !__atomic_load_n(&w->stopped, __ATOMIC_SEQ_CST))
+                r = writer_wait(w->space_fd);
+        __atomic_store_n(&w->producer_waiting, false, __ATOMIC_SEQ_CST);
+
+        return r;
+}
+
+int journal_writer_enqueue(
+                JournalWriter *w,
+                JournalFile *f,
+                uid_t uid,
+                int priority,
+                const dual_timestamp *ts,
+                const struct iovec *iovec,
+                size_t n_iovec) {
+
+        JournalWriterEntry *e;
+        usec_t begin = USEC_INFINITY;
+        uint64_t head;
+        uint8_t *p;
+        int r;
+
+        assert(w);
+        assert(f);
+        assert(ts);
+        assert(iovec || n_iovec == 0);
+
+        for (;;) {
+                /* The caller has to take over the entries queued so far first */
+                if (__atomic_load_n(&w->stopped, __ATOMIC_SEQ_CST))
+                        return -EAGAIN;
+
+                head = __atomic_load_n(&w->head, __ATOMIC_SEQ_CST);
+                if (w->tail - head < w->size)
+                        break;
+
+                /* The queue is full. We wait until the writer thread made some room, which means we stop
+                 * reading from the sockets, which in turn makes the clients block. */
+                if (begin == USEC_INFINITY) {
+                        begin = now(CLOCK_MONOTONIC);
+                        w->n_blocked++;
+                }
+
+                r = writer_wait_for_progress(w, head);
+                if (r < 0)
+                        return r;
+        }
+
+        if (begin != USEC_INFINITY)
+                w->blocked_usec += usec_sub_unsigned(now(CLOCK_MONOTONIC), begin);
+
+        e = malloc(offsetof(JournalWriterEntry, iovec) +
+                   n_iovec * sizeof(struct iovec) +
+                   IOVEC_TOTAL_SIZE(iovec, n_iovec));
+        if (!e)
+                return -ENOMEM;
+
+        e->file = f;
+        e->ts = *ts;
+        e->uid = uid;
+        e->priority = priority;
+        e->n_iovec = n_iovec;
+
+        p = (uint8_t*) (e->iovec + n_iovec);
+        for (size_t i = 0; i < n_iovec; i++) {
+                e->iovec[i] = IOVEC_MAKE(p, iovec[i].iov_len);
+                p = mempcpy_safe(p, iovec[i].iov_base, iovec[i].iov_len);
+        }
+
+        *writer_slot(w, w->tail) = e;
+        __atomic_store_n(&w->tail, w->tail + 1, __ATOMIC_SEQ_CST);
+
+        w->n_queued++;
+        w->queue_depth_max = MAX(w->queue_depth_max, (size_t) (w->tail - head));
+
+        if (__atomic_load_n(&w->writer_waiting, __ATOMIC_SEQ_CST))
+                writer_wake(w->wakeup_fd);
+
+        return 0;
+}
+
+static int writer_take_back(
+                JournalWriter *w,
+                JournalWriterEntry ***ret_entries,
+                size_t *ret_n_entries,
+                int *ret_error) {
+
+        _cleanup_free_ JournalWriterEntry **entries = NULL;
+        uint64_t head;
+        size_t n;
+
+        assert(w);
+        assert(ret_entries);
+        assert(ret_n_entries);
+        assert(ret_error);
+
+        /* The writer thread is stopped, hence we may take over its part of the queue */
+        head = __atomic_load_n(&w->head, __ATOMIC_SEQ_CST);
+        n = w->tail - head;
+
+        if (n > 0) {
+                entries = new(JournalWriterEntry*, n);
+                if (!entries)
+                        return -ENOMEM;
+        }
+
+        for (size_t i = 0; i < n; i++)
+                entries[i] = TAKE_PTR(*writer_slot(w, head + i));
+
+        w->n_returned += n;
+        *ret_error = w->error;
+
+        __atomic_store_n(&w->head, w->tail, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&w->stopped, false, __ATOMIC_SEQ_CST);
+        writer_wake(w->wakeup_fd);
+
+        *ret_entries = TAKE_PTR(entries);
+        *ret_n_entries = n;
+        return 1;
+}
+
+int journal_writer_drain(
+                JournalWriter *w,
+                bool wait,
+                JournalWriterEntry ***ret_entries,
+                size_t *ret_n_entries,
+                int *ret_error) {
+
+        int r;
+
+        assert(w);
+        assert(ret_entries);
+        assert(ret_n_entries);
+        assert(ret_error);
+
+        /* If the writer thread stopped, returns all entries it did not write, in order, together with the
+         * error it stopped on (or 0 if a file should be rotated). The caller has to write them, and owns
+         * them now. If 'wait' is true, waits until either all queued entries are written or the writer
+         * thread stopped. After this returned, the writer thread won't touch any journal file until
+         * something is queued again. */
+
+        for (;;) {
+                uint64_t head;
+
+                head = __atomic_load_n(&w->head, __ATOMIC_SEQ_CST);
+
+                if (__atomic_load_n(&w->stopped, __ATOMIC_SEQ_CST))
+                        return writer_take_back(w, ret_entries, ret_n_entries, ret_error);
+
+                if (!wait || head == w->tail) {
+                        *ret_entries = NULL;
+                        *ret_n_entries = 0;
+                        *ret_error = 0;
+                        return 0;
+                }
+
+                r = writer_wait_for_progress(w, head);
+                if (r < 0)
+                        return r;
+        }
+}
+
+int journal_writer_stop(
+                JournalWriter *w,
+                JournalWriterEntry ***ret_entries,
+                size_t *ret_n_entries,
+                int *ret_error) {
+
+        assert(w);
+        assert(ret_entries);
+        assert(ret_n_entries);
+        assert(ret_error);
+
+        /* Terminates the writer thread for good, for when journal_writer_drain() cannot wait for it. Unlike
+         * waiting for progress, joining the thread cannot fail, hence afterwards the writer thread is
+         * guaranteed not to touch any journal file anymore. Returns what it didn't write like
+         * journal_writer_drain(). Nothing may be queued anymore after this. */
+
+        if (w->thread_started) {
+                __atomic_store_n(&w->exit, true, __ATOMIC_SEQ_CST);
+                writer_wake(w->wakeup_fd);
+
+                (void) pthread_join(w->thread, NULL);
+                w->thread_started = false;
+        }
+
+        /* The thread finishes everything queued before it exits, unless it stopped */
+        if (!__atomic_load_n(&w->stopped, __ATOMIC_SEQ_CST)) {
+                assert(w->head == w->tail);
+
+                *ret_entries = NULL;
+                *ret_n_entries = 0;
+                *ret_error = 0;
+                return 0;
+        }
+
+        return writer_take_back(w, ret_entries, ret_n_entries, ret_error);
+}
+
+void journal_writer_get_stats(JournalWriter *w, JournalWriterStats *ret) {
+        assert(w);
+        assert(ret);
+
+        *ret = (JournalWriterStats) {
+                .queue_size = w->size,
+                .queue_depth = w->tail - __atomic_load_n(&w->head, __ATOMIC_SEQ_CST),
+                .queue_depth_max = w->queue_depth_max,
+                .n_queued = w->n_queued,
+                .n_written = __atomic_load_n(&w->n_written, __ATOMIC_RELAXED),
+                .n_returned = w->n_returned,
+                .n_stopped = __atomic_load_n(&w->n_stopped, __ATOMIC_RELAXED),
+                .n_blocked = w->n_blocked,
+                .blocked_usec = w->blocked_usec,
+        };
+}
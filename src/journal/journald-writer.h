@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "journal-file.h"
+#include "macro.h"
+#include "time-util.h"
+
+/* An optional helper thread that appends entries to journal files, so that page faults on cold windows, a
+ * slow file system or writeback throttling don't stall the event loop that reads from the sockets. Entries
+ * are passed through a bounded single-producer/single-consumer ring: the event loop thread is the only
+ * producer, the writer thread the only consumer.
+ *
+ * The writer thread only ever appends. Whenever the event loop thread wants to do anything else with the
+ * journal files (or the MMapCache they share), it first has to drain the queue via journal_writer_drain(),
+ * and must not queue anything until it is done. If an append fails, or the writer finds that a file should
+ * be rotated, it stops and hands all entries it didn't write back to the event loop thread, which then
+ * deals with them the usual way. */
+
+typedef struct JournalWriter JournalWriter;
+
+typedef struct JournalWriterEntry {
+        JournalFile *file;
+        dual_timestamp ts;
+        uid_t uid;
+        int priority;
+        size_t n_iovec;
+        struct iovec iovec[];
+} JournalWriterEntry;
+
+typedef struct JournalWriterStats {
+        size_t queue_size;
+        size_t queue_depth;
+        size_t queue_depth_max;
+
+        uint64_t n_queued;      /* Entries handed to the writer thread */
+        uint64_t n_written;     /* … of which the writer thread wrote */
+        uint64_t n_returned;    /* … of which were handed back after the writer thread stopped */
+        uint64_t n_stopped;     /* How often the writer thread stopped */
+
+        uint64_t n_blocked;     /* How often the queue was full when an entry was queued */
+        usec_t blocked_usec;    /* Time spent waiting for the writer thread while the queue was full */
+} JournalWriterStats;
+
+int journal_writer_new(
+                size_t queue_size,
+                usec_t max_file_usec,
+                uint64_t *seqnum,
+                sd_id128_t *seqnum_id,
+                JournalWriter **ret);
+JournalWriter* journal_writer_free(JournalWriter *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalWriter*, journal_writer_free);
+
+int journal_writer_get_fd(JournalWriter *w);
+void journal_writer_flush_fd(JournalWriter *w);
+
+int journal_writer_enqueue(
+                JournalWriter *w,
+                JournalFile *f,
+                uid_t uid,
+                int priority,
+                const dual_timestamp *ts,
+                const struct iovec *iovec,
+                size_t n_iovec);
+
+int journal_writer_drain(
+                JournalWriter *w,
+                bool wait,
+                JournalWriterEntry ***ret_entries,
+                size_t *ret_n_entries,
+                int *ret_error);
+
+int journal_writer_stop(
+                JournalWriter *w,
+                JournalWriterEntry ***ret_entries,
+                size_t *ret_n_entries,
+                int *ret_error);
+
+void journal_writer_get_stats(JournalWriter *w, JournalWriterStats *ret);
@@ -9,14 +9,17 @@
 #include "fd-util.h"
 #include "format-util.h"
 #include "journal-authenticate.h"
+#include "journal-index.h"
 #include "managed-journal-file.h"
 #include "path-util.h"
 #include "random-util.h"
 #include "set.h"
 #include "stat-util.h"
+#include "string-util.h"
 #include "sync-util.h"
 
 #define PAYLOAD_BUFFER_SIZE (16U * 1024U)
+#define NEXT_FILE_SUFFIX ".next"
 #define MINIMUM_HOLE_SIZE (1U * 1024U * 1024U / 2U)
 
 static int managed_journal_file_truncate(JournalFile *f) {
@@ -194,6 +197,7 @@ static void managed_journal_file_set_offline_internal(ManagedJournalFile *f) {
                         if (f->file->archive) {
                                 (void) managed_journal_file_truncate(f->file);
                                 (void) managed_journal_file_punch_holes(f->file);
+                                (void) journal_index_build(f->file);
                         }
 
                         (void) fsync(f->file->fd);
@@ -401,7 +405,7 @@ ManagedJournalFile* managed_journal_file_close(ManagedJournalFile *f) {
         }
 #endif
 
-        if (sd_event_source_get_enabled(f->file->post_change_timer, NULL) > 0)
+        if (f->file->post_change_pending || sd_event_source_get_enabled(f->file->post_change_timer, NULL) > 0)
                 journal_file_post_change(f->file);
         sd_event_source_disable_unref(f->file->post_change_timer);
 
@@ -409,6 +413,8 @@ ManagedJournalFile* managed_journal_file_close(ManagedJournalFile *f) {
 
         journal_file_close(f->file);
 
+        managed_journal_file_discard_next(f);
+
         return mfree(f);
 }
 
@@ -471,6 +477,134 @@ ManagedJournalFile* managed_journal_file_initiate_close(ManagedJournalFile *f, S
         return managed_journal_file_close(f);
 }
 
+static char* next_file_path(JournalFile *f) {
+        assert(f);
+
+        /* The prepared file is opened under the path it takes over on rotation, but lives under a name that
+         * readers ignore until then. */
+        return strjoin(f->path, NEXT_FILE_SUFFIX);
+}
+
+int managed_journal_file_prepare_next(
+                ManagedJournalFile *f,
+                MMapCache *mmap_cache,
+                JournalFileFlags file_flags,
+                uint64_t compress_threshold_bytes) {
+
+        _cleanup_free_ char *p = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        int r;
+
+        assert(f);
+
+        /* Creates the file that replaces this one when it is rotated, so that rotation only needs to rename
+         * it into place instead of creating and initializing a new file (and its hash tables) while entries
+         * are waiting to be written. */
+
+        if (f->next)
+                return 0;
+
+        if (!journal_file_writable(f->file) || f->file->archive)
+                return -EINVAL;
+
+        if (!endswith(f->file->path, ".journal"))
+                return -EINVAL;
+
+        p = next_file_path(f->file);
+        if (!p)
+                return -ENOMEM;
+
+        /* A left-over from a previous run is never used, it might be anything */
+        fd = open(p, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW, f->file->mode);
+        if (fd < 0)
+                return -errno;
+
+        r = journal_file_open(
+                        fd,
+                        f->file->path,
+                        f->file->open_flags,
+                        file_flags,
+                        f->file->mode,
+                        compress_threshold_bytes,
+                        /* metrics= */ NULL,
+                        mmap_cache,
+                        /* template= */ f->file,
+                        &f->next);
+        if (r < 0) {
+                (void) unlink(p);
+                return r;
+        }
+
+        TAKE_FD(fd); /* Donated to journal_file_open() */
+
+        log_debug("Prepared %s to replace %s on rotation.", p, f->file->path);
+        return 1;
+}
+
+void managed_journal_file_discard_next(ManagedJournalFile *f) {
+        _cleanup_free_ char *p = NULL;
+
+        assert(f);
+
+        if (!f->next)
+                return;
+
+        p = next_file_path(f->next);
+        if (!p)
+                log_oom_debug();
+        else if (unlink(p) < 0 && errno != ENOENT)
+                log_debug_errno(errno, "Failed to remove %s, ignoring: %m", p);
+
+        f->next = journal_file_close(f->next);
+}
+
+static int managed_journal_file_install_next(
+                ManagedJournalFile *f,
+                const char *path,
+                Set *deferred_closes,
+                ManagedJournalFile **ret) {
+
+        _cleanup_free_ ManagedJournalFile *new_file = NULL;
+        _cleanup_free_ char *p = NULL;
+        JournalFile *next;
+
+        assert(f);
+        assert(f->next);
+        assert(path);
+        assert(ret);
+
+        next = f->next;
+
+        /* Something might have been appended to it after all */
+        if (!streq(next->path, path) || next->header->n_entries != 0)
+                return -ESTALE;
+
+        p = next_file_path(next);
+        if (!p)
+                return -ENOMEM;
+
+        new_file = new0(ManagedJournalFile, 1);
+        if (!new_file)
+                return -ENOMEM;
+
+        if (rename(p, next->path) < 0)
+                return -errno;
+
+        (void) fsync_directory_of_file(next->fd);
+
+        /* Continue the sequence of the file we replace, which has advanced since the file was prepared. The
+         * file was online since then, hence the header will be written out when it's offlined. */
+        next->header->seqnum_id = f->file->header->seqnum_id;
+        next->header->tail_entry_seqnum = f->file->header->tail_entry_seqnum;
+
+        set_clear_with_destructor(deferred_closes, managed_journal_file_close);
+
+        new_file->file = TAKE_PTR(f->next);
+        *ret = TAKE_PTR(new_file);
+
+        return 0;
+}
+
 int managed_journal_file_rotate(
                 ManagedJournalFile **f,
                 MMapCache *mmap_cache,
@@ -489,18 +623,27 @@ int managed_journal_file_rotate(
         if (r < 0)
                 return r;
 
-        r = managed_journal_file_open(
-                        /* fd= */ -1,
-                        path,
-                        (*f)->file->open_flags,
-                        file_flags,
-                        (*f)->file->mode,
-                        compress_threshold_bytes,
-                        /* metrics= */ NULL,
-                        mmap_cache,
-                        deferred_closes,
-                        /* template= */ *f,
-                        &new_file);
+        if ((*f)->next) {
+                r = managed_journal_file_install_next(*f, path, deferred_closes, &new_file);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to use prepared journal file for %s, creating a new one: %m", path);
+                        managed_journal_file_discard_next(*f);
+                }
+        }
+
+        if (!new_file)
+                r = managed_journal_file_open(
+                                /* fd= */ -1,
+                                path,
+                                (*f)->file->open_flags,
+                                file_flags,
+                                (*f)->file->mode,
+                                compress_threshold_bytes,
+                                /* metrics= */ NULL,
+                                mmap_cache,
+                                deferred_closes,
+                                /* template= */ *f,
+                                &new_file);
 
         managed_journal_file_initiate_close(*f, deferred_closes);
         *f = new_file;
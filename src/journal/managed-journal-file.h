@@ -5,6 +5,9 @@
 
 typedef struct {
         JournalFile *file;
+        /* An empty file prepared in advance, that replaces this one when it is rotated, see
+         * managed_journal_file_prepare_next() */
+        JournalFile *next;
 } ManagedJournalFile;
 
 int managed_journal_file_open(
@@ -38,4 +41,6 @@ int managed_journal_file_open_reliably(
                 ManagedJournalFile **ret);
 
 ManagedJournalFile* managed_journal_file_initiate_close(ManagedJournalFile *f, Set *deferred_closes);
+int managed_journal_file_prepare_next(ManagedJournalFile *f, MMapCache *mmap_cache, JournalFileFlags file_flags, uint64_t compress_threshold_bytes);
+void managed_journal_file_discard_next(ManagedJournalFile *f);
 int managed_journal_file_rotate(ManagedJournalFile **f, MMapCache *mmap_cache, JournalFileFlags file_flags, uint64_t compress_threshold_bytes, Set *deferred_closes);
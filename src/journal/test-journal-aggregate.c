@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "chattr-util.h"
+#include "hashmap.h"
+#include "io-util.h"
+#include "journal-aggregate.h"
+#include "managed-journal-file.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+/* More than the number of values the aggregation collects upfront per field */
+#define N_ENTRIES 10000U
+
+static void write_entries(const char *dn) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_free_ char *fn1 = NULL, *fn2 = NULL, *large = NULL;
+        ManagedJournalFile *one, *two;
+        uint64_t seqnum = 0;
+
+        assert_se(m = mmap_cache_new());
+        assert_se(fn1 = path_join(dn, "one.journal"));
+        assert_se(fn2 = path_join(dn, "two.journal"));
+
+        assert_se(managed_journal_file_open(-EBADF, fn1, O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0644, UINT64_MAX, NULL, m, NULL, NULL, &one) == 0);
+        assert_se(managed_journal_file_open(-EBADF, fn2, O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0644, UINT64_MAX, NULL, m, NULL, NULL, &two) == 0);
+
+        /* Large enough to be compressed */
+        assert_se(large = strjoin("LARGE=", strrepa("x", 4096)));
+
+        for (unsigned i = 0; i < N_ENTRIES; i++) {
+                _cleanup_free_ char *number = NULL, *unit = NULL, *priority = NULL;
+                struct iovec iovec[6];
+                dual_timestamp ts;
+                size_t n = 0;
+
+                /* One entry every 7s */
+                ts = (dual_timestamp) {
+                        .realtime = 1000 * USEC_PER_SEC + i * 7 * USEC_PER_SEC,
+                        .monotonic = 1000 * USEC_PER_SEC + i * 7 * USEC_PER_SEC,
+                };
+
+                assert_se(asprintf(&number, "NUMBER=%u", i) >= 0);
+                assert_se(asprintf(&unit, "UNIT=unit%u.service", i % 5) >= 0);
+                assert_se(asprintf(&priority, "PRIORITY=%u", i % 4) >= 0);
+
+                iovec[n++] = IOVEC_MAKE_STRING("MESSAGE=hello");
+                iovec[n++] = IOVEC_MAKE_STRING(number);
+                iovec[n++] = IOVEC_MAKE_STRING(unit);
+                if (i % 3 != 0)
+                        iovec[n++] = IOVEC_MAKE_STRING(priority);
+                if (i % 11 == 0)
+                        iovec[n++] = IOVEC_MAKE(large, strlen(large));
+
+                assert_se(journal_file_append_entry(i % 4 == 0 ? two->file : one->file, &ts, NULL, iovec, n, &seqnum, NULL, NULL, NULL) == 0);
+        }
+
+        (void) managed_journal_file_close(one);
+        (void) managed_journal_file_close(two);
+}
+
+static char* group_key(usec_t bucket, const char * const *values, size_t n_values) {
+        _cleanup_free_ char *s = NULL;
+
+        assert_se(asprintf(&s, USEC_FMT, bucket) >= 0);
+
+        for (size_t i = 0; i < n_values; i++)
+                assert_se(strextend(&s, " ", values[i] ?: "(null)"));
+
+        return TAKE_PTR(s);
+}
+
+static void test_aggregate_one(const char *dn, char **fields, usec_t interval, const char *match) {
+        _cleanup_(journal_aggregate_freep) JournalAggregate *a = NULL;
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_hashmap_free_ Hashmap *expected = NULL;
+        _cleanup_free_ JournalAggregateGroup **groups = NULL;
+        _cleanup_free_ const char **values = NULL;
+        _cleanup_free_ char *joined = NULL;
+        size_t n_groups, n_fields = strv_length(fields);
+        uint64_t n_entries = 0, total = 0;
+
+        assert_se(joined = strv_join(fields, ","));
+        log_info("/* %s(%s, %s, %s) */", __func__, joined, FORMAT_TIMESPAN(interval, 0), strna(match));
+
+        assert_se(sd_journal_open_directory(&j, dn, 0) >= 0);
+        assert_se(sd_journal_set_data_threshold(j, 0) >= 0);
+        if (match)
+                assert_se(sd_journal_add_match(j, match, 0) >= 0);
+
+        assert_se(values = new0(const char*, n_fields + 1));
+
+        /* Count the slow way first */
+        SD_JOURNAL_FOREACH(j) {
+                _cleanup_free_ char *key = NULL;
+                usec_t realtime;
+                void *count;
+
+                assert_se(sd_journal_get_realtime_usec(j, &realtime) >= 0);
+                n_entries++;
+
+                for (size_t i = 0; i < n_fields; i++) {
+                        const void *data;
+                        size_t size;
+                        int r;
+
+                        r = sd_journal_get_data(j, fields[i], &data, &size);
+                        if (r == -ENOENT) {
+                                values[i] = NULL;
+                                continue;
+                        }
+                        assert_se(r >= 0);
+
+                        values[i] = strndupa_safe((const char*) data + strlen(fields[i]) + 1, size - strlen(fields[i]) - 1);
+                }
+
+                assert_se(key = group_key(interval > 0 ? realtime - realtime % interval : 0, values, n_fields));
+
+                count = hashmap_get(expected, key);
+                if (count)
+                        assert_se(hashmap_update(expected, key, UINT_TO_PTR(PTR_TO_UINT(count) + 1)) >= 0);
+                else {
+                        assert_se(hashmap_ensure_put(&expected, &string_hash_ops_free, key, UINT_TO_PTR(1)) >= 0);
+                        TAKE_PTR(key);
+                }
+        }
+
+        assert_se(journal_aggregate_new(fields, interval, &a) >= 0);
+
+        SD_JOURNAL_FOREACH(j)
+                assert_se(journal_aggregate_add(a, j) >= 0);
+
+        assert_se(journal_aggregate_get_groups(a, &groups, &n_groups) >= 0);
+        assert_se(n_groups == hashmap_size(expected));
+
+        for (size_t i = 0; i < n_groups; i++) {
+                _cleanup_free_ char *key = NULL;
+
+                assert_se(groups[i]->n_values == n_fields);
+                assert_se(key = group_key(groups[i]->bucket, groups[i]->values, n_fields));
+                assert_se(PTR_TO_UINT(hashmap_get(expected, key)) == groups[i]->count);
+
+                /* Groups are ordered by bucket first */
+                if (i > 0)
+                        assert_se(groups[i - 1]->bucket <= groups[i]->bucket);
+
+                total += groups[i]->count;
+        }
+
+        assert_se(total == n_entries);
+        assert_se(n_entries > 0);
+}
+
+TEST(aggregate) {
+        _cleanup_(rm_rf_physical_and_freep) char *dn = NULL;
+
+        assert_se(mkdtemp_malloc("/var/tmp/test-journal-aggregate.XXXXXX", &dn) >= 0);
+        (void) chattr_path(dn, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        write_entries(dn);
+
+        test_aggregate_one(dn, NULL, USEC_PER_HOUR, NULL);
+        test_aggregate_one(dn, STRV_MAKE("UNIT"), 0, NULL);
+        test_aggregate_one(dn, STRV_MAKE("UNIT"), USEC_PER_MINUTE, NULL);
+        test_aggregate_one(dn, STRV_MAKE("UNIT", "PRIORITY"), USEC_PER_HOUR, NULL);
+        test_aggregate_one(dn, STRV_MAKE("PRIORITY", "UNIT"), USEC_PER_HOUR, "PRIORITY=3");
+        test_aggregate_one(dn, STRV_MAKE("UNIT"), 0, "UNIT=unit0.service");
+        /* Compressed values */
+        test_aggregate_one(dn, STRV_MAKE("LARGE"), 0, NULL);
+        /* Too many values to collect them upfront */
+        test_aggregate_one(dn, STRV_MAKE("NUMBER", "UNIT"), USEC_PER_DAY, NULL);
+        /* A field that doesn't exist */
+        test_aggregate_one(dn, STRV_MAKE("FOOBAR"), 0, NULL);
+}
+
+static int intro(void) {
+        /* managed_journal_file_open requires a valid machine id */
+        if (access("/etc/machine-id", F_OK) != 0)
+                return log_tests_skipped("/etc/machine-id not found");
+
+        return EXIT_SUCCESS;
+}
+
+DEFINE_TEST_MAIN_WITH_INTRO(LOG_INFO, intro);
@@ -0,0 +1,278 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "chattr-util.h"
+#include "escape.h"
+#include "io-util.h"
+#include "journal-columnar.h"
+#include "journal-internal.h"
+#include "managed-journal-file.h"
+#include "memstream-util.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+#define N_ENTRIES 100U
+
+typedef struct Reader {
+        const uint8_t *p, *end;
+} Reader;
+
+static uint64_t read_varint(Reader *r) {
+        uint64_t v = 0;
+
+        for (unsigned shift = 0;; shift += 7) {
+                uint8_t b;
+
+                assert_se(r->p < r->end);
+                assert_se(shift < 64);
+
+                b = *(r->p++);
+                v |= (uint64_t) (b & 0x7f) << shift;
+                if (!(b & 0x80))
+                        return v;
+        }
+}
+
+static const uint8_t* read_bytes(Reader *r, size_t n) {
+        const uint8_t *p = r->p;
+
+        assert_se((size_t) (r->end - r->p) >= n);
+        r->p += n;
+
+        return p;
+}
+
+static void read_deltas(Reader *r, uint64_t *a, size_t n) {
+        uint64_t previous = 0;
+
+        for (size_t i = 0; i < n; i++) {
+                uint64_t z = read_varint(r);
+
+                previous += (uint64_t) ((int64_t) (z >> 1) ^ -(int64_t) (z & 1));
+                a[i] = previous;
+        }
+}
+
+static char* format_field(const char *name, size_t name_len, const void *value, size_t value_len) {
+        _cleanup_free_ char *e = NULL;
+        char *s;
+
+        assert_se(e = cescape_length(value, value_len));
+        assert_se(asprintf(&s, "%.*s=%s", (int) name_len, name, e) >= 0);
+
+        return s;
+}
+
+/* Decodes the columnar data into one line per entry: timestamps and seqnum, followed by the sorted fields */
+static char** decode(const char *buf, size_t size) {
+        _cleanup_strv_free_ char **entries = NULL;
+        Reader r = {
+                .p = (const uint8_t*) buf,
+                .end = (const uint8_t*) buf + size,
+        };
+
+        assert_se(memcmp(read_bytes(&r, STRLEN(JOURNAL_COLUMNAR_MAGIC)), JOURNAL_COLUMNAR_MAGIC, STRLEN(JOURNAL_COLUMNAR_MAGIC)) == 0);
+
+        while (r.p < r.end) {
+                _cleanup_free_ uint64_t *realtime = NULL, *monotonic = NULL, *seqnum = NULL;
+                char ***fields = NULL;
+                uint64_t n_entries, n_columns;
+
+                n_entries = read_varint(&r);
+                n_columns = read_varint(&r);
+                assert_se(n_entries > 0);
+
+                assert_se(realtime = new(uint64_t, n_entries));
+                assert_se(monotonic = new(uint64_t, n_entries));
+                assert_se(seqnum = new(uint64_t, n_entries));
+                assert_se(fields = new0(char**, n_entries));
+
+                read_deltas(&r, realtime, n_entries);
+                read_deltas(&r, monotonic, n_entries);
+                read_deltas(&r, seqnum, n_entries);
+
+                for (uint64_t c = 0; c < n_columns; c++) {
+                        _cleanup_free_ struct iovec *values = NULL;
+                        const char *name;
+                        uint64_t name_len, n_values;
+
+                        name_len = read_varint(&r);
+                        name = (const char*) read_bytes(&r, name_len);
+
+                        n_values = read_varint(&r);
+                        assert_se(values = new(struct iovec, n_values));
+                        for (uint64_t v = 0; v < n_values; v++) {
+                                values[v].iov_len = read_varint(&r);
+                                values[v].iov_base = (void*) read_bytes(&r, values[v].iov_len);
+                        }
+
+                        for (uint64_t e = 0; e < n_entries; e++)
+                                for (uint64_t k = read_varint(&r); k > 0; k--) {
+                                        uint64_t id = read_varint(&r);
+
+                                        assert_se(id < n_values);
+                                        assert_se(strv_consume(&fields[e], format_field(name, name_len, values[id].iov_base, values[id].iov_len)) >= 0);
+                                }
+                }
+
+                for (uint64_t e = 0; e < n_entries; e++) {
+                        _cleanup_free_ char *joined = NULL;
+
+                        strv_sort(fields[e]);
+                        assert_se(joined = strv_join(fields[e], " "));
+                        assert_se(strv_extendf(&entries, "%" PRIu64 " %" PRIu64 " %" PRIu64 " %s",
+                                               realtime[e], monotonic[e], seqnum[e], joined) >= 0);
+                        strv_free(fields[e]);
+                }
+
+                free(fields);
+        }
+
+        return TAKE_PTR(entries);
+}
+
+static char** expected_entries(sd_journal *j) {
+        _cleanup_strv_free_ char **entries = NULL;
+
+        SD_JOURNAL_FOREACH(j) {
+                _cleanup_strv_free_ char **fields = NULL;
+                _cleanup_free_ char *joined = NULL;
+                sd_id128_t boot_id, seqnum_id;
+                uint64_t realtime, monotonic, seqnum;
+                const void *data;
+                size_t size;
+
+                assert_se(sd_journal_get_realtime_usec(j, &realtime) >= 0);
+                assert_se(sd_journal_get_monotonic_usec(j, &monotonic, &boot_id) >= 0);
+                assert_se(sd_journal_get_seqnum(j, &seqnum, &seqnum_id) >= 0);
+
+                assert_se(strv_extendf(&fields, "_BOOT_ID=%s", SD_ID128_TO_STRING(boot_id)) >= 0);
+                assert_se(strv_extendf(&fields, "__SEQNUM_ID=%s", SD_ID128_TO_STRING(seqnum_id)) >= 0);
+
+                SD_JOURNAL_FOREACH_DATA(j, data, size) {
+                        const char *eq;
+
+                        if (memory_startswith(data, size, "_BOOT_ID="))
+                                continue;
+
+                        assert_se(eq = memchr(data, '=', size));
+                        assert_se(strv_consume(&fields, format_field(data, eq - (const char*) data, eq + 1, size - (eq + 1 - (const char*) data))) >= 0);
+                }
+
+                strv_sort(fields);
+                assert_se(joined = strv_join(fields, " "));
+                assert_se(strv_extendf(&entries, "%" PRIu64 " %" PRIu64 " %" PRIu64 " %s",
+                                       realtime, monotonic, seqnum, joined) >= 0);
+        }
+
+        return TAKE_PTR(entries);
+}
+
+static void write_entries(const char *dn) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        ManagedJournalFile *one, *two;
+        dual_timestamp ts, previous_ts = DUAL_TIMESTAMP_NULL;
+        _cleanup_free_ char *large = NULL;
+        _cleanup_free_ char *fn1 = NULL, *fn2 = NULL;
+        uint64_t seqnum = 0;
+
+        assert_se(m = mmap_cache_new());
+
+        assert_se(fn1 = path_join(dn, "one.journal"));
+        assert_se(fn2 = path_join(dn, "two.journal"));
+        assert_se(managed_journal_file_open(-EBADF, fn1, O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0644, UINT64_MAX, NULL, m, NULL, NULL, &one) == 0);
+        assert_se(managed_journal_file_open(-EBADF, fn2, O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0644, UINT64_MAX, NULL, m, NULL, NULL, &two) == 0);
+
+        /* Large enough to be compressed */
+        assert_se(large = strjoin("LARGE=", strrepa("x", 4096)));
+
+        for (unsigned i = 0; i < N_ENTRIES; i++) {
+                _cleanup_free_ char *number = NULL, *message = NULL;
+                struct iovec iovec[7];
+                size_t n = 0;
+
+                dual_timestamp_get(&ts);
+                if (ts.monotonic <= previous_ts.monotonic)
+                        ts.monotonic = previous_ts.monotonic + 1;
+                if (ts.realtime <= previous_ts.realtime)
+                        ts.realtime = previous_ts.realtime + 1;
+                previous_ts = ts;
+
+                assert_se(asprintf(&number, "NUMBER=%u", i) >= 0);
+                assert_se(asprintf(&message, "MESSAGE=message %u", i % 7) >= 0);
+
+                iovec[n++] = IOVEC_MAKE_STRING(number);
+                iovec[n++] = IOVEC_MAKE_STRING(message);
+
+                if (i % 3 == 0)
+                        iovec[n++] = IOVEC_MAKE_STRING("PRIORITY=3");
+                if (i % 10 == 0) {
+                        /* The same field twice in one entry */
+                        iovec[n++] = IOVEC_MAKE_STRING("MULTI=first");
+                        iovec[n++] = IOVEC_MAKE_STRING("MULTI=second");
+                }
+                if (i % 11 == 0)
+                        iovec[n++] = IOVEC_MAKE(large, strlen(large));
+                if (i % 13 == 0)
+                        iovec[n++] = IOVEC_MAKE("BINARY=a\0b\n", STRLEN("BINARY=a") + 3);
+
+                assert_se(journal_file_append_entry(i % 4 == 0 ? two->file : one->file, &ts, NULL, iovec, n, &seqnum, NULL, NULL, NULL) == 0);
+        }
+
+        (void) managed_journal_file_close(one);
+        (void) managed_journal_file_close(two);
+}
+
+static void test_columnar_one(const char *dn, size_t block_entries) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_(journal_columnar_writer_freep) JournalColumnarWriter *w = NULL;
+        _cleanup_(memstream_done) MemStream m = {};
+        _cleanup_strv_free_ char **expected = NULL, **decoded = NULL;
+        _cleanup_free_ char *buf = NULL;
+        size_t size;
+        FILE *f;
+
+        log_info("/* %s(%zu) */", __func__, block_entries);
+
+        assert_se(sd_journal_open_directory(&j, dn, 0) >= 0);
+        assert_se(sd_journal_set_data_threshold(j, 0) >= 0);
+
+        assert_se(expected = expected_entries(j));
+        assert_se(strv_length(expected) == N_ENTRIES);
+
+        assert_se(f = memstream_init(&m));
+        assert_se(journal_columnar_writer_new(f, block_entries, &w) >= 0);
+
+        SD_JOURNAL_FOREACH(j)
+                assert_se(journal_columnar_writer_add(w, j) >= 0);
+
+        assert_se(journal_columnar_writer_flush(w) >= 0);
+        assert_se(memstream_finalize(&m, &buf, &size) >= 0);
+
+        assert_se(decoded = decode(buf, size));
+        assert_se(strv_equal(decoded, expected));
+}
+
+TEST(columnar) {
+        _cleanup_(rm_rf_physical_and_freep) char *dn = NULL;
+
+        assert_se(mkdtemp_malloc("/var/tmp/test-journal-columnar.XXXXXX", &dn) >= 0);
+        (void) chattr_path(dn, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        write_entries(dn);
+
+        test_columnar_one(dn, 0);
+        test_columnar_one(dn, 1);
+        test_columnar_one(dn, 7);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "chattr-util.h"
+#include "io-util.h"
+#include "journal-verify.h"
+#include "managed-journal-file.h"
+#include "memory-util.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+#define N_ENTRIES 6000U
+
+static char* message(unsigned i) {
+        char *s;
+
+        assert_se(asprintf(&s, "MESSAGE=pam_unix(sshd:session): session %s for user user%u(uid=%u) by (uid=0), attempt %u",
+                           i % 2 == 0 ? "opened" : "closed", i % 23, 1000 + i % 23, i) >= 0);
+        return s;
+}
+
+static uint64_t write_entries(const char *fn, unsigned n_entries) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        ManagedJournalFile *f;
+        dual_timestamp ts, previous_ts = DUAL_TIMESTAMP_NULL;
+        uint64_t used;
+
+        assert_se(m = mmap_cache_new());
+        assert_se(managed_journal_file_open(-EBADF, fn, O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0644, UINT64_MAX, NULL, m, NULL, NULL, &f) == 0);
+
+        for (unsigned i = 0; i < n_entries; i++) {
+                _cleanup_free_ char *t = NULL;
+                struct iovec iovec[2];
+
+                dual_timestamp_get(&ts);
+                if (ts.monotonic <= previous_ts.monotonic)
+                        ts.monotonic = previous_ts.monotonic + 1;
+                if (ts.realtime <= previous_ts.realtime)
+                        ts.realtime = previous_ts.realtime + 1;
+                previous_ts = ts;
+
+                t = message(i);
+                iovec[0] = IOVEC_MAKE_STRING(t);
+                iovec[1] = IOVEC_MAKE_STRING("_SYSTEMD_UNIT=sshd.service");
+
+                assert_se(journal_file_append_entry(f->file, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL, NULL) == 0);
+        }
+
+        used = le64toh(f->file->header->tail_object_offset);
+        (void) managed_journal_file_close(f);
+
+        return used;
+}
+
+static void check_entries(const char *fn, unsigned n_entries) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        unsigned i = 0;
+
+        assert_se(sd_journal_open_files(&j, (const char**) STRV_MAKE(fn), 0) >= 0);
+        assert_se(sd_journal_set_data_threshold(j, 0) >= 0);
+
+        SD_JOURNAL_FOREACH(j) {
+                _cleanup_free_ char *t = NULL;
+                const void *data;
+                size_t size;
+
+                t = message(i++);
+                assert_se(sd_journal_get_data(j, "MESSAGE", &data, &size) >= 0);
+                assert_se(memcmp_nn(data, size, t, strlen(t)) == 0);
+        }
+
+        assert_se(i == n_entries);
+
+        /* Matching looks up the data objects by payload, which decompresses the candidates */
+        _cleanup_free_ char *match = message(n_entries - 1);
+        assert_se(sd_journal_add_match(j, match, 0) >= 0);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_next(j) == 1);
+        assert_se(sd_journal_next(j) == 0);
+}
+
+static void check_file(const char *fn, unsigned n_entries) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_(journal_file_closep) JournalFile *f = NULL;
+        unsigned n_compressed = 0;
+        uint64_t p;
+        Object *o;
+
+        assert_se(m = mmap_cache_new());
+        assert_se(journal_file_open(-EBADF, fn, O_RDONLY, 0, 0644, 0, NULL, m, NULL, &f) == 0);
+
+        assert_se(JOURNAL_HEADER_ZSTD_DICTIONARY(f->header));
+        assert_se(le64toh(f->header->compression_dictionary_offset) != 0);
+
+        /* The messages are below the regular compression threshold, hence only the dictionary makes it
+         * worth compressing them */
+        p = le64toh(f->header->header_size);
+        for (;;) {
+                assert_se(journal_file_move_to_object(f, OBJECT_UNUSED, p, &o) >= 0);
+
+                if (o->object.type == OBJECT_DATA && COMPRESSION_FROM_OBJECT(o) == COMPRESSION_ZSTD)
+                        n_compressed++;
+
+                if (p == le64toh(f->header->tail_object_offset))
+                        break;
+                p += ALIGN64(le64toh(o->object.size));
+        }
+
+        log_info("%u of %u messages compressed with dictionary", n_compressed, n_entries);
+        assert_se(n_compressed > 0);
+
+        assert_se(journal_file_verify(f, NULL, NULL, NULL, NULL, false) >= 0);
+}
+
+TEST(dictionary) {
+        _cleanup_(rm_rf_physical_and_freep) char *dn = NULL;
+        _cleanup_free_ char *fn = NULL;
+        uint64_t used;
+
+        assert_se(mkdtemp_malloc("/var/tmp/test-journal-dictionary.XXXXXX", &dn) >= 0);
+        (void) chattr_path(dn, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        assert_se(fn = path_join(dn, "dictionary.journal"));
+
+        used = write_entries(fn, N_ENTRIES);
+        log_info("Used %"PRIu64" bytes with dictionary", used);
+
+        check_entries(fn, N_ENTRIES);
+        check_file(fn, N_ENTRIES);
+}
+
+static int intro(void) {
+        /* managed_journal_file_open requires a valid machine id */
+        if (access("/etc/machine-id", F_OK) != 0)
+                return log_tests_skipped("/etc/machine-id not found");
+
+        if (!compression_supported(COMPRESSION_ZSTD))
+                return log_tests_skipped("ZSTD support is not compiled in");
+
+        assert_se(setenv("SYSTEMD_JOURNAL_COMPRESS", "ZSTD", 1) >= 0);
+        assert_se(setenv("SYSTEMD_JOURNAL_COMPRESS_DICTIONARY", "1", 1) >= 0);
+
+        return EXIT_SUCCESS;
+}
+
+DEFINE_TEST_MAIN_WITH_INTRO(LOG_INFO, intro);
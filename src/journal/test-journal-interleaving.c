@@ -14,6 +14,8 @@
 #include "managed-journal-file.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "tests.h"
 
 /* This program tests skipping around in a multi-file journal. */
@@ -314,6 +316,72 @@ TEST(skip) {
         test_skip_one(setup_interleaved);
 }
 
+#define MERGE_FILES 8
+#define MERGE_ENTRIES 400
+
+static void setup_merge(void) {
+        ManagedJournalFile *f[MERGE_FILES];
+
+        for (unsigned i = 0; i < MERGE_FILES; i++) {
+                char fn[STRLEN("merge-.journal") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(fn, "merge-%u.journal", i);
+                f[i] = test_open(fn);
+        }
+
+        /* Spread the entries unevenly over the files, so that the order of the files in the merge queue
+         * changes all the time */
+        for (int n = 1; n <= MERGE_ENTRIES; n++)
+                append_number(f[(n * 7 + n / 13) % MERGE_FILES], n, NULL);
+
+        for (unsigned i = 0; i < MERGE_FILES; i++)
+                test_close(f[i]);
+}
+
+static void test_merge_one(int flags) {
+        char t[] = "/var/tmp/journal-merge-XXXXXX";
+        sd_journal *j;
+        int r;
+
+        mkdtemp_chdir_chattr(t);
+
+        setup_merge();
+
+        assert_ret(sd_journal_open_directory(&j, t, flags));
+        assert_ret(sd_journal_next(j));
+        test_check_numbers_down(j, MERGE_ENTRIES);
+        sd_journal_close(j);
+
+        assert_ret(sd_journal_open_directory(&j, t, flags));
+        assert_ret(sd_journal_seek_tail(j));
+        assert_ret(sd_journal_previous(j));
+        test_check_numbers_up(j, MERGE_ENTRIES);
+        sd_journal_close(j);
+
+        /* Change direction in the middle */
+        assert_ret(sd_journal_open_directory(&j, t, flags));
+        assert_ret(r = sd_journal_next_skip(j, MERGE_ENTRIES / 2));
+        assert_se(r == MERGE_ENTRIES / 2);
+        test_check_number(j, MERGE_ENTRIES / 2);
+        assert_ret(r = sd_journal_previous_skip(j, MERGE_ENTRIES / 4));
+        assert_se(r == MERGE_ENTRIES / 4);
+        test_check_numbers_up(j, MERGE_ENTRIES / 4);
+        sd_journal_close(j);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+}
+
+TEST(merge) {
+        test_merge_one(0);
+        test_merge_one(SD_JOURNAL_PARALLEL);
+}
+
 static void test_sequence_numbers_one(void) {
         _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
         char t[] = "/var/tmp/journal-seq-XXXXXX";
@@ -14,6 +14,9 @@
 #include "managed-journal-file.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "set.h"
+#include "string-util.h"
+#include "strv.h"
 #include "tests.h"
 
 #define N_ENTRIES 200
@@ -58,6 +61,134 @@ static void verify_contents(sd_journal *j, unsigned skip) {
                 assert_se(i == N_ENTRIES);
 }
 
+static void verify_data_fields(sd_journal *j) {
+        unsigned n_large = 0;
+
+        assert_se(j);
+
+        assert_se(sd_journal_set_data_fields(j, STRV_MAKE("NUMBER", "LARGE")) >= 0);
+
+        SD_JOURNAL_FOREACH(j) {
+                const void *d;
+                size_t l;
+                unsigned n = 0;
+
+                SD_JOURNAL_FOREACH_DATA(j, d, l) {
+                        assert_se(memory_startswith(d, l, "NUMBER=") || memory_startswith(d, l, "LARGE="));
+                        n_large += !!memory_startswith(d, l, "LARGE=");
+                        n++;
+                }
+
+                assert_se(IN_SET(n, 1, 2));
+
+                /* Explicit lookups are not affected by the projection */
+                assert_se(sd_journal_get_data(j, "MAGIC", &d, &l) >= 0);
+        }
+
+        assert_se(n_large == N_ENTRIES / 4);
+
+        /* Now the compressed objects are not part of the projection anymore */
+        assert_se(sd_journal_set_data_fields(j, STRV_MAKE("MAGIC")) >= 0);
+
+        SD_JOURNAL_FOREACH(j) {
+                const void *d;
+                size_t l;
+                unsigned n = 0;
+
+                SD_JOURNAL_FOREACH_DATA(j, d, l) {
+                        assert_se(memory_startswith(d, l, "MAGIC="));
+                        n++;
+                }
+
+                assert_se(n == 1);
+        }
+
+        assert_se(sd_journal_set_data_fields(j, STRV_MAKE("FOO=BAR")) == -EINVAL);
+
+        assert_se(sd_journal_set_data_fields(j, NULL) >= 0);
+
+        SD_JOURNAL_FOREACH(j) {
+                const void *d;
+                size_t l;
+                unsigned n = 0;
+
+                SD_JOURNAL_FOREACH_DATA(j, d, l)
+                        n++;
+
+                assert_se(n >= 2);
+        }
+}
+
+static uint64_t expected_unique_count(const char *field, unsigned u) {
+        uint64_t n = 0;
+
+        /* Entries in one.journal are also written to two.journal if their number is a multiple of 3, and
+         * those are counted twice as they are separate entries. */
+        for (unsigned i = 0; i < N_ENTRIES; i++) {
+                bool match;
+
+                if (streq(field, "NUMBER"))
+                        match = i == u;
+                else
+                        match = (i % 5 == 0) == (u == 0);
+
+                if (match)
+                        n += i % 10 != 0 && i % 3 == 0 ? 2 : 1;
+        }
+
+        return n;
+}
+
+static void verify_unique_one(sd_journal *j, const char *field, unsigned n_values, bool incomplete) {
+        _cleanup_set_free_ Set *seen = NULL;
+        const void *d;
+        size_t l;
+        uint64_t n;
+        int r;
+
+        log_info("/* %s(%s, %s) */", __func__, field, yes_no(incomplete));
+
+        assert_se(sd_journal_query_unique(j, field) >= 0);
+
+        /* Pretend that the set of returned values hit its size limit, so that values are deduplicated by
+         * looking at the earlier files again */
+        j->unique_values_incomplete = incomplete;
+
+        while ((r = sd_journal_enumerate_unique_with_count(j, &d, &l, &n)) > 0) {
+                _cleanup_free_ char *v = NULL;
+                unsigned u = 0;
+
+                assert_se(v = strndup(d, l));
+                assert_se(startswith(v, field));
+                assert_se(v[strlen(field)] == '=');
+
+                if (streq(field, "NUMBER"))
+                        assert_se(safe_atou(v + strlen(field) + 1, &u) >= 0);
+                else
+                        u = streq(v + strlen(field) + 1, "quux") ? 0 : 1;
+
+                assert_se(n == expected_unique_count(field, u));
+                assert_se(set_ensure_consume(&seen, &string_hash_ops_free, TAKE_PTR(v)) > 0);
+        }
+        assert_se(r == 0);
+
+        assert_se(set_size(seen) == n_values);
+
+        /* Restarting returns all values again */
+        sd_journal_restart_unique(j);
+        n = 0;
+        SD_JOURNAL_FOREACH_UNIQUE(j, d, l)
+                n++;
+        assert_se(n == n_values);
+}
+
+static void verify_unique(sd_journal *j) {
+        verify_unique_one(j, "NUMBER", N_ENTRIES, false);
+        verify_unique_one(j, "NUMBER", N_ENTRIES, true);
+        verify_unique_one(j, "MAGIC", 2, false);
+        verify_unique_one(j, "MAGIC", 2, true);
+}
+
 static void run_test(void) {
         _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
         ManagedJournalFile *one, *two, *three;
@@ -68,6 +199,7 @@ static void run_test(void) {
         const void *data;
         size_t l;
         dual_timestamp previous_ts = DUAL_TIMESTAMP_NULL;
+        _cleanup_free_ char *large = NULL;
 
         m = mmap_cache_new();
         assert_se(m != NULL);
@@ -80,10 +212,14 @@ static void run_test(void) {
         assert_se(managed_journal_file_open(-1, "two.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &two) == 0);
         assert_se(managed_journal_file_open(-1, "three.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &three) == 0);
 
+        /* Large enough to be compressed */
+        assert_se(large = strjoin("LARGE=", strrepa("x", 4096)));
+
         for (i = 0; i < N_ENTRIES; i++) {
                 char *p, *q;
                 dual_timestamp ts;
-                struct iovec iovec[2];
+                struct iovec iovec[3];
+                size_t n = 2;
 
                 dual_timestamp_get(&ts);
 
@@ -102,13 +238,16 @@ static void run_test(void) {
 
                 iovec[1] = IOVEC_MAKE(q, strlen(q));
 
+                if (i % 4 == 0)
+                        iovec[n++] = IOVEC_MAKE_STRING(large);
+
                 if (i % 10 == 0)
-                        assert_se(journal_file_append_entry(three->file, &ts, NULL, iovec, 2, NULL, NULL, NULL, NULL) == 0);
+                        assert_se(journal_file_append_entry(three->file, &ts, NULL, iovec, n, NULL, NULL, NULL, NULL) == 0);
                 else {
                         if (i % 3 == 0)
-                                assert_se(journal_file_append_entry(two->file, &ts, NULL, iovec, 2, NULL, NULL, NULL, NULL) == 0);
+                                assert_se(journal_file_append_entry(two->file, &ts, NULL, iovec, n, NULL, NULL, NULL, NULL) == 0);
 
-                        assert_se(journal_file_append_entry(one->file, &ts, NULL, iovec, 2, NULL, NULL, NULL, NULL) == 0);
+                        assert_se(journal_file_append_entry(one->file, &ts, NULL, iovec, n, NULL, NULL, NULL, NULL) == 0);
                 }
 
                 free(p);
@@ -146,6 +285,8 @@ static void run_test(void) {
 
         verify_contents(j, 1);
 
+        verify_data_fields(j);
+
         printf("NEXT TEST\n");
         assert_se(sd_journal_add_match(j, "MAGIC=quux", 0) >= 0);
 
@@ -172,6 +313,8 @@ static void run_test(void) {
         SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
                 printf("%.*s\n", (int) l, (const char*) data);
 
+        verify_unique(j);
+
         assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 }
 
@@ -12,6 +12,7 @@
 #include "managed-journal-file.h"
 #include "mmap-cache.h"
 #include "rm-rf.h"
+#include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
 #include "tests.h"
@@ -61,11 +62,50 @@ static int raw_verify(const char *fn, const char *verification_key) {
                 return r;
 
         r = journal_file_verify(f, verification_key, NULL, NULL, NULL, false);
+
+        /* Checking the hashes in threads must not make a difference */
+        assert_se((journal_file_verify_full(f, verification_key, 0, 3, NULL, NULL, NULL) >= 0) == (r >= 0));
+
         (void) journal_file_close(f);
 
         return r;
 }
 
+static void test_checkpoint(JournalFile *f, const char *verification_key) {
+        _cleanup_free_ char *checkpoint = NULL;
+        usec_t from = 0, to = 0, total = 0;
+        Object *o;
+        uint64_t p;
+
+        assert_se(checkpoint = strjoin(f->path, JOURNAL_VERIFY_CHECKPOINT_SUFFIX));
+        (void) unlink(checkpoint);
+
+        /* The first run writes the checkpoint, the second one uses it and results in the same */
+        assert_se(journal_file_verify_full(f, verification_key, JOURNAL_VERIFY_CHECKPOINT, 0, NULL, NULL, NULL) >= 0);
+
+        if (!verification_key || !JOURNAL_HEADER_SEALED(f->header) || le64toh(f->header->n_tags) == 0) {
+                assert_se(access(checkpoint, F_OK) < 0 && errno == ENOENT);
+                return;
+        }
+
+        assert_se(access(checkpoint, F_OK) >= 0);
+        assert_se(journal_file_verify_full(f, verification_key, JOURNAL_VERIFY_CHECKPOINT, 2, &from, &to, &total) >= 0);
+        assert_se(to > 0);
+
+        /* The payload hashes covered by the checkpoint are not checked anymore, but modifying a payload
+         * must still be detected, by the seal. */
+        assert_se(journal_file_next_entry(f, 0, DIRECTION_DOWN, &o, NULL) > 0);
+        p = journal_file_entry_item_object_offset(f, o, 0);
+        assert_se(journal_file_move_to_object(f, OBJECT_DATA, p, &o) >= 0);
+        p = (p + le64toh(o->object.size) - 1) * 8;
+
+        bit_toggle(f->path, p);
+        assert_se(journal_file_verify_full(f, verification_key, JOURNAL_VERIFY_CHECKPOINT, 0, NULL, NULL, NULL) < 0);
+        bit_toggle(f->path, p);
+
+        assert_se(unlink(checkpoint) >= 0);
+}
+
 static int run_test(const char *verification_key, ssize_t max_iterations) {
         _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
         char t[] = "/var/tmp/journal-XXXXXX";
@@ -143,6 +183,7 @@ static int run_test(const char *verification_key, ssize_t max_iterations) {
         journal_file_dump(f);
 
         assert_se(journal_file_verify(f, verification_key, &from, &to, &total, true) >= 0);
+        test_checkpoint(f, verification_key);
 
         if (verification_key && JOURNAL_HEADER_SEALED(f->header))
                 log_info("=> Validated from %s to %s, %s missing",
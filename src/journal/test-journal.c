@@ -6,10 +6,14 @@
 #include "chattr-util.h"
 #include "io-util.h"
 #include "journal-authenticate.h"
+#include "journal-internal.h"
 #include "journal-vacuum.h"
+#include "journal-verify.h"
 #include "log.h"
 #include "managed-journal-file.h"
 #include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
 #include "tests.h"
 
 static bool arg_keep = false;
@@ -174,6 +178,211 @@ TEST(empty) {
         test_empty_one();
 }
 
+#define APPEND_ENTRIES 1000U
+
+static void test_append_entries_one(void) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_free_ JournalFileAppendEntry *entries = NULL;
+        _cleanup_free_ dual_timestamp *ts = NULL;
+        _cleanup_free_ struct iovec *iovec = NULL;
+        _cleanup_strv_free_ char **messages = NULL;
+        ManagedJournalFile *single, *batch;
+        char t[] = "/var/tmp/journal-append-XXXXXX";
+        uint64_t p = 0, q = 0;
+        sd_id128_t boot_id;
+        size_t n;
+
+        m = mmap_cache_new();
+        assert_se(m != NULL);
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(managed_journal_file_open(-1, "single.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &single) == 0);
+        assert_se(managed_journal_file_open(-1, "batch.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &batch) == 0);
+
+        assert_se(sd_id128_randomize(&boot_id) >= 0);
+        assert_se(entries = new(JournalFileAppendEntry, APPEND_ENTRIES));
+        assert_se(ts = new(dual_timestamp, APPEND_ENTRIES));
+        assert_se(iovec = new(struct iovec, APPEND_ENTRIES * 4));
+
+        for (unsigned i = 0; i < APPEND_ENTRIES; i++) {
+                struct iovec *v = iovec + i * 4;
+
+                assert_se(strv_extendf(&messages, "MESSAGE=%u", i) >= 0);
+                assert_se(strv_extendf(&messages, "MOD=%u", i % 7) >= 0);
+
+                v[0] = IOVEC_MAKE_STRING(messages[i * 2]);
+                v[1] = IOVEC_MAKE_STRING(messages[i * 2 + 1]);
+                v[2] = IOVEC_MAKE_STRING("COMMON=yes");
+                v[3] = IOVEC_MAKE_STRING("COMMON=yes"); /* duplicates within an entry are dropped */
+
+                ts[i] = (dual_timestamp) {
+                        .realtime = 1600000000 * USEC_PER_SEC + i,
+                        .monotonic = 1 + i,
+                };
+
+                entries[i] = (JournalFileAppendEntry) {
+                        .ts = ts + i,
+                        .boot_id = &boot_id,
+                        .iovec = v,
+                        .n_iovec = 4,
+                };
+
+                assert_se(journal_file_append_entry(single->file, ts + i, &boot_id, v, 4, NULL, NULL, NULL, NULL) == 0);
+        }
+
+        /* Append in batches of varying size, so that entry arrays fill up in the middle of a batch */
+        for (unsigned i = 0, k = 1; i < APPEND_ENTRIES; i += n, k = k * 3 % 67) {
+                assert_se(journal_file_append_entries(batch->file, entries + i, MIN(k, APPEND_ENTRIES - i), NULL, NULL, &n) == 0);
+                assert_se(n == MIN(k, APPEND_ENTRIES - i));
+        }
+
+        /* Entries must not go backwards in time in strict mode, and the ones before the offending one are
+         * still appended */
+        batch->file->strict_order = true;
+        ts[0].realtime = ts[1].realtime = ts[APPEND_ENTRIES - 1].realtime + 1;
+        ts[0].monotonic = ts[1].monotonic = ts[APPEND_ENTRIES - 1].monotonic + 1;
+        ts[2].realtime = 1;
+        assert_se(journal_file_append_entries(batch->file, entries, 3, NULL, NULL, &n) == -EREMCHG);
+        assert_se(n == 2);
+        batch->file->strict_order = false;
+        assert_se(journal_file_append_entries(single->file, entries, 2, NULL, NULL, &n) == 0);
+        assert_se(n == 2);
+
+        assert_se(le64toh(single->file->header->n_entries) == APPEND_ENTRIES + 2);
+        assert_se(le64toh(batch->file->header->n_entries) == APPEND_ENTRIES + 2);
+        assert_se(single->file->header->tail_entry_realtime == batch->file->header->tail_entry_realtime);
+        assert_se(single->file->header->head_entry_realtime == batch->file->header->head_entry_realtime);
+
+        for (;;) {
+                Object *o, *b;
+                int r;
+
+                r = journal_file_next_entry(single->file, p, DIRECTION_DOWN, &o, &p);
+                assert_se(r >= 0);
+                assert_se(journal_file_next_entry(batch->file, q, DIRECTION_DOWN, &b, &q) == r);
+                if (r == 0)
+                        break;
+
+                assert_se(o->entry.seqnum == b->entry.seqnum);
+                assert_se(o->entry.realtime == b->entry.realtime);
+                assert_se(o->entry.xor_hash == b->entry.xor_hash);
+                assert_se(journal_file_entry_n_items(single->file, o) == 3);
+                assert_se(journal_file_entry_n_items(batch->file, b) == 3);
+        }
+
+        STRV_FOREACH(s, STRV_MAKE("COMMON=yes", "MOD=0", "MOD=6", "MESSAGE=0", "MESSAGE=999")) {
+                Object *o, *b;
+
+                assert_se(journal_file_find_data_object(single->file, *s, strlen(*s), &o, NULL) == 1);
+                assert_se(journal_file_find_data_object(batch->file, *s, strlen(*s), &b, NULL) == 1);
+                assert_se(o->data.n_entries == b->data.n_entries);
+
+                assert_se(journal_file_next_entry_for_data(single->file, o, DIRECTION_UP, &o, NULL) == 1);
+                assert_se(journal_file_next_entry_for_data(batch->file, b, DIRECTION_UP, &b, NULL) == 1);
+                assert_se(o->entry.seqnum == b->entry.seqnum);
+        }
+
+        assert_se(journal_file_verify(batch->file, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) managed_journal_file_close(single);
+        (void) managed_journal_file_close(batch);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+}
+
+TEST(append_entries) {
+        assert_se(setenv("SYSTEMD_JOURNAL_COMPACT", "0", 1) >= 0);
+        test_append_entries_one();
+
+        assert_se(setenv("SYSTEMD_JOURNAL_COMPACT", "1", 1) >= 0);
+        test_append_entries_one();
+}
+
+static void test_prepare_next_one(void) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        static const char test[] = "TEST1=1";
+        char t[] = "/var/tmp/journal-XXXXXX";
+        uint64_t p, size, seqnum;
+        ManagedJournalFile *f;
+        struct iovec iovec;
+        dual_timestamp ts;
+        unsigned n = 0;
+        Object *o;
+
+        assert_se(m = mmap_cache_new());
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(managed_journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &f) == 0);
+
+        assert_se(dual_timestamp_get(&ts));
+        iovec = IOVEC_MAKE_STRING(test);
+        assert_se(journal_file_append_entry(f->file, &ts, NULL, &iovec, 1, NULL, NULL, NULL, NULL) == 0);
+
+        /* Grow the file ahead of the tail, once */
+        assert_se(journal_file_tail_end_by_mmap(f->file, &p) >= 0);
+        assert_se(journal_file_preallocate(f->file, 32U * 1024U * 1024U) > 0);
+        size = le64toh(f->file->header->header_size) + le64toh(f->file->header->arena_size);
+        assert_se(size >= p + 32U * 1024U * 1024U);
+        assert_se(journal_file_preallocate(f->file, 32U * 1024U * 1024U) == 0);
+        assert_se(le64toh(f->file->header->header_size) + le64toh(f->file->header->arena_size) == size);
+
+        /* The successor is not visible to readers */
+        assert_se(managed_journal_file_prepare_next(f, m, JOURNAL_COMPRESS, UINT64_MAX) > 0);
+        assert_se(managed_journal_file_prepare_next(f, m, JOURNAL_COMPRESS, UINT64_MAX) == 0);
+        assert_se(streq(f->next->path, f->file->path));
+        assert_se(access("test.journal.next", F_OK) >= 0);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        SD_JOURNAL_FOREACH(j)
+                n++;
+        assert_se(n == 1);
+        sd_journal_close(TAKE_PTR(j));
+
+        /* Rotation renames it into place, and the sequence continues */
+        seqnum = le64toh(f->file->header->tail_entry_seqnum);
+        assert_se(managed_journal_file_rotate(&f, m, JOURNAL_COMPRESS, UINT64_MAX, NULL) >= 0);
+        assert_se(!f->next);
+        assert_se(access("test.journal.next", F_OK) < 0 && errno == ENOENT);
+        assert_se(le64toh(f->file->header->n_entries) == 0);
+
+        assert_se(journal_file_append_entry(f->file, &ts, NULL, &iovec, 1, NULL, NULL, &o, NULL) == 0);
+        assert_se(le64toh(o->entry.seqnum) == seqnum + 1);
+
+        /* Closing a file removes its successor */
+        assert_se(managed_journal_file_prepare_next(f, m, JOURNAL_COMPRESS, UINT64_MAX) > 0);
+        assert_se(access("test.journal.next", F_OK) >= 0);
+        (void) managed_journal_file_close(f);
+        assert_se(access("test.journal.next", F_OK) < 0 && errno == ENOENT);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        n = 0;
+        SD_JOURNAL_FOREACH(j)
+                n++;
+        assert_se(n == 2);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
+TEST(prepare_next) {
+        assert_se(setenv("SYSTEMD_JOURNAL_COMPACT", "0", 1) >= 0);
+        test_prepare_next_one();
+
+        assert_se(setenv("SYSTEMD_JOURNAL_COMPACT", "1", 1) >= 0);
+        test_prepare_next_one();
+}
+
 #if HAVE_COMPRESSION
 static bool check_compressed(uint64_t compress_threshold, uint64_t data_size) {
         _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
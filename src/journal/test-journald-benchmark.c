@@ -0,0 +1,613 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "extract-word.h"
+#include "fd-util.h"
+#include "format-table.h"
+#include "io-util.h"
+#include "journal-internal.h"
+#include "journald-rate-limit.h"
+#include "journald-server.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "process-util.h"
+#include "random-util.h"
+#include "rm-rf.h"
+#include "socket-util.h"
+#include "sort-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+/* Measures end-to-end throughput of journald: a Server is set up as for a log namespace, with its sockets
+ * and journal files in a temporary directory (on tmpfs by default), and a number of client processes log
+ * to it via the native protocol, syslog and stdout streams. Each message carries the time it was sent, so
+ * that the latency up to the event loop iteration that wrote it can be determined from the journal
+ * afterwards. */
+
+#define N_CODE_LOCATIONS 64U
+#define N_USERS 1000U
+#define LARGE_MESSAGE_EVERY 100U
+#define LARGE_MESSAGE_SIZE (4U * 1024U)
+#define QUIESCE_USEC (100 * USEC_PER_MSEC)
+
+typedef enum Transport {
+        TRANSPORT_NATIVE,
+        TRANSPORT_SYSLOG,
+        TRANSPORT_STDOUT,
+        _TRANSPORT_MAX,
+} Transport;
+
+typedef struct Result {
+        bool compress;
+        bool seal;
+        bool sealed;
+        uint64_t n_entries;
+        usec_t elapsed;
+        usec_t p50;
+        usec_t p99;
+        uint64_t bytes;
+} Result;
+
+static uint64_t arg_entries = 100000;
+static unsigned arg_clients = 4;
+static unsigned arg_mix[_TRANSPORT_MAX] = { 60, 20, 20 };
+static unsigned arg_identifiers = 32;
+static bool arg_compress = true;
+static bool arg_seal = false;
+static bool arg_compare = false;
+static const char *arg_directory = NULL;
+static bool arg_keep = false;
+
+static const char* const message_templates[] = {
+        "Accepted connection from 10.%u.%u.%u",
+        "Request %u completed in %u ms with status 200",
+        "Cache miss for key session:%u, fetching from backend %u",
+        "Worker %u picked up job %u from queue",
+        "Failed to resolve host replica-%u.example.com, retrying in %u s",
+        "User %u logged in from terminal pts/%u",
+};
+
+static Transport pick_transport(void) {
+        unsigned total = 0, n;
+
+        for (Transport t = 0; t < _TRANSPORT_MAX; t++)
+                total += arg_mix[t];
+
+        n = random_u64_range(total);
+        for (Transport t = 0; t < _TRANSPORT_MAX; t++) {
+                if (n < arg_mix[t])
+                        return t;
+                n -= arg_mix[t];
+        }
+
+        assert_not_reached();
+}
+
+static int pick_priority(void) {
+        static const int priorities[] = {
+                LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO,
+                LOG_DEBUG, LOG_DEBUG, LOG_NOTICE, LOG_WARNING, LOG_ERR,
+        };
+
+        return priorities[random_u64_range(ELEMENTSOF(priorities))];
+}
+
+static char* make_message(uint64_t i) {
+        _cleanup_free_ char *text = NULL, *large = NULL;
+        char *m;
+
+        /* Mostly short messages with a few variable parts, plus the occasional large one that will be
+         * compressed */
+        assert_se(asprintf(&text, message_templates[i % ELEMENTSOF(message_templates)],
+                           (unsigned) random_u64_range(256), (unsigned) random_u64_range(10000)) >= 0);
+
+        if (i % LARGE_MESSAGE_EVERY == 0)
+                assert_se(large = strrep(" backtrace frame", LARGE_MESSAGE_SIZE / STRLEN(" backtrace frame")));
+
+        assert_se(asprintf(&m, "%s%s sent=" USEC_FMT, text, strempty(large), now(CLOCK_REALTIME)) >= 0);
+        return m;
+}
+
+static int connect_socket(const char *dir, const char *name, int type) {
+        _cleanup_close_ int fd = -EBADF;
+        _cleanup_free_ char *p = NULL;
+        union sockaddr_union sa;
+        int r;
+
+        assert_se(p = path_join(dir, name));
+
+        r = sockaddr_un_set_path(&sa.un, p);
+        if (r < 0)
+                return r;
+
+        fd = socket(AF_UNIX, type|SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return -errno;
+
+        if (connect(fd, &sa.sa, r) < 0)
+                return -errno;
+
+        return TAKE_FD(fd);
+}
+
+static int run_client(const char *run_dir, unsigned id, uint64_t n_entries) {
+        _cleanup_close_ int native_fd = -EBADF, syslog_fd = -EBADF, stdout_fd = -EBADF;
+        _cleanup_free_ char *header = NULL;
+        int r;
+
+        native_fd = connect_socket(run_dir, "socket", SOCK_DGRAM);
+        if (native_fd < 0)
+                return log_error_errno(native_fd, "Failed to connect to native socket: %m");
+
+        syslog_fd = connect_socket(run_dir, "dev-log", SOCK_DGRAM);
+        if (syslog_fd < 0)
+                return log_error_errno(syslog_fd, "Failed to connect to syslog socket: %m");
+
+        stdout_fd = connect_socket(run_dir, "stdout", SOCK_STREAM);
+        if (stdout_fd < 0)
+                return log_error_errno(stdout_fd, "Failed to connect to stdout socket: %m");
+
+        /* Identifier, unit ID, priority, level prefix, and forwarding to syslog, kmsg and the console */
+        assert_se(asprintf(&header, "bench-stdout%u\n\n%i\n0\n0\n0\n0\n", id, LOG_INFO) >= 0);
+        r = loop_write(stdout_fd, header, strlen(header));
+        if (r < 0)
+                return log_error_errno(r, "Failed to write stdout stream header: %m");
+
+        for (uint64_t i = 0; i < n_entries; i++) {
+                _cleanup_free_ char *message = NULL, *buf = NULL;
+                unsigned identifier = random_u64_range(arg_identifiers),
+                        location = random_u64_range(N_CODE_LOCATIONS);
+                int priority = pick_priority();
+
+                message = make_message(i);
+
+                switch (pick_transport()) {
+
+                case TRANSPORT_NATIVE:
+                        assert_se(asprintf(&buf,
+                                           "MESSAGE=%s\n"
+                                           "PRIORITY=%i\n"
+                                           "SYSLOG_IDENTIFIER=bench-app%u\n"
+                                           "CODE_FILE=src/app/module%u.c\n"
+                                           "CODE_LINE=%u\n"
+                                           "CODE_FUNC=handler_%u\n"
+                                           "REQUEST_ID=%016" PRIx64 "\n"
+                                           "USER_ID=%u\n",
+                                           message, priority, identifier, location / 8, location * 17 + 3, location,
+                                           random_u64(), (unsigned) random_u64_range(N_USERS)) >= 0);
+
+                        if (send(native_fd, buf, strlen(buf), MSG_NOSIGNAL) < 0)
+                                return log_error_errno(errno, "Failed to send native message: %m");
+                        break;
+
+                case TRANSPORT_SYSLOG:
+                        assert_se(asprintf(&buf, "<%i>bench-app%u[" PID_FMT "]: %s",
+                                           LOG_USER | priority, identifier, getpid_cached(), message) >= 0);
+
+                        if (send(syslog_fd, buf, strlen(buf), MSG_NOSIGNAL) < 0)
+                                return log_error_errno(errno, "Failed to send syslog message: %m");
+                        break;
+
+                case TRANSPORT_STDOUT:
+                        assert_se(buf = strjoin(message, "\n"));
+
+                        r = loop_write(stdout_fd, buf, strlen(buf));
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to write to stdout stream: %m");
+                        break;
+
+                default:
+                        assert_not_reached();
+                }
+        }
+
+        return 0;
+}
+
+static int server_setup(Server *s, const char *dir, bool compress, bool seal) {
+        _cleanup_free_ char *run_dir = NULL, *log_dir = NULL;
+        int r;
+
+        assert(s);
+        assert(dir);
+
+        assert_se(run_dir = path_join(dir, "run"));
+        assert_se(log_dir = path_join(dir, "log"));
+
+        /* Log namespaces always write to persistent storage, don't read from /dev/kmsg, and only read
+         * their own configuration file. The directories are picked up from the environment, as when
+         * running as a service with RuntimeDirectory= and LogsDirectory=. */
+        assert_se(setenv("RUNTIME_DIRECTORY", run_dir, /* overwrite= */ true) >= 0);
+        assert_se(setenv("LOGS_DIRECTORY", log_dir, /* overwrite= */ true) >= 0);
+        assert_se(unsetenv("NOTIFY_SOCKET") >= 0);
+
+        r = server_init(s, "benchmark");
+        if (r < 0)
+                return r;
+
+        /* Nothing but the benchmark traffic please, and all of it */
+        s->audit_event_source = sd_event_source_disable_unref(s->audit_event_source);
+        s->idle_event_source = sd_event_source_disable_unref(s->idle_event_source);
+        journal_ratelimit_free(TAKE_PTR(s->ratelimit));
+        s->forward_to_wall = false;
+
+        /* The files were opened with the settings from the configuration file, start new ones */
+        s->compress.enabled = compress;
+        s->seal = seal;
+        server_rotate(s);
+
+        return 0;
+}
+
+static int compare_usec(const usec_t *a, const usec_t *b) {
+        return CMP(*a, *b);
+}
+
+static int collect_results(const char *dir, Result *result) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ usec_t *latencies = NULL;
+        _cleanup_free_ char *log_dir = NULL;
+        size_t n = 0;
+        JournalFile *f;
+        int r;
+
+        assert(dir);
+        assert(result);
+
+        assert_se(log_dir = path_join(dir, "log"));
+
+        r = sd_journal_open_directory(&j, log_dir, 0);
+        if (r < 0)
+                return log_error_errno(r, "Failed to open journal in %s: %m", log_dir);
+
+        assert_se(latencies = new(usec_t, arg_entries));
+
+        SD_JOURNAL_FOREACH(j) {
+                const char *sent;
+                const void *d;
+                usec_t t, realtime;
+                size_t l;
+
+                if (sd_journal_get_data(j, "MESSAGE", &d, &l) < 0)
+                        continue;
+
+                sent = memmem_safe(d, l, " sent=", STRLEN(" sent="));
+                if (!sent)
+                        continue; /* Not ours */
+
+                sent += STRLEN(" sent=");
+                if (safe_atou64(strndupa_safe(sent, (const char*) d + l - sent), &t) < 0)
+                        continue;
+
+                assert_se(sd_journal_get_realtime_usec(j, &realtime) >= 0);
+
+                if (n < arg_entries)
+                        latencies[n++] = LESS_BY(realtime, t);
+        }
+
+        /* The hash tables are allocated upfront, count only what was appended after them */
+        ORDERED_HASHMAP_FOREACH(f, j->files) {
+                uint64_t p, start;
+
+                if (le64toh(f->header->n_entries) == 0)
+                        continue;
+
+                r = journal_file_tail_end_by_mmap(f, &p);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to determine end of %s: %m", f->path);
+
+                start = MAX(le64toh(f->header->data_hash_table_offset) + le64toh(f->header->data_hash_table_size),
+                            le64toh(f->header->field_hash_table_offset) + le64toh(f->header->field_hash_table_size));
+
+                result->bytes += LESS_BY(p, start);
+        }
+
+        typesafe_qsort(latencies, n, compare_usec);
+
+        result->n_entries = n;
+        if (n > 0) {
+                result->p50 = latencies[n / 2];
+                result->p99 = latencies[MIN(n * 99 / 100, n - 1)];
+        }
+
+        if (n < arg_entries)
+                log_warning("Only %zu of %" PRIu64 " messages were found in the journal.", n, arg_entries);
+
+        return 0;
+}
+
+static int run_benchmark(bool compress, bool seal, Result *ret) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_free_ pid_t *pids = NULL;
+        _cleanup_free_ char *run_dir = NULL, *template = NULL;
+        unsigned n_running = 0;
+        usec_t start, end;
+        Server s;
+        int r;
+
+        assert(ret);
+
+        log_info("/* %s(compress=%s, seal=%s) */", __func__, yes_no(compress), yes_no(seal));
+
+        assert_se(template = path_join(arg_directory ?: (access("/dev/shm", W_OK) >= 0 ? "/dev/shm" : "/tmp"),
+                                       "journald-benchmark-XXXXXX"));
+        assert_se(mkdtemp_malloc(template, &dir) >= 0);
+        assert_se(run_dir = path_join(dir, "run"));
+
+        r = server_setup(&s, dir, compress, seal);
+        if (r < 0) {
+                server_done(&s);
+                return log_error_errno(r, "Failed to set up journal server: %m");
+        }
+
+        *ret = (Result) {
+                .compress = compress,
+                .seal = seal,
+                .sealed = s.system_journal && JOURNAL_HEADER_SEALED(s.system_journal->file->header),
+        };
+
+        assert_se(pids = new0(pid_t, arg_clients));
+
+        start = now(CLOCK_MONOTONIC);
+
+        for (unsigned i = 0; i < arg_clients; i++) {
+                uint64_t n = arg_entries / arg_clients + (i < arg_entries % arg_clients);
+
+                r = safe_fork("(bench-client)", FORK_DEATHSIG|FORK_LOG, &pids[i]);
+                assert_se(r >= 0);
+                if (r == 0)
+                        _exit(run_client(run_dir, i, n) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+
+                n_running++;
+        }
+
+        /* Serve the clients until they are done… */
+        end = start;
+        while (n_running > 0) {
+                r = sd_event_run(s.event, 10 * USEC_PER_MSEC);
+                assert_se(r >= 0);
+                if (r > 0)
+                        end = now(CLOCK_MONOTONIC);
+
+                for (unsigned i = 0; i < arg_clients; i++) {
+                        siginfo_t si = {};
+
+                        if (pids[i] == 0)
+                                continue;
+
+                        assert_se(waitid(P_PID, pids[i], &si, WEXITED|WNOHANG) >= 0);
+                        if (si.si_pid == 0)
+                                continue;
+
+                        if (si.si_code != CLD_EXITED || si.si_status != EXIT_SUCCESS)
+                                log_warning("Client %u failed.", i);
+
+                        pids[i] = 0;
+                        n_running--;
+                }
+        }
+
+        /* … and until everything they sent has been written */
+        while ((r = sd_event_run(s.event, QUIESCE_USEC)) > 0)
+                end = now(CLOCK_MONOTONIC);
+        assert_se(r >= 0);
+
+        ret->elapsed = end - start;
+
+        server_sync(&s);
+        server_done(&s);
+
+        r = collect_results(dir, ret);
+        if (r < 0)
+                return r;
+
+        if (arg_keep) {
+                log_info("Not removing %s", dir);
+                dir = mfree(dir);
+        }
+
+        return 0;
+}
+
+static int print_results(const Result *results, size_t n) {
+        _cleanup_(table_unrefp) Table *table = NULL;
+        int r;
+
+        table = table_new("compress", "seal", "entries", "entries/s", "p50", "p99", "bytes/entry");
+        if (!table)
+                return log_oom();
+
+        for (size_t i = 0; i < n; i++) {
+                const Result *res = results + i;
+
+                r = table_add_many(table,
+                                   TABLE_BOOLEAN, res->compress,
+                                   TABLE_STRING, res->seal ? (res->sealed ? "yes" : "no key") : "no",
+                                   TABLE_UINT64, res->n_entries,
+                                   TABLE_UINT64, res->elapsed > 0 ? res->n_entries * USEC_PER_SEC / res->elapsed : 0,
+                                   TABLE_TIMESPAN, res->p50,
+                                   TABLE_TIMESPAN, res->p99,
+                                   TABLE_UINT64, res->n_entries > 0 ? res->bytes / res->n_entries : 0);
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+
+        return table_print(table, NULL);
+}
+
+static void help(void) {
+        printf("%s [OPTIONS...]\n\n"
+               "Measures journald throughput and latency.\n\n"
+               "  -h --help              Show this help\n"
+               "     --entries=N         Number of messages to send in total (default: %" PRIu64 ")\n"
+               "     --clients=N         Number of client processes (default: %u)\n"
+               "     --mix=NATIVE:SYSLOG:STDOUT\n"
+               "                         Weights of the transports (default: %u:%u:%u)\n"
+               "     --identifiers=N     Number of distinct syslog identifiers (default: %u)\n"
+               "     --compress=BOOL     Compress journal files (default: %s)\n"
+               "     --seal=BOOL         Seal journal files, needs a sealing key for the machine\n"
+               "                         (default: %s)\n"
+               "     --compare           Run with all combinations of --compress= and --seal=\n"
+               "     --directory=PATH    Where to create the journal files (default: /dev/shm)\n"
+               "     --keep              Don't remove the journal files afterwards\n",
+               program_invocation_short_name,
+               arg_entries, arg_clients,
+               arg_mix[TRANSPORT_NATIVE], arg_mix[TRANSPORT_SYSLOG], arg_mix[TRANSPORT_STDOUT],
+               arg_identifiers, yes_no(arg_compress), yes_no(arg_seal));
+}
+
+static int parse_argv(int argc, char *argv[]) {
+        enum {
+                ARG_ENTRIES = 0x100,
+                ARG_CLIENTS,
+                ARG_MIX,
+                ARG_IDENTIFIERS,
+                ARG_COMPRESS,
+                ARG_SEAL,
+                ARG_COMPARE,
+                ARG_DIRECTORY,
+                ARG_KEEP,
+        };
+
+        static const struct option options[] = {
+                { "help",        no_argument,       NULL, 'h'             },
+                { "entries",     required_argument, NULL, ARG_ENTRIES     },
+                { "clients",     required_argument, NULL, ARG_CLIENTS     },
+                { "mix",         required_argument, NULL, ARG_MIX         },
+                { "identifiers", required_argument, NULL, ARG_IDENTIFIERS },
+                { "compress",    required_argument, NULL, ARG_COMPRESS    },
+                { "seal",        required_argument, NULL, ARG_SEAL        },
+                { "compare",     no_argument,       NULL, ARG_COMPARE     },
+                { "directory",   required_argument, NULL, ARG_DIRECTORY   },
+                { "keep",        no_argument,       NULL, ARG_KEEP        },
+                {}
+        };
+
+        int c, r;
+
+        assert(argc >= 0);
+        assert(argv);
+
+        while ((c = getopt_long(argc, argv, "h", options, NULL)) >= 0)
+                switch (c) {
+
+                case 'h':
+                        help();
+                        return 0;
+
+                case ARG_ENTRIES:
+                        r = safe_atou64(optarg, &arg_entries);
+                        if (r < 0 || arg_entries == 0)
+                                return log_error_errno(r < 0 ? r : SYNTHETIC_ERRNO(EINVAL),
+                                                       "Invalid number of entries: %s", optarg);
+                        break;
+
+                case ARG_CLIENTS:
+                        r = safe_atou(optarg, &arg_clients);
+                        if (r < 0 || arg_clients == 0)
+                                return log_error_errno(r < 0 ? r : SYNTHETIC_ERRNO(EINVAL),
+                                                       "Invalid number of clients: %s", optarg);
+                        break;
+
+                case ARG_MIX: {
+                        _cleanup_free_ char *native = NULL, *syslog = NULL, *stdout_stream = NULL;
+                        const char *p = optarg;
+
+                        r = extract_many_words(&p, ":", 0, &native, &syslog, &stdout_stream, NULL);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse transport mix: %s", optarg);
+                        if (r != 3 || !isempty(p) ||
+                            safe_atou(native, arg_mix + TRANSPORT_NATIVE) < 0 ||
+                            safe_atou(syslog, arg_mix + TRANSPORT_SYSLOG) < 0 ||
+                            safe_atou(stdout_stream, arg_mix + TRANSPORT_STDOUT) < 0 ||
+                            arg_mix[TRANSPORT_NATIVE] + arg_mix[TRANSPORT_SYSLOG] + arg_mix[TRANSPORT_STDOUT] == 0)
+                                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Invalid transport mix: %s", optarg);
+                        break;
+                }
+
+                case ARG_IDENTIFIERS:
+                        r = safe_atou(optarg, &arg_identifiers);
+                        if (r < 0 || arg_identifiers == 0)
+                                return log_error_errno(r < 0 ? r : SYNTHETIC_ERRNO(EINVAL),
+                                                       "Invalid number of identifiers: %s", optarg);
+                        break;
+
+                case ARG_COMPRESS:
+                        r = parse_boolean(optarg);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --compress= argument: %s", optarg);
+                        arg_compress = r;
+                        break;
+
+                case ARG_SEAL:
+                        r = parse_boolean(optarg);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --seal= argument: %s", optarg);
+                        arg_seal = r;
+                        break;
+
+                case ARG_COMPARE:
+                        arg_compare = true;
+                        break;
+
+                case ARG_DIRECTORY:
+                        arg_directory = optarg;
+                        break;
+
+                case ARG_KEEP:
+                        arg_keep = true;
+                        break;
+
+                case '?':
+                        return -EINVAL;
+
+                default:
+                        assert_not_reached();
+                }
+
+        if (optind < argc)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "This program takes no arguments.");
+
+        return 1;
+}
+
+int main(int argc, char *argv[]) {
+        Result results[4] = {};
+        size_t n = 0;
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        r = parse_argv(argc, argv);
+        if (r <= 0)
+                return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+        /* The journal server requires a valid machine id */
+        if (sd_id128_get_machine(NULL) < 0)
+                return log_tests_skipped("No valid machine ID found");
+
+        if (arg_compare) {
+                FOREACH_ARRAY(c, ((const bool[]) { false, true }), 2)
+                        FOREACH_ARRAY(s, ((const bool[]) { false, true }), 2) {
+                                r = run_benchmark(*c, *s, results + n);
+                                if (r < 0)
+                                        return EXIT_FAILURE;
+                                n++;
+                        }
+        } else {
+                r = run_benchmark(arg_compress, arg_seal, results + n);
+                if (r < 0)
+                        return EXIT_FAILURE;
+                n++;
+        }
+
+        return print_results(results, n) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
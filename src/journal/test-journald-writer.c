@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "chattr-util.h"
+#include "io-util.h"
+#include "journald-writer.h"
+#include "managed-journal-file.h"
+#include "mmap-cache.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+#define N_ENTRIES 1000U
+
+static void free_entries(JournalWriterEntry **entries, size_t n) {
+        FOREACH_ARRAY(e, entries, n)
+                free(*e);
+        free(entries);
+}
+
+static ManagedJournalFile* open_file(const char *dn, const char *name, MMapCache *m, JournalMetrics *metrics) {
+        _cleanup_free_ char *fn = NULL;
+        ManagedJournalFile *f = NULL;
+
+        assert_se(fn = path_join(dn, name));
+        assert_se(managed_journal_file_open(-EBADF, fn, O_RDWR|O_CREAT, 0, 0644, UINT64_MAX, metrics, m, NULL, NULL, &f) == 0);
+
+        return f;
+}
+
+TEST(writer_order) {
+        _cleanup_(rm_rf_physical_and_freep) char *dn = NULL;
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_(journal_writer_freep) JournalWriter *w = NULL;
+        ManagedJournalFile *f1, *f2;
+        JournalWriterEntry **entries;
+        JournalWriterStats stats;
+        uint64_t seqnum = 0;
+        sd_id128_t seqnum_id = SD_ID128_NULL;
+        dual_timestamp ts;
+        size_t n_entries;
+        Object *o;
+        uint64_t p;
+        int error;
+
+        assert_se(m = mmap_cache_new());
+        assert_se(mkdtemp_malloc("/var/tmp/test-journald-writer.XXXXXX", &dn) >= 0);
+        (void) chattr_path(dn, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        f1 = open_file(dn, "one.journal", m, NULL);
+        f2 = open_file(dn, "two.journal", m, NULL);
+
+        /* A tiny queue, so that we have to wait for the writer thread */
+        assert_se(journal_writer_new(3, 0, &seqnum, &seqnum_id, &w) >= 0);
+
+        for (unsigned i = 0; i < N_ENTRIES; i++) {
+                _cleanup_free_ char *t = NULL;
+                struct iovec iovec;
+
+                assert_se(asprintf(&t, "MESSAGE=%u", i) >= 0);
+                iovec = IOVEC_MAKE_STRING(t);
+
+                dual_timestamp_get(&ts);
+                assert_se(journal_writer_enqueue(w, i % 3 == 0 ? f2->file : f1->file, 0, LOG_INFO, &ts, &iovec, 1) >= 0);
+        }
+
+        assert_se(journal_writer_drain(w, /* wait= */ true, &entries, &n_entries, &error) == 0);
+        assert_se(!entries);
+        assert_se(n_entries == 0);
+        assert_se(error == 0);
+
+        journal_writer_get_stats(w, &stats);
+        assert_se(stats.queue_size == 4);
+        assert_se(stats.queue_depth == 0);
+        assert_se(stats.queue_depth_max <= 4);
+        assert_se(stats.n_queued == N_ENTRIES);
+        assert_se(stats.n_written == N_ENTRIES);
+        assert_se(stats.n_returned == 0);
+        assert_se(stats.n_stopped == 0);
+        assert_se(seqnum == N_ENTRIES);
+
+        /* Both files got their entries in order, with seqnums shared between them */
+        FOREACH_ARRAY(f, ((ManagedJournalFile*[]) { f1, f2 }), 2) {
+                uint64_t last_seqnum = 0;
+                unsigned n = 0;
+
+                assert_se(journal_file_next_entry((*f)->file, 0, DIRECTION_DOWN, &o, &p) == 1);
+                for (;;) {
+                        assert_se(le64toh(o->entry.seqnum) > last_seqnum);
+                        last_seqnum = le64toh(o->entry.seqnum);
+                        n++;
+
+                        if (journal_file_next_entry((*f)->file, p, DIRECTION_DOWN, &o, &p) <= 0)
+                                break;
+                }
+
+                assert_se(n == (*f == f2 ? (N_ENTRIES + 2) / 3 : N_ENTRIES - (N_ENTRIES + 2) / 3));
+        }
+
+        w = journal_writer_free(w);
+
+        (void) managed_journal_file_close(f1);
+        (void) managed_journal_file_close(f2);
+}
+
+TEST(writer_stop) {
+        _cleanup_(rm_rf_physical_and_freep) char *dn = NULL;
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_(journal_writer_freep) JournalWriter *w = NULL;
+        _cleanup_free_ char *payload = NULL;
+        JournalMetrics metrics = { .max_size = 1 };
+        JournalWriterStats stats;
+        uint64_t seqnum = 0;
+        sd_id128_t seqnum_id = SD_ID128_NULL;
+        ManagedJournalFile *f;
+        unsigned n_returned = 0, i;
+        dual_timestamp ts;
+        int r;
+
+        assert_se(m = mmap_cache_new());
+        assert_se(mkdtemp_malloc("/var/tmp/test-journald-writer.XXXXXX", &dn) >= 0);
+        (void) chattr_path(dn, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        /* The maximum size is bumped to the minimum file size, which large entries fill up quickly */
+        f = open_file(dn, "full.journal", m, &metrics);
+
+        assert_se(journal_writer_new(16, 0, &seqnum, &seqnum_id, &w) >= 0);
+
+        assert_se(payload = malloc(64 * 1024));
+        memset(payload, 'x', 64 * 1024);
+        memcpy(payload, "MESSAGE=", STRLEN("MESSAGE="));
+
+        for (i = 0; i < 1000; i++) {
+                struct iovec iovec = IOVEC_MAKE(payload, 64 * 1024);
+
+                /* Make every entry unique, so that the data objects are not deduplicated */
+                memcpy(payload + STRLEN("MESSAGE="), &i, sizeof(i));
+
+                dual_timestamp_get(&ts);
+                r = journal_writer_enqueue(w, f->file, 0, LOG_INFO, &ts, &iovec, 1);
+                if (r == -EAGAIN)
+                        break;
+                assert_se(r >= 0);
+        }
+
+        /* The writer thread must have given up at some point */
+        assert_se(i < 1000);
+
+        for (;;) {
+                JournalWriterEntry **entries;
+                size_t n_entries;
+                int error;
+
+                r = journal_writer_drain(w, /* wait= */ true, &entries, &n_entries, &error);
+                assert_se(r >= 0);
+                if (r == 0)
+                        break;
+
+                /* Either the file is full, or the writer thread noticed that it should be rotated first */
+                assert_se(IN_SET(error, 0, -E2BIG));
+                n_returned += n_entries;
+                free_entries(entries, n_entries);
+        }
+
+        journal_writer_get_stats(w, &stats);
+        assert_se(stats.n_queued == i);
+        assert_se(stats.n_stopped >= 1);
+        assert_se(stats.n_returned == n_returned);
+        assert_se(stats.n_written + stats.n_returned == stats.n_queued);
+        assert_se(stats.n_written == seqnum);
+        assert_se(stats.n_written == le64toh(f->file->header->n_entries));
+
+        /* The writer is usable again after the entries were taken back */
+        struct iovec small = IOVEC_MAKE_STRING("MESSAGE=small");
+        assert_se(journal_writer_enqueue(w, f->file, 0, LOG_INFO, &ts, &small, 1) >= 0);
+
+        w = journal_writer_free(w);
+
+        (void) managed_journal_file_close(f);
+}
+
+TEST(writer_terminate) {
+        _cleanup_(rm_rf_physical_and_freep) char *dn = NULL;
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_(journal_writer_freep) JournalWriter *w = NULL;
+        JournalWriterEntry **entries;
+        JournalWriterStats stats;
+        uint64_t seqnum = 0;
+        sd_id128_t seqnum_id = SD_ID128_NULL;
+        ManagedJournalFile *f;
+        dual_timestamp ts;
+        size_t n_entries;
+        int error;
+
+        assert_se(m = mmap_cache_new());
+        assert_se(mkdtemp_malloc("/var/tmp/test-journald-writer.XXXXXX", &dn) >= 0);
+        (void) chattr_path(dn, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        f = open_file(dn, "terminate.journal", m, NULL);
+
+        assert_se(journal_writer_new(64, 0, &seqnum, &seqnum_id, &w) >= 0);
+
+        for (unsigned i = 0; i < N_ENTRIES; i++) {
+                _cleanup_free_ char *t = NULL;
+                struct iovec iovec;
+
+                assert_se(asprintf(&t, "MESSAGE=%u", i) >= 0);
+                iovec = IOVEC_MAKE_STRING(t);
+
+                dual_timestamp_get(&ts);
+                assert_se(journal_writer_enqueue(w, f->file, 0, LOG_INFO, &ts, &iovec, 1) >= 0);
+        }
+
+        /* After stopping, everything queued is either written or handed back, and the thread is gone */
+        assert_se(journal_writer_stop(w, &entries, &n_entries, &error) >= 0);
+        free_entries(entries, n_entries);
+
+        journal_writer_get_stats(w, &stats);
+        assert_se(stats.queue_depth == 0);
+        assert_se(stats.n_written + n_entries == N_ENTRIES);
+        assert_se(stats.n_written == le64toh(f->file->header->n_entries));
+
+        w = journal_writer_free(w);
+
+        (void) managed_journal_file_close(f);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
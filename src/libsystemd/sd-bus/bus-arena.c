@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "bus-arena.h"
+
+BusArena* bus_arena_new(size_t size) {
+        BusArena *a;
+
+        size = ALIGN8(size);
+
+        a = malloc(offsetof(BusArena, data) + size);
+        if (!a)
+                return NULL;
+
+        a->n_ref = 1;
+        a->allocated = size;
+
+        return a;
+}
+
+static BusArena* bus_arena_free(BusArena *a) {
+        return mfree(a);
+}
+
+DEFINE_TRIVIAL_REF_UNREF_FUNC(BusArena, bus_arena, bus_arena_free);
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macro.h"
+
+/* A reference counted buffer incoming messages are read into. Messages reference the slice of the arena they
+ * were read into, instead of owning a buffer of their own, so that a connection can receive many messages
+ * without allocating memory for each of them. */
+
+#define BUS_ARENA_SIZE_DEFAULT (16U * 1024U)
+
+typedef struct BusArena {
+        unsigned n_ref;
+        size_t allocated; /* always a multiple of 8 */
+        _alignas_(uint64_t) uint8_t data[];
+} BusArena;
+
+BusArena* bus_arena_new(size_t size);
+BusArena* bus_arena_ref(BusArena *a);
+BusArena* bus_arena_unref(BusArena *a);
+DEFINE_TRIVIAL_CLEANUP_FUNC(BusArena*, bus_arena_unref);
@@ -5,6 +5,7 @@
 
 #include "sd-bus.h"
 
+#include "bus-arena.h"
 #include "bus-error.h"
 #include "bus-kernel.h"
 #include "bus-match.h"
@@ -218,8 +219,12 @@ struct sd_bus {
 
         signed int use_memfd:2;
 
+        /* While authenticating, and on connections passing fds, rbuffer is allocated on its own, and
+         * handed over to the message read into it. Otherwise it points into rarena after authenticating,
+         * which received messages reference. */
         void *rbuffer;
         size_t rbuffer_size;
+        BusArena *rarena;
 
         sd_bus_message **rqueue;
         size_t rqueue_size;
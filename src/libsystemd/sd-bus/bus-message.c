@@ -15,6 +15,8 @@
 #include "io-util.h"
 #include "memfd-util.h"
 #include "memory-util.h"
+#include "mempool.h"
+#include "process-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "time-util.h"
@@ -119,6 +121,39 @@ static void message_reset_containers(sd_bus_message *m) {
         m->root_container.index = 0;
 }
 
+DEFINE_MEMPOOL(bus_message_pool, sd_bus_message, 64);
+
+static sd_bus_message* message_new0(size_t extra) {
+        sd_bus_message *m;
+
+        /* Received messages are allocated and freed at a high rate, hence take them from a memory pool
+         * if we can, and they need no extra space. */
+        if (extra == 0 && mempool_enabled && mempool_enabled()) { /* mempool_enabled is a weak symbol */
+                m = mempool_alloc0_tile(&bus_message_pool);
+                if (m)
+                        m->from_pool = true;
+
+                return m;
+        }
+
+        return malloc0(ALIGN(sizeof(sd_bus_message)) + extra);
+}
+
+static sd_bus_message* message_release(sd_bus_message *m) {
+        if (!m)
+                return NULL;
+
+        if (m->from_pool) {
+                /* Ensure that the object didn't get migrated between threads. */
+                assert_se(is_main_thread());
+                return mempool_free_tile(&bus_message_pool, m);
+        }
+
+        return mfree(m);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(sd_bus_message*, message_release);
+
 static sd_bus_message* message_free(sd_bus_message *m) {
         assert(m);
 
@@ -127,6 +162,8 @@ static sd_bus_message* message_free(sd_bus_message *m) {
         if (m->free_header)
                 free(m->header);
 
+        bus_arena_unref(m->arena);
+
         /* Note that we don't unref m->bus here. That's already done by sd_bus_message_unref() as each user
          * reference to the bus message also is considered a reference to the bus connection itself. */
 
@@ -143,7 +180,7 @@ static sd_bus_message* message_free(sd_bus_message *m) {
         message_free_last_container(m);
 
         bus_creds_done(&m->creds);
-        return mfree(m);
+        return message_release(m);
 }
 
 static void *message_extend_fields(sd_bus_message *m, size_t sz, bool add_offset) {
@@ -338,9 +375,9 @@ static int message_from_header(
                 const char *label,
                 sd_bus_message **ret) {
 
-        _cleanup_free_ sd_bus_message *m = NULL;
+        _cleanup_(message_releasep) sd_bus_message *m = NULL;
         struct bus_header *h;
-        size_t a, label_sz = 0; /* avoid false maybe-uninitialized warning */
+        size_t a = 0, label_sz = 0; /* avoid false maybe-uninitialized warning */
 
         assert(bus);
         assert(buffer || message_size <= 0);
@@ -362,14 +399,12 @@ static int message_from_header(
 
         /* Note that we are happy with unknown flags in the flags header! */
 
-        a = ALIGN(sizeof(sd_bus_message));
-
         if (label) {
                 label_sz = strlen(label);
                 a += label_sz + 1;
         }
 
-        m = malloc0(a);
+        m = message_new0(a);
         if (!m)
                 return -ENOMEM;
 
@@ -405,8 +440,9 @@ static int message_from_header(
         return 0;
 }
 
-int bus_message_from_malloc(
+static int message_from_buffer(
                 sd_bus *bus,
+                BusArena *arena,
                 void *buffer,
                 size_t length,
                 int *fds,
@@ -445,13 +481,50 @@ int bus_message_from_malloc(
                 return r;
 
         /* We take possession of the memory and fds now */
-        m->free_header = true;
+        if (arena)
+                m->arena = bus_arena_ref(arena);
+        else
+                m->free_header = true;
         m->free_fds = true;
 
         *ret = TAKE_PTR(m);
         return 0;
 }
 
+int bus_message_from_malloc(
+                sd_bus *bus,
+                void *buffer,
+                size_t length,
+                int *fds,
+                size_t n_fds,
+                const char *label,
+                sd_bus_message **ret) {
+
+        return message_from_buffer(bus, NULL, buffer, length, fds, n_fds, label, ret);
+}
+
+int bus_message_from_arena(
+                sd_bus *bus,
+                BusArena *arena,
+                void *buffer,
+                size_t length,
+                int *fds,
+                size_t n_fds,
+                sd_bus_message **ret) {
+
+        assert(arena);
+        assert((uint8_t*) buffer >= arena->data);
+        assert((uint8_t*) buffer + length <= arena->data + arena->allocated);
+
+        /* Like bus_message_from_malloc(), but the message references a slice of the arena, instead of taking
+         * possession of the buffer. The buffer needs to be 8 byte aligned, as the fields of the message are
+         * accessed directly. */
+
+        assert(buffer == ALIGN8_PTR(buffer));
+
+        return message_from_buffer(bus, arena, buffer, length, fds, n_fds, NULL, ret);
+}
+
 _public_ int sd_bus_message_new(
                 sd_bus *bus,
                 sd_bus_message **m,
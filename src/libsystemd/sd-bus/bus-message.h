@@ -7,6 +7,7 @@
 
 #include "sd-bus.h"
 
+#include "bus-arena.h"
 #include "bus-creds.h"
 #include "bus-protocol.h"
 #include "macro.h"
@@ -80,10 +81,14 @@ struct sd_bus_message {
         bool free_fds:1;
         bool poisoned:1;
         bool sensitive:1;
+        bool from_pool:1;
 
         /* The first bytes of the message */
         struct bus_header *header;
 
+        /* If set, the message was received into this arena, and the header and body point into it */
+        BusArena *arena;
+
         size_t fields_size;
         size_t body_size;
         size_t user_body_size;
@@ -169,6 +174,15 @@ int bus_message_from_malloc(
                 const char *label,
                 sd_bus_message **ret);
 
+int bus_message_from_arena(
+                sd_bus *bus,
+                BusArena *arena,
+                void *buffer,
+                size_t length,
+                int *fds,
+                size_t n_fds,
+                sd_bus_message **ret);
+
 int bus_message_get_arg(sd_bus_message *m, unsigned i, const char **str);
 int bus_message_get_arg_strv(sd_bus_message *m, unsigned i, char ***strv);
 
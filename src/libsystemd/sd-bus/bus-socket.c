@@ -1198,15 +1198,123 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         return 0;
 }
 
-static int bus_socket_make_message(sd_bus *bus, size_t size) {
+static int bus_socket_arena_replace(sd_bus *bus, size_t size) {
+        BusArena *a;
+
+        assert(bus);
+        assert(size >= bus->rbuffer_size);
+
+        /* Starts a new arena with room for at least 'size' bytes, and moves what we read so far into it */
+
+        a = bus_arena_new(MAX(size, (size_t) BUS_ARENA_SIZE_DEFAULT));
+        if (!a)
+                return -ENOMEM;
+
+        memcpy_safe(a->data, bus->rbuffer, bus->rbuffer_size);
+
+        if (bus->rarena)
+                bus_arena_unref(bus->rarena);
+        else
+                free(bus->rbuffer); /* Left over from authentication */
+
+        bus->rarena = a;
+        bus->rbuffer = a->data;
+        return 0;
+}
+
+static int bus_socket_arena_reserve(sd_bus *bus, size_t need) {
+        BusArena *a;
+
+        assert(bus);
+
+        /* Makes sure rbuffer has room for 'need' bytes. If no received message references the arena
+         * anymore we can reuse it, otherwise a new one is started. Also makes sure rbuffer is aligned, in
+         * case bus_socket_arena_consume() failed to do so. */
+
+        a = bus->rarena;
+        if (!a)
+                return bus_socket_arena_replace(bus, need);
+
+        if (a->n_ref == 1 && (uint8_t*) bus->rbuffer != a->data) {
+                memmove(a->data, bus->rbuffer, bus->rbuffer_size);
+                bus->rbuffer = a->data;
+        }
+
+        if (bus->rbuffer == ALIGN8_PTR(bus->rbuffer) &&
+            (uint8_t*) bus->rbuffer + need <= a->data + a->allocated)
+                return 0;
+
+        return bus_socket_arena_replace(bus, need);
+}
+
+static int bus_socket_arena_consume(sd_bus *bus, size_t size) {
+        uint8_t *p;
+
+        assert(bus);
+        assert(bus->rarena);
+        assert(bus->rbuffer_size >= size);
+
+        bus->rbuffer = (uint8_t*) bus->rbuffer + size;
+        bus->rbuffer_size -= size;
+
+        if (bus->rbuffer_size == 0 && bus->rarena->allocated > BUS_ARENA_SIZE_DEFAULT) {
+                /* Don't hold on to arenas that were allocated for an oversized message */
+                bus->rarena = bus_arena_unref(bus->rarena);
+                bus->rbuffer = NULL;
+                return 0;
+        }
+
+        /* The next message needs to start at an aligned address, as its fields are accessed directly.
+         * Since the arena is 8 byte aligned both at the beginning and at the end, we'll always find room
+         * for that if the buffer is empty. If we fail here, bus_socket_arena_reserve() tries again before
+         * anything is read into the buffer. */
+        p = ALIGN8_PTR(bus->rbuffer);
+        if (p == bus->rbuffer)
+                return 0;
+
+        if (p + bus->rbuffer_size <= bus->rarena->data + bus->rarena->allocated) {
+                memmove(p, bus->rbuffer, bus->rbuffer_size);
+                bus->rbuffer = p;
+                return 0;
+        }
+
+        return bus_socket_arena_replace(bus, bus->rbuffer_size);
+}
+
+static bool bus_socket_arena_mostly_free(sd_bus *bus) {
+        assert(bus);
+        assert(bus->rarena);
+
+        /* Returns true if less than half of the arena was filled with what we read */
+        return (size_t) ((uint8_t*) bus->rbuffer + bus->rbuffer_size - bus->rarena->data) < bus->rarena->allocated / 2;
+}
+
+static void bus_socket_queue_message(sd_bus *bus, sd_bus_message *t) {
+        assert(bus);
+
+        bus->fds = NULL;
+        bus->n_fds = 0;
+
+        if (t) {
+                t->read_counter = ++bus->read_counter;
+                bus->rqueue[bus->rqueue_size++] = bus_message_ref_queued(t, bus);
+                sd_bus_message_unref(t);
+        }
+}
+
+static int bus_socket_make_message_malloc(sd_bus *bus, size_t size) {
         sd_bus_message *t = NULL;
         void *b;
         int r;
 
         assert(bus);
+        assert(!bus->rarena);
         assert(bus->rbuffer_size >= size);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
+        /* Turns the beginning of rbuffer into a message that takes ownership of the buffer, used on
+         * connections that read exactly one message at a time, see bus_socket_read_message(). */
+
         r = bus_rqueue_make_room(bus);
         if (r < 0)
                 return r;
@@ -1236,25 +1344,93 @@ static int bus_socket_make_message(sd_bus *bus, size_t size) {
         bus->rbuffer = b;
         bus->rbuffer_size -= size;
 
-        bus->fds = NULL;
-        bus->n_fds = 0;
+        bus_socket_queue_message(bus, t);
+        return 1;
+}
 
-        if (t) {
-                t->read_counter = ++bus->read_counter;
-                bus->rqueue[bus->rqueue_size++] = bus_message_ref_queued(t, bus);
-                sd_bus_message_unref(t);
-        }
+static int bus_socket_make_message(sd_bus *bus, size_t size) {
+        sd_bus_message *t = NULL;
+        int r;
+
+        assert(bus);
+        assert(bus->rarena);
+        assert(bus->rbuffer_size >= size);
+        assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
+
+        r = bus_rqueue_make_room(bus);
+        if (r < 0)
+                return r;
+
+        /* A message keeps all of the arena it references around for as long as it lives. That's a good
+         * deal if many messages were read into the arena at once, but a single message kept around by the
+         * application would pin all of an otherwise empty arena. Hence only messages read in bulk reference
+         * the arena, the others get a copy of their own, and the arena is reused for the next read right
+         * away. Note that the message can't be moved out of the arena later, e.g. after it was dispatched,
+         * as the application might hold pointers into it. */
+        if (bus_socket_arena_mostly_free(bus)) {
+                void *b;
+
+                b = memdup(bus->rbuffer, size);
+                if (!b)
+                        return -ENOMEM;
+
+                r = bus_message_from_malloc(bus,
+                                            b, size,
+                                            bus->fds, bus->n_fds,
+                                            NULL,
+                                            &t);
+                if (r < 0)
+                        free(b);
+        } else
+                r = bus_message_from_arena(bus,
+                                           bus->rarena,
+                                           bus->rbuffer, size,
+                                           bus->fds, bus->n_fds,
+                                           &t);
+        if (r == -EBADMSG)
+                log_debug_errno(r, "Received invalid message from connection %s, dropping.", strna(bus->description));
+        else if (r < 0)
+                return r;
+
+        bus_socket_queue_message(bus, t);
+
+        r = bus_socket_arena_consume(bus, size);
+        if (r < 0)
+                return r;
 
         return 1;
 }
 
+static int bus_socket_make_messages(sd_bus *bus) {
+        size_t need;
+        int r, ret = 0;
+
+        assert(bus);
+
+        /* Turns everything we have read completely into messages */
+
+        for (;;) {
+                r = bus_socket_read_message_need(bus, &need);
+                if (r < 0)
+                        return r;
+
+                if (bus->rbuffer_size < need)
+                        return ret;
+
+                r = bus_socket_make_message(bus, need);
+                if (r < 0)
+                        return r;
+
+                ret = 1;
+        }
+}
+
 int bus_socket_read_message(sd_bus *bus) {
         struct msghdr mh;
         struct iovec iov = {};
         ssize_t k;
-        size_t need;
+        size_t need, size;
         int r;
-        void *b;
         CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(int) * BUS_FDS_MAX)) control;
         bool handle_cmsg = false;
 
@@ -1265,16 +1441,34 @@ int bus_socket_read_message(sd_bus *bus) {
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+        /* If fds are passed on this connection, read exactly one message at a time, so that we know which
+         * message the fds we receive belong to. There's nothing to share then, hence read it into a buffer
+         * of its own that the message takes over. Otherwise, read as much as fits into the arena, in order
+         * to receive multiple messages at once. */
+        if (bus->can_fds) {
+                void *b;
 
-        b = realloc(bus->rbuffer, need);
-        if (!b)
-                return -ENOMEM;
+                if (bus->rbuffer_size >= need)
+                        return bus_socket_make_message_malloc(bus, need);
 
-        bus->rbuffer = b;
+                b = realloc(bus->rbuffer, need);
+                if (!b)
+                        return -ENOMEM;
 
-        iov = IOVEC_MAKE((uint8_t *)bus->rbuffer + bus->rbuffer_size, need - bus->rbuffer_size);
+                bus->rbuffer = b;
+                size = need;
+        } else {
+                r = bus_socket_arena_reserve(bus, need);
+                if (r < 0)
+                        return r;
+
+                if (bus->rbuffer_size >= need)
+                        return bus_socket_make_messages(bus);
+
+                size = bus->rarena->data + bus->rarena->allocated - (uint8_t*) bus->rbuffer;
+        }
+
+        iov = IOVEC_MAKE((uint8_t*) bus->rbuffer + bus->rbuffer_size, size - bus->rbuffer_size);
 
         if (bus->prefer_readv) {
                 k = readv(bus->input_fd, &iov, 1);
@@ -1342,13 +1536,21 @@ int bus_socket_read_message(sd_bus *bus) {
                                           cmsg->cmsg_level, cmsg->cmsg_type);
         }
 
-        r = bus_socket_read_message_need(bus, &need);
+        if (bus->can_fds) {
+                r = bus_socket_read_message_need(bus, &need);
+                if (r < 0)
+                        return r;
+
+                if (bus->rbuffer_size >= need)
+                        return bus_socket_make_message_malloc(bus, need);
+
+                return 1;
+        }
+
+        r = bus_socket_make_messages(bus);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
-
         return 1;
 }
 
@@ -196,7 +196,10 @@ static sd_bus* bus_free(sd_bus *b) {
 
         free(b->label);
         free(b->groups);
-        free(b->rbuffer);
+        if (b->rarena)
+                bus_arena_unref(b->rarena);
+        else
+                free(b->rbuffer);
         free(b->unique_name);
         free(b->auth_buffer);
         free(b->address);
@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <unistd.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "socket-util.h"
+#include "tests.h"
+
+#define N_MESSAGES 2000U
+
+static void connect_pair(bool fds, sd_bus **ret_server, sd_bus **ret_client) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *a = NULL, *b = NULL;
+        int pair[2];
+        sd_id128_t id;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&a) >= 0);
+        assert_se(sd_bus_set_fd(a, pair[0], pair[0]) >= 0);
+        assert_se(sd_bus_set_server(a, true, id) >= 0);
+        assert_se(sd_bus_negotiate_fds(a, fds) >= 0);
+        assert_se(sd_bus_start(a) >= 0);
+
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, pair[1], pair[1]) >= 0);
+        assert_se(sd_bus_negotiate_fds(b, fds) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        while (sd_bus_is_ready(a) <= 0 || sd_bus_is_ready(b) <= 0) {
+                assert_se(sd_bus_process(a, NULL) >= 0);
+                assert_se(sd_bus_process(b, NULL) >= 0);
+        }
+
+        *ret_server = TAKE_PTR(a);
+        *ret_client = TAKE_PTR(b);
+}
+
+static size_t string_size(unsigned i) {
+        return (i * 7) % 97;
+}
+
+static size_t array_size(unsigned i) {
+        /* Every now and then a message that doesn't fit into an arena of the default size */
+        return i % 100 == 99 ? 70000 : i % 13;
+}
+
+static void send_one(sd_bus *bus, bool fds, unsigned i) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_free_ char *s = NULL;
+        _cleanup_free_ uint8_t *a = NULL;
+
+        assert_se(s = malloc(string_size(i) + 1));
+        memset(s, 'a' + i % 26, string_size(i));
+        s[string_size(i)] = 0;
+
+        assert_se(a = malloc(array_size(i) + 1));
+        memset(a, i & 0xff, array_size(i));
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/", "org.freedesktop.systemd.test", "Pipelined") >= 0);
+        assert_se(sd_bus_message_append(m, "us", i, s) >= 0);
+        assert_se(sd_bus_message_append_array(m, 'y', a, array_size(i)) >= 0);
+
+        if (fds) {
+                _cleanup_close_pair_ int p[2] = PIPE_EBADF;
+
+                /* Pass the read side of a pipe that carries the index of the message, so that we can tell
+                 * whether the fds end up with the right message. */
+                assert_se(pipe2(p, O_CLOEXEC) >= 0);
+                assert_se(loop_write(p[1], &i, sizeof(i)) >= 0);
+                assert_se(sd_bus_message_append(m, "h", p[0]) >= 0);
+        }
+
+        assert_se(sd_bus_send(bus, m, NULL) >= 0);
+}
+
+static void check_one(sd_bus_message *m, bool fds, bool read_fd, unsigned i) {
+        const uint8_t *a;
+        const char *s;
+        size_t sz;
+        unsigned j;
+
+        assert_se(sd_bus_message_rewind(m, true) >= 0);
+
+        assert_se(sd_bus_message_read(m, "us", &j, &s) >= 0);
+        assert_se(j == i);
+        assert_se(strlen(s) == string_size(i));
+        for (size_t k = 0; k < string_size(i); k++)
+                assert_se(s[k] == (char) ('a' + i % 26));
+
+        assert_se(sd_bus_message_read_array(m, 'y', (const void**) &a, &sz) >= 0);
+        assert_se(sz == array_size(i));
+        for (size_t k = 0; k < sz; k++)
+                assert_se(a[k] == (i & 0xff));
+
+        if (fds) {
+                int fd;
+
+                assert_se(sd_bus_message_read(m, "h", &fd) >= 0);
+                assert_se(fd >= 0);
+
+                if (read_fd) {
+                        assert_se(loop_read_exact(fd, &j, sizeof(j), false) >= 0);
+                        assert_se(j == i);
+                }
+        }
+
+        assert_se(sd_bus_message_at_end(m, true) > 0);
+}
+
+static void test_pipelined_one(bool fds) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *a = NULL, *b = NULL;
+        sd_bus_message *kept[N_MESSAGES] = {};
+        unsigned n_received = 0;
+
+        log_info("/* %s(fds=%s) */", __func__, yes_no(fds));
+
+        connect_pair(fds, &a, &b);
+
+        /* Queue everything first, so that the receiving side finds many messages in the socket at once */
+        for (unsigned i = 0; i < N_MESSAGES; i++)
+                send_one(b, fds, i);
+
+        while (n_received < N_MESSAGES) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                int r, k;
+
+                r = sd_bus_process(b, NULL);
+                assert_se(r >= 0);
+
+                k = sd_bus_process(a, &m);
+                assert_se(k >= 0);
+
+                if (m) {
+                        check_one(m, fds, /* read_fd= */ true, n_received);
+
+                        /* Keep some of the messages around, so that some arenas cannot be reused */
+                        if (n_received % 3 == 0)
+                                kept[n_received] = TAKE_PTR(m);
+
+                        n_received++;
+                }
+
+                if (r == 0 && k == 0)
+                        assert_se(sd_bus_wait(a, 100 * USEC_PER_MSEC) >= 0);
+        }
+
+        /* The messages we kept must not have been changed by anything received later */
+        for (unsigned i = 0; i < N_MESSAGES; i++) {
+                if (!kept[i])
+                        continue;
+
+                check_one(kept[i], fds, /* read_fd= */ false, i);
+                sd_bus_message_unref(kept[i]);
+        }
+}
+
+static void test_lone_message_one(bool fds) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *a = NULL, *b = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+        log_info("/* %s(fds=%s) */", __func__, yes_no(fds));
+
+        connect_pair(fds, &a, &b);
+
+        /* A message that arrives on its own must not pin an arena. If fds are passed, messages are read
+         * one by one into a buffer of their own in the first place. */
+        send_one(b, fds, 1);
+        assert_se(sd_bus_flush(b) >= 0);
+
+        while (!m) {
+                assert_se(sd_bus_process(a, &m) >= 0);
+                if (!m)
+                        assert_se(sd_bus_wait(a, 100 * USEC_PER_MSEC) >= 0);
+        }
+
+        check_one(m, fds, /* read_fd= */ true, 1);
+        assert_se(!m->arena);
+        assert_se(!a->rarena == fds);
+}
+
+TEST(lone_message) {
+        test_lone_message_one(false);
+        test_lone_message_one(true);
+}
+
+TEST(pipelined) {
+        test_pipelined_one(false);
+}
+
+TEST(pipelined_fds) {
+        test_pipelined_one(true);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
@@ -0,0 +1,314 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "event-offload.h"
+#include "fd-util.h"
+#include "macro.h"
+
+typedef struct OffloadQueue {
+        LIST_HEAD(OffloadJob, head);
+        OffloadJob *tail;
+} OffloadQueue;
+
+struct OffloadPool {
+        pthread_mutex_t mutex;
+        pthread_cond_t work_cond;  /* signalled when a job got queued, or when the workers shall exit */
+        pthread_cond_t done_cond;  /* broadcast whenever a job is done */
+
+        pthread_t *threads;
+        size_t n_threads;
+        unsigned n_idle;
+        unsigned n_queued;
+        unsigned max_threads;
+
+        /* Jobs are taken off 'queued' in the order they were submitted, and end up on 'done' in the order
+         * they completed. Both lists are protected by the mutex. */
+        OffloadQueue queued;
+        OffloadQueue done;
+
+        bool exit;
+
+        int fd; /* worker threads → event loop thread: some jobs are done */
+};
+
+static void offload_queue_append(OffloadQueue *q, OffloadJob *j) {
+        assert(q);
+        assert(j);
+
+        LIST_INSERT_AFTER(jobs, q->head, q->tail, j);
+        q->tail = j;
+}
+
+static void offload_queue_remove(OffloadQueue *q, OffloadJob *j) {
+        assert(q);
+        assert(j);
+
+        if (q->tail == j)
+                q->tail = j->jobs_prev;
+
+        LIST_REMOVE(jobs, q->head, j);
+}
+
+static OffloadJob* offload_queue_pop(OffloadQueue *q) {
+        OffloadJob *j;
+
+        assert(q);
+
+        j = q->head;
+        if (j)
+                offload_queue_remove(q, j);
+
+        return j;
+}
+
+static void* offload_thread(void *userdata) {
+        OffloadPool *p = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "event-offload");
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        for (;;) {
+                OffloadJob *j;
+                int r;
+
+                j = offload_queue_pop(&p->queued);
+                if (j)
+                        p->n_queued--;
+                else {
+                        if (p->exit)
+                                break;
+
+                        p->n_idle++;
+                        assert_se(pthread_cond_wait(&p->work_cond, &p->mutex) == 0);
+                        p->n_idle--;
+                        continue;
+                }
+
+                j->state = OFFLOAD_JOB_RUNNING;
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+                r = j->work(j->userdata);
+
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+                j->result = r;
+                j->state = OFFLOAD_JOB_DONE;
+                offload_queue_append(&p->done, j);
+                assert_se(pthread_cond_broadcast(&p->done_cond) == 0);
+
+                /* This only fails if the counter would overflow, in which case the event loop thread is
+                 * woken up anyway */
+                (void) eventfd_write(p->fd, 1);
+        }
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        return NULL;
+}
+
+static int offload_start_thread(OffloadPool *p) {
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(p);
+
+        if (!GREEDY_REALLOC(p->threads, p->n_threads + 1))
+                return -ENOMEM;
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        /* No signals in the worker threads, please */
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(p->threads + p->n_threads, NULL, offload_thread, p);
+        if (r == 0)
+                p->n_threads++;
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+        if (k > 0)
+                return -k;
+
+        return 0;
+}
+
+unsigned offload_pool_default_max_threads(void) {
+        long n;
+
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n <= 0)
+                return 1;
+
+        return MIN((unsigned long) n, (unsigned long) OFFLOAD_THREADS_MAX);
+}
+
+int offload_pool_new(OffloadPool **ret) {
+        _cleanup_free_ OffloadPool *p = NULL;
+
+        assert(ret);
+
+        p = new(OffloadPool, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (OffloadPool) {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .work_cond = PTHREAD_COND_INITIALIZER,
+                .done_cond = PTHREAD_COND_INITIALIZER,
+                .max_threads = offload_pool_default_max_threads(),
+        };
+
+        p->fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (p->fd < 0)
+                return -errno;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+OffloadPool* offload_pool_free(OffloadPool *p) {
+        if (!p)
+                return NULL;
+
+        /* Jobs still queued are dropped, running ones are finished first */
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        for (OffloadJob *j; (j = offload_queue_pop(&p->queued)); )
+                j->state = OFFLOAD_JOB_IDLE;
+        p->n_queued = 0;
+        p->exit = true;
+        assert_se(pthread_cond_broadcast(&p->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        for (size_t i = 0; i < p->n_threads; i++)
+                (void) pthread_join(p->threads[i], NULL);
+
+        free(p->threads);
+        safe_close(p->fd);
+
+        (void) pthread_cond_destroy(&p->work_cond);
+        (void) pthread_cond_destroy(&p->done_cond);
+        (void) pthread_mutex_destroy(&p->mutex);
+
+        return mfree(p);
+}
+
+OffloadPool* offload_pool_abandon(OffloadPool *p) {
+        if (!p)
+                return NULL;
+
+        /* Releases the resources of a pool inherited via fork(): the worker threads don't exist in the child
+         * process, and the mutex might have been held by one of them, hence don't touch either. */
+        free(p->threads);
+        safe_close(p->fd);
+
+        return mfree(p);
+}
+
+int offload_pool_get_fd(OffloadPool *p) {
+        assert(p);
+
+        /* Becomes readable whenever a job is done. Call offload_pool_flush() and then offload_pool_collect()
+         * until it returns NULL when that happens. */
+        return p->fd;
+}
+
+void offload_pool_set_max_threads(OffloadPool *p, unsigned n) {
+        assert(p);
+
+        /* Threads that are running already are kept around until the pool is freed */
+        p->max_threads = CLAMP(n, 1U, OFFLOAD_THREADS_MAX);
+}
+
+unsigned offload_pool_get_max_threads(OffloadPool *p) {
+        assert(p);
+
+        return p->max_threads;
+}
+
+int offload_pool_submit(OffloadPool *p, OffloadJob *j) {
+        int r = 0;
+
+        assert(p);
+        assert(j);
+        assert(j->work);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        assert(j->state == OFFLOAD_JOB_IDLE);
+
+        /* Start another thread if nobody is around to pick up the job. If that fails we still queue the job
+         * as long as there's at least one thread, it'll get to it eventually. */
+        if (p->n_idle <= p->n_queued && p->n_threads < p->max_threads) {
+                r = offload_start_thread(p);
+                if (r < 0 && p->n_threads > 0)
+                        r = 0;
+        }
+
+        if (r >= 0) {
+                j->state = OFFLOAD_JOB_QUEUED;
+                offload_queue_append(&p->queued, j);
+                p->n_queued++;
+                assert_se(pthread_cond_signal(&p->work_cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        return r;
+}
+
+void offload_pool_cancel(OffloadPool *p, OffloadJob *j) {
+        assert(p);
+        assert(j);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        /* We cannot interrupt a job that is being worked on, hence wait for it to finish */
+        while (j->state == OFFLOAD_JOB_RUNNING)
+                assert_se(pthread_cond_wait(&p->done_cond, &p->mutex) == 0);
+
+        if (j->state == OFFLOAD_JOB_QUEUED) {
+                offload_queue_remove(&p->queued, j);
+                p->n_queued--;
+        } else if (j->state == OFFLOAD_JOB_DONE)
+                offload_queue_remove(&p->done, j);
+
+        j->state = OFFLOAD_JOB_IDLE;
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+}
+
+int offload_pool_flush(OffloadPool *p) {
+        eventfd_t v;
+
+        assert(p);
+
+        if (eventfd_read(p->fd, &v) < 0 && errno != EAGAIN)
+                return -errno;
+
+        return 0;
+}
+
+OffloadJob* offload_pool_collect(OffloadPool *p) {
+        OffloadJob *j;
+
+        assert(p);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        j = offload_queue_pop(&p->done);
+        if (j)
+                j->state = OFFLOAD_JOB_IDLE;
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        return j;
+}
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "list.h"
+#include "macro.h"
+
+/* A pool of worker threads that run jobs off the event loop thread. Jobs are queued by the event loop
+ * thread, and once done they are collected by it again, after it got woken up via the pool's eventfd. */
+
+#define OFFLOAD_THREADS_MAX 64U
+
+typedef struct OffloadPool OffloadPool;
+typedef struct OffloadJob OffloadJob;
+
+typedef enum OffloadJobState {
+        OFFLOAD_JOB_IDLE,       /* not submitted, or collected already */
+        OFFLOAD_JOB_QUEUED,
+        OFFLOAD_JOB_RUNNING,
+        OFFLOAD_JOB_DONE,       /* waiting to be collected */
+} OffloadJobState;
+
+struct OffloadJob {
+        int (*work)(void *userdata);
+        void *userdata;
+        int result;
+
+        /* Protected by the mutex of the pool */
+        OffloadJobState state;
+        LIST_FIELDS(OffloadJob, jobs);
+};
+
+int offload_pool_new(OffloadPool **ret);
+OffloadPool* offload_pool_free(OffloadPool *p);
+OffloadPool* offload_pool_abandon(OffloadPool *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(OffloadPool*, offload_pool_free);
+
+int offload_pool_get_fd(OffloadPool *p);
+void offload_pool_set_max_threads(OffloadPool *p, unsigned n);
+unsigned offload_pool_get_max_threads(OffloadPool *p);
+
+int offload_pool_submit(OffloadPool *p, OffloadJob *j);
+void offload_pool_cancel(OffloadPool *p, OffloadJob *j);
+int offload_pool_flush(OffloadPool *p);
+OffloadJob* offload_pool_collect(OffloadPool *p);
+
+unsigned offload_pool_default_max_threads(void);
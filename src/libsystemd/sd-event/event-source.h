@@ -7,6 +7,8 @@
 
 #include "sd-event.h"
 
+#include "event-offload.h"
+#include "event-timer-wheel.h"
 #include "hashmap.h"
 #include "inotify-util.h"
 #include "list.h"
@@ -28,6 +30,7 @@ typedef enum EventSourceType {
         SOURCE_WATCHDOG,
         SOURCE_INOTIFY,
         SOURCE_MEMORY_PRESSURE,
+        SOURCE_OFFLOAD,
         _SOURCE_EVENT_SOURCE_TYPE_MAX,
         _SOURCE_EVENT_SOURCE_TYPE_INVALID = -EINVAL,
 } EventSourceType;
@@ -70,6 +73,7 @@ struct sd_event_source {
         unsigned prepare_index;
         uint64_t pending_iteration;
         uint64_t prepare_iteration;
+        uint64_t budget_iteration; /* not to be ordered before this iteration, see source_account_dispatch() */
 
         sd_event_destroy_t destroy_callback;
         sd_event_handler_t ratelimit_expire_callback;
@@ -78,6 +82,13 @@ struct sd_event_source {
 
         RateLimit rate_limit;
 
+        /* Accounting, see sd_event_source_get_statistics() */
+        usec_t pending_since;
+        uint64_t n_dispatched;
+        uint64_t n_over_budget;
+        usec_t dispatch_usec, dispatch_max_usec;
+        usec_t pending_usec, pending_max_usec;
+
         /* These are primarily fields relevant for time event sources, but since any event source can
          * effectively become one when rate-limited, this is part of the common fields. */
         unsigned earliest_index;
@@ -89,12 +100,17 @@ struct sd_event_source {
                         int fd;
                         uint32_t events;
                         uint32_t revents;
+                        LIST_FIELDS(sd_event_source, parked);
                         bool registered:1;
                         bool owned:1;
+                        bool oneshot:1;  /* registered with EPOLLONESHOT */
+                        bool disarmed:1; /* … and the kernel reported an event since, hence disabled it */
+                        bool parked:1;   /* disabled, but left in the epoll set, see source_io_unregister() */
                 } io;
                 struct {
                         sd_event_time_handler_t callback;
                         usec_t next, accuracy;
+                        TimerWheelEntry wheel; /* if far enough in the future or disabled, instead of the prioqs */
                 } time;
                 struct {
                         sd_event_signal_handler_t callback;
@@ -141,6 +157,12 @@ struct sd_event_source {
                         bool locked:1;
                         bool in_write_list:1;
                 } memory_pressure;
+                struct {
+                        sd_event_offload_handler_t callback;
+                        OffloadJob job;
+                        bool submitted:1; /* handed to the offload pool, and not collected yet */
+                        bool done:1;      /* collected, but not dispatched yet */
+                } offload;
         };
 };
 
@@ -159,6 +181,12 @@ struct clock_data {
         Prioq *latest;
         usec_t next;
 
+        /* Timer event sources that elapse further in the future, or that are disabled, are kept in the
+         * timer wheel instead, and are only moved to the two prioqs shortly before they elapse. This makes
+         * re-arming and cancelling such timers cheap. The prioqs always have enough room allocated for
+         * all entries of the wheel. */
+        TimerWheel *wheel;
+
         bool needs_rearm:1;
 };
 
@@ -0,0 +1,270 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "event-timer-wheel.h"
+
+#define SLOT_MASK ((uint64_t) TIMER_WHEEL_SLOTS - 1)
+
+struct TimerWheel {
+        /* All ticks up to and including this one have been processed. This runs ahead of the actual time by
+         * TIMER_WHEEL_HORIZON_TICKS. */
+        uint64_t now_tick;
+
+        size_t n_entries;
+        size_t n_parked;
+
+        uint64_t occupied[TIMER_WHEEL_LEVELS]; /* bitmaps of the non-empty slots of each level */
+        TimerWheelEntry *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+        /* Entries that never elapse */
+        LIST_HEAD(TimerWheelEntry, parked);
+};
+
+assert_cc(TIMER_WHEEL_SLOTS == sizeof(uint64_t) * 8);
+
+static uint64_t usec_to_tick(usec_t t) {
+        return t >> TIMER_WHEEL_TICK_SHIFT;
+}
+
+static usec_t tick_to_usec(uint64_t tick) {
+        return (usec_t) tick << TIMER_WHEEL_TICK_SHIFT;
+}
+
+static unsigned level_shift(unsigned level) {
+        return level * TIMER_WHEEL_SLOT_BITS;
+}
+
+static unsigned slot_encode(unsigned level, unsigned idx) {
+        return 1 + level * TIMER_WHEEL_SLOTS + idx;
+}
+
+static void slot_decode(unsigned slot, unsigned *ret_level, unsigned *ret_idx) {
+        assert(slot != TIMER_WHEEL_SLOT_NONE);
+        assert(slot != TIMER_WHEEL_SLOT_PARKED);
+
+        *ret_level = (slot - 1) / TIMER_WHEEL_SLOTS;
+        *ret_idx = (slot - 1) % TIMER_WHEEL_SLOTS;
+}
+
+int timer_wheel_new(usec_t now, TimerWheel **ret) {
+        TimerWheel *w;
+
+        assert(ret);
+
+        w = new0(TimerWheel, 1);
+        if (!w)
+                return -ENOMEM;
+
+        w->now_tick = usec_to_tick(now) + TIMER_WHEEL_HORIZON_TICKS;
+
+        *ret = w;
+        return 0;
+}
+
+TimerWheel* timer_wheel_free(TimerWheel *w) {
+        if (!w)
+                return NULL;
+
+        /* The entries are owned by the caller, who should have removed them already */
+        assert(w->n_entries == 0);
+
+        return mfree(w);
+}
+
+static void timer_wheel_place(TimerWheel *w, TimerWheelEntry *e) {
+        uint64_t delta, tick;
+        unsigned level, idx;
+
+        assert(w);
+        assert(e);
+        assert(e->tick > w->now_tick);
+
+        /* Timers are put on the lowest level whose range covers them, in the slot in which they'll be
+         * processed, i.e. moved down a level, or handed back on the lowest level. */
+        delta = e->tick - w->now_tick;
+        tick = e->tick;
+
+        for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++)
+                if (delta < UINT64_C(1) << level_shift(level + 1))
+                        break;
+
+        /* Beyond the range of the top level? Then put it in the last slot, and look again once we get there */
+        if (delta >= UINT64_C(1) << level_shift(TIMER_WHEEL_LEVELS))
+                tick = w->now_tick + (UINT64_C(1) << level_shift(TIMER_WHEEL_LEVELS)) - 1;
+
+        idx = (tick >> level_shift(level)) & SLOT_MASK;
+
+        LIST_PREPEND(entries, w->slots[level][idx], e);
+        w->occupied[level] |= UINT64_C(1) << idx;
+        e->slot = slot_encode(level, idx);
+}
+
+bool timer_wheel_add(TimerWheel *w, TimerWheelEntry *e, usec_t t) {
+        assert(w);
+        assert(e);
+        assert(!timer_wheel_entry_linked(e));
+
+        if (t == USEC_INFINITY) {
+                LIST_PREPEND(entries, w->parked, e);
+                e->slot = TIMER_WHEEL_SLOT_PARKED;
+                w->n_parked++;
+                w->n_entries++;
+                return true;
+        }
+
+        /* Too close, the caller has to track this one itself */
+        if (usec_to_tick(t) <= w->now_tick)
+                return false;
+
+        e->tick = usec_to_tick(t);
+        timer_wheel_place(w, e);
+        w->n_entries++;
+        return true;
+}
+
+void timer_wheel_remove(TimerWheel *w, TimerWheelEntry *e) {
+        unsigned level, idx;
+
+        assert(w);
+        assert(e);
+
+        if (!timer_wheel_entry_linked(e))
+                return;
+
+        if (e->slot == TIMER_WHEEL_SLOT_PARKED) {
+                LIST_REMOVE(entries, w->parked, e);
+                w->n_parked--;
+        } else {
+                slot_decode(e->slot, &level, &idx);
+
+                LIST_REMOVE(entries, w->slots[level][idx], e);
+                if (!w->slots[level][idx])
+                        w->occupied[level] &= ~(UINT64_C(1) << idx);
+        }
+
+        e->slot = TIMER_WHEEL_SLOT_NONE;
+        w->n_entries--;
+}
+
+static void timer_wheel_process_slot(
+                TimerWheel *w,
+                unsigned level,
+                unsigned idx,
+                timer_wheel_expire_t expire,
+                void *userdata) {
+
+        TimerWheelEntry *list;
+
+        assert(w);
+        assert(level < TIMER_WHEEL_LEVELS);
+        assert(idx < TIMER_WHEEL_SLOTS);
+        assert(expire);
+
+        /* Detach the slot first, entries might be put into the very same slot again */
+        list = TAKE_PTR(w->slots[level][idx]);
+        w->occupied[level] &= ~(UINT64_C(1) << idx);
+
+        for (TimerWheelEntry *e; (e = LIST_POP(entries, list)); ) {
+                e->slot = TIMER_WHEEL_SLOT_NONE;
+
+                if (e->tick > w->now_tick) {
+                        timer_wheel_place(w, e);
+                        continue;
+                }
+
+                w->n_entries--;
+                expire(e, userdata);
+        }
+}
+
+static uint64_t timer_wheel_next_tick(TimerWheel *w) {
+        uint64_t next = UINT64_MAX;
+
+        assert(w);
+
+        /* Returns the next tick at which a non-empty slot is processed */
+
+        for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+                uint64_t block, rotated;
+                unsigned first;
+
+                if (w->occupied[level] == 0)
+                        continue;
+
+                /* The slots are processed in order, starting with the one after the current one, and ending
+                 * with the current one, 64 blocks from now. */
+                block = w->now_tick >> level_shift(level);
+                first = (block + 1) & SLOT_MASK;
+                rotated = first == 0 ? w->occupied[level] :
+                        (w->occupied[level] >> first) | (w->occupied[level] << (TIMER_WHEEL_SLOTS - first));
+
+                next = MIN(next, (block + 1 + (uint64_t) __builtin_ctzll(rotated)) << level_shift(level));
+        }
+
+        return next;
+}
+
+bool timer_wheel_advance(TimerWheel *w, usec_t now, timer_wheel_expire_t expire, void *userdata) {
+        bool changed = false;
+        uint64_t target;
+
+        assert(w);
+        assert(expire);
+
+        target = usec_to_tick(now) + TIMER_WHEEL_HORIZON_TICKS;
+
+        while (w->now_tick < target) {
+                uint64_t next;
+
+                /* Skip ahead to the next tick with anything to do */
+                next = w->n_entries > w->n_parked ? timer_wheel_next_tick(w) : UINT64_MAX;
+                if (next > target) {
+                        w->now_tick = target;
+                        break;
+                }
+
+                assert(next > w->now_tick);
+                w->now_tick = next;
+                changed = true;
+
+                /* Move the entries of the higher levels down first, whenever we reach the start of a slot
+                 * there. Then hand back what's left on the lowest level. */
+                for (unsigned level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+                        if ((next & ((UINT64_C(1) << level_shift(level)) - 1)) != 0)
+                                break;
+
+                        timer_wheel_process_slot(w, level, (next >> level_shift(level)) & SLOT_MASK, expire, userdata);
+                }
+
+                timer_wheel_process_slot(w, 0, next & SLOT_MASK, expire, userdata);
+        }
+
+        /* Returns true if any entries were moved, i.e. if timer_wheel_next() changed */
+        return changed;
+}
+
+bool timer_wheel_next(TimerWheel *w, usec_t *ret_earliest, usec_t *ret_latest) {
+        uint64_t next;
+
+        assert(w);
+        assert(ret_earliest);
+        assert(ret_latest);
+
+        /* Returns the time window in which timer_wheel_advance() should be called next, so that all timers
+         * are handed back in time, i.e. at least a tick before they elapse. */
+
+        if (w->n_entries == w->n_parked)
+                return false;
+
+        next = timer_wheel_next_tick(w);
+        assert(next != UINT64_MAX);
+        assert(next > TIMER_WHEEL_HORIZON_TICKS);
+
+        *ret_earliest = tick_to_usec(next - TIMER_WHEEL_HORIZON_TICKS);
+        *ret_latest = tick_to_usec(next - 1);
+        return true;
+}
+
+size_t timer_wheel_size(TimerWheel *w) {
+        return w ? w->n_entries : 0;
+}
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "list.h"
+#include "macro.h"
+#include "time-util.h"
+
+/* A hierarchical timing wheel, holding timers that elapse some time in the future. Adding and removing a
+ * timer is O(1), regardless of how many timers there are. The wheel does not dispatch timers itself: when
+ * a timer gets close to elapsing (i.e. within TIMER_WHEEL_HORIZON_USEC), it is handed back to the caller
+ * via timer_wheel_advance(), who is expected to track it precisely from then on. Timers that are added while
+ * within that horizon already are refused. This makes the wheel suitable for the common case of timeouts
+ * that are armed, and then almost always cancelled long before they elapse. */
+
+#define TIMER_WHEEL_LEVELS 4U
+#define TIMER_WHEEL_SLOT_BITS 6U
+#define TIMER_WHEEL_SLOTS (1U << TIMER_WHEEL_SLOT_BITS)
+
+/* The granularity of the lowest level, ~1.05s. The wheel hence covers about 203 days, timers further in
+ * the future are kept in the top level, and get re-sorted when that comes around. */
+#define TIMER_WHEEL_TICK_SHIFT 20U
+
+/* Timers are handed back at least this long before they elapse */
+#define TIMER_WHEEL_HORIZON_TICKS 4U
+#define TIMER_WHEEL_HORIZON_USEC ((usec_t) TIMER_WHEEL_HORIZON_TICKS << TIMER_WHEEL_TICK_SHIFT)
+
+#define TIMER_WHEEL_SLOT_NONE 0U
+#define TIMER_WHEEL_SLOT_PARKED UINT_MAX
+
+typedef struct TimerWheel TimerWheel;
+typedef struct TimerWheelEntry TimerWheelEntry;
+
+struct TimerWheelEntry {
+        uint64_t tick;
+        unsigned slot; /* TIMER_WHEEL_SLOT_NONE if not in a wheel, hence zero-initialization is fine */
+        LIST_FIELDS(TimerWheelEntry, entries);
+};
+
+/* Called for each timer that is handed back. It is already removed from the wheel then, and the function
+ * must not modify the wheel itself. */
+typedef void (*timer_wheel_expire_t)(TimerWheelEntry *e, void *userdata);
+
+int timer_wheel_new(usec_t now, TimerWheel **ret);
+TimerWheel* timer_wheel_free(TimerWheel *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(TimerWheel*, timer_wheel_free);
+
+static inline bool timer_wheel_entry_linked(const TimerWheelEntry *e) {
+        return e->slot != TIMER_WHEEL_SLOT_NONE;
+}
+
+bool timer_wheel_add(TimerWheel *w, TimerWheelEntry *e, usec_t t);
+void timer_wheel_remove(TimerWheel *w, TimerWheelEntry *e);
+bool timer_wheel_advance(TimerWheel *w, usec_t now, timer_wheel_expire_t expire, void *userdata);
+bool timer_wheel_next(TimerWheel *w, usec_t *ret_earliest, usec_t *ret_latest);
+size_t timer_wheel_size(TimerWheel *w);
@@ -0,0 +1,653 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <endian.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+#include "alloc-util.h"
+#include "event-uring.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "list.h"
+#include "log.h"
+#include "missing_syscall.h"
+
+/* Multishot polls need the headers of Linux 5.13 or newer */
+#if HAVE_LINUX_IO_URING_H && defined(IORING_POLL_ADD_MULTI)
+
+#define EVENT_URING_ENTRIES 256U
+
+/* Multishot polls were added in Linux 5.13, in the same release as IORING_FEAT_RSRC_TAGS, which is hence
+ * checked for them. Timeouts for io_uring_enter() need Linux 5.11, and completions are never dropped since
+ * Linux 5.5. */
+#define EVENT_URING_FEATURES                    \
+        (IORING_FEAT_SINGLE_MMAP |              \
+         IORING_FEAT_NODROP |                   \
+         IORING_FEAT_POLL_32BITS |              \
+         IORING_FEAT_EXT_ARG |                  \
+         IORING_FEAT_RSRC_TAGS)
+
+typedef struct UringPoll UringPoll;
+typedef struct UringRequest UringRequest;
+
+/* A registered fd, the equivalent of an entry in an epoll set */
+struct UringPoll {
+        int fd;
+        struct epoll_event event;
+        UringRequest *request; /* the poll request currently armed for the fd, if any */
+};
+
+/* A poll request handed to the kernel, freed once its last completion was collected. If the registration it
+ * was made for is modified or removed before that, the request is cancelled, and its 'poll' pointer is
+ * cleared, so that completions of it that are still underway are ignored. */
+struct UringRequest {
+        UringPoll *poll;
+        LIST_FIELDS(UringRequest, requests);
+};
+
+struct EventUring {
+        int fd;
+
+        void *ring; /* the submission and completion rings share one mapping */
+        size_t ring_size;
+        struct io_uring_sqe *sqes;
+        size_t sqes_size;
+
+        unsigned *sq_head, *sq_tail, *sq_flags;
+        unsigned sq_mask, sq_entries;
+        unsigned *cq_head, *cq_tail;
+        unsigned cq_mask;
+        struct io_uring_cqe *cqes;
+
+        unsigned n_queued; /* submission queue entries not handed to the kernel yet */
+
+        Hashmap *polls; /* fd → UringPoll */
+        LIST_HEAD(UringRequest, requests);
+};
+
+static void uring_request_free(EventUring *u, UringRequest *req) {
+        assert(u);
+        assert(req);
+
+        if (req->poll && req->poll->request == req)
+                req->poll->request = NULL;
+
+        LIST_REMOVE(requests, u->requests, req);
+        free(req);
+}
+
+EventUring* event_uring_free(EventUring *u) {
+        if (!u)
+                return NULL;
+
+        /* Requests still armed in the kernel go away along with the ring */
+        while (u->requests)
+                uring_request_free(u, u->requests);
+
+        hashmap_free_free(u->polls);
+
+        if (u->sqes != MAP_FAILED)
+                (void) munmap(u->sqes, u->sqes_size);
+        if (u->ring != MAP_FAILED)
+                (void) munmap(u->ring, u->ring_size);
+
+        safe_close(u->fd);
+
+        return mfree(u);
+}
+
+int event_uring_new(EventUring **ret) {
+        _cleanup_(event_uring_freep) EventUring *u = NULL;
+        struct io_uring_params params = {};
+        unsigned *array;
+
+        assert(ret);
+
+        u = new(EventUring, 1);
+        if (!u)
+                return -ENOMEM;
+
+        *u = (EventUring) {
+                .fd = -EBADF,
+                .ring = MAP_FAILED,
+                .sqes = MAP_FAILED,
+        };
+
+        u->fd = io_uring_setup(EVENT_URING_ENTRIES, &params);
+        if (u->fd < 0)
+                return -errno;
+
+        u->fd = fd_move_above_stdio(u->fd);
+
+        if ((params.features & EVENT_URING_FEATURES) != EVENT_URING_FEATURES)
+                return -EOPNOTSUPP;
+
+        u->ring_size = MAX(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                           params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+        u->ring = mmap(NULL, u->ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+        if (u->ring == MAP_FAILED)
+                return -errno;
+
+        u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        u->sqes = mmap(NULL, u->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+        if (u->sqes == MAP_FAILED)
+                return -errno;
+
+        u->sq_head = (unsigned*) ((uint8_t*) u->ring + params.sq_off.head);
+        u->sq_tail = (unsigned*) ((uint8_t*) u->ring + params.sq_off.tail);
+        u->sq_flags = (unsigned*) ((uint8_t*) u->ring + params.sq_off.flags);
+        u->sq_mask = *(unsigned*) ((uint8_t*) u->ring + params.sq_off.ring_mask);
+        u->sq_entries = params.sq_entries;
+
+        u->cq_head = (unsigned*) ((uint8_t*) u->ring + params.cq_off.head);
+        u->cq_tail = (unsigned*) ((uint8_t*) u->ring + params.cq_off.tail);
+        u->cq_mask = *(unsigned*) ((uint8_t*) u->ring + params.cq_off.ring_mask);
+        u->cqes = (struct io_uring_cqe*) ((uint8_t*) u->ring + params.cq_off.cqes);
+
+        /* Submission queue entries are always used in ring order */
+        array = (unsigned*) ((uint8_t*) u->ring + params.sq_off.array);
+        for (unsigned i = 0; i < params.sq_entries; i++)
+                array[i] = i;
+
+        *ret = TAKE_PTR(u);
+        return 0;
+}
+
+int event_uring_get_fd(EventUring *u) {
+        assert(u);
+
+        return u->fd;
+}
+
+static bool uring_cq_empty(EventUring *u) {
+        assert(u);
+
+        return *u->cq_head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+}
+
+static bool uring_cq_overflow(EventUring *u) {
+        assert(u);
+
+        /* Set if the kernel holds back completions, since the completion ring was full */
+        return FLAGS_SET(__atomic_load_n(u->sq_flags, __ATOMIC_RELAXED), IORING_SQ_CQ_OVERFLOW);
+}
+
+static int uring_enter(EventUring *u, bool wait, usec_t timeout) {
+        struct io_uring_getevents_arg arg = {
+                .sigmask_sz = _NSIG / 8,
+        };
+        struct __kernel_timespec ts;
+        int r;
+
+        assert(u);
+
+        if (wait && timeout != USEC_INFINITY) {
+                ts = (struct __kernel_timespec) {
+                        .tv_sec = timeout / USEC_PER_SEC,
+                        .tv_nsec = (timeout % USEC_PER_SEC) * NSEC_PER_USEC,
+                };
+                arg.ts = PTR_TO_UINT64(&ts);
+        }
+
+        r = io_uring_enter(u->fd, u->n_queued, wait, IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        if (r < 0)
+                return -errno;
+
+        /* The kernel stops at the first entry it fails to submit, the rest stays queued */
+        u->n_queued -= MIN((unsigned) r, u->n_queued);
+        return 0;
+}
+
+int event_uring_submit(EventUring *u) {
+        int r;
+
+        assert(u);
+
+        while (u->n_queued > 0) {
+                unsigned n = u->n_queued;
+
+                r = uring_enter(u, /* wait= */ false, USEC_INFINITY);
+                if (r < 0)
+                        return r;
+                if (u->n_queued == n)
+                        return -EIO;
+        }
+
+        return 0;
+}
+
+static int uring_queue(EventUring *u, const struct io_uring_sqe *sqe) {
+        unsigned tail;
+        int r;
+
+        assert(u);
+        assert(sqe);
+
+        tail = *u->sq_tail;
+        if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+                /* The submission ring is full, hand what we have to the kernel first */
+                r = event_uring_submit(u);
+                if (r < 0)
+                        return r;
+        }
+
+        u->sqes[tail & u->sq_mask] = *sqe;
+        __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+        u->n_queued++;
+
+        return 0;
+}
+
+static uint32_t uring_poll_events(uint32_t events) {
+        /* The kernel reports errors and hangups anyway, and learns about one-shot and edge-triggered
+         * registrations from the kind of poll request they get. */
+        events &= ~(EPOLLET|EPOLLONESHOT|EPOLLEXCLUSIVE|EPOLLWAKEUP);
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+        /* The kernel expects the two halves of the mask swapped on big endian */
+        events = events << 16 | events >> 16;
+#endif
+
+        return events;
+}
+
+static bool uring_poll_multishot(const UringPoll *p) {
+        assert(p);
+
+        /* Edge-triggered registrations are served by a single multishot poll, which reports each wakeup
+         * of the fd. Everything else gets single-shot polls, see uring_poll_rearm(). */
+        return FLAGS_SET(p->event.events, EPOLLET) && !FLAGS_SET(p->event.events, EPOLLONESHOT);
+}
+
+static int uring_poll_arm(EventUring *u, UringPoll *p, bool multishot) {
+        UringRequest *req;
+        int r;
+
+        assert(u);
+        assert(p);
+        assert(!p->request);
+
+        req = new(UringRequest, 1);
+        if (!req)
+                return -ENOMEM;
+
+        *req = (UringRequest) {
+                .poll = p,
+        };
+
+        r = uring_queue(u, &(const struct io_uring_sqe) {
+                        .opcode = IORING_OP_POLL_ADD,
+                        .fd = p->fd,
+                        .poll32_events = uring_poll_events(p->event.events),
+                        .len = multishot ? IORING_POLL_ADD_MULTI : 0,
+                        .user_data = PTR_TO_UINT64(req),
+                });
+        if (r < 0) {
+                free(req);
+                return r;
+        }
+
+        LIST_PREPEND(requests, u->requests, req);
+        p->request = req;
+
+        return 0;
+}
+
+static void uring_poll_detach(UringPoll *p) {
+        assert(p);
+
+        if (!p->request)
+                return;
+
+        p->request->poll = NULL;
+        p->request = NULL;
+}
+
+static int uring_poll_disarm(EventUring *u, UringPoll *p) {
+        uint64_t user_data;
+
+        assert(u);
+        assert(p);
+
+        if (!p->request)
+                return 0;
+
+        /* Completions of the request that are still underway are ignored from now on, even if it can't be
+         * cancelled. */
+        user_data = PTR_TO_UINT64(p->request);
+        uring_poll_detach(p);
+
+        return uring_queue(u, &(const struct io_uring_sqe) {
+                        .opcode = IORING_OP_POLL_REMOVE,
+                        .fd = -EBADF,
+                        .addr = user_data,
+                        .user_data = 0, /* results of cancellations are ignored */
+                });
+}
+
+static int uring_poll_rearm(EventUring *u, UringPoll *p) {
+        int r;
+
+        assert(u);
+        assert(p);
+
+        if (uring_poll_multishot(p)) {
+                /* The kernel may end multishot polls, e.g. if it couldn't post a completion. Arm it anew
+                 * then. */
+                if (p->request)
+                        return 0;
+
+                return uring_poll_arm(u, p, /* multishot= */ true);
+        }
+
+        /* The initial poll of any registration is a multishot one, see uring_poll_add(). Other than for
+         * edge-triggered registrations it has to go with the first event. */
+        r = uring_poll_disarm(u, p);
+        if (r < 0)
+                return r;
+
+        if (FLAGS_SET(p->event.events, EPOLLONESHOT))
+                return 0;
+
+        /* Level-triggered registrations get a new single-shot poll after each event. It's only submitted
+         * with the next event_uring_wait(), i.e. after the event was dispatched. If the fd is still ready
+         * by then, the poll completes right away, and the event is reported again, as epoll does it. */
+        return uring_poll_arm(u, p, /* multishot= */ false);
+}
+
+static int uring_request_peek(EventUring *u, UringRequest *req) {
+        unsigned head, tail;
+
+        assert(u);
+        assert(req);
+
+        /* Looks for a completion of the request that is queued already, without collecting it */
+
+        head = *u->cq_head;
+        tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++) {
+                const struct io_uring_cqe *cqe = u->cqes + (head & u->cq_mask);
+
+                if (cqe->user_data != PTR_TO_UINT64(req))
+                        continue;
+
+                if (cqe->res < 0)
+                        return cqe->res;
+
+                /* A multishot poll that ended right away: the fd doesn't support polling */
+                if (!FLAGS_SET(cqe->flags, IORING_CQE_F_MORE))
+                        return -EPERM;
+        }
+
+        return 0;
+}
+
+static int uring_poll_add(EventUring *u, int fd, const struct epoll_event *ev) {
+        _cleanup_free_ UringPoll *p = NULL;
+        int r;
+
+        assert(u);
+        assert(fd >= 0);
+        assert(ev);
+
+        p = new(UringPoll, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (UringPoll) {
+                .fd = fd,
+                .event = *ev,
+        };
+
+        r = hashmap_ensure_put(&u->polls, NULL, FD_TO_PTR(fd), p);
+        if (r < 0)
+                return r;
+
+        /* Start with a multishot poll in any case, and submit it right away, so that errors are reported
+         * to the caller, as epoll_ctl() does. Fds that don't support polling are refused with EPERM like
+         * there: the kernel completes a multishot poll for them immediately, rather than keeping it armed. */
+        r = uring_poll_arm(u, p, /* multishot= */ true);
+        if (r >= 0)
+                r = event_uring_submit(u);
+        if (r >= 0) {
+                r = uring_request_peek(u, p->request);
+                if (r < 0)
+                        /* The request is done already, there's nothing to cancel */
+                        uring_poll_detach(p);
+        }
+        if (r < 0) {
+                (void) uring_poll_disarm(u, p);
+                assert_se(hashmap_remove(u->polls, FD_TO_PTR(fd)) == p);
+                return r;
+        }
+
+        TAKE_PTR(p);
+        return 0;
+}
+
+int event_uring_ctl(EventUring *u, int op, int fd, const struct epoll_event *ev) {
+        UringPoll *p;
+        bool armed;
+        int r;
+
+        assert(u);
+        assert(ev || op == EPOLL_CTL_DEL);
+
+        if (fd < 0)
+                return -EBADF;
+
+        p = hashmap_get(u->polls, FD_TO_PTR(fd));
+
+        switch (op) {
+
+        case EPOLL_CTL_ADD:
+                if (p)
+                        return -EEXIST;
+
+                return uring_poll_add(u, fd, ev);
+
+        case EPOLL_CTL_MOD:
+                if (!p)
+                        return -ENOENT;
+
+                r = uring_poll_disarm(u, p);
+                if (r < 0)
+                        return r;
+
+                p->event = *ev;
+
+                return uring_poll_arm(u, p, uring_poll_multishot(p));
+
+        case EPOLL_CTL_DEL:
+                if (!p)
+                        return -ENOENT;
+
+                armed = p->request;
+                r = uring_poll_disarm(u, p);
+
+                assert_se(hashmap_remove(u->polls, FD_TO_PTR(fd)) == p);
+                free(p);
+
+                if (r < 0 || !armed)
+                        return r;
+
+                /* An armed poll holds a reference to the file. The caller might close the fd next, and
+                 * expect the file to be released then, as with epoll. Hence submit the cancellation right
+                 * away. */
+                return event_uring_submit(u);
+
+        default:
+                return -EINVAL;
+        }
+}
+
+static int uring_reap(EventUring *u, struct epoll_event *events, size_t n_events, size_t *n) {
+        unsigned head, tail;
+        int r = 0;
+
+        assert(u);
+        assert(events);
+        assert(n);
+
+        head = *u->cq_head;
+        tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail && *n < n_events && r >= 0; head++) {
+                const struct io_uring_cqe *cqe = u->cqes + (head & u->cq_mask);
+                UringRequest *req = UINT64_TO_PTR(cqe->user_data);
+                UringPoll *p;
+
+                if (!req) /* a cancellation */
+                        continue;
+
+                p = req->poll;
+                if (!FLAGS_SET(cqe->flags, IORING_CQE_F_MORE))
+                        uring_request_free(u, req);
+                if (!p) /* cancelled already */
+                        continue;
+
+                if (cqe->res < 0) {
+                        /* This happens if the fd got closed before a poll request for it was submitted.
+                         * epoll would have forgotten about the fd then, hence don't arm it again. */
+                        log_debug_errno(cqe->res, "Failed to poll fd %i via io_uring, ignoring: %m", p->fd);
+                        continue;
+                }
+
+                events[(*n)++] = (struct epoll_event) {
+                        .events = (uint32_t) cqe->res,
+                        .data = p->event.data,
+                };
+
+                r = uring_poll_rearm(u, p);
+        }
+
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+        return r;
+}
+
+int event_uring_flush(EventUring *u) {
+        unsigned head, tail;
+        int r;
+
+        assert(u);
+
+        r = event_uring_submit(u);
+        if (r < 0)
+                return r;
+
+        /* The ring fd polls readable as long as there are completions in the ring, including those that
+         * don't carry any event. Drop them as far as possible, so that an outer loop isn't woken up for
+         * nothing. */
+
+        head = *u->cq_head;
+        tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++) {
+                const struct io_uring_cqe *cqe = u->cqes + (head & u->cq_mask);
+                UringRequest *req = UINT64_TO_PTR(cqe->user_data);
+
+                if (req) {
+                        if (req->poll)
+                                break;
+
+                        if (!FLAGS_SET(cqe->flags, IORING_CQE_F_MORE))
+                                uring_request_free(u, req);
+                }
+        }
+
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+        return 0;
+}
+
+int event_uring_wait(EventUring *u, struct epoll_event *events, size_t n_events, usec_t timeout) {
+        usec_t until = USEC_INFINITY;
+        size_t n = 0;
+        int r;
+
+        assert(u);
+        assert(events);
+        assert(n_events > 0);
+
+        if (!IN_SET(timeout, 0, USEC_INFINITY))
+                until = usec_add(now(CLOCK_MONOTONIC), timeout);
+
+        for (;;) {
+                bool wait = timeout > 0 && uring_cq_empty(u), timed_out = false;
+
+                /* Completions that are queued already are collected without a syscall, unless there are
+                 * changes to submit first. */
+                if (wait || u->n_queued > 0 || uring_cq_overflow(u)) {
+                        r = uring_enter(u, wait, timeout);
+                        if (r == -ETIME)
+                                timed_out = true;
+                        else if (r < 0)
+                                return r;
+                        else if (wait && uring_cq_empty(u)) {
+                                /* If io_uring_enter() submitted anything, it reports that instead of a
+                                 * timeout or an interruption by a signal. Tell them apart here. */
+                                if (until != USEC_INFINITY && now(CLOCK_MONOTONIC) >= until)
+                                        timed_out = true;
+                                else
+                                        return -EINTR;
+                        }
+                }
+
+                r = uring_reap(u, events, n_events, &n);
+                if (r < 0)
+                        return r;
+
+                if (n > 0 || timeout == 0 || timed_out)
+                        return (int) n;
+
+                /* Only completions of cancelled requests came in, wait for the remaining time */
+                if (until != USEC_INFINITY) {
+                        usec_t k = now(CLOCK_MONOTONIC);
+
+                        if (k >= until)
+                                return 0;
+
+                        timeout = until - k;
+                }
+        }
+}
+
+#else
+
+int event_uring_new(EventUring **ret) {
+        return -EOPNOTSUPP;
+}
+
+EventUring* event_uring_free(EventUring *u) {
+        assert(!u);
+        return NULL;
+}
+
+int event_uring_get_fd(EventUring *u) {
+        assert_not_reached();
+}
+
+int event_uring_ctl(EventUring *u, int op, int fd, const struct epoll_event *ev) {
+        assert_not_reached();
+}
+
+int event_uring_submit(EventUring *u) {
+        assert_not_reached();
+}
+
+int event_uring_flush(EventUring *u) {
+        assert_not_reached();
+}
+
+int event_uring_wait(EventUring *u, struct epoll_event *events, size_t n_events, usec_t timeout) {
+        assert_not_reached();
+}
+
+#endif
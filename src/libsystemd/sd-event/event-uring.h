@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <sys/epoll.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+/* An io_uring based replacement for the epoll set of an event loop. Fds are registered with the same
+ * operations and flags as with epoll_ctl(), and events are collected in struct epoll_event form, so that
+ * the event loop can use either. Changes to registrations are queued in the submission ring, and handed to
+ * the kernel in one go with the next event_uring_wait(). */
+
+typedef struct EventUring EventUring;
+
+int event_uring_new(EventUring **ret);
+EventUring* event_uring_free(EventUring *u);
+DEFINE_TRIVIAL_CLEANUP_FUNC(EventUring*, event_uring_free);
+
+int event_uring_get_fd(EventUring *u);
+
+int event_uring_ctl(EventUring *u, int op, int fd, const struct epoll_event *ev);
+int event_uring_submit(EventUring *u);
+int event_uring_flush(EventUring *u);
+int event_uring_wait(EventUring *u, struct epoll_event *events, size_t n_events, usec_t timeout);
@@ -146,3 +146,26 @@ int event_add_time_change(sd_event *e, sd_event_source **ret, sd_event_io_handle
 
         return 0;
 }
+
+int event_source_add_statistics(sd_event_source *s, EventSourceStatistics *stats) {
+        EventSourceStatistics t;
+        int r;
+
+        assert(s);
+        assert(stats);
+
+        /* Adds up the statistics of multiple event sources serving the same purpose */
+
+        r = sd_event_source_get_statistics(s, &t.n_dispatched, &t.dispatch_usec, &t.dispatch_max_usec,
+                                           &t.pending_usec, &t.pending_max_usec);
+        if (r < 0)
+                return r;
+
+        stats->n_dispatched += t.n_dispatched;
+        stats->dispatch_usec = usec_add(stats->dispatch_usec, t.dispatch_usec);
+        stats->dispatch_max_usec = MAX(stats->dispatch_max_usec, t.dispatch_max_usec);
+        stats->pending_usec = usec_add(stats->pending_usec, t.pending_usec);
+        stats->pending_max_usec = MAX(stats->pending_max_usec, t.pending_max_usec);
+
+        return 0;
+}
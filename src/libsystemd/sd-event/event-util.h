@@ -5,6 +5,8 @@
 
 #include "sd-event.h"
 
+#include "time-util.h"
+
 int event_reset_time(
                 sd_event *e,
                 sd_event_source **s,
@@ -32,3 +34,11 @@ static inline int event_source_disable(sd_event_source *s) {
 }
 
 int event_add_time_change(sd_event *e, sd_event_source **ret, sd_event_io_handler_t callback, void *userdata);
+
+typedef struct EventSourceStatistics {
+        uint64_t n_dispatched;
+        usec_t dispatch_usec, dispatch_max_usec;
+        usec_t pending_usec, pending_max_usec;
+} EventSourceStatistics;
+
+int event_source_add_statistics(sd_event_source *s, EventSourceStatistics *stats);
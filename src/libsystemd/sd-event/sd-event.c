@@ -12,6 +12,7 @@
 #include "alloc-util.h"
 #include "env-util.h"
 #include "event-source.h"
+#include "event-uring.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "glyph-util.h"
@@ -33,6 +34,7 @@
 #include "set.h"
 #include "signal-util.h"
 #include "socket-util.h"
+#include "sort-util.h"
 #include "stat-util.h"
 #include "string-table.h"
 #include "string-util.h"
@@ -74,6 +76,7 @@ static const char* const event_source_type_table[_SOURCE_EVENT_SOURCE_TYPE_MAX]
         [SOURCE_WATCHDOG]            = "watchdog",
         [SOURCE_INOTIFY]             = "inotify",
         [SOURCE_MEMORY_PRESSURE]     = "memory-pressure",
+        [SOURCE_OFFLOAD]             = "offload",
 };
 
 DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(event_source_type, int);
@@ -110,6 +113,9 @@ struct sd_event {
         int epoll_fd;
         int watchdog_fd;
 
+        /* Used instead of the epoll fd, if the io_uring backend is selected */
+        EventUring *uring;
+
         Prioq *pending;
         Prioq *prepare;
 
@@ -145,6 +151,9 @@ struct sd_event {
         /* A list of memory pressure event sources that still need their subscription string written */
         LIST_HEAD(sd_event_source, memory_pressure_write_list);
 
+        /* A list of disabled IO event sources that are still in the epoll set */
+        LIST_HEAD(sd_event_source, io_parked_list);
+
         uint64_t origin_id;
 
         uint64_t iteration;
@@ -155,6 +164,7 @@ struct sd_event {
         bool need_process_child:1;
         bool watchdog:1;
         bool profile_delays:1;
+        bool fd_exported:1;
 
         int exit_code;
 
@@ -173,6 +183,12 @@ struct sd_event {
 
         usec_t last_run_usec, last_log_usec;
         unsigned delays[sizeof(usec_t) * 8];
+
+        usec_t dispatch_budget;
+
+        /* Worker threads for offload event sources, allocated on first use */
+        OffloadPool *offload_pool;
+        unsigned offload_threads;
 };
 
 DEFINE_PRIVATE_ORIGIN_ID_HELPERS(sd_event, event);
@@ -336,6 +352,7 @@ static void free_clock_data(struct clock_data *d) {
         safe_close(d->fd);
         prioq_free(d->earliest);
         prioq_free(d->latest);
+        timer_wheel_free(d->wheel);
 }
 
 static sd_event *event_free(sd_event *e) {
@@ -354,10 +371,17 @@ static sd_event *event_free(sd_event *e) {
 
         assert(e->n_sources == 0);
 
+        /* After a fork() the worker threads are gone, and the pool's mutex might be held by one of them */
+        if (event_origin_changed(e))
+                e->offload_pool = offload_pool_abandon(e->offload_pool);
+        else
+                e->offload_pool = offload_pool_free(e->offload_pool);
+
         if (e->default_event_ptr)
                 *(e->default_event_ptr) = NULL;
 
         safe_close(e->epoll_fd);
+        event_uring_free(e->uring);
         safe_close(e->watchdog_fd);
 
         free_clock_data(&e->realtime);
@@ -383,6 +407,43 @@ static sd_event *event_free(sd_event *e) {
         return mfree(e);
 }
 
+static const char* const event_backend_table[] = {
+        [SD_EVENT_BACKEND_EPOLL]    = "epoll",
+        [SD_EVENT_BACKEND_IO_URING] = "io_uring",
+};
+
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP_FROM_STRING(event_backend, int);
+
+static int event_setup_backend(sd_event *e, int backend) {
+        int r;
+
+        assert(e);
+
+        if (backend == SD_EVENT_BACKEND_IO_URING) {
+                _cleanup_(event_uring_freep) EventUring *u = NULL;
+
+                r = event_uring_new(&u);
+                if (r < 0)
+                        return r;
+
+                e->epoll_fd = safe_close(e->epoll_fd);
+                event_uring_free(e->uring);
+                e->uring = TAKE_PTR(u);
+        } else {
+                _cleanup_close_ int fd = -EBADF;
+
+                fd = epoll_create1(EPOLL_CLOEXEC);
+                if (fd < 0)
+                        return -errno;
+
+                e->uring = event_uring_free(e->uring);
+                safe_close(e->epoll_fd);
+                e->epoll_fd = fd_move_above_stdio(TAKE_FD(fd));
+        }
+
+        return 0;
+}
+
 _public_ int sd_event_new(sd_event** ret) {
         sd_event *e;
         int r;
@@ -420,13 +481,23 @@ _public_ int sd_event_new(sd_event** ret) {
         if (r < 0)
                 goto fail;
 
-        e->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
-        if (e->epoll_fd < 0) {
-                r = -errno;
-                goto fail;
+        const char *backend = secure_getenv("SD_EVENT_BACKEND");
+        if (backend) {
+                r = event_backend_from_string(backend);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to parse $SD_EVENT_BACKEND, ignoring: %s", backend);
+                else if (r == SD_EVENT_BACKEND_IO_URING) {
+                        r = event_setup_backend(e, SD_EVENT_BACKEND_IO_URING);
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to set up io_uring for event loop, falling back to epoll: %m");
+                }
         }
 
-        e->epoll_fd = fd_move_above_stdio(e->epoll_fd);
+        if (!e->uring) {
+                r = event_setup_backend(e, SD_EVENT_BACKEND_EPOLL);
+                if (r < 0)
+                        goto fail;
+        }
 
         if (secure_getenv("SD_EVENT_PROFILE_DELAYS")) {
                 log_debug("Event loop profiling enabled. Logarithmic histogram of event loop iterations in the range 2^0 %s 2^63 us will be logged every 5s.",
@@ -434,6 +505,15 @@ _public_ int sd_event_new(sd_event** ret) {
                 e->profile_delays = true;
         }
 
+        const char *budget = secure_getenv("SD_EVENT_DISPATCH_BUDGET");
+        if (budget) {
+                r = parse_sec(budget, &e->dispatch_budget);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to parse $SD_EVENT_DISPATCH_BUDGET, ignoring: %s", budget);
+                else if (e->dispatch_budget == USEC_INFINITY)
+                        e->dispatch_budget = 0;
+        }
+
         *ret = e;
         return 0;
 
@@ -476,7 +556,39 @@ _public_ sd_event_source* sd_event_source_disable_unref(sd_event_source *s) {
         return sd_event_source_unref(s);
 }
 
-static void source_io_unregister(sd_event_source *s) {
+static int event_poll_ctl(sd_event *e, int op, int fd, struct epoll_event *ev) {
+        assert(e);
+
+        if (e->uring)
+                return event_uring_ctl(e->uring, op, fd, ev);
+
+        return RET_NERRNO(epoll_ctl(e->epoll_fd, op, fd, ev));
+}
+
+static uint32_t event_drained_fd_events(sd_event *e) {
+        assert(e);
+
+        /* Timerfds and the eventfd of the offload pool are read until they are drained whenever they are
+         * reported. With io_uring they are hence watched edge-triggered, which takes a single multishot poll
+         * request rather than a new one after each event. */
+        return EPOLLIN | (e->uring ? EPOLLET : 0);
+}
+
+static void source_io_remove_from_parked_list(sd_event_source *s) {
+        assert(s);
+        assert(s->type == SOURCE_IO);
+
+        if (!s->io.parked)
+                return;
+
+        LIST_REMOVE(io.parked, s->event->io_parked_list, s);
+        s->io.parked = false;
+}
+
+static void source_io_unregister(sd_event_source *s, bool park) {
+        bool was_parked;
+        int r;
+
         assert(s);
         assert(s->type == SOURCE_IO);
 
@@ -486,11 +598,39 @@ static void source_io_unregister(sd_event_source *s) {
         if (!s->io.registered)
                 return;
 
-        if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->io.fd, NULL) < 0)
-                log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
+        /* Once an EPOLLONESHOT registration fired, the kernel won't report any further events for the fd
+         * until it is re-armed. If such a source is merely disabled, leave it in the epoll set hence: one-shot
+         * sources are usually re-enabled right away, and then a single EPOLL_CTL_MOD suffices, instead of
+         * EPOLL_CTL_DEL followed by EPOLL_CTL_ADD. */
+        if (park && s->io.disarmed) {
+                if (!s->io.parked) {
+                        LIST_PREPEND(io.parked, s->event->io_parked_list, s);
+                        s->io.parked = true;
+                }
+                return;
+        }
+
+        was_parked = s->io.parked;
+        source_io_remove_from_parked_list(s);
+
+        /* The fd of a parked source might have been closed already, which is fine */
+        r = event_poll_ctl(s->event, EPOLL_CTL_DEL, s->io.fd, NULL);
+        if (r < 0 && !(was_parked && IN_SET(r, -EBADF, -ENOENT)))
+                log_debug_errno(r, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
                                 strna(s->description), event_source_type_to_string(s->type));
 
-        s->io.registered = false;
+        s->io.registered = s->io.oneshot = s->io.disarmed = false;
+}
+
+static void event_unpark_io_sources(sd_event *e) {
+        assert(e);
+
+        /* The fd of a parked source might have been closed, and its number reused for an fd that is about to
+         * be added to the epoll set. Hence remove parked sources for good before adding anything, so that
+         * the EPOLL_CTL_DEL for them can't hit the new fd later on. */
+
+        LIST_FOREACH(io.parked, s, e->io_parked_list)
+                source_io_unregister(s, /* park= */ false);
 }
 
 static int source_io_register(
@@ -498,6 +638,8 @@ static int source_io_register(
                 int enabled,
                 uint32_t events) {
 
+        int r;
+
         assert(s);
         assert(s->type == SOURCE_IO);
         assert(enabled != SD_EVENT_OFF);
@@ -507,17 +649,39 @@ static int source_io_register(
                 .data.ptr = s,
         };
 
-        if (epoll_ctl(s->event->epoll_fd,
-                      s->io.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-                      s->io.fd, &ev) < 0)
-                return -errno;
+        if (s->io.parked) {
+                source_io_remove_from_parked_list(s);
+
+                /* If the fd was closed and its number reused meanwhile, add it from scratch below */
+                r = event_poll_ctl(s->event, EPOLL_CTL_MOD, s->io.fd, &ev);
+                if (r == -ENOENT)
+                        s->io.registered = false;
+                else if (r < 0)
+                        return r;
+        } else if (s->io.registered) {
+                r = event_poll_ctl(s->event, EPOLL_CTL_MOD, s->io.fd, &ev);
+                if (r < 0)
+                        return r;
+        }
+
+        if (!s->io.registered) {
+                event_unpark_io_sources(s->event);
+
+                r = event_poll_ctl(s->event, EPOLL_CTL_ADD, s->io.fd, &ev);
+                if (r < 0)
+                        return r;
+        }
 
         s->io.registered = true;
+        s->io.oneshot = enabled == SD_EVENT_ONESHOT;
+        s->io.disarmed = false;
 
         return 0;
 }
 
 static void source_child_pidfd_unregister(sd_event_source *s) {
+        int r;
+
         assert(s);
         assert(s->type == SOURCE_CHILD);
 
@@ -527,15 +691,19 @@ static void source_child_pidfd_unregister(sd_event_source *s) {
         if (!s->child.registered)
                 return;
 
-        if (EVENT_SOURCE_WATCH_PIDFD(s))
-                if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->child.pidfd, NULL) < 0)
-                        log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
+        if (EVENT_SOURCE_WATCH_PIDFD(s)) {
+                r = event_poll_ctl(s->event, EPOLL_CTL_DEL, s->child.pidfd, NULL);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
                                         strna(s->description), event_source_type_to_string(s->type));
+        }
 
         s->child.registered = false;
 }
 
 static int source_child_pidfd_register(sd_event_source *s, int enabled) {
+        int r;
+
         assert(s);
         assert(s->type == SOURCE_CHILD);
         assert(enabled != SD_EVENT_OFF);
@@ -546,10 +714,14 @@ static int source_child_pidfd_register(sd_event_source *s, int enabled) {
                         .data.ptr = s,
                 };
 
-                if (epoll_ctl(s->event->epoll_fd,
-                              s->child.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-                              s->child.pidfd, &ev) < 0)
-                        return -errno;
+                if (!s->child.registered)
+                        event_unpark_io_sources(s->event);
+
+                r = event_poll_ctl(s->event,
+                                   s->child.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                                   s->child.pidfd, &ev);
+                if (r < 0)
+                        return r;
         }
 
         s->child.registered = true;
@@ -557,6 +729,8 @@ static int source_child_pidfd_register(sd_event_source *s, int enabled) {
 }
 
 static void source_memory_pressure_unregister(sd_event_source *s) {
+        int r;
+
         assert(s);
         assert(s->type == SOURCE_MEMORY_PRESSURE);
 
@@ -566,14 +740,17 @@ static void source_memory_pressure_unregister(sd_event_source *s) {
         if (!s->memory_pressure.registered)
                 return;
 
-        if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->memory_pressure.fd, NULL) < 0)
-                log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
+        r = event_poll_ctl(s->event, EPOLL_CTL_DEL, s->memory_pressure.fd, NULL);
+        if (r < 0)
+                log_debug_errno(r, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
                                 strna(s->description), event_source_type_to_string(s->type));
 
         s->memory_pressure.registered = false;
 }
 
 static int source_memory_pressure_register(sd_event_source *s, int enabled) {
+        int r;
+
         assert(s);
         assert(s->type == SOURCE_MEMORY_PRESSURE);
         assert(enabled != SD_EVENT_OFF);
@@ -584,10 +761,14 @@ static int source_memory_pressure_register(sd_event_source *s, int enabled) {
                 .data.ptr = s,
         };
 
-        if (epoll_ctl(s->event->epoll_fd,
-                      s->memory_pressure.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-                      s->memory_pressure.fd, &ev) < 0)
-                return -errno;
+        if (!s->memory_pressure.registered)
+                event_unpark_io_sources(s->event);
+
+        r = event_poll_ctl(s->event,
+                           s->memory_pressure.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                           s->memory_pressure.fd, &ev);
+        if (r < 0)
+                return r;
 
         s->memory_pressure.registered = true;
         return 0;
@@ -615,6 +796,62 @@ static void source_memory_pressure_remove_from_write_list(sd_event_source *s) {
         s->memory_pressure.in_write_list = false;
 }
 
+static int event_setup_offload_pool(sd_event *e) {
+        _cleanup_(offload_pool_freep) OffloadPool *p = NULL;
+        int r;
+
+        assert(e);
+
+        if (e->offload_pool)
+                return 0;
+
+        r = offload_pool_new(&p);
+        if (r < 0)
+                return r;
+
+        if (e->offload_threads > 0)
+                offload_pool_set_max_threads(p, e->offload_threads);
+
+        struct epoll_event ev = {
+                .events = event_drained_fd_events(e),
+                .data.ptr = INT_TO_PTR(SOURCE_OFFLOAD),
+        };
+
+        event_unpark_io_sources(e);
+
+        r = event_poll_ctl(e, EPOLL_CTL_ADD, offload_pool_get_fd(p), &ev);
+        if (r < 0)
+                return r;
+
+        e->offload_pool = TAKE_PTR(p);
+        return 0;
+}
+
+static int source_offload_submit(sd_event_source *s) {
+        int r;
+
+        assert(s);
+        assert(s->type == SOURCE_OFFLOAD);
+
+        if (s->offload.submitted || s->offload.done)
+                return 0;
+
+        r = event_setup_offload_pool(s->event);
+        if (r < 0)
+                return r;
+
+        /* The worker thread gets its own copy of the userdata pointer, so that the event loop thread may
+         * change the source's userdata while the work is running */
+        s->offload.job.userdata = s->userdata;
+
+        r = offload_pool_submit(s->event->offload_pool, &s->offload.job);
+        if (r < 0)
+                return r;
+
+        s->offload.submitted = true;
+        return 0;
+}
+
 static clockid_t event_source_type_to_clock(EventSourceType t) {
 
         switch (t) {
@@ -695,6 +932,11 @@ static void event_free_signal_data(sd_event *e, struct signal_data *d) {
                 return;
 
         hashmap_remove(e->signal_data, &d->priority);
+
+        /* Don't rely on close() to remove the fd from the backend: armed io_uring polls keep the file open */
+        if (d->fd >= 0 && !event_origin_changed(e))
+                (void) event_poll_ctl(e, EPOLL_CTL_DEL, d->fd, NULL);
+
         safe_close(d->fd);
         free(d);
 }
@@ -773,10 +1015,11 @@ static int event_make_signal_data(
                 .data.ptr = d,
         };
 
-        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, d->fd, &ev) < 0) {
-                r = -errno;
+        event_unpark_io_sources(e);
+
+        r = event_poll_ctl(e, EPOLL_CTL_ADD, d->fd, &ev);
+        if (r < 0)
                 goto fail;
-        }
 
         if (ret)
                 *ret = d;
@@ -876,6 +1119,33 @@ static void event_source_pp_prioq_reshuffle(sd_event_source *s) {
                 prioq_reshuffle(s->event->prepare, s, &s->prepare_index);
 }
 
+static bool event_source_time_wheel_add(sd_event_source *s, struct clock_data *d) {
+        assert(s);
+        assert(d);
+
+        /* Ratelimited event sources are always kept in the prioqs of CLOCK_MONOTONIC, and pending ones are
+         * ordered differently there. Everything else goes into the wheel, if far enough in the future. */
+        if (!d->wheel || s->ratelimited || s->pending || !EVENT_SOURCE_IS_TIME(s->type))
+                return false;
+
+        if (!timer_wheel_add(d->wheel, &s->time.wheel,
+                             s->enabled == SD_EVENT_OFF ? USEC_INFINITY : s->time.next))
+                return false;
+
+        d->needs_rearm = true;
+        return true;
+}
+
+static void event_source_time_wheel_expire(TimerWheelEntry *entry, void *userdata) {
+        sd_event_source *s = container_of(ASSERT_PTR(entry), sd_event_source, time.wheel);
+        struct clock_data *d = ASSERT_PTR(userdata);
+
+        /* Room for this was reserved when the event source was added to the wheel, and is kept reserved when
+         * anything else is added to the prioqs, see event_source_time_prioq_reserve(). Hence this can't fail. */
+        assert_se(prioq_put(d->earliest, s, &s->earliest_index) >= 0);
+        assert_se(prioq_put(d->latest, s, &s->latest_index) >= 0);
+}
+
 static void event_source_time_prioq_reshuffle(sd_event_source *s) {
         struct clock_data *d;
 
@@ -883,13 +1153,29 @@ static void event_source_time_prioq_reshuffle(sd_event_source *s) {
 
         /* Called whenever the event source's timer ordering properties changed, i.e. time, accuracy,
          * pending, enable state, and ratelimiting state. Makes sure the two prioq's are ordered
-         * properly again. */
+         * properly again, or moves the event source in or out of the timer wheel. */
 
         if (s->ratelimited)
                 d = &s->event->monotonic;
-        else if (EVENT_SOURCE_IS_TIME(s->type))
+        else if (EVENT_SOURCE_IS_TIME(s->type)) {
                 assert_se(d = event_get_clock_data(s->event, s->type));
-        else
+
+                if (timer_wheel_entry_linked(&s->time.wheel)) {
+                        timer_wheel_remove(d->wheel, &s->time.wheel);
+                        if (!event_source_time_wheel_add(s, d))
+                                event_source_time_wheel_expire(&s->time.wheel, d);
+
+                        d->needs_rearm = true;
+                        return;
+                }
+
+                if (event_source_time_wheel_add(s, d)) {
+                        prioq_remove(d->earliest, s, &s->earliest_index);
+                        prioq_remove(d->latest, s, &s->latest_index);
+                        s->earliest_index = s->latest_index = PRIOQ_IDX_NULL;
+                        return;
+                }
+        } else
                 return; /* no-op for an event source which is neither a timer nor ratelimited. */
 
         prioq_reshuffle(d->earliest, s, &s->earliest_index);
@@ -904,9 +1190,14 @@ static void event_source_time_prioq_remove(
         assert(s);
         assert(d);
 
-        prioq_remove(d->earliest, s, &s->earliest_index);
-        prioq_remove(d->latest, s, &s->latest_index);
-        s->earliest_index = s->latest_index = PRIOQ_IDX_NULL;
+        if (EVENT_SOURCE_IS_TIME(s->type) && timer_wheel_entry_linked(&s->time.wheel))
+                timer_wheel_remove(d->wheel, &s->time.wheel);
+        else {
+                prioq_remove(d->earliest, s, &s->earliest_index);
+                prioq_remove(d->latest, s, &s->latest_index);
+                s->earliest_index = s->latest_index = PRIOQ_IDX_NULL;
+        }
+
         d->needs_rearm = true;
 }
 
@@ -925,7 +1216,7 @@ static void source_disconnect(sd_event_source *s) {
 
         case SOURCE_IO:
                 if (s->io.fd >= 0)
-                        source_io_unregister(s);
+                        source_io_unregister(s, /* park= */ false);
 
                 break;
 
@@ -1043,6 +1334,15 @@ static void source_disconnect(sd_event_source *s) {
                 source_memory_pressure_unregister(s);
                 break;
 
+        case SOURCE_OFFLOAD:
+                /* If the work function is running right now this waits for it to finish, as it might
+                 * reference the userdata of this event source */
+                if (s->offload.submitted && !event_origin_changed(s->event))
+                        offload_pool_cancel(s->event->offload_pool, &s->offload.job);
+
+                s->offload.submitted = s->offload.done = false;
+                break;
+
         default:
                 assert_not_reached();
         }
@@ -1138,7 +1438,11 @@ static int source_set_pending(sd_event_source *s, bool b) {
         s->pending = b;
 
         if (b) {
-                s->pending_iteration = s->event->iteration;
+                s->pending_iteration = MAX(s->event->iteration, s->budget_iteration);
+
+                /* While collecting events the timestamp of the wakeup is close enough, and for free */
+                s->pending_since = s->event->state == SD_EVENT_ARMED && s->event->timestamp.monotonic > 0 ?
+                                   s->event->timestamp.monotonic : now(CLOCK_MONOTONIC);
 
                 r = prioq_put(s->event->pending, s, &s->pending_index);
                 if (r < 0) {
@@ -1194,6 +1498,7 @@ static sd_event_source *source_new(sd_event *e, bool floating, EventSourceType t
                 [SOURCE_EXIT]                = endoffsetof_field(sd_event_source, exit),
                 [SOURCE_INOTIFY]             = endoffsetof_field(sd_event_source, inotify),
                 [SOURCE_MEMORY_PRESSURE]     = endoffsetof_field(sd_event_source, memory_pressure),
+                [SOURCE_OFFLOAD]             = endoffsetof_field(sd_event_source, offload),
         };
 
         sd_event_source *s;
@@ -1300,6 +1605,8 @@ static int event_setup_timer_fd(
                 struct clock_data *d,
                 clockid_t clock) {
 
+        int r;
+
         assert(e);
         assert(d);
 
@@ -1315,12 +1622,15 @@ static int event_setup_timer_fd(
         fd = fd_move_above_stdio(fd);
 
         struct epoll_event ev = {
-                .events = EPOLLIN,
+                .events = event_drained_fd_events(e),
                 .data.ptr = d,
         };
 
-        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
-                return -errno;
+        event_unpark_io_sources(e);
+
+        r = event_poll_ctl(e, EPOLL_CTL_ADD, fd, &ev);
+        if (r < 0)
+                return r;
 
         d->fd = TAKE_FD(fd);
         return 0;
@@ -1351,9 +1661,38 @@ static int setup_clock_data(sd_event *e, struct clock_data *d, clockid_t clock)
         if (r < 0)
                 return r;
 
+        if (!d->wheel) {
+                usec_t n;
+
+                assert_se(sd_event_now(e, clock, &n) >= 0);
+
+                r = timer_wheel_new(n, &d->wheel);
+                if (r < 0)
+                        return r;
+        }
+
         return 0;
 }
 
+static int event_source_time_prioq_reserve(struct clock_data *d) {
+        unsigned n;
+        int r;
+
+        assert(d);
+
+        /* Entries of the timer wheel are moved to the prioqs when they are about to elapse, from code paths
+         * that cannot fail, see event_source_time_wheel_expire(). Hence, whenever something is added to
+         * either, make sure the prioqs have room for everything. */
+
+        n = prioq_size(d->earliest) + timer_wheel_size(d->wheel) + 1;
+
+        r = prioq_reserve(d->earliest, n);
+        if (r < 0)
+                return r;
+
+        return prioq_reserve(d->latest, n);
+}
+
 static int event_source_time_prioq_put(
                 sd_event_source *s,
                 struct clock_data *d) {
@@ -1364,6 +1703,10 @@ static int event_source_time_prioq_put(
         assert(d);
         assert(EVENT_SOURCE_USES_TIME_PRIOQ(s->type));
 
+        r = event_source_time_prioq_reserve(d);
+        if (r < 0)
+                return r;
+
         r = prioq_put(d->earliest, s, &s->earliest_index);
         if (r < 0)
                 return r;
@@ -1379,6 +1722,28 @@ static int event_source_time_prioq_put(
         return 0;
 }
 
+static int event_source_time_queue_put(
+                sd_event_source *s,
+                struct clock_data *d) {
+
+        int r;
+
+        assert(s);
+        assert(d);
+
+        /* Like event_source_time_prioq_put(), but puts timer event sources into the timer wheel if
+         * possible. */
+
+        r = event_source_time_prioq_reserve(d);
+        if (r < 0)
+                return r;
+
+        if (event_source_time_wheel_add(s, d))
+                return 0;
+
+        return event_source_time_prioq_put(s, d);
+}
+
 _public_ int sd_event_add_time(
                 sd_event *e,
                 sd_event_source **ret,
@@ -1426,7 +1791,7 @@ _public_ int sd_event_add_time(
         s->userdata = userdata;
         s->enabled = SD_EVENT_ONESHOT;
 
-        r = event_source_time_prioq_put(s, d);
+        r = event_source_time_queue_put(s, d);
         if (r < 0)
                 return r;
 
@@ -1927,6 +2292,42 @@ static int memory_pressure_callback(sd_event_source *s, void *userdata) {
         return 0;
 }
 
+_public_ int sd_event_add_offload(
+                sd_event *e,
+                sd_event_source **ret,
+                sd_event_offload_work_t work,
+                sd_event_offload_handler_t callback,
+                void *userdata) {
+
+        _cleanup_(source_freep) sd_event_source *s = NULL;
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(work, -EINVAL);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        s = source_new(e, !ret, SOURCE_OFFLOAD);
+        if (!s)
+                return -ENOMEM;
+
+        s->offload.callback = callback;
+        s->offload.job.work = work;
+        s->userdata = userdata;
+        s->enabled = SD_EVENT_ONESHOT;
+
+        r = source_offload_submit(s);
+        if (r < 0)
+                return r;
+
+        if (ret)
+                *ret = s;
+        TAKE_PTR(s);
+
+        return 0;
+}
+
 _public_ int sd_event_add_memory_pressure(
                 sd_event *e,
                 sd_event_source **ret,
@@ -2128,6 +2529,8 @@ _public_ int sd_event_add_memory_pressure(
 }
 
 static void event_free_inotify_data(sd_event *e, struct inotify_data *d) {
+        int r;
+
         assert(e);
 
         if (!d)
@@ -2145,9 +2548,11 @@ static void event_free_inotify_data(sd_event *e, struct inotify_data *d) {
         assert_se(hashmap_remove(e->inotify_data, &d->priority) == d);
 
         if (d->fd >= 0) {
-                if (!event_origin_changed(e) &&
-                    epoll_ctl(e->epoll_fd, EPOLL_CTL_DEL, d->fd, NULL) < 0)
-                        log_debug_errno(errno, "Failed to remove inotify fd from epoll, ignoring: %m");
+                if (!event_origin_changed(e)) {
+                        r = event_poll_ctl(e, EPOLL_CTL_DEL, d->fd, NULL);
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to remove inotify fd from epoll, ignoring: %m");
+                }
 
                 safe_close(d->fd);
         }
@@ -2200,8 +2605,10 @@ static int event_make_inotify_data(
                 .data.ptr = d,
         };
 
-        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, d->fd, &ev) < 0) {
-                r = -errno;
+        event_unpark_io_sources(e);
+
+        r = event_poll_ctl(e, EPOLL_CTL_ADD, d->fd, &ev);
+        if (r < 0) {
                 d->fd = safe_close(d->fd); /* let's close this ourselves, as event_free_inotify_data() would otherwise
                                             * remove the fd from the epoll first, which we don't want as we couldn't
                                             * add it in the first place. */
@@ -2648,8 +3055,8 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
                 return 0;
 
         if (event_source_is_offline(s)) {
+                source_io_unregister(s, /* park= */ false);
                 s->io.fd = fd;
-                s->io.registered = false;
         } else {
                 int saved_fd;
 
@@ -2666,7 +3073,7 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
                         return r;
                 }
 
-                (void) epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, saved_fd, NULL);
+                (void) event_poll_ctl(s->event, EPOLL_CTL_DEL, saved_fd, NULL);
         }
 
         return 0;
@@ -2897,7 +3304,7 @@ static int event_source_offline(
         switch (s->type) {
 
         case SOURCE_IO:
-                source_io_unregister(s);
+                source_io_unregister(s, /* park= */ true);
                 break;
 
         case SOURCE_SIGNAL:
@@ -2932,6 +3339,7 @@ static int event_source_offline(
         case SOURCE_DEFER:
         case SOURCE_POST:
         case SOURCE_INOTIFY:
+        case SOURCE_OFFLOAD:
                 break;
 
         default:
@@ -3018,6 +3426,17 @@ static int event_source_online(
 
                 break;
 
+        case SOURCE_OFFLOAD:
+                /* Either the work finished while we were offline, or it needs to be started (again) */
+                if (s->offload.done)
+                        r = source_set_pending(s, true);
+                else
+                        r = source_offload_submit(s);
+                if (r < 0)
+                        return r;
+
+                break;
+
         case SOURCE_TIME_REALTIME:
         case SOURCE_TIME_BOOTTIME:
         case SOURCE_TIME_MONOTONIC:
@@ -3541,6 +3960,7 @@ static int event_arm_timer(
                 sd_event *e,
                 struct clock_data *d) {
 
+        usec_t earliest = USEC_INFINITY, latest = USEC_INFINITY, wheel_earliest, wheel_latest;
         struct itimerspec its = {};
         sd_event_source *a, *b;
         usec_t t;
@@ -3555,7 +3975,22 @@ static int event_arm_timer(
 
         a = prioq_peek(d->earliest);
         assert(!a || EVENT_SOURCE_USES_TIME_PRIOQ(a->type));
-        if (!a || a->enabled == SD_EVENT_OFF || time_event_source_next(a) == USEC_INFINITY) {
+        if (a && a->enabled != SD_EVENT_OFF && time_event_source_next(a) != USEC_INFINITY) {
+                b = prioq_peek(d->latest);
+                assert(b && EVENT_SOURCE_USES_TIME_PRIOQ(b->type));
+                assert(b->enabled != SD_EVENT_OFF);
+
+                earliest = time_event_source_next(a);
+                latest = time_event_source_latest(b);
+        }
+
+        /* We also need to wake up in time to move entries of the timer wheel to the prioqs */
+        if (d->wheel && timer_wheel_next(d->wheel, &wheel_earliest, &wheel_latest)) {
+                earliest = MIN(earliest, wheel_earliest);
+                latest = MIN(latest, wheel_latest);
+        }
+
+        if (earliest == USEC_INFINITY) {
 
                 if (d->fd < 0)
                         return 0;
@@ -3571,11 +4006,7 @@ static int event_arm_timer(
                 return 0;
         }
 
-        b = prioq_peek(d->latest);
-        assert(!b || EVENT_SOURCE_USES_TIME_PRIOQ(b->type));
-        assert(b && b->enabled != SD_EVENT_OFF);
-
-        t = sleep_between(e, time_event_source_next(a), time_event_source_latest(b));
+        t = sleep_between(e, earliest, latest);
         if (d->next == t)
                 return 0;
 
@@ -3611,6 +4042,9 @@ static int process_io(sd_event *e, sd_event_source *s, uint32_t revents) {
         else
                 s->io.revents = revents;
 
+        if (s->io.oneshot)
+                s->io.disarmed = true;
+
         return source_set_pending(s, true);
 }
 
@@ -3652,6 +4086,11 @@ static int process_timer(
         assert(e);
         assert(d);
 
+        /* Move timers that are about to elapse out of the wheel first. The timer needs to be armed anew
+         * then, even if nothing else changes below. */
+        if (d->wheel && timer_wheel_advance(d->wheel, n, event_source_time_wheel_expire, d))
+                d->needs_rearm = true;
+
         for (;;) {
                 s = prioq_peek(d->earliest);
                 assert(!s || EVENT_SOURCE_USES_TIME_PRIOQ(s->type));
@@ -4018,6 +4457,42 @@ static int process_memory_pressure(sd_event_source *s, uint32_t revents) {
         return source_set_pending(s, true);
 }
 
+static int process_offload(sd_event *e, uint32_t revents) {
+        OffloadJob *j;
+        int r;
+
+        assert(e);
+        assert(e->offload_pool);
+
+        if (!(revents & EPOLLIN))
+                return 0;
+
+        /* Flush the eventfd first, so that jobs that finish while we collect result in another wakeup */
+        r = offload_pool_flush(e->offload_pool);
+        if (r < 0)
+                return r;
+
+        while ((j = offload_pool_collect(e->offload_pool))) {
+                sd_event_source *s = container_of(j, sd_event_source, offload.job);
+
+                assert(s->type == SOURCE_OFFLOAD);
+                assert(s->offload.submitted);
+
+                s->offload.submitted = false;
+                s->offload.done = true;
+
+                /* If the source is disabled the result is dispatched once it is enabled again */
+                if (event_source_is_offline(s))
+                        continue;
+
+                r = source_set_pending(s, true);
+                if (r < 0)
+                        return r;
+        }
+
+        return 1;
+}
+
 static int source_memory_pressure_write(sd_event_source *s) {
         ssize_t n;
         int r;
@@ -4115,9 +4590,51 @@ static int source_memory_pressure_initiate_dispatch(sd_event_source *s) {
         return 0; /* go on, dispatch to user callback */
 }
 
+static void source_account_dispatch(sd_event_source *s, usec_t pending, usec_t start) {
+        usec_t elapsed;
+
+        assert(s);
+
+        elapsed = usec_sub_unsigned(now(CLOCK_MONOTONIC), start);
+
+        s->n_dispatched++;
+        s->dispatch_usec = usec_add(s->dispatch_usec, elapsed);
+        s->dispatch_max_usec = MAX(s->dispatch_max_usec, elapsed);
+        s->pending_usec = usec_add(s->pending_usec, pending);
+        s->pending_max_usec = MAX(s->pending_max_usec, pending);
+
+        /* Defer sources stay pending, count from the end of this dispatch for those */
+        if (s->pending)
+                s->pending_since = start + elapsed;
+
+        /* The callback might have disconnected the source */
+        if (!s->event || s->event->dispatch_budget == 0)
+                return;
+
+        /* Pending sources of the same priority are dispatched in the order they became pending. With a
+         * budget set, a source whose callback took n times the budget is ordered as if it became pending only
+         * n iterations later the next time, so that it can't take more than its share of time away from the
+         * others. Sources that stay pending (i.e. defer sources) are moved to the back too, or else the one
+         * that became pending first would always be dispatched before the others. */
+        if (elapsed > s->event->dispatch_budget) {
+                s->n_over_budget++;
+                s->budget_iteration = s->event->iteration + elapsed / s->event->dispatch_budget;
+
+                log_debug("Event source %s (type %s) took %s to dispatch, exceeding the budget of %s.",
+                          strna(s->description), event_source_type_to_string(s->type),
+                          FORMAT_TIMESPAN(elapsed, 1), FORMAT_TIMESPAN(s->event->dispatch_budget, 1));
+        }
+
+        if (s->pending) {
+                s->pending_iteration = MAX(s->event->iteration, s->budget_iteration);
+                prioq_reshuffle(s->event->pending, s, &s->pending_index);
+        }
+}
+
 static int source_dispatch(sd_event_source *s) {
         EventSourceType saved_type;
         sd_event *saved_event;
+        usec_t start, pending;
         int r = 0;
 
         assert(s);
@@ -4142,6 +4659,9 @@ static int source_dispatch(sd_event_source *s) {
                 return 1;
         }
 
+        start = now(CLOCK_MONOTONIC);
+        pending = s->type == SOURCE_EXIT ? 0 : usec_sub_unsigned(start, s->pending_since);
+
         if (!IN_SET(s->type, SOURCE_DEFER, SOURCE_EXIT)) {
                 r = source_set_pending(s, false);
                 if (r < 0)
@@ -4163,6 +4683,9 @@ static int source_dispatch(sd_event_source *s) {
                 }
         }
 
+        if (s->type == SOURCE_OFFLOAD)
+                s->offload.done = false;
+
         if (s->type == SOURCE_MEMORY_PRESSURE) {
                 r = source_memory_pressure_initiate_dispatch(s);
                 if (r == -EIO) /* handle EIO errors similar to callback errors */
@@ -4263,6 +4786,11 @@ static int source_dispatch(sd_event_source *s) {
                 r = s->memory_pressure.callback(s, s->userdata);
                 break;
 
+        case SOURCE_OFFLOAD:
+                if (s->offload.callback)
+                        r = s->offload.callback(s, s->offload.job.result, s->userdata);
+                break;
+
         case SOURCE_WATCHDOG:
         case _SOURCE_EVENT_SOURCE_TYPE_MAX:
         case _SOURCE_EVENT_SOURCE_TYPE_INVALID:
@@ -4271,6 +4799,12 @@ static int source_dispatch(sd_event_source *s) {
 
         s->dispatching = false;
 
+        source_account_dispatch(s, pending, start);
+
+        /* Sources that are left enabled keep running their work function */
+        if (r >= 0 && s->type == SOURCE_OFFLOAD && s->event && s->enabled == SD_EVENT_ON)
+                r = source_offload_submit(s);
+
 finish:
         if (r < 0) {
                 log_debug_errno(r, "Event source %s (type %s) returned error, %s: %m",
@@ -4503,6 +5037,15 @@ _public_ int sd_event_prepare(sd_event *e) {
         if (event_next_pending(e) || e->need_process_child || e->buffered_inotify_data_list)
                 goto pending;
 
+        /* Changes to io_uring registrations are normally submitted by sd_event_wait(). But if the fd was
+         * handed out, it's polled before that, and they need to be in effect by then. Completions that
+         * carry no events are dropped too, so that the fd isn't reported readable for them. */
+        if (e->uring && e->fd_exported) {
+                r = event_uring_flush(e->uring);
+                if (r < 0)
+                        return r;
+        }
+
         e->state = SD_EVENT_ARMED;
 
         return 0;
@@ -4587,11 +5130,18 @@ static int process_epoll(sd_event *e, usec_t timeout, int64_t threshold, int64_t
                 timeout = 0;
 
         for (;;) {
-                r = epoll_wait_usec(
-                                e->epoll_fd,
-                                e->event_queue,
-                                n_event_max,
-                                timeout);
+                if (e->uring)
+                        r = event_uring_wait(
+                                        e->uring,
+                                        e->event_queue,
+                                        n_event_max,
+                                        timeout);
+                else
+                        r = epoll_wait_usec(
+                                        e->epoll_fd,
+                                        e->event_queue,
+                                        n_event_max,
+                                        timeout);
                 if (r < 0)
                         return r;
 
@@ -4618,6 +5168,8 @@ static int process_epoll(sd_event *e, usec_t timeout, int64_t threshold, int64_t
 
                 if (e->event_queue[i].data.ptr == INT_TO_PTR(SOURCE_WATCHDOG))
                         r = flush_timer(e, e->watchdog_fd, e->event_queue[i].events, NULL);
+                else if (e->event_queue[i].data.ptr == INT_TO_PTR(SOURCE_OFFLOAD))
+                        r = process_offload(e, e->event_queue[i].events);
                 else {
                         WakeupType *t = e->event_queue[i].data.ptr;
 
@@ -4901,6 +5453,12 @@ _public_ int sd_event_get_fd(sd_event *e) {
         assert_return(e = event_resolve(e), -ENOPKG);
         assert_return(!event_origin_changed(e), -ECHILD);
 
+        e->fd_exported = true;
+
+        /* The io_uring fd is readable whenever there are completions to collect */
+        if (e->uring)
+                return event_uring_get_fd(e->uring);
+
         return e->epoll_fd;
 }
 
@@ -5022,18 +5580,19 @@ _public_ int sd_event_set_watchdog(sd_event *e, int b) {
                         goto fail;
 
                 struct epoll_event ev = {
-                        .events = EPOLLIN,
+                        .events = event_drained_fd_events(e),
                         .data.ptr = INT_TO_PTR(SOURCE_WATCHDOG),
                 };
 
-                if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, e->watchdog_fd, &ev) < 0) {
-                        r = -errno;
+                event_unpark_io_sources(e);
+
+                r = event_poll_ctl(e, EPOLL_CTL_ADD, e->watchdog_fd, &ev);
+                if (r < 0)
                         goto fail;
-                }
 
         } else {
                 if (e->watchdog_fd >= 0) {
-                        (void) epoll_ctl(e->epoll_fd, EPOLL_CTL_DEL, e->watchdog_fd, NULL);
+                        (void) event_poll_ctl(e, EPOLL_CTL_DEL, e->watchdog_fd, NULL);
                         e->watchdog_fd = safe_close(e->watchdog_fd);
                 }
         }
@@ -5063,6 +5622,176 @@ _public_ int sd_event_get_iteration(sd_event *e, uint64_t *ret) {
         return 0;
 }
 
+_public_ int sd_event_set_dispatch_budget(sd_event *e, uint64_t usec) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        /* Both 0 and USEC_INFINITY turn the budget off */
+        if (usec == USEC_INFINITY)
+                usec = 0;
+
+        if (usec == 0)
+                LIST_FOREACH(sources, s, e->sources)
+                        s->budget_iteration = 0;
+
+        e->dispatch_budget = usec;
+        return 0;
+}
+
+_public_ int sd_event_get_dispatch_budget(sd_event *e, uint64_t *ret) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(ret, -EINVAL);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        *ret = e->dispatch_budget;
+        return 0;
+}
+
+_public_ int sd_event_set_offload_threads(sd_event *e, unsigned n) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        /* 0 selects the default, i.e. the number of online CPUs */
+        e->offload_threads = MIN(n, OFFLOAD_THREADS_MAX);
+
+        if (e->offload_pool)
+                offload_pool_set_max_threads(e->offload_pool, n > 0 ? n : offload_pool_default_max_threads());
+
+        return 0;
+}
+
+_public_ int sd_event_get_offload_threads(sd_event *e, unsigned *ret) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(ret, -EINVAL);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        *ret = e->offload_threads > 0 ? e->offload_threads : offload_pool_default_max_threads();
+        return 0;
+}
+
+static bool event_has_backend_registrations(sd_event *e) {
+        assert(e);
+
+        /* Event sources might have registered fds with the backend, and so might the event loop itself,
+         * for timers, signals, inotify watches, offloaded work and the watchdog. */
+        return e->n_sources > 0 ||
+                e->watchdog_fd >= 0 ||
+                e->realtime.fd >= 0 ||
+                e->boottime.fd >= 0 ||
+                e->monotonic.fd >= 0 ||
+                e->realtime_alarm.fd >= 0 ||
+                e->boottime_alarm.fd >= 0 ||
+                !hashmap_isempty(e->signal_data) ||
+                !hashmap_isempty(e->inotify_data) ||
+                e->offload_pool;
+}
+
+_public_ int sd_event_set_backend(sd_event *e, int backend) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(IN_SET(backend, SD_EVENT_BACKEND_EPOLL, SD_EVENT_BACKEND_IO_URING), -EINVAL);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        if (backend == (e->uring ? SD_EVENT_BACKEND_IO_URING : SD_EVENT_BACKEND_EPOLL))
+                return 0;
+
+        /* Registrations aren't carried over to the new backend, and the fd handed out by sd_event_get_fd()
+         * would become invalid. */
+        if (event_has_backend_registrations(e) || e->fd_exported)
+                return -EBUSY;
+
+        return event_setup_backend(e, backend);
+}
+
+_public_ int sd_event_get_backend(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        return e->uring ? SD_EVENT_BACKEND_IO_URING : SD_EVENT_BACKEND_EPOLL;
+}
+
+_public_ int sd_event_source_get_statistics(
+                sd_event_source *s,
+                uint64_t *ret_n_dispatched,
+                uint64_t *ret_dispatch_usec,
+                uint64_t *ret_dispatch_max_usec,
+                uint64_t *ret_pending_usec,
+                uint64_t *ret_pending_max_usec) {
+
+        assert_return(s, -EINVAL);
+        assert_return(!event_origin_changed(s->event), -ECHILD);
+
+        if (ret_n_dispatched)
+                *ret_n_dispatched = s->n_dispatched;
+        if (ret_dispatch_usec)
+                *ret_dispatch_usec = s->dispatch_usec;
+        if (ret_dispatch_max_usec)
+                *ret_dispatch_max_usec = s->dispatch_max_usec;
+        if (ret_pending_usec)
+                *ret_pending_usec = s->pending_usec;
+        if (ret_pending_max_usec)
+                *ret_pending_max_usec = s->pending_max_usec;
+
+        return 0;
+}
+
+static int source_dispatch_usec_compare(sd_event_source * const *a, sd_event_source * const *b) {
+        return CMP((*b)->dispatch_usec, (*a)->dispatch_usec);
+}
+
+_public_ int sd_event_dump_statistics(sd_event *e, FILE *f) {
+        _cleanup_free_ sd_event_source **sources = NULL;
+        size_t n = 0;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_origin_changed(e), -ECHILD);
+
+        /* NB: this is a debugging aid, the output is not supposed to be stable between versions */
+
+        if (!f)
+                f = stdout;
+
+        sources = new(sd_event_source*, e->n_sources);
+        if (!sources)
+                return -ENOMEM;
+
+        LIST_FOREACH(sources, s, e->sources)
+                if (s->n_dispatched > 0)
+                        sources[n++] = s;
+
+        /* Most expensive ones first */
+        typesafe_qsort(sources, n, source_dispatch_usec_compare);
+
+        fprintf(f, "Event loop iterations: %" PRIu64 "\n", e->iteration);
+        if (e->dispatch_budget > 0)
+                fprintf(f, "Event loop dispatch budget: %s\n", FORMAT_TIMESPAN(e->dispatch_budget, 0));
+
+        FOREACH_ARRAY(i, sources, n) {
+                sd_event_source *s = *i;
+
+                fprintf(f, "Event source %s (type %s, priority %" PRIi64 "): dispatched %" PRIu64 " times, "
+                        "callbacks took %s (max %s), pending for %s (max %s)",
+                        strna(s->description), event_source_type_to_string(s->type), s->priority,
+                        s->n_dispatched,
+                        FORMAT_TIMESPAN(s->dispatch_usec, 1), FORMAT_TIMESPAN(s->dispatch_max_usec, 1),
+                        FORMAT_TIMESPAN(s->pending_usec, 1), FORMAT_TIMESPAN(s->pending_max_usec, 1));
+
+                if (s->n_over_budget > 0)
+                        fprintf(f, ", %" PRIu64 " times over budget", s->n_over_budget);
+
+                fputc('\n', f);
+        }
+
+        return 0;
+}
+
 _public_ int sd_event_source_set_destroy_callback(sd_event_source *s, sd_event_destroy_t callback) {
         assert_return(s, -EINVAL);
         assert_return(s->event, -EINVAL);
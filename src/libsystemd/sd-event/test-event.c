@@ -6,9 +6,11 @@
 #include "sd-event.h"
 
 #include "alloc-util.h"
+#include "event-timer-wheel.h"
 #include "exec-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
+#include "io-util.h"
 #include "log.h"
 #include "macro.h"
 #include "missing_syscall.h"
@@ -899,4 +901,564 @@ TEST(leave_ratelimit) {
         assert_se(manually_left_ratelimit);
 }
 
+static int oneshot_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        unsigned *c = userdata;
+        char x;
+
+        assert_se(revents == EPOLLIN);
+        assert_se(read(fd, &x, 1) == 1);
+
+        (*c)++;
+        return 0;
+}
+
+TEST(io_oneshot_rearm) {
+        _cleanup_close_pair_ int pfd[2] = PIPE_EBADF, qfd[2] = PIPE_EBADF;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL, *t = NULL;
+        unsigned c = 0, d = 0;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(pipe2(pfd, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(sd_event_add_io(e, &s, pfd[0], EPOLLIN, oneshot_handler, &c) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+
+        /* After each dispatch the source is disabled, but left in the epoll set, and re-armed when enabled
+         * again */
+        for (unsigned i = 1; i <= 3; i++) {
+                assert_se(write(pfd[1], "x", 1) == 1);
+                assert_se(sd_event_run(e, 0) > 0);
+                assert_se(c == i);
+                assert_se(sd_event_source_get_enabled(s, NULL) == SD_EVENT_OFF);
+
+                /* Nothing is reported while disabled */
+                assert_se(write(pfd[1], "x", 1) == 1);
+                assert_se(sd_event_run(e, 0) == 0);
+                assert_se(c == i);
+
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+                assert_se(sd_event_run(e, 0) > 0);
+                assert_se(c == i + 1);
+                c--;
+
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        }
+
+        assert_se(write(pfd[1], "x", 1) == 1);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(c == 4);
+
+        /* Close the fd of the disabled source and reuse its number for a new source. Freeing the old source
+         * afterwards must not remove the new fd from the epoll set. */
+        pfd[0] = safe_close(pfd[0]);
+        pfd[1] = safe_close(pfd[1]);
+        assert_se(pipe2(qfd, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(sd_event_add_io(e, &t, qfd[0], EPOLLIN, oneshot_handler, &d) >= 0);
+        s = sd_event_source_unref(s);
+
+        for (unsigned i = 1; i <= 3; i++) {
+                assert_se(write(qfd[1], "x", 1) == 1);
+                assert_se(sd_event_run(e, 0) > 0);
+                assert_se(d == i);
+        }
+
+        assert_se(c == 4);
+}
+
+static int count_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        unsigned *c = userdata;
+
+        (*c)++;
+        return 0;
+}
+
+TEST(io_uring_backend) {
+        _cleanup_close_pair_ int pfd[2] = PIPE_EBADF, qfd[2] = PIPE_EBADF;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL, *t = NULL, *u = NULL;
+        _cleanup_close_ int null_fd = -EBADF;
+        unsigned c = 0, d = 0, o = 0;
+        char x;
+        int r, fd;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        r = sd_event_set_backend(e, SD_EVENT_BACKEND_IO_URING);
+        if (ERRNO_IS_NEG_NOT_SUPPORTED(r) || ERRNO_IS_NEG_PRIVILEGE(r))
+                return (void) log_tests_skipped_errno(r, "io_uring is not available");
+        assert_se(r >= 0);
+        assert_se(sd_event_get_backend(e) == SD_EVENT_BACKEND_IO_URING);
+
+        assert_se(pipe2(pfd, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(pipe2(qfd, O_CLOEXEC|O_NONBLOCK) >= 0);
+
+        /* Level-triggered sources are reported for as long as the fd is readable */
+        assert_se(sd_event_add_io(e, &s, pfd[0], EPOLLIN, count_handler, &c) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(write(pfd[1], "x", 1) == 1);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(c == 2);
+        assert_se(read(pfd[0], &x, 1) == 1);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(c == 2);
+
+        /* Edge-triggered sources only once per wakeup */
+        assert_se(sd_event_add_io(e, &t, qfd[0], EPOLLIN|EPOLLET, count_handler, &d) >= 0);
+        for (unsigned i = 1; i <= 3; i++) {
+                assert_se(write(qfd[1], "x", 1) == 1);
+                assert_se(sd_event_run(e, 0) > 0);
+                assert_se(sd_event_run(e, 0) == 0);
+                assert_se(d == i);
+                assert_se(read(qfd[0], &x, 1) == 1);
+        }
+
+        /* Oneshot sources are left alone until enabled again */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(write(pfd[1], "x", 1) == 1);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(c == 3);
+        assert_se(sd_event_source_get_enabled(s, NULL) == SD_EVENT_OFF);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(c == 4);
+        assert_se(read(pfd[0], &x, 1) == 1);
+
+        /* Changing the event mask replaces the registration */
+        assert_se(sd_event_add_io(e, &u, pfd[1], EPOLLIN, count_handler, &o) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(sd_event_source_set_io_events(u, EPOLLOUT) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(o == 1);
+        u = sd_event_source_unref(u);
+
+        /* Fds that cannot be polled are refused, like epoll does */
+        null_fd = open("/dev/null", O_RDONLY|O_CLOEXEC);
+        assert_se(null_fd >= 0);
+        assert_se(sd_event_add_io(e, NULL, null_fd, EPOLLIN, count_handler, NULL) == -EPERM);
+
+        /* The backend cannot be switched once sources are registered */
+        assert_se(sd_event_set_backend(e, SD_EVENT_BACKEND_EPOLL) == -EBUSY);
+
+        /* The ring fd handed out to an outer loop becomes readable when there's something to dispatch */
+        fd = sd_event_get_fd(e);
+        assert_se(fd >= 0);
+        assert_se(sd_event_prepare(e) == 0);
+        assert_se(fd_wait_for_event(fd, POLLIN, 0) == 0);
+        assert_se(write(pfd[1], "x", 1) == 1);
+        assert_se(fd_wait_for_event(fd, POLLIN, USEC_PER_SEC) > 0);
+        assert_se(sd_event_wait(e, 0) > 0);
+        assert_se(sd_event_dispatch(e) > 0);
+        assert_se(c == 5);
+        assert_se(read(pfd[0], &x, 1) == 1);
+
+        /* Timers are delivered through the ring too */
+        assert_se(sd_event_add_time_relative(e, NULL, CLOCK_MONOTONIC, 10 * USEC_PER_MSEC, 0, NULL, INT_TO_PTR(17)) >= 0);
+        assert_se(sd_event_loop(e) == 17);
+}
+
+static int slow_handler(sd_event_source *s, void *userdata) {
+        unsigned *c = userdata;
+
+        (void) usleep_safe(2 * USEC_PER_MSEC);
+
+        (*c)++;
+        return 0;
+}
+
+static int fast_handler(sd_event_source *s, void *userdata) {
+        unsigned *c = userdata;
+
+        (*c)++;
+        return 0;
+}
+
+TEST(dispatch_budget) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *slow = NULL, *fast = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        uint64_t n, usec, max_usec, pending_usec, pending_max_usec;
+        unsigned n_slow = 0, n_fast = 0;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_dispatch_budget(e, USEC_PER_MSEC) >= 0);
+        assert_se(sd_event_get_dispatch_budget(e, &usec) >= 0);
+        assert_se(usec == USEC_PER_MSEC);
+
+        /* Two defer sources of the same priority, which hence are always pending. The slow one was added
+         * first, and would hence be dispatched each time without a budget. */
+        assert_se(sd_event_add_defer(e, &slow, slow_handler, &n_slow) >= 0);
+        assert_se(sd_event_source_set_enabled(slow, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_source_set_description(slow, "slow") >= 0);
+        assert_se(sd_event_add_defer(e, &fast, fast_handler, &n_fast) >= 0);
+        assert_se(sd_event_source_set_enabled(fast, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_source_set_description(fast, "fast") >= 0);
+
+        for (unsigned i = 0; i < 30; i++)
+                assert_se(sd_event_run(e, 0) > 0);
+
+        log_info("slow: %u, fast: %u", n_slow, n_fast);
+        assert_se(n_slow + n_fast == 30);
+        assert_se(n_slow > 0);
+        assert_se(n_fast > n_slow);
+
+        assert_se(sd_event_source_get_statistics(slow, &n, &usec, &max_usec, &pending_usec, &pending_max_usec) >= 0);
+        assert_se(n == n_slow);
+        assert_se(max_usec >= 2 * USEC_PER_MSEC);
+        assert_se(usec >= n * 2 * USEC_PER_MSEC);
+        assert_se(usec >= max_usec);
+        assert_se(pending_usec >= pending_max_usec);
+
+        assert_se(sd_event_source_get_statistics(fast, &n, NULL, NULL, NULL, &pending_max_usec) >= 0);
+        assert_se(n == n_fast);
+        assert_se(pending_max_usec >= 2 * USEC_PER_MSEC); /* it had to wait for the slow one at least once */
+
+        assert_se(sd_event_dump_statistics(e, NULL) >= 0);
+
+        /* Without a budget the first one wins again */
+        assert_se(sd_event_set_dispatch_budget(e, 0) >= 0);
+        n_slow = n_fast = 0;
+        for (unsigned i = 0; i < 5; i++)
+                assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n_slow + n_fast == 5);
+}
+
+typedef struct OffloadTest {
+        unsigned id;
+        uint64_t sum;
+        unsigned n_work;
+        unsigned n_done;
+        int result;
+} OffloadTest;
+
+static int offload_work(void *userdata) {
+        OffloadTest *t = ASSERT_PTR(userdata);
+
+        t->sum = 0;
+        for (uint64_t i = 0; i <= 100000; i++)
+                t->sum += i * t->id;
+
+        t->n_work++;
+        return (int) t->id;
+}
+
+static int offload_handler(sd_event_source *s, int result, void *userdata) {
+        OffloadTest *t = ASSERT_PTR(userdata);
+
+        assert_se(result == (int) t->id);
+        assert_se(t->sum == (uint64_t) t->id * 100000 * 100001 / 2);
+
+        t->result = result;
+        t->n_done++;
+
+        /* Have the first one run three times */
+        if (t->id == 0 && t->n_done < 3)
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+
+        return 0;
+}
+
+static int offload_slow_work(void *userdata) {
+        unsigned *n = ASSERT_PTR(userdata);
+
+        usleep_safe(20 * USEC_PER_MSEC);
+        __atomic_add_fetch(n, 1, __ATOMIC_SEQ_CST);
+
+        return 0;
+}
+
+TEST(offload) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *sources[16] = {}, *s;
+        OffloadTest t[ELEMENTSOF(sources)] = {}, disabled = { .id = 77 };
+        unsigned threads;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_offload_threads(e, 4) >= 0);
+        assert_se(sd_event_get_offload_threads(e, &threads) >= 0);
+        assert_se(threads == 4);
+
+        for (unsigned i = 0; i < ELEMENTSOF(sources); i++) {
+                t[i] = (OffloadTest) { .id = i, .result = -1 };
+                assert_se(sd_event_add_offload(e, sources + i, offload_work, offload_handler, t + i) >= 0);
+        }
+
+        /* A disabled source still gets its work done, but it is only dispatched once enabled again */
+        assert_se(sd_event_add_offload(e, &s, offload_work, offload_handler, &disabled) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+
+        for (;;) {
+                bool all = true;
+
+                for (unsigned i = 0; i < ELEMENTSOF(sources); i++)
+                        if (t[i].n_done < (i == 0 ? 3U : 1U))
+                                all = false;
+                if (all)
+                        break;
+
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+        }
+
+        for (unsigned i = 0; i < ELEMENTSOF(sources); i++) {
+                assert_se(t[i].result == (int) i);
+                assert_se(t[i].n_work == t[i].n_done);
+                assert_se(sd_event_source_get_enabled(sources[i], NULL) == 0);
+                sources[i] = sd_event_source_unref(sources[i]);
+        }
+
+        while (__atomic_load_n(&disabled.n_work, __ATOMIC_SEQ_CST) == 0)
+                assert_se(sd_event_run(e, 10 * USEC_PER_MSEC) >= 0);
+        assert_se(sd_event_run(e, 10 * USEC_PER_MSEC) >= 0);
+        assert_se(disabled.n_done == 0);
+
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        while (disabled.n_done == 0)
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+        assert_se(disabled.n_done == 1);
+        assert_se(disabled.result == 77);
+        assert_se(disabled.n_work == 1);
+        s = sd_event_source_unref(s);
+}
+
+TEST(offload_cancel) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *sources[16] = {};
+        unsigned n_slow = 0, n;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_offload_threads(e, 1) >= 0);
+
+        for (unsigned i = 0; i < ELEMENTSOF(sources); i++)
+                assert_se(sd_event_add_offload(e, sources + i, offload_slow_work, NULL, &n_slow) >= 0);
+
+        /* Dropping sources drops queued work, and waits for running work to finish. Drop the queued ones
+         * first, so that the worker thread doesn't pick them up while we wait for the running one. */
+        usleep_safe(10 * USEC_PER_MSEC);
+        for (size_t i = ELEMENTSOF(sources); i > 0; i--)
+                sources[i - 1] = sd_event_source_unref(sources[i - 1]);
+
+        n = __atomic_load_n(&n_slow, __ATOMIC_SEQ_CST);
+        assert_se(n > 0);
+        assert_se(n < ELEMENTSOF(sources));
+        usleep_safe(50 * USEC_PER_MSEC);
+        assert_se(__atomic_load_n(&n_slow, __ATOMIC_SEQ_CST) == n);
+
+        /* A floating source without a handler, that is still running when the event loop is freed */
+        assert_se(sd_event_add_offload(e, NULL, offload_slow_work, NULL, &n_slow) >= 0);
+        e = sd_event_unref(e);
+        assert_se(__atomic_load_n(&n_slow, __ATOMIC_SEQ_CST) <= n + 1);
+}
+
+typedef struct WheelTestEntry {
+        TimerWheelEntry entry;
+        usec_t time;
+        bool expired;
+} WheelTestEntry;
+
+static void wheel_test_expire(TimerWheelEntry *entry, void *userdata) {
+        WheelTestEntry *t = container_of(entry, WheelTestEntry, entry);
+        usec_t *n = ASSERT_PTR(userdata);
+
+        assert_se(!t->expired);
+        assert_se(t->time != USEC_INFINITY);
+
+        /* Handed back not too early, and not too late */
+        assert_se(t->time < usec_add(*n, TIMER_WHEEL_HORIZON_USEC) + (USEC_PER_SEC << 1));
+        assert_se(t->time >> TIMER_WHEEL_TICK_SHIFT <= (*n >> TIMER_WHEEL_TICK_SHIFT) + TIMER_WHEEL_HORIZON_TICKS);
+
+        t->expired = true;
+}
+
+TEST(timer_wheel) {
+        _cleanup_(timer_wheel_freep) TimerWheel *w = NULL;
+        _cleanup_free_ WheelTestEntry *entries = NULL;
+        usec_t n = 1000 * USEC_PER_DAY, earliest, latest;
+        size_t n_entries = 10000, n_linked = 0;
+
+        assert_se(timer_wheel_new(n, &w) >= 0);
+        assert_se(!timer_wheel_next(w, &earliest, &latest));
+
+        /* Too close */
+        assert_se(entries = new0(WheelTestEntry, n_entries));
+        assert_se(!timer_wheel_add(w, &entries[0].entry, n + USEC_PER_SEC));
+        assert_se(!timer_wheel_entry_linked(&entries[0].entry));
+
+        for (size_t i = 0; i < n_entries; i++) {
+                switch (i % 5) {
+                case 0: /* Never */
+                        entries[i].time = USEC_INFINITY;
+                        break;
+                case 1: /* Beyond the range of the wheel */
+                        entries[i].time = n + 300 * USEC_PER_DAY + random_u64_range(300 * USEC_PER_DAY);
+                        break;
+                default:
+                        entries[i].time = n + TIMER_WHEEL_HORIZON_USEC + random_u64_range(USEC_PER_DAY);
+                }
+
+                assert_se(timer_wheel_add(w, &entries[i].entry, entries[i].time));
+                n_linked++;
+        }
+
+        assert_se(timer_wheel_size(w) == n_linked);
+
+        while (n_linked > 0) {
+                size_t i;
+
+                /* Cancel one here and there */
+                i = random_u64_range(n_entries);
+                if (timer_wheel_entry_linked(&entries[i].entry)) {
+                        timer_wheel_remove(w, &entries[i].entry);
+                        n_linked--;
+                }
+
+                if (timer_wheel_next(w, &earliest, &latest)) {
+                        assert_se(earliest <= latest);
+
+                        /* Everything in the wheel is handed back if we advance in time */
+                        for (size_t j = 0; j < n_entries; j++)
+                                if (timer_wheel_entry_linked(&entries[j].entry))
+                                        assert_se(entries[j].time > latest);
+
+                        /* Sometimes jump ahead further, sometimes just as far as needed */
+                        n = random_u64_range(5) == 0 ? latest + random_u64_range(USEC_PER_DAY) :
+                                                       MAX(n, earliest + random_u64_range(latest - earliest + 1));
+                } else {
+                        /* Only parked entries left */
+                        for (size_t j = 0; j < n_entries; j++)
+                                if (timer_wheel_entry_linked(&entries[j].entry)) {
+                                        assert_se(entries[j].time == USEC_INFINITY);
+                                        timer_wheel_remove(w, &entries[j].entry);
+                                        n_linked--;
+                                }
+
+                        break;
+                }
+
+                timer_wheel_advance(w, n, wheel_test_expire, &n);
+
+                n_linked = 0;
+                for (size_t j = 0; j < n_entries; j++)
+                        if (timer_wheel_entry_linked(&entries[j].entry)) {
+                                assert_se(entries[j].time >> TIMER_WHEEL_TICK_SHIFT > (n >> TIMER_WHEEL_TICK_SHIFT) + TIMER_WHEEL_HORIZON_TICKS);
+                                n_linked++;
+                        }
+
+                assert_se(timer_wheel_size(w) == n_linked);
+        }
+
+        assert_se(timer_wheel_size(w) == 0);
+}
+
+static int timer_wheel_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        unsigned *n = ASSERT_PTR(userdata);
+
+        (*n)++;
+        return 0;
+}
+
+TEST(timer_wheel_rearm) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        unsigned n = 0;
+        usec_t t, u;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* Starts out in the wheel, far in the future */
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_event_add_time(e, &s, CLOCK_MONOTONIC, t + USEC_PER_HOUR, 0, timer_wheel_handler, &n) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n == 0);
+
+        /* Moves to the prioqs */
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_event_source_set_time(s, t + 10 * USEC_PER_MSEC) >= 0);
+        assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+        assert_se(n == 1);
+        assert_se(now(CLOCK_MONOTONIC) >= t + 10 * USEC_PER_MSEC);
+
+        /* Disabled while far in the future, then re-enabled close by */
+        assert_se(sd_event_source_set_time(s, t + USEC_PER_DAY) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(sd_event_source_set_time_relative(s, 10 * USEC_PER_MSEC) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+        assert_se(n == 2);
+
+        if (!slow_tests_enabled())
+                return;
+
+        /* Elapses while in the wheel, and is moved to the prioqs in time */
+        t = now(CLOCK_MONOTONIC) + TIMER_WHEEL_HORIZON_USEC + 2 * USEC_PER_SEC;
+        assert_se(sd_event_source_set_time(s, t) >= 0);
+        assert_se(sd_event_source_set_time_accuracy(s, USEC_PER_MSEC) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        while (n < 3)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+        u = now(CLOCK_MONOTONIC);
+        log_info("Timer elapsed %s late.", FORMAT_TIMESPAN(u - t, 1));
+        assert_se(u >= t);
+        assert_se(u < t + 250 * USEC_PER_MSEC);
+}
+
+static void timer_rearm_benchmark_one(size_t n_sources, usec_t offset, usec_t spread) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_free_ sd_event_source **sources = NULL;
+        unsigned n = 0;
+        usec_t base, start, end;
+        size_t rounds = 3;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sources = new0(sd_event_source*, n_sources));
+
+        base = now(CLOCK_MONOTONIC);
+        for (size_t i = 0; i < n_sources; i++) {
+                assert_se(sd_event_add_time(e, sources + i, CLOCK_MONOTONIC, base + offset + (i * 7919) % spread, 0, timer_wheel_handler, &n) >= 0);
+                assert_se(sd_event_source_set_enabled(sources[i], SD_EVENT_OFF) >= 0);
+        }
+
+        assert_se(sd_event_run(e, 0) >= 0);
+
+        /* Arm, and cancel again: what a job timeout or a watchdog typically does */
+        start = now(CLOCK_MONOTONIC);
+        for (size_t r = 0; r < rounds; r++) {
+                for (size_t i = 0; i < n_sources; i++) {
+                        assert_se(sd_event_source_set_time(sources[i], base + offset + (i * 7919 + r * 104729) % spread) >= 0);
+                        assert_se(sd_event_source_set_enabled(sources[i], SD_EVENT_ONESHOT) >= 0);
+                }
+
+                for (size_t i = 0; i < n_sources; i++)
+                        assert_se(sd_event_source_set_enabled(sources[i], SD_EVENT_OFF) >= 0);
+        }
+        end = now(CLOCK_MONOTONIC);
+
+        log_info("%zu timers elapsing in %s: %.1f ns per re-arm and cancel",
+                 n_sources, FORMAT_TIMESPAN(offset, USEC_PER_SEC),
+                 (double) (end - start) * NSEC_PER_USEC / (double) (rounds * n_sources));
+
+        assert_se(n == 0);
+
+        for (size_t i = 0; i < n_sources; i++)
+                sd_event_source_unref(sources[i]);
+}
+
+TEST(timer_rearm_benchmark) {
+        static const size_t sizes[] = { 10000, 100000, 1000000 };
+
+        FOREACH_ARRAY(i, sizes, ELEMENTSOF(sizes)) {
+                size_t n = *i;
+
+                if (n > 100000 && !slow_tests_enabled())
+                        break;
+
+                /* Short timeouts are kept in the prioqs, long ones in the timer wheel */
+                timer_rearm_benchmark_one(n, 200 * USEC_PER_MSEC, USEC_PER_SEC);
+                timer_rearm_benchmark_one(n, 90 * USEC_PER_SEC, 30 * USEC_PER_SEC);
+                timer_rearm_benchmark_one(n, 10 * USEC_PER_MINUTE, USEC_PER_HOUR);
+        }
+}
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
@@ -0,0 +1,449 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "journal-aggregate.h"
+#include "journal-file.h"
+#include "journal-internal.h"
+#include "memory-util.h"
+#include "set.h"
+#include "siphash24.h"
+#include "string-util.h"
+#include "strv.h"
+
+/* If a grouping field takes more values than this in a file, we don't collect its data objects upfront, but
+ * look at the data objects of the entries as they come along instead */
+#define AGGREGATE_FIELD_VALUES_MAX 4096U
+
+/* Maps a data object in a journal file to the grouping field and value it carries. If value is NULL the data
+ * object belongs to some other field. */
+typedef struct AggregateDataRef {
+        JournalFile *file;
+        uint64_t offset;
+
+        size_t field;
+        const char *value;
+} AggregateDataRef;
+
+typedef struct AggregateFile {
+        /* If true, all data objects of the grouping fields up to tail_offset are known, hence any other data
+         * object up to there belongs to some other field and needs not be looked at. */
+        bool indexed;
+        uint64_t tail_offset;
+} AggregateFile;
+
+struct JournalAggregate {
+        char **fields;
+        size_t n_fields;
+        usec_t interval;
+
+        /* All values of all grouping fields, so that groups can be told apart by pointer */
+        Set *values;
+
+        Set *groups;
+        JournalAggregateGroup *key;
+
+        /* The data refs and files are only valid as long as no journal file was closed */
+        Set *data_refs;
+        Hashmap *files;
+        sd_journal *journal;
+        unsigned invalidate_counter;
+
+        uint64_t *item_offsets;
+};
+
+static void aggregate_group_hash_func(const JournalAggregateGroup *g, struct siphash *state) {
+        siphash24_compress(&g->bucket, sizeof(g->bucket), state);
+        siphash24_compress_safe(g->values, g->n_values * sizeof(char*), state);
+}
+
+static int aggregate_group_compare_func(const JournalAggregateGroup *x, const JournalAggregateGroup *y) {
+        int r;
+
+        assert(x->n_values == y->n_values);
+
+        /* Values are interned, hence comparing them by string is consistent with hashing them by pointer,
+         * and lets set_dump_sorted() return the groups in output order */
+        r = CMP(x->bucket, y->bucket);
+        if (r != 0)
+                return r;
+
+        for (size_t i = 0; i < x->n_values; i++) {
+                r = strcmp_ptr(x->values[i], y->values[i]);
+                if (r != 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(aggregate_group_hash_ops, JournalAggregateGroup,
+                                            aggregate_group_hash_func, aggregate_group_compare_func, free);
+
+static void aggregate_data_ref_hash_func(const AggregateDataRef *d, struct siphash *state) {
+        siphash24_compress(&d->file, sizeof(d->file), state);
+        siphash24_compress(&d->offset, sizeof(d->offset), state);
+}
+
+static int aggregate_data_ref_compare_func(const AggregateDataRef *x, const AggregateDataRef *y) {
+        int r;
+
+        r = CMP(x->file, y->file);
+        if (r != 0)
+                return r;
+
+        return CMP(x->offset, y->offset);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(aggregate_data_ref_hash_ops, AggregateDataRef,
+                                            aggregate_data_ref_hash_func, aggregate_data_ref_compare_func, free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(aggregate_file_hash_ops, void, trivial_hash_func, trivial_compare_func,
+                                              AggregateFile, free);
+
+int journal_aggregate_new(char * const *fields, usec_t interval, JournalAggregate **ret) {
+        _cleanup_(journal_aggregate_freep) JournalAggregate *a = NULL;
+        size_t n;
+
+        assert(ret);
+
+        n = strv_length((char**) fields);
+
+        a = new(JournalAggregate, 1);
+        if (!a)
+                return -ENOMEM;
+
+        *a = (JournalAggregate) {
+                .fields = strv_copy((char**) fields),
+                .n_fields = n,
+                .interval = interval,
+                .key = malloc0(offsetof(JournalAggregateGroup, values) + n * sizeof(char*)),
+        };
+
+        if (!a->fields || !a->key)
+                return -ENOMEM;
+
+        a->key->n_values = n;
+
+        *ret = TAKE_PTR(a);
+        return 0;
+}
+
+JournalAggregate* journal_aggregate_free(JournalAggregate *a) {
+        if (!a)
+                return NULL;
+
+        set_free(a->groups);
+        set_free(a->data_refs);
+        hashmap_free(a->files);
+        set_free(a->values);
+
+        strv_free(a->fields);
+        free(a->key);
+        free(a->item_offsets);
+
+        return mfree(a);
+}
+
+static int aggregate_intern_value(JournalAggregate *a, const void *data, size_t size, const char **ret) {
+        _cleanup_free_ char *s = NULL;
+        const char *existing;
+        int r;
+
+        assert(a);
+        assert(data || size == 0);
+        assert(ret);
+
+        s = memdup_suffix0(data, size);
+        if (!s)
+                return -ENOMEM;
+
+        existing = set_get(a->values, s);
+        if (existing) {
+                *ret = existing;
+                return 0;
+        }
+
+        r = set_ensure_put(&a->values, &string_hash_ops_free, s);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(s);
+        return 0;
+}
+
+static int aggregate_add_data_ref(
+                JournalAggregate *a,
+                JournalFile *f,
+                uint64_t offset,
+                size_t field,
+                const void *data,
+                size_t size,
+                const AggregateDataRef **ret) {
+
+        _cleanup_free_ AggregateDataRef *d = NULL;
+        int r;
+
+        assert(a);
+        assert(f);
+
+        d = new(AggregateDataRef, 1);
+        if (!d)
+                return -ENOMEM;
+
+        *d = (AggregateDataRef) {
+                .file = f,
+                .offset = offset,
+                .field = field,
+        };
+
+        if (field != SIZE_MAX) {
+                r = aggregate_intern_value(a, data, size, &d->value);
+                if (r < 0)
+                        return r;
+        }
+
+        r = set_ensure_put(&a->data_refs, &aggregate_data_ref_hash_ops, d);
+        if (r < 0)
+                return r;
+
+        if (ret)
+                *ret = d;
+
+        TAKE_PTR(d);
+        return 1;
+}
+
+static int aggregate_index_file(JournalAggregate *a, sd_journal *j, JournalFile *f, AggregateFile **ret) {
+        _cleanup_free_ AggregateFile *af = NULL;
+        int r;
+
+        assert(a);
+        assert(j);
+        assert(f);
+        assert(ret);
+
+        af = new(AggregateFile, 1);
+        if (!af)
+                return -ENOMEM;
+
+        /* Data objects are linked into the list of their field right after being appended. Hence, if the file
+         * is still written to, everything up to the tail we see now will be in the lists when we walk them,
+         * and whatever comes after is looked at individually. */
+        *af = (AggregateFile) {
+                .indexed = true,
+                .tail_offset = le64toh(READ_NOW(f->header->tail_object_offset)),
+        };
+
+        for (size_t i = 0; i < a->n_fields && af->indexed; i++) {
+                size_t k = strlen(a->fields[i]);
+                unsigned n = 0;
+                uint64_t p;
+                Object *o;
+
+                r = journal_file_find_field_object(f, a->fields[i], k, &o, NULL);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                for (p = le64toh(o->field.head_data_offset); p != 0;) {
+                        uint64_t next;
+                        size_t l;
+                        void *data;
+
+                        if (++n > AGGREGATE_FIELD_VALUES_MAX) {
+                                log_debug("Field %s takes more than %u values in %s, looking at data objects of entries individually.",
+                                          a->fields[i], AGGREGATE_FIELD_VALUES_MAX, f->path);
+                                af->indexed = false;
+                                break;
+                        }
+
+                        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                        if (r >= 0) {
+                                next = le64toh(o->data.next_field_offset);
+                                r = journal_file_data_payload(f, o, p, a->fields[i], k, j->data_threshold, &data, &l);
+                                if (r == 0)
+                                        r = -EBADMSG;
+                        }
+                        if (IN_SET(r, -EADDRNOTAVAIL, -EBADMSG)) {
+                                log_debug_errno(r, "Data object at offset %"PRIu64" of %s is bad, looking at data objects of entries individually: %m",
+                                                p, f->path);
+                                af->indexed = false;
+                                break;
+                        }
+                        if (r < 0)
+                                return r;
+
+                        r = aggregate_add_data_ref(a, f, p, i, (const uint8_t*) data + k + 1, l - k - 1, NULL);
+                        if (r < 0)
+                                return r;
+
+                        p = next;
+                }
+        }
+
+        r = hashmap_ensure_put(&a->files, &aggregate_file_hash_ops, f, af);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(af);
+        return 0;
+}
+
+static int aggregate_resolve_data(
+                JournalAggregate *a,
+                sd_journal *j,
+                JournalFile *f,
+                const AggregateFile *af,
+                uint64_t p,
+                const AggregateDataRef **ret) {
+
+        AggregateDataRef *existing;
+        bool compressed;
+        Object *o;
+        int r;
+
+        assert(a);
+        assert(j);
+        assert(f);
+        assert(af);
+        assert(ret);
+
+        existing = set_get(a->data_refs, &(AggregateDataRef) { .file = f, .offset = p });
+        if (existing) {
+                *ret = existing;
+                return 1;
+        }
+
+        if (af->indexed && p <= af->tail_offset)
+                return 0;
+
+        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+        if (IN_SET(r, -EADDRNOTAVAIL, -EBADMSG)) {
+                log_debug_errno(r, "Data object at offset %"PRIu64" is bad, skipping over it: %m", p);
+                return 0;
+        }
+        if (r < 0)
+                return r;
+
+        compressed = COMPRESSION_FROM_OBJECT(o) != COMPRESSION_NONE;
+
+        /* Only the start of the payload is decompressed to tell whether it belongs to one of our fields */
+        for (size_t i = 0; i < a->n_fields; i++) {
+                size_t k = strlen(a->fields[i]), l;
+                void *data;
+
+                r = journal_file_data_payload(f, NULL, p, a->fields[i], k, j->data_threshold, &data, &l);
+                if (IN_SET(r, -EADDRNOTAVAIL, -EBADMSG)) {
+                        log_debug_errno(r, "Data object at offset %"PRIu64" is bad, skipping over it: %m", p);
+                        return 0;
+                }
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                return aggregate_add_data_ref(a, f, p, i, (const uint8_t*) data + k + 1, l - k - 1, ret);
+        }
+
+        /* Checking an uncompressed data object again is cheap, don't bloat the cache with them */
+        if (!compressed)
+                return 0;
+
+        return aggregate_add_data_ref(a, f, p, SIZE_MAX, NULL, 0, ret);
+}
+
+int journal_aggregate_add(JournalAggregate *a, sd_journal *j) {
+        JournalAggregateGroup *g;
+        AggregateFile *af;
+        JournalFile *f;
+        usec_t realtime;
+        uint64_t n;
+        Object *o;
+        int r;
+
+        assert(a);
+        assert(j);
+
+        if (a->journal != j || a->invalidate_counter != j->current_invalidate_counter) {
+                /* A journal file might have been closed, and another one might be allocated at the same
+                 * address, hence forget what we know about the files. The groups are kept, of course. */
+                set_clear(a->data_refs);
+                hashmap_clear(a->files);
+                a->journal = j;
+                a->invalidate_counter = j->current_invalidate_counter;
+        }
+
+        f = j->current_file;
+        if (!f || f->current_offset <= 0)
+                return -EADDRNOTAVAIL;
+
+        r = sd_journal_get_realtime_usec(j, &realtime);
+        if (r < 0)
+                return r;
+
+        af = hashmap_get(a->files, f);
+        if (!af) {
+                r = aggregate_index_file(a, j, f, &af);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Collect the item offsets first, reading data objects might move the entry object's window */
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
+        if (r < 0)
+                return r;
+
+        n = journal_file_entry_n_items(f, o);
+        if (!GREEDY_REALLOC(a->item_offsets, n))
+                return -ENOMEM;
+
+        for (uint64_t i = 0; i < n; i++)
+                a->item_offsets[i] = journal_file_entry_item_object_offset(f, o, i);
+
+        a->key->bucket = a->interval > 0 ? realtime - realtime % a->interval : 0;
+        memzero(a->key->values, a->n_fields * sizeof(char*));
+
+        FOREACH_ARRAY(p, a->item_offsets, n) {
+                const AggregateDataRef *d;
+
+                r = aggregate_resolve_data(a, j, f, af, *p, &d);
+                if (r < 0)
+                        return r;
+                if (r == 0 || !d->value)
+                        continue;
+
+                /* Items are ordered by offset, hence if an entry carries a field more than once, it is
+                 * counted for the value that was written to the file first */
+                if (!a->key->values[d->field])
+                        a->key->values[d->field] = d->value;
+        }
+
+        g = set_get(a->groups, a->key);
+        if (g) {
+                g->count++;
+                return 0;
+        }
+
+        g = memdup(a->key, offsetof(JournalAggregateGroup, values) + a->n_fields * sizeof(char*));
+        if (!g)
+                return -ENOMEM;
+
+        g->count = 1;
+
+        r = set_ensure_consume(&a->groups, &aggregate_group_hash_ops, g);
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
+int journal_aggregate_get_groups(JournalAggregate *a, JournalAggregateGroup ***ret, size_t *ret_n) {
+        assert(a);
+        assert(ret);
+
+        /* Returns the groups ordered by bucket, then by value. The array must be freed by the caller, the
+         * groups themselves remain owned by the JournalAggregate object. */
+        return set_dump_sorted(a->groups, (void***) ret, ret_n);
+}
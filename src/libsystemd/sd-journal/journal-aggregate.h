@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "sd-journal.h"
+
+#include "macro.h"
+#include "time-util.h"
+
+/* Counts journal entries grouped by the values of some fields and by time buckets of their realtime
+ * timestamp. Only the item offsets of the entries are looked at: the data objects of the grouping fields are
+ * found by walking each field's list of data objects once per file, hence the data objects of all other
+ * fields are neither read nor decompressed. */
+
+typedef struct JournalAggregate JournalAggregate;
+
+typedef struct JournalAggregateGroup {
+        usec_t bucket;          /* Start of the time bucket, 0 if no interval was specified */
+        uint64_t count;
+        size_t n_values;
+        const char *values[];   /* One per field, NULL if the entries of this group lack the field */
+} JournalAggregateGroup;
+
+int journal_aggregate_new(char * const *fields, usec_t interval, JournalAggregate **ret);
+JournalAggregate* journal_aggregate_free(JournalAggregate *a);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalAggregate*, journal_aggregate_free);
+
+int journal_aggregate_add(JournalAggregate *a, sd_journal *j);
+int journal_aggregate_get_groups(JournalAggregate *a, JournalAggregateGroup ***ret, size_t *ret_n);
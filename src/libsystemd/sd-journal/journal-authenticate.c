@@ -284,6 +284,11 @@ int journal_file_hmac_put_object(JournalFile *f, ObjectType type, Object *o, uin
                 gcry_md_write(f->hmac, &o->tag.seqnum, sizeof(o->tag.seqnum));
                 gcry_md_write(f->hmac, &o->tag.epoch, sizeof(o->tag.epoch));
                 break;
+
+        case OBJECT_COMPRESSION_DICTIONARY:
+                /* All */
+                gcry_md_write(f->hmac, o->compression_dictionary.payload, le64toh(o->object.size) - offsetof(Object, compression_dictionary.payload));
+                break;
         default:
                 return -EINVAL;
         }
@@ -0,0 +1,504 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "hashmap.h"
+#include "journal-columnar.h"
+#include "journal-file.h"
+#include "journal-internal.h"
+#include "memory-util.h"
+#include "set.h"
+#include "siphash24.h"
+#include "string-util.h"
+
+typedef struct ColumnarValue {
+        uint64_t id;
+        size_t size;
+        void *data;
+} ColumnarValue;
+
+typedef struct ColumnarColumn {
+        char *name;
+
+        /* The dictionary of this field in the current block, ordered by ID */
+        ColumnarValue **values;
+        size_t n_values;
+        Set *values_by_data;
+
+        /* For each entry of the current block the number of values of this field, followed by the IDs of all
+         * values in entry order. Entries that were added before the field was first seen in the block are
+         * implicitly padded with zero counts. */
+        uint64_t *counts;
+        size_t n_counts;
+        uint64_t *ids;
+        size_t n_ids;
+} ColumnarColumn;
+
+/* Maps a data object in a journal file to its dictionary entry in the current block. If column is NULL the
+ * data object is not exported. */
+typedef struct ColumnarDataRef {
+        JournalFile *file;
+        uint64_t offset;
+
+        ColumnarColumn *column;
+        ColumnarValue *value;
+} ColumnarDataRef;
+
+struct JournalColumnarWriter {
+        FILE *f;
+        bool header_written;
+
+        size_t block_entries;
+        size_t n_entries;
+        uint64_t *realtime;
+        uint64_t *monotonic;
+        uint64_t *seqnum;
+
+        OrderedHashmap *columns;
+        Set *data_refs;
+
+        /* The data refs are only valid as long as no journal file was closed */
+        sd_journal *journal;
+        unsigned invalidate_counter;
+
+        uint64_t *item_offsets;
+};
+
+static void columnar_value_hash_func(const ColumnarValue *v, struct siphash *state) {
+        siphash24_compress(&v->size, sizeof(v->size), state);
+        siphash24_compress_safe(v->data, v->size, state);
+}
+
+static int columnar_value_compare_func(const ColumnarValue *x, const ColumnarValue *y) {
+        int r;
+
+        r = CMP(x->size, y->size);
+        if (r != 0)
+                return r;
+
+        return memcmp_safe(x->data, y->data, x->size);
+}
+
+DEFINE_PRIVATE_HASH_OPS(columnar_value_hash_ops, ColumnarValue, columnar_value_hash_func, columnar_value_compare_func);
+
+static ColumnarColumn* columnar_column_free(ColumnarColumn *c) {
+        if (!c)
+                return NULL;
+
+        set_free(c->values_by_data);
+
+        FOREACH_ARRAY(v, c->values, c->n_values) {
+                free((*v)->data);
+                free(*v);
+        }
+        free(c->values);
+
+        free(c->counts);
+        free(c->ids);
+        free(c->name);
+
+        return mfree(c);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ColumnarColumn*, columnar_column_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(columnar_column_hash_ops, char, string_hash_func, string_compare_func,
+                                              ColumnarColumn, columnar_column_free);
+
+static void columnar_data_ref_hash_func(const ColumnarDataRef *d, struct siphash *state) {
+        siphash24_compress(&d->file, sizeof(d->file), state);
+        siphash24_compress(&d->offset, sizeof(d->offset), state);
+}
+
+static int columnar_data_ref_compare_func(const ColumnarDataRef *x, const ColumnarDataRef *y) {
+        int r;
+
+        r = CMP(x->file, y->file);
+        if (r != 0)
+                return r;
+
+        return CMP(x->offset, y->offset);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(columnar_data_ref_hash_ops, ColumnarDataRef,
+                                            columnar_data_ref_hash_func, columnar_data_ref_compare_func, free);
+
+int journal_columnar_writer_new(FILE *f, size_t block_entries, JournalColumnarWriter **ret) {
+        _cleanup_(journal_columnar_writer_freep) JournalColumnarWriter *w = NULL;
+
+        assert(f);
+        assert(ret);
+
+        if (block_entries == 0)
+                block_entries = JOURNAL_COLUMNAR_BLOCK_ENTRIES_DEFAULT;
+
+        w = new(JournalColumnarWriter, 1);
+        if (!w)
+                return -ENOMEM;
+
+        *w = (JournalColumnarWriter) {
+                .f = f,
+                .block_entries = block_entries,
+                .realtime = new(uint64_t, block_entries),
+                .monotonic = new(uint64_t, block_entries),
+                .seqnum = new(uint64_t, block_entries),
+        };
+
+        if (!w->realtime || !w->monotonic || !w->seqnum)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
+
+JournalColumnarWriter* journal_columnar_writer_free(JournalColumnarWriter *w) {
+        if (!w)
+                return NULL;
+
+        set_free(w->data_refs);
+        ordered_hashmap_free(w->columns);
+
+        free(w->realtime);
+        free(w->monotonic);
+        free(w->seqnum);
+        free(w->item_offsets);
+
+        return mfree(w);
+}
+
+static int columnar_get_column(JournalColumnarWriter *w, const char *name, size_t name_len, ColumnarColumn **ret) {
+        _cleanup_(columnar_column_freep) ColumnarColumn *c = NULL;
+        _cleanup_free_ char *n = NULL;
+        ColumnarColumn *existing;
+        int r;
+
+        assert(w);
+        assert(name);
+        assert(ret);
+
+        n = strndup(name, name_len);
+        if (!n)
+                return -ENOMEM;
+
+        existing = ordered_hashmap_get(w->columns, n);
+        if (existing) {
+                *ret = existing;
+                return 0;
+        }
+
+        c = new0(ColumnarColumn, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->name = TAKE_PTR(n);
+
+        r = ordered_hashmap_ensure_put(&w->columns, &columnar_column_hash_ops, c->name, c);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+static int columnar_column_get_value(ColumnarColumn *c, const void *data, size_t size, ColumnarValue **ret) {
+        _cleanup_free_ ColumnarValue *v = NULL;
+        ColumnarValue *existing;
+        int r;
+
+        assert(c);
+        assert(data || size == 0);
+        assert(ret);
+
+        existing = set_get(c->values_by_data, &(ColumnarValue) { .data = (void*) data, .size = size });
+        if (existing) {
+                *ret = existing;
+                return 0;
+        }
+
+        if (!GREEDY_REALLOC(c->values, c->n_values + 1))
+                return -ENOMEM;
+
+        v = new(ColumnarValue, 1);
+        if (!v)
+                return -ENOMEM;
+
+        *v = (ColumnarValue) {
+                .id = c->n_values,
+                .size = size,
+                .data = memdup_suffix0(data, size),
+        };
+        if (!v->data)
+                return -ENOMEM;
+
+        r = set_ensure_put(&c->values_by_data, &columnar_value_hash_ops, v);
+        if (r < 0) {
+                free(v->data);
+                return r;
+        }
+
+        c->values[c->n_values++] = v;
+        *ret = TAKE_PTR(v);
+        return 0;
+}
+
+static int columnar_column_record(ColumnarColumn *c, size_t entry, const ColumnarValue *v) {
+        assert(c);
+        assert(v);
+        assert(c->n_counts <= entry + 1);
+
+        if (c->n_counts < entry + 1) {
+                if (!GREEDY_REALLOC(c->counts, entry + 1))
+                        return -ENOMEM;
+
+                memzero(c->counts + c->n_counts, (entry + 1 - c->n_counts) * sizeof(uint64_t));
+                c->n_counts = entry + 1;
+        }
+
+        if (!GREEDY_REALLOC(c->ids, c->n_ids + 1))
+                return -ENOMEM;
+
+        c->ids[c->n_ids++] = v->id;
+        c->counts[entry]++;
+
+        return 0;
+}
+
+static int columnar_add_string(JournalColumnarWriter *w, const char *field, const char *value) {
+        ColumnarColumn *c;
+        ColumnarValue *v;
+        int r;
+
+        assert(w);
+        assert(field);
+        assert(value);
+
+        r = columnar_get_column(w, field, strlen(field), &c);
+        if (r < 0)
+                return r;
+
+        r = columnar_column_get_value(c, value, strlen(value), &v);
+        if (r < 0)
+                return r;
+
+        return columnar_column_record(c, w->n_entries, v);
+}
+
+static int columnar_resolve_data(JournalColumnarWriter *w, sd_journal *j, JournalFile *f, uint64_t p, ColumnarDataRef **ret) {
+        _cleanup_free_ ColumnarDataRef *d = NULL;
+        ColumnarDataRef *existing;
+        const char *eq;
+        size_t l;
+        void *data;
+        int r;
+
+        assert(w);
+        assert(j);
+        assert(f);
+        assert(ret);
+
+        existing = set_get(w->data_refs, &(ColumnarDataRef) { .file = f, .offset = p });
+        if (existing) {
+                *ret = existing;
+                return 1;
+        }
+
+        /* Only data objects we haven't seen in this block yet are read and decompressed */
+        r = journal_file_data_payload(f, NULL, p, NULL, 0, j->data_threshold, &data, &l);
+        if (IN_SET(r, -EADDRNOTAVAIL, -EBADMSG)) {
+                log_debug_errno(r, "Data object at offset %"PRIu64" is bad, skipping over it: %m", p);
+                return 0;
+        }
+        if (r < 0)
+                return r;
+
+        d = new(ColumnarDataRef, 1);
+        if (!d)
+                return -ENOMEM;
+
+        *d = (ColumnarDataRef) {
+                .file = f,
+                .offset = p,
+        };
+
+        eq = memchr(data, '=', l);
+
+        /* The boot ID is taken from the entry header, like the export format does */
+        if (eq && !memory_startswith(data, l, "_BOOT_ID=")) {
+                r = columnar_get_column(w, data, eq - (const char*) data, &d->column);
+                if (r < 0)
+                        return r;
+
+                r = columnar_column_get_value(d->column, eq + 1, l - (eq + 1 - (const char*) data), &d->value);
+                if (r < 0)
+                        return r;
+        }
+
+        r = set_ensure_put(&w->data_refs, &columnar_data_ref_hash_ops, d);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(d);
+        return 1;
+}
+
+int journal_columnar_writer_add(JournalColumnarWriter *w, sd_journal *j) {
+        sd_id128_t boot_id, seqnum_id;
+        uint64_t realtime, monotonic, seqnum, n;
+        JournalFile *f;
+        Object *o;
+        int r;
+
+        assert(w);
+        assert(j);
+
+        if (w->n_entries >= w->block_entries) {
+                r = journal_columnar_writer_flush(w);
+                if (r < 0)
+                        return r;
+        }
+
+        if (w->journal != j || w->invalidate_counter != j->current_invalidate_counter) {
+                /* A journal file might have been closed, and another one might be allocated at the same
+                 * address, hence forget where we saw which data. */
+                set_clear(w->data_refs);
+                w->journal = j;
+                w->invalidate_counter = j->current_invalidate_counter;
+        }
+
+        f = j->current_file;
+        if (!f || f->current_offset <= 0)
+                return -EADDRNOTAVAIL;
+
+        r = sd_journal_get_realtime_usec(j, &realtime);
+        if (r < 0)
+                return r;
+
+        r = sd_journal_get_monotonic_usec(j, &monotonic, &boot_id);
+        if (r < 0)
+                return r;
+
+        r = sd_journal_get_seqnum(j, &seqnum, &seqnum_id);
+        if (r < 0)
+                return r;
+
+        /* Collect the item offsets first, reading the data objects might move the entry object's window */
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
+        if (r < 0)
+                return r;
+
+        n = journal_file_entry_n_items(f, o);
+        if (!GREEDY_REALLOC(w->item_offsets, n))
+                return -ENOMEM;
+
+        for (uint64_t i = 0; i < n; i++)
+                w->item_offsets[i] = journal_file_entry_item_object_offset(f, o, i);
+
+        r = columnar_add_string(w, "_BOOT_ID", SD_ID128_TO_STRING(boot_id));
+        if (r < 0)
+                return r;
+
+        r = columnar_add_string(w, "__SEQNUM_ID", SD_ID128_TO_STRING(seqnum_id));
+        if (r < 0)
+                return r;
+
+        FOREACH_ARRAY(p, w->item_offsets, n) {
+                ColumnarDataRef *d;
+
+                r = columnar_resolve_data(w, j, f, *p, &d);
+                if (r < 0)
+                        return r;
+                if (r == 0 || !d->column)
+                        continue;
+
+                r = columnar_column_record(d->column, w->n_entries, d->value);
+                if (r < 0)
+                        return r;
+        }
+
+        w->realtime[w->n_entries] = realtime;
+        w->monotonic[w->n_entries] = monotonic;
+        w->seqnum[w->n_entries] = seqnum;
+        w->n_entries++;
+
+        return 0;
+}
+
+static void columnar_write_varint(FILE *f, uint64_t v) {
+        assert(f);
+
+        do {
+                uint8_t b = v & 0x7f;
+
+                v >>= 7;
+                if (v != 0)
+                        b |= 0x80;
+
+                fputc_unlocked(b, f);
+        } while (v != 0);
+}
+
+static void columnar_write_delta_column(FILE *f, const uint64_t *a, size_t n) {
+        uint64_t previous = 0;
+
+        assert(f);
+        assert(a || n == 0);
+
+        /* Deltas may be negative (entries of different boots or files interleave), hence zigzag encode them */
+        FOREACH_ARRAY(i, a, n) {
+                int64_t d = (int64_t) (*i - previous);
+
+                columnar_write_varint(f, ((uint64_t) d << 1) ^ (uint64_t) (d >> 63));
+                previous = *i;
+        }
+}
+
+int journal_columnar_writer_flush(JournalColumnarWriter *w) {
+        ColumnarColumn *c;
+
+        assert(w);
+
+        if (w->n_entries == 0)
+                return 0;
+
+        if (!w->header_written) {
+                fputs(JOURNAL_COLUMNAR_MAGIC, w->f);
+                w->header_written = true;
+        }
+
+        columnar_write_varint(w->f, w->n_entries);
+        columnar_write_varint(w->f, ordered_hashmap_size(w->columns));
+
+        columnar_write_delta_column(w->f, w->realtime, w->n_entries);
+        columnar_write_delta_column(w->f, w->monotonic, w->n_entries);
+        columnar_write_delta_column(w->f, w->seqnum, w->n_entries);
+
+        ORDERED_HASHMAP_FOREACH(c, w->columns) {
+                const uint64_t *id = c->ids;
+
+                columnar_write_varint(w->f, strlen(c->name));
+                fputs(c->name, w->f);
+
+                columnar_write_varint(w->f, c->n_values);
+                FOREACH_ARRAY(v, c->values, c->n_values) {
+                        columnar_write_varint(w->f, (*v)->size);
+                        fwrite((*v)->data, 1, (*v)->size, w->f);
+                }
+
+                for (size_t i = 0; i < w->n_entries; i++) {
+                        uint64_t k = i < c->n_counts ? c->counts[i] : 0;
+
+                        columnar_write_varint(w->f, k);
+                        for (; k > 0; k--)
+                                columnar_write_varint(w->f, *(id++));
+                }
+
+                assert(id == c->ids + c->n_ids);
+        }
+
+        /* Dictionaries are per block, so that each block can be decoded on its own */
+        set_clear(w->data_refs);
+        ordered_hashmap_clear(w->columns);
+        w->n_entries = 0;
+
+        return fflush_and_check(w->f);
+}
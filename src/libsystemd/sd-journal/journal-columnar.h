@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stdio.h>
+
+#include "sd-journal.h"
+
+#include "macro.h"
+
+/* Writes journal entries in the column-oriented "Journal Columnar Format", see
+ * docs/JOURNAL_EXPORT_FORMATS.md. Entries are collected into blocks, and within a block each field is
+ * stored as a column of dictionary IDs. Data objects are deduplicated by their location in the journal
+ * file, hence each distinct data object is only decompressed once per block. */
+
+#define JOURNAL_COLUMNAR_MAGIC "SDJCOL1\n"
+#define JOURNAL_COLUMNAR_BLOCK_ENTRIES_DEFAULT 16384U
+
+typedef struct JournalColumnarWriter JournalColumnarWriter;
+
+int journal_columnar_writer_new(FILE *f, size_t block_entries, JournalColumnarWriter **ret);
+JournalColumnarWriter* journal_columnar_writer_free(JournalColumnarWriter *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalColumnarWriter*, journal_columnar_writer_free);
+
+int journal_columnar_writer_add(JournalColumnarWriter *w, sd_journal *j);
+int journal_columnar_writer_flush(JournalColumnarWriter *w);
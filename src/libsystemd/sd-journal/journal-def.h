@@ -23,6 +23,7 @@ typedef struct EntryObject EntryObject;
 typedef struct HashTableObject HashTableObject;
 typedef struct EntryArrayObject EntryArrayObject;
 typedef struct TagObject TagObject;
+typedef struct CompressionDictionaryObject CompressionDictionaryObject;
 
 typedef struct HashItem HashItem;
 
@@ -38,6 +39,7 @@ typedef enum ObjectType {
         OBJECT_FIELD_HASH_TABLE,
         OBJECT_ENTRY_ARRAY,
         OBJECT_TAG,
+        OBJECT_COMPRESSION_DICTIONARY,
         _OBJECT_TYPE_MAX,
         _OBJECT_TYPE_INVALID = -EINVAL,
 } ObjectType;
@@ -150,6 +152,11 @@ struct TagObject {
         uint8_t tag[TAG_LENGTH]; /* SHA-256 HMAC */
 } _packed_;
 
+struct CompressionDictionaryObject {
+        ObjectHeader object;
+        uint8_t payload[]; /* ZSTD dictionary */
+} _packed_;
+
 union Object {
         ObjectHeader object;
         DataObject data;
@@ -158,6 +165,7 @@ union Object {
         HashTableObject hash_table;
         EntryArrayObject entry_array;
         TagObject tag;
+        CompressionDictionaryObject compression_dictionary;
 };
 
 enum {
@@ -174,16 +182,19 @@ enum {
         HEADER_INCOMPATIBLE_KEYED_HASH      = 1 << 2,
         HEADER_INCOMPATIBLE_COMPRESSED_ZSTD = 1 << 3,
         HEADER_INCOMPATIBLE_COMPACT         = 1 << 4,
+        HEADER_INCOMPATIBLE_ZSTD_DICTIONARY = 1 << 5,
 
         HEADER_INCOMPATIBLE_ANY             = HEADER_INCOMPATIBLE_COMPRESSED_XZ |
                                               HEADER_INCOMPATIBLE_COMPRESSED_LZ4 |
                                               HEADER_INCOMPATIBLE_KEYED_HASH |
                                               HEADER_INCOMPATIBLE_COMPRESSED_ZSTD |
-                                              HEADER_INCOMPATIBLE_COMPACT,
+                                              HEADER_INCOMPATIBLE_COMPACT |
+                                              HEADER_INCOMPATIBLE_ZSTD_DICTIONARY,
 
         HEADER_INCOMPATIBLE_SUPPORTED       = (HAVE_XZ ? HEADER_INCOMPATIBLE_COMPRESSED_XZ : 0) |
                                               (HAVE_LZ4 ? HEADER_INCOMPATIBLE_COMPRESSED_LZ4 : 0) |
                                               (HAVE_ZSTD ? HEADER_INCOMPATIBLE_COMPRESSED_ZSTD : 0) |
+                                              (HAVE_ZSTD ? HEADER_INCOMPATIBLE_ZSTD_DICTIONARY : 0) |
                                               HEADER_INCOMPATIBLE_KEYED_HASH |
                                               HEADER_INCOMPATIBLE_COMPACT,
 };
@@ -242,12 +253,14 @@ enum {
         le32_t tail_entry_array_n_entries;              \
         /* Added in 254 */                              \
         le64_t tail_entry_offset;                       \
+        /* Added in 255 */                              \
+        le64_t compression_dictionary_offset;           \
         }
 
 struct Header struct_Header__contents;
 struct Header__packed struct_Header__contents _packed_;
 assert_cc(sizeof(struct Header) == sizeof(struct Header__packed));
-assert_cc(sizeof(struct Header) == 272);
+assert_cc(sizeof(struct Header) == 280);
 
 #define FSS_HEADER_SIGNATURE                                            \
         ((const char[]) { 'K', 'S', 'H', 'H', 'R', 'H', 'L', 'P' })
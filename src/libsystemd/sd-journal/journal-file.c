@@ -24,6 +24,7 @@
 #include "journal-authenticate.h"
 #include "journal-def.h"
 #include "journal-file.h"
+#include "journal-index.h"
 #include "journal-internal.h"
 #include "lookup3.h"
 #include "memory-util.h"
@@ -47,6 +48,17 @@
 #define DEFAULT_COMPRESS_THRESHOLD (512ULL)
 #define MIN_COMPRESS_THRESHOLD (8ULL)
 
+/* With a trained dictionary even short payloads compress well, only the tiniest ones don't make up for the
+ * frame overhead */
+#define DICTIONARY_COMPRESS_THRESHOLD (32ULL)
+
+/* The dictionary is trained once this many payloads or bytes have been collected. Payloads larger than the
+ * sample size limit compress well on their own, and aren't used for training. */
+#define DICTIONARY_SIZE_MAX (16U * 1024U)                 /* 16 KiB */
+#define DICTIONARY_SAMPLES_MAX 4096U
+#define DICTIONARY_SAMPLES_SIZE_MAX (512U * 1024U)        /* 512 KiB */
+#define DICTIONARY_SAMPLE_SIZE_MAX (4U * 1024U)           /* 4 KiB */
+
 /* This is the minimum journal file size */
 #define JOURNAL_FILE_SIZE_MIN (512 * 1024ULL)             /* 512 KiB */
 #define JOURNAL_COMPACT_SIZE_MAX UINT32_MAX               /* 4 GiB */
@@ -286,6 +298,7 @@ JournalFile* journal_file_close(JournalFile *f) {
                 return NULL;
 
         assert(f->newest_boot_id_prioq_idx == PRIOQ_IDX_NULL);
+        assert(f->merge_prioq_idx == PRIOQ_IDX_NULL);
 
         if (f->cache_fd)
                 mmap_cache_fd_free(f->cache_fd);
@@ -295,11 +308,16 @@ JournalFile* journal_file_close(JournalFile *f) {
         free(f->path);
 
         ordered_hashmap_free_free(f->chain_cache);
+        journal_index_free(f->index);
 
 #if HAVE_COMPRESSION
         free(f->compress_buffer);
 #endif
 
+        compress_dictionary_free(f->compress_dictionary);
+        free(f->dictionary_samples);
+        free(f->dictionary_sample_sizes);
+
 #if HAVE_GCRYPT
         if (f->fss_file)
                 munmap(f->fss_file, PAGE_ALIGN(f->fss_file_size));
@@ -349,6 +367,23 @@ static bool compact_mode_requested(void) {
         return cached;
 }
 
+static bool compress_dictionary_requested(void) {
+        static thread_local int cached = -1;
+        int r;
+
+        if (cached < 0) {
+                r = getenv_bool("SYSTEMD_JOURNAL_COMPRESS_DICTIONARY");
+                if (r < 0) {
+                        if (r != -ENXIO)
+                                log_debug_errno(r, "Failed to parse $SYSTEMD_JOURNAL_COMPRESS_DICTIONARY environment variable, ignoring: %m");
+                        cached = false;
+                } else
+                        cached = r;
+        }
+
+        return cached;
+}
+
 #if HAVE_COMPRESSION
 static Compression getenv_compression(void) {
         Compression c;
@@ -396,6 +431,7 @@ static int journal_file_init_header(
                 JournalFileFlags file_flags,
                 JournalFile *template) {
 
+        Compression c = FLAGS_SET(file_flags, JOURNAL_COMPRESS) ? compression_requested() : COMPRESSION_NONE;
         bool seal = false;
         ssize_t k;
         int r;
@@ -410,9 +446,10 @@ static int journal_file_init_header(
         Header h = {
                 .header_size = htole64(ALIGN64(sizeof(h))),
                 .incompatible_flags = htole32(
-                                FLAGS_SET(file_flags, JOURNAL_COMPRESS) * COMPRESSION_TO_HEADER_INCOMPATIBLE_FLAG(compression_requested()) |
+                                COMPRESSION_TO_HEADER_INCOMPATIBLE_FLAG(c) |
                                 keyed_hash_requested() * HEADER_INCOMPATIBLE_KEYED_HASH |
-                                compact_mode_requested() * HEADER_INCOMPATIBLE_COMPACT),
+                                compact_mode_requested() * HEADER_INCOMPATIBLE_COMPACT |
+                                (c == COMPRESSION_ZSTD && compress_dictionary_requested()) * HEADER_INCOMPATIBLE_ZSTD_DICTIONARY),
                 .compatible_flags = htole32(
                                 (seal * HEADER_COMPATIBLE_SEALED) |
                                 HEADER_COMPATIBLE_TAIL_ENTRY_BOOT_ID),
@@ -480,7 +517,7 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                   f->path, type, flags & ~any);
                 flags = (flags & any) & ~supported;
                 if (flags) {
-                        const char* strv[6];
+                        const char* strv[7];
                         size_t n = 0;
                         _cleanup_free_ char *t = NULL;
 
@@ -498,6 +535,8 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                         strv[n++] = "keyed-hash";
                                 if (flags & HEADER_INCOMPATIBLE_COMPACT)
                                         strv[n++] = "compact";
+                                if (flags & HEADER_INCOMPATIBLE_ZSTD_DICTIONARY)
+                                        strv[n++] = "zstd-dictionary";
                         }
                         strv[n] = NULL;
                         assert(n < ELEMENTSOF(strv));
@@ -627,6 +666,10 @@ static int journal_file_verify_header(JournalFile *f) {
                 if (!offset_is_valid(le64toh(f->header->tail_entry_offset), header_size, tail_object_offset))
                         return -ENODATA;
 
+        if (JOURNAL_HEADER_CONTAINS(f->header, compression_dictionary_offset))
+                if (!offset_is_valid(le64toh(f->header->compression_dictionary_offset), header_size, tail_object_offset))
+                        return -ENODATA;
+
         /* Verify number of objects */
         uint64_t n_objects = le64toh(f->header->n_objects);
         if (n_objects > arena_size / sizeof(ObjectHeader))
@@ -792,6 +835,46 @@ static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size)
         return journal_file_fstat(f);
 }
 
+int journal_file_preallocate(JournalFile *f, uint64_t headroom) {
+        uint64_t p, old_arena_size;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Grows the file ahead of time, so that at least the specified number of bytes may be appended
+         * before journal_file_allocate() has to call posix_fallocate() in the append path. Returns > 0 if
+         * the file was grown, 0 if there was enough room already, or the file may not grow any further. */
+
+        if (!journal_file_writable(f))
+                return -EPERM;
+
+        /* Growing the file means updating the header, hence leave files alone that are offline or being
+         * offlined. They'll be set online again by the next append, which allocates as needed anyway. */
+        if (f->offline_state != OFFLINE_JOINED || f->header->state != STATE_ONLINE)
+                return 0;
+
+        r = journal_file_tail_end_by_mmap(f, &p);
+        if (r < 0)
+                return r;
+
+        /* The file is rotated before it reaches its maximum size anyway */
+        if (f->metrics.max_size > 0)
+                headroom = MIN(headroom, LESS_BY(f->metrics.max_size, p));
+        if (headroom == 0)
+                return 0;
+
+        old_arena_size = le64toh(f->header->arena_size);
+
+        r = journal_file_allocate(f, p, headroom);
+        if (r == -E2BIG) /* Hit the disk space or file size limits, the append path will handle that */
+                return 0;
+        if (r < 0)
+                return r;
+
+        return le64toh(f->header->arena_size) > old_arena_size;
+}
+
 static unsigned type_to_context(ObjectType type) {
         /* One context for each type, plus one catch-all for the rest */
         assert_cc(_OBJECT_TYPE_MAX <= MMAP_CACHE_MAX_CONTEXTS);
@@ -848,6 +931,7 @@ static uint64_t minimum_header_size(JournalFile *f, Object *o) {
                 [OBJECT_FIELD_HASH_TABLE] = sizeof(HashTableObject),
                 [OBJECT_ENTRY_ARRAY]      = sizeof(EntryArrayObject),
                 [OBJECT_TAG]              = sizeof(TagObject),
+                [OBJECT_COMPRESSION_DICTIONARY] = sizeof(CompressionDictionaryObject),
         };
 
         assert(f);
@@ -1046,6 +1130,16 @@ static int check_object(JournalFile *f, Object *o, uint64_t offset) {
                                                le64toh(o->tag.epoch), offset);
 
                 break;
+
+        case OBJECT_COMPRESSION_DICTIONARY:
+                if (le64toh(o->object.size) <= offsetof(Object, compression_dictionary.payload))
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Bad compression dictionary size (<= %zu): %" PRIu64 ": %" PRIu64,
+                                               offsetof(Object, compression_dictionary.payload),
+                                               le64toh(o->object.size),
+                                               offset);
+
+                break;
         }
 
         return 0;
@@ -1762,6 +1856,140 @@ static int journal_file_append_field(
         return 0;
 }
 
+int journal_file_get_compress_dictionary(JournalFile *f, CompressDictionary **ret) {
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Returns the dictionary DATA objects are compressed with, or NULL if there is none (yet). The
+         * dictionary object has an mmap context of its own, hence loading it leaves any DATA object the
+         * caller is looking at mapped. */
+
+        if (!f->compress_dictionary &&
+            JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) &&
+            JOURNAL_HEADER_CONTAINS(f->header, compression_dictionary_offset)) {
+                p = le64toh(READ_NOW(f->header->compression_dictionary_offset));
+                if (p != 0) {
+                        r = journal_file_move_to_object(f, OBJECT_COMPRESSION_DICTIONARY, p, &o);
+                        if (r < 0)
+                                return r;
+
+                        r = compress_dictionary_new(
+                                        o->compression_dictionary.payload,
+                                        le64toh(READ_NOW(o->object.size)) - offsetof(Object, compression_dictionary.payload),
+                                        &f->compress_dictionary);
+                        if (r < 0)
+                                return log_debug_errno(r, "Failed to load compression dictionary of %s: %m", f->path);
+                }
+        }
+
+        if (ret)
+                *ret = f->compress_dictionary;
+
+        return !!f->compress_dictionary;
+}
+
+static int journal_file_append_compress_dictionary(JournalFile *f, const void *data, size_t size) {
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(data);
+
+        r = compress_dictionary_new(data, size, &d);
+        if (r < 0)
+                return r;
+
+        r = journal_file_append_object(f, OBJECT_COMPRESSION_DICTIONARY,
+                                       offsetof(Object, compression_dictionary.payload) + size, &o, &p);
+        if (r < 0)
+                return r;
+
+        memcpy(o->compression_dictionary.payload, data, size);
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_COMPRESSION_DICTIONARY, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        /* Readers may only pick it up once it is complete */
+        f->header->compression_dictionary_offset = htole64(p);
+        f->compress_dictionary = TAKE_PTR(d);
+
+        log_debug("Appended %zu byte compression dictionary %"PRIu32" to %s.",
+                  size, compress_dictionary_id(f->compress_dictionary), f->path);
+
+        return 0;
+}
+
+static int journal_file_train_compress_dictionary(JournalFile *f, const void *data, uint64_t size) {
+        _cleanup_free_ void *dictionary = NULL;
+        size_t dictionary_size;
+        usec_t begin;
+        int r;
+
+        assert(f);
+
+        /* Collects the payloads written to a file until there are enough of them, then trains a
+         * dictionary from them and appends it to the file. If that fails we don't try again, and stick to
+         * compressing payloads individually. */
+
+        if (!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) || f->dictionary_failed)
+                return 0;
+
+        r = journal_file_get_compress_dictionary(f, NULL);
+        if (r != 0)
+                return r;
+
+        if (size > DICTIONARY_SAMPLE_SIZE_MAX)
+                return 0;
+
+        if (!GREEDY_REALLOC(f->dictionary_samples, f->dictionary_samples_size + size) ||
+            !GREEDY_REALLOC(f->dictionary_sample_sizes, f->n_dictionary_samples + 1))
+                return -ENOMEM;
+
+        memcpy(f->dictionary_samples + f->dictionary_samples_size, data, size);
+        f->dictionary_samples_size += size;
+        f->dictionary_sample_sizes[f->n_dictionary_samples++] = size;
+
+        if (f->n_dictionary_samples < DICTIONARY_SAMPLES_MAX &&
+            f->dictionary_samples_size < DICTIONARY_SAMPLES_SIZE_MAX)
+                return 0;
+
+        begin = now(CLOCK_MONOTONIC);
+
+        r = compress_dictionary_train(f->dictionary_samples, f->dictionary_sample_sizes, f->n_dictionary_samples,
+                                      DICTIONARY_SIZE_MAX, &dictionary, &dictionary_size);
+
+        f->dictionary_samples = mfree(f->dictionary_samples);
+        f->dictionary_sample_sizes = mfree(f->dictionary_sample_sizes);
+        f->dictionary_samples_size = f->n_dictionary_samples = 0;
+
+        if (r >= 0) {
+                log_debug("Trained compression dictionary for %s in %s.",
+                          f->path, FORMAT_TIMESPAN(usec_sub_unsigned(now(CLOCK_MONOTONIC), begin), USEC_PER_MSEC));
+
+                r = journal_file_append_compress_dictionary(f, dictionary, dictionary_size);
+        }
+        if (r < 0) {
+                f->dictionary_failed = true;
+
+                /* Running out of space is something the caller has to deal with, let it know */
+                if (r == -E2BIG)
+                        return r;
+
+                log_debug_errno(r, "Failed to set up compression dictionary for %s, compressing without: %m", f->path);
+        }
+
+        return 0;
+}
+
 static int maybe_compress_payload(JournalFile *f, uint8_t *dst, const uint8_t *src, uint64_t size, size_t *rsize) {
         assert(f);
         assert(f->header);
@@ -1771,7 +1999,23 @@ static int maybe_compress_payload(JournalFile *f, uint8_t *dst, const uint8_t *s
         int r;
 
         c = JOURNAL_FILE_COMPRESSION(f);
-        if (c == COMPRESSION_NONE || size < f->compress_threshold_bytes)
+        if (c == COMPRESSION_NONE)
+                return 0;
+
+        if (c == COMPRESSION_ZSTD && f->compress_dictionary) {
+                if (size < MIN(f->compress_threshold_bytes, DICTIONARY_COMPRESS_THRESHOLD))
+                        return 0;
+
+                r = compress_blob_zstd_with_dictionary(f->compress_dictionary, src, size, dst, size - 1, rsize);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to compress data object using dictionary, ignoring: %m");
+
+                log_debug("Compressed data object %"PRIu64" -> %zu using dictionary", size, *rsize);
+
+                return 1; /* compressed */
+        }
+
+        if (size < f->compress_threshold_bytes)
                 return 0;
 
         r = compress_blob(c, src, size, dst, size - 1, rsize);
@@ -1816,6 +2060,10 @@ static int journal_file_append_data(
         if (!eq)
                 return -EINVAL;
 
+        r = journal_file_train_compress_dictionary(f, data, size);
+        if (r < 0)
+                return r;
+
         osize = journal_file_data_payload_offset(f) + size;
         r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
         if (r < 0)
@@ -1892,8 +2140,12 @@ static int maybe_decompress_payload(
                 int r;
 
                 if (field) {
-                        r = decompress_startswith(compression, payload, size, &f->compress_buffer, field,
-                                                  field_length, '=');
+                        if (compression == COMPRESSION_ZSTD)
+                                r = decompress_startswith_zstd_with_dictionary(f->compress_dictionary, payload, size,
+                                                                               &f->compress_buffer, field, field_length, '=');
+                        else
+                                r = decompress_startswith(compression, payload, size, &f->compress_buffer, field,
+                                                          field_length, '=');
                         if (r < 0)
                                 return log_debug_errno(r,
                                                        "Cannot decompress %s object of length %" PRIu64 ": %m",
@@ -1908,7 +2160,11 @@ static int maybe_decompress_payload(
                         }
                 }
 
-                r = decompress_blob(compression, payload, size, &f->compress_buffer, &rsize, 0);
+                if (compression == COMPRESSION_ZSTD)
+                        r = decompress_blob_zstd_with_dictionary(f->compress_dictionary, payload, size,
+                                                                 &f->compress_buffer, &rsize, 0);
+                else
+                        r = decompress_blob(compression, payload, size, &f->compress_buffer, &rsize, 0);
                 if (r < 0)
                         return r;
 
@@ -1970,6 +2226,12 @@ int journal_file_data_payload(
         if (c < 0)
                 return -EPROTONOSUPPORT;
 
+        if (c == COMPRESSION_ZSTD) {
+                r = journal_file_get_compress_dictionary(f, NULL);
+                if (r < 0)
+                        return r;
+        }
+
         return maybe_decompress_payload(f, journal_file_data_payload_field(f, o), size, c, field,
                                         field_length, data_threshold, ret_data, ret_size);
 }
@@ -2032,15 +2294,17 @@ static void write_entry_array_item(JournalFile *f, Object *o, uint64_t i, uint64
                 o->entry_array.items.regular[i] = htole64(p);
 }
 
-static int link_entry_into_array(
+static int link_entries_into_array(
                 JournalFile *f,
                 le64_t *first,
                 le64_t *idx,
                 le32_t *tail,
                 le32_t *tidx,
-                uint64_t p) {
+                const uint64_t p[],
+                size_t n_p) {
 
         uint64_t n = 0, ap = 0, q, i, a, hidx;
+        size_t k = 0;
         Object *o;
         int r;
 
@@ -2048,7 +2312,13 @@ static int link_entry_into_array(
         assert(f->header);
         assert(first);
         assert(idx);
-        assert(p > 0);
+        assert(p || n_p == 0);
+
+        /* Appends the specified entry offsets to the specified entry array chain, in order. If this fails
+         * half-way, *idx reflects how many of them have been linked. */
+
+        if (n_p == 0)
+                return 0;
 
         a = tail ? le32toh(*tail) : le64toh(*first);
         hidx = le64toh(READ_NOW(*idx));
@@ -2060,118 +2330,181 @@ static int link_entry_into_array(
                         return r;
 
                 n = journal_file_entry_array_n_items(f, o);
-                if (i < n) {
-                        write_entry_array_item(f, o, i, p);
-                        *idx = htole64(hidx + 1);
+
+                /* Fill up the free slots of this array, if there are any */
+                for (; i < n && k < n_p; i++, k++) {
+                        assert(p[k] > 0);
+
+                        write_entry_array_item(f, o, i, p[k]);
+                        *idx = htole64(++hidx);
                         if (tidx)
                                 *tidx = htole32(le32toh(*tidx) + 1);
-                        return 0;
                 }
+                if (k >= n_p)
+                        return 0;
 
                 i -= n;
                 ap = a;
                 a = le64toh(o->entry_array.next_entry_array_offset);
         }
 
-        if (hidx > n)
-                n = (hidx+1) * 2;
-        else
-                n = n * 2;
+        while (k < n_p) {
+                uint64_t m;
 
-        if (n < 4)
-                n = 4;
+                if (hidx > n)
+                        n = (hidx+1) * 2;
+                else
+                        n = n * 2;
 
-        r = journal_file_append_object(f, OBJECT_ENTRY_ARRAY,
-                                       offsetof(Object, entry_array.items) + n * journal_file_entry_array_item_size(f),
-                                       &o, &q);
-        if (r < 0)
-                return r;
+                if (n < 4)
+                        n = 4;
+
+                r = journal_file_append_object(f, OBJECT_ENTRY_ARRAY,
+                                               offsetof(Object, entry_array.items) + n * journal_file_entry_array_item_size(f),
+                                               &o, &q);
+                if (r < 0)
+                        return r;
 
 #if HAVE_GCRYPT
-        r = journal_file_hmac_put_object(f, OBJECT_ENTRY_ARRAY, o, q);
-        if (r < 0)
-                return r;
+                r = journal_file_hmac_put_object(f, OBJECT_ENTRY_ARRAY, o, q);
+                if (r < 0)
+                        return r;
 #endif
 
-        write_entry_array_item(f, o, i, p);
+                for (m = 0; i < n && k < n_p; i++, k++, m++) {
+                        assert(p[k] > 0);
+                        write_entry_array_item(f, o, i, p[k]);
+                }
 
-        if (ap == 0)
-                *first = htole64(q);
-        else {
-                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, ap, &o);
-                if (r < 0)
-                        return r;
+                if (ap == 0)
+                        *first = htole64(q);
+                else {
+                        r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, ap, &o);
+                        if (r < 0)
+                                return r;
 
-                o->entry_array.next_entry_array_offset = htole64(q);
-        }
+                        o->entry_array.next_entry_array_offset = htole64(q);
+                }
 
-        if (tail)
-                *tail = htole32(q);
+                if (tail)
+                        *tail = htole32(q);
 
-        if (JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
-                f->header->n_entry_arrays = htole64(le64toh(f->header->n_entry_arrays) + 1);
+                if (JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
+                        f->header->n_entry_arrays = htole64(le64toh(f->header->n_entry_arrays) + 1);
+
+                hidx += m;
+                *idx = htole64(hidx);
+                if (tidx)
+                        *tidx = htole32(m);
 
-        *idx = htole64(hidx + 1);
-        if (tidx)
-                *tidx = htole32(1);
+                ap = q;
+                i = 0;
+        }
 
         return 0;
 }
 
-static int link_entry_into_array_plus_one(
+static int link_entry_into_array(
                 JournalFile *f,
-                le64_t *extra,
                 le64_t *first,
                 le64_t *idx,
                 le32_t *tail,
                 le32_t *tidx,
                 uint64_t p) {
 
+        assert(p > 0);
+
+        return link_entries_into_array(f, first, idx, tail, tidx, &p, 1);
+}
+
+static int link_entries_into_array_plus_one(
+                JournalFile *f,
+                le64_t *extra,
+                le64_t *first,
+                le64_t *idx,
+                le32_t *tail,
+                le32_t *tidx,
+                const uint64_t p[],
+                size_t n_p) {
+
         uint64_t hidx;
+        le64_t i;
         int r;
 
         assert(f);
         assert(extra);
         assert(first);
         assert(idx);
-        assert(p > 0);
+        assert(p || n_p == 0);
+
+        if (n_p == 0)
+                return 0;
 
         hidx = le64toh(READ_NOW(*idx));
         if (hidx == UINT64_MAX)
                 return -EBADMSG;
-        if (hidx == 0)
-                *extra = htole64(p);
-        else {
-                le64_t i;
+        if (hidx == 0) {
+                assert(p[0] > 0);
 
-                i = htole64(hidx - 1);
-                r = link_entry_into_array(f, first, &i, tail, tidx, p);
-                if (r < 0)
-                        return r;
+                *extra = htole64(p[0]);
+                *idx = htole64(1);
+
+                p++;
+                n_p--;
+                hidx = 1;
+
+                if (n_p == 0)
+                        return 0;
         }
 
-        *idx = htole64(hidx + 1);
-        return 0;
+        i = htole64(hidx - 1);
+        r = link_entries_into_array(f, first, &i, tail, tidx, p, n_p);
+
+        /* Even on failure, some of the entries might have been linked, account for them */
+        *idx = htole64(le64toh(i) + 1);
+        return r;
 }
 
-static int journal_file_link_entry_item(JournalFile *f, uint64_t offset, uint64_t p) {
+static int journal_file_link_entries_to_data(JournalFile *f, uint64_t p, const uint64_t offsets[], size_t n_offsets) {
         Object *o;
         int r;
 
         assert(f);
-        assert(offset > 0);
 
         r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
         if (r < 0)
                 return r;
 
-        return link_entry_into_array_plus_one(f,
-                                              &o->data.entry_offset,
-                                              &o->data.entry_array_offset,
-                                              &o->data.n_entries,
-                                              JOURNAL_HEADER_COMPACT(f->header) ? &o->data.compact.tail_entry_array_offset : NULL,
-                                              JOURNAL_HEADER_COMPACT(f->header) ? &o->data.compact.tail_entry_array_n_entries : NULL,
-                                              offset);
+        return link_entries_into_array_plus_one(f,
+                                                &o->data.entry_offset,
+                                                &o->data.entry_array_offset,
+                                                &o->data.n_entries,
+                                                JOURNAL_HEADER_COMPACT(f->header) ? &o->data.compact.tail_entry_array_offset : NULL,
+                                                JOURNAL_HEADER_COMPACT(f->header) ? &o->data.compact.tail_entry_array_n_entries : NULL,
+                                                offsets,
+                                                n_offsets);
+}
+
+static int journal_file_link_entry_item(JournalFile *f, uint64_t offset, uint64_t p) {
+        assert(f);
+        assert(offset > 0);
+
+        return journal_file_link_entries_to_data(f, p, &offset, 1);
+}
+
+static void journal_file_set_tail_entry(JournalFile *f, Object *o, uint64_t offset) {
+        assert(f);
+        assert(f->header);
+        assert(o);
+
+        if (f->header->head_entry_realtime == 0)
+                f->header->head_entry_realtime = o->entry.realtime;
+
+        f->header->tail_entry_realtime = o->entry.realtime;
+        f->header->tail_entry_monotonic = o->entry.monotonic;
+        if (JOURNAL_HEADER_CONTAINS(f->header, tail_entry_offset))
+                f->header->tail_entry_offset = htole64(offset);
+        f->newest_mtime = 0; /* we have a new tail entry now, explicitly invalidate newest boot id/timestamp info */
 }
 
 static int journal_file_link_entry(
@@ -2205,14 +2538,7 @@ static int journal_file_link_entry(
 
         /* log_debug("=> %s seqnr=%"PRIu64" n_entries=%"PRIu64, f->path, o->entry.seqnum, f->header->n_entries); */
 
-        if (f->header->head_entry_realtime == 0)
-                f->header->head_entry_realtime = o->entry.realtime;
-
-        f->header->tail_entry_realtime = o->entry.realtime;
-        f->header->tail_entry_monotonic = o->entry.monotonic;
-        if (JOURNAL_HEADER_CONTAINS(f->header, tail_entry_offset))
-                f->header->tail_entry_offset = htole64(offset);
-        f->newest_mtime = 0; /* we have a new tail entry now, explicitly invalidate newest boot id/timestamp info */
+        journal_file_set_tail_entry(f, o, offset);
 
         /* Link up the items */
         for (uint64_t i = 0; i < n_items; i++) {
@@ -2246,28 +2572,16 @@ static void write_entry_item(JournalFile *f, Object *o, uint64_t i, const EntryI
         }
 }
 
-static int journal_file_append_entry_internal(
+static int journal_file_check_entry_order(
                 JournalFile *f,
                 const dual_timestamp *ts,
                 const sd_id128_t *boot_id,
-                const sd_id128_t *machine_id,
-                uint64_t xor_hash,
-                const EntryItem items[],
-                size_t n_items,
-                uint64_t *seqnum,
-                sd_id128_t *seqnum_id,
-                Object **ret_object,
-                uint64_t *ret_offset) {
-
-        uint64_t np;
-        uint64_t osize;
-        Object *o;
-        int r;
+                uint64_t tail_realtime,
+                uint64_t tail_monotonic) {
 
         assert(f);
         assert(f->header);
         assert(ts);
-        assert(items || n_items == 0);
 
         if (f->strict_order) {
                 /* If requested be stricter with ordering in this journal file, to make searching via
@@ -2281,23 +2595,51 @@ static int journal_file_append_entry_internal(
                  * Typically, if any of the errors generated here are seen journald will just rotate the
                  * journal files and start anew. */
 
-                if (ts->realtime < le64toh(f->header->tail_entry_realtime))
+                if (ts->realtime < tail_realtime)
                         return log_debug_errno(SYNTHETIC_ERRNO(EREMCHG),
                                                "Realtime timestamp %" PRIu64 " smaller than previous realtime "
                                                "timestamp %" PRIu64 ", refusing entry.",
-                                               ts->realtime, le64toh(f->header->tail_entry_realtime));
+                                               ts->realtime, tail_realtime);
 
                 if ((!boot_id || sd_id128_equal(*boot_id, f->header->tail_entry_boot_id)) &&
-                    ts->monotonic < le64toh(f->header->tail_entry_monotonic))
+                    ts->monotonic < tail_monotonic)
                         return log_debug_errno(
                                         SYNTHETIC_ERRNO(ENOTNAM),
                                         "Monotonic timestamp %" PRIu64
                                         " smaller than previous monotonic timestamp %" PRIu64
                                         " while having the same boot ID, refusing entry.",
                                         ts->monotonic,
-                                        le64toh(f->header->tail_entry_monotonic));
+                                        tail_monotonic);
         }
 
+        return 0;
+}
+
+static int journal_file_append_entry_object(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                const sd_id128_t *machine_id,
+                uint64_t xor_hash,
+                const EntryItem items[],
+                size_t n_items,
+                uint64_t *seqnum,
+                sd_id128_t *seqnum_id,
+                Object **ret_object,
+                uint64_t *ret_offset) {
+
+        uint64_t np;
+        uint64_t osize;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(ts);
+        assert(items || n_items == 0);
+        assert(ret_object);
+        assert(ret_offset);
+
         if (seqnum_id) {
                 /* Settle the passed in sequence number ID */
 
@@ -2340,6 +2682,44 @@ static int journal_file_append_entry_internal(
                 return r;
 #endif
 
+        *ret_object = o;
+        *ret_offset = np;
+
+        return 0;
+}
+
+static int journal_file_append_entry_internal(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                const sd_id128_t *machine_id,
+                uint64_t xor_hash,
+                const EntryItem items[],
+                size_t n_items,
+                uint64_t *seqnum,
+                sd_id128_t *seqnum_id,
+                Object **ret_object,
+                uint64_t *ret_offset) {
+
+        uint64_t np;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        r = journal_file_check_entry_order(
+                        f, ts, boot_id,
+                        le64toh(f->header->tail_entry_realtime),
+                        le64toh(f->header->tail_entry_monotonic));
+        if (r < 0)
+                return r;
+
+        r = journal_file_append_entry_object(
+                        f, ts, boot_id, machine_id, xor_hash, items, n_items, seqnum, seqnum_id, &o, &np);
+        if (r < 0)
+                return r;
+
         r = journal_file_link_entry(f, o, np, items, n_items);
         if (r < 0)
                 return r;
@@ -2418,6 +2798,15 @@ fail:
         journal_file_post_change(f);
 }
 
+void journal_file_schedule_post_change(JournalFile *f) {
+        assert(f);
+
+        if (f->post_change_timer)
+                schedule_post_change(f);
+        else
+                journal_file_post_change(f);
+}
+
 /* Enable coalesced change posting in a timer on the provided sd_event instance */
 int journal_file_enable_post_change_timer(JournalFile *f, sd_event *e, usec_t t) {
         _cleanup_(sd_event_source_unrefp) sd_event_source *timer = NULL;
@@ -2585,10 +2974,308 @@ int journal_file_append_entry(
         if (mmap_cache_fd_got_sigbus(f->cache_fd))
                 r = -EIO;
 
-        if (f->post_change_timer)
-                schedule_post_change(f);
+        if (!f->defer_post_change)
+                journal_file_schedule_post_change(f);
+
+        return r;
+}
+
+typedef struct BatchData {
+        struct iovec iovec; /* the payload, as passed in by the caller */
+        uint64_t offset;
+        uint64_t hash;
+        uint64_t xor_hash;
+} BatchData;
+
+static void batch_data_hash_func(const BatchData *d, struct siphash *state) {
+        siphash24_compress_safe(d->iovec.iov_base, d->iovec.iov_len, state);
+}
+
+static int batch_data_compare_func(const BatchData *a, const BatchData *b) {
+        return memcmp_nn(a->iovec.iov_base, a->iovec.iov_len, b->iovec.iov_base, b->iovec.iov_len);
+}
+
+DEFINE_PRIVATE_HASH_OPS(batch_data_hash_ops, BatchData, batch_data_hash_func, batch_data_compare_func);
+
+typedef struct BatchLink {
+        uint64_t data_offset;
+        uint64_t entry_offset;
+} BatchLink;
+
+static int batch_link_cmp(const BatchLink *a, const BatchLink *b) {
+        int r;
+
+        r = CMP(a->data_offset, b->data_offset);
+        if (r != 0)
+                return r;
+
+        return CMP(a->entry_offset, b->entry_offset);
+}
+
+static int journal_file_link_batch(
+                JournalFile *f,
+                const uint64_t entry_offsets[],
+                size_t n_entries,
+                BatchLink links[],
+                size_t n_links,
+                size_t *ret_n_linked) {
+
+        _cleanup_free_ uint64_t *run = NULL;
+        uint64_t n_before, max_offset;
+        size_t n_linked, n_run = 0;
+        Object *o;
+        int r, k;
+
+        assert(f);
+        assert(f->header);
+        assert(entry_offsets || n_entries == 0);
+        assert(links || n_links == 0);
+        assert(ret_n_linked);
+
+        if (n_entries == 0) {
+                *ret_n_linked = 0;
+                return 0;
+        }
+
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        /* Link up all entries in one go, so that we have to walk the global entry array chain only once */
+        n_before = le64toh(f->header->n_entries);
+        r = link_entries_into_array(f,
+                                    &f->header->entry_array_offset,
+                                    &f->header->n_entries,
+                                    JOURNAL_HEADER_CONTAINS(f->header, tail_entry_array_offset) ? &f->header->tail_entry_array_offset : NULL,
+                                    JOURNAL_HEADER_CONTAINS(f->header, tail_entry_array_n_entries) ? &f->header->tail_entry_array_n_entries : NULL,
+                                    entry_offsets,
+                                    n_entries);
+        n_linked = le64toh(f->header->n_entries) - n_before;
+        *ret_n_linked = n_linked;
+        if (n_linked == 0)
+                return r;
+
+        k = journal_file_move_to_object(f, OBJECT_ENTRY, entry_offsets[0], &o);
+        if (k < 0)
+                return k;
+        journal_file_set_tail_entry(f, o, entry_offsets[0]);
+
+        k = journal_file_move_to_object(f, OBJECT_ENTRY, entry_offsets[n_linked - 1], &o);
+        if (k < 0)
+                return k;
+        journal_file_set_tail_entry(f, o, entry_offsets[n_linked - 1]);
+
+        /* Now link up the items, one DATA object at a time. Entries which didn't make it into the global
+         * entry array shall not be referenced by any DATA object either. */
+        max_offset = entry_offsets[n_linked - 1];
+        typesafe_qsort(links, n_links, batch_link_cmp);
+
+        run = new(uint64_t, MIN(n_links, n_linked));
+        if (!run)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < n_links; i++) {
+                if (links[i].entry_offset <= max_offset)
+                        run[n_run++] = links[i].entry_offset;
+
+                if (i + 1 < n_links && links[i + 1].data_offset == links[i].data_offset)
+                        continue;
+
+                /* Like in journal_file_link_entry(), don't give up if we can't allocate a new entry array
+                 * for this DATA object, the others might still be linkable. */
+                k = journal_file_link_entries_to_data(f, links[i].data_offset, run, n_run);
+                if (k == -E2BIG) {
+                        if (r >= 0)
+                                r = k;
+                } else if (k < 0)
+                        return k;
+
+                n_run = 0;
+        }
+
+        return r;
+}
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const JournalFileAppendEntry entries[],
+                size_t n_entries,
+                uint64_t *seqnum,
+                sd_id128_t *seqnum_id,
+                size_t *ret_n_appended) {
+
+        _cleanup_hashmap_free_ Hashmap *cache = NULL;
+        _cleanup_free_ BatchData *data = NULL;
+        _cleanup_free_ BatchLink *links = NULL;
+        _cleanup_free_ uint64_t *entry_offsets = NULL;
+        _cleanup_free_ EntryItem *items = NULL;
+        size_t n_data = 0, n_links = 0, n_written = 0, n_linked = 0, n_iovec_max = 0, n_iovec_total = 0;
+        uint64_t tail_realtime, tail_monotonic;
+        sd_id128_t _boot_id, _machine_id, *machine_id;
+        int r = 0, k;
+
+        assert(f);
+        assert(f->header);
+        assert(entries || n_entries == 0);
+
+        /* Appends multiple entries to the journal file at once. This is equivalent to calling
+         * journal_file_append_entry() for each of them, except that identical payloads are looked up only
+         * once per batch, the global entry array chain and the entry array chain of each DATA object is
+         * walked only once, and the change is posted only once. On failure, *ret_n_appended is set to the
+         * number of leading entries that have been appended nonetheless, so that the caller may rotate and
+         * continue with the rest. */
+
+        if (n_entries == 0) {
+                if (ret_n_appended)
+                        *ret_n_appended = 0;
+                return 0;
+        }
+
+        /* Sealing requires tags to be written in between the entries in strict order with the entry array
+         * objects they cover, hence simply append one entry at a time in that case. */
+        if (JOURNAL_HEADER_SEALED(f->header)) {
+                for (n_linked = 0; n_linked < n_entries; n_linked++) {
+                        r = journal_file_append_entry(
+                                        f,
+                                        entries[n_linked].ts,
+                                        entries[n_linked].boot_id,
+                                        entries[n_linked].iovec,
+                                        entries[n_linked].n_iovec,
+                                        seqnum,
+                                        seqnum_id,
+                                        NULL,
+                                        NULL);
+                        if (r < 0)
+                                break;
+                }
+
+                if (ret_n_appended)
+                        *ret_n_appended = n_linked;
+                return r;
+        }
+
+        r = sd_id128_get_boot(&_boot_id);
+        if (r < 0)
+                return r;
+
+        r = sd_id128_get_machine(&_machine_id);
+        if (ERRNO_IS_NEG_MACHINE_ID_UNSET(r))
+                /* Gracefully handle the machine ID not being initialized yet */
+                machine_id = NULL;
+        else if (r < 0)
+                return r;
         else
-                journal_file_post_change(f);
+                machine_id = &_machine_id;
+
+        for (size_t i = 0; i < n_entries; i++) {
+                assert(entries[i].iovec);
+                assert(entries[i].n_iovec > 0);
+
+                n_iovec_max = MAX(n_iovec_max, entries[i].n_iovec);
+                n_iovec_total += entries[i].n_iovec;
+        }
+
+        cache = hashmap_new(&batch_data_hash_ops);
+        data = new(BatchData, n_iovec_total);
+        links = new(BatchLink, n_iovec_total);
+        entry_offsets = new(uint64_t, n_entries);
+        items = new(EntryItem, n_iovec_max);
+        if (!cache || !data || !links || !entry_offsets || !items)
+                return -ENOMEM;
+
+        tail_realtime = le64toh(f->header->tail_entry_realtime);
+        tail_monotonic = le64toh(f->header->tail_entry_monotonic);
+
+        for (; n_written < n_entries; n_written++) {
+                const JournalFileAppendEntry *e = entries + n_written;
+                const sd_id128_t *boot_id = e->boot_id ?: &_boot_id;
+                dual_timestamp ts;
+                uint64_t xor_hash = 0, np;
+                size_t n_items;
+                Object *o;
+
+                if (e->ts) {
+                        if (!VALID_REALTIME(e->ts->realtime) || !VALID_MONOTONIC(e->ts->monotonic)) {
+                                r = log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                                    "Invalid timestamp %" PRIu64 "/%" PRIu64 ", refusing entry.",
+                                                    e->ts->realtime, e->ts->monotonic);
+                                break;
+                        }
+
+                        ts = *e->ts;
+                } else
+                        dual_timestamp_get(&ts);
+
+                /* The entries of this batch are not linked yet, hence the header doesn't know about them. */
+                r = journal_file_check_entry_order(f, &ts, boot_id, tail_realtime, tail_monotonic);
+                if (r < 0)
+                        break;
+
+                for (size_t j = 0; j < e->n_iovec; j++) {
+                        BatchData *d, key = {
+                                .iovec = e->iovec[j],
+                        };
+
+                        d = hashmap_get(cache, &key);
+                        if (!d) {
+                                r = journal_file_append_data(f, e->iovec[j].iov_base, e->iovec[j].iov_len, &o, &key.offset);
+                                if (r < 0)
+                                        break;
+
+                                key.hash = le64toh(o->data.hash);
+
+                                /* See journal_file_append_entry() for the reasoning */
+                                key.xor_hash = JOURNAL_HEADER_KEYED_HASH(f->header) ?
+                                        jenkins_hash64(e->iovec[j].iov_base, e->iovec[j].iov_len) :
+                                        key.hash;
+
+                                d = data + n_data++;
+                                *d = key;
+
+                                r = hashmap_put(cache, d, d);
+                                if (r < 0)
+                                        break;
+                        }
+
+                        xor_hash ^= d->xor_hash;
+                        items[j] = (EntryItem) {
+                                .object_offset = d->offset,
+                                .hash = d->hash,
+                        };
+                }
+                if (r < 0)
+                        break;
+
+                typesafe_qsort(items, e->n_iovec, entry_item_cmp);
+                n_items = remove_duplicate_entry_items(items, e->n_iovec);
+
+                r = journal_file_append_entry_object(
+                                f, &ts, boot_id, machine_id, xor_hash, items, n_items, seqnum, seqnum_id, &o, &np);
+                if (r < 0)
+                        break;
+
+                entry_offsets[n_written] = np;
+                for (size_t j = 0; j < n_items; j++)
+                        links[n_links++] = (BatchLink) {
+                                .data_offset = items[j].object_offset,
+                                .entry_offset = np,
+                        };
+
+                tail_realtime = ts.realtime;
+                tail_monotonic = ts.monotonic;
+        }
+
+        /* Link up whatever we managed to write, even if we failed half-way */
+        k = journal_file_link_batch(f, entry_offsets, n_written, links, n_links, &n_linked);
+        if (r >= 0)
+                r = k;
+
+        if (mmap_cache_fd_got_sigbus(f->cache_fd))
+                r = -EIO;
+
+        if (!f->defer_post_change)
+                journal_file_schedule_post_change(f);
+
+        if (ret_n_appended)
+                *ret_n_appended = n_linked;
 
         return r;
 }
@@ -3154,6 +3841,18 @@ found:
         return 1;
 }
 
+int journal_file_move_to_entry_by_index(JournalFile *f, uint64_t i, Object **ret_object, uint64_t *ret_offset) {
+        assert(f);
+        assert(f->header);
+
+        /* Returns the i-th entry of the global entry array chain of the file. */
+
+        if (i >= le64toh(f->header->n_entries))
+                return 0;
+
+        return generic_array_get(f, le64toh(f->header->entry_array_offset), i, DIRECTION_DOWN, ret_object, ret_offset);
+}
+
 static int test_object_offset(JournalFile *f, uint64_t p, uint64_t needle) {
         assert(f);
         assert(p > 0);
@@ -3702,7 +4401,7 @@ void journal_file_print_header(JournalFile *f) {
                "Sequential number ID: %s\n"
                "State: %s\n"
                "Compatible flags:%s%s%s\n"
-               "Incompatible flags:%s%s%s%s%s%s\n"
+               "Incompatible flags:%s%s%s%s%s%s%s\n"
                "Header size: %"PRIu64"\n"
                "Arena size: %"PRIu64"\n"
                "Data hash table size: %"PRIu64"\n"
@@ -3731,6 +4430,7 @@ void journal_file_print_header(JournalFile *f) {
                JOURNAL_HEADER_COMPRESSED_ZSTD(f->header) ? " COMPRESSED-ZSTD" : "",
                JOURNAL_HEADER_KEYED_HASH(f->header) ? " KEYED-HASH" : "",
                JOURNAL_HEADER_COMPACT(f->header) ? " COMPACT" : "",
+               JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) ? " ZSTD-DICTIONARY" : "",
                (le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_ANY) ? " ???" : "",
                le64toh(f->header->header_size),
                le64toh(f->header->arena_size),
@@ -3939,6 +4639,7 @@ int journal_file_open(
                                             MAX(MIN_COMPRESS_THRESHOLD, compress_threshold_bytes),
                 .strict_order = FLAGS_SET(file_flags, JOURNAL_STRICT_ORDER),
                 .newest_boot_id_prioq_idx = PRIOQ_IDX_NULL,
+                .merge_prioq_idx = PRIOQ_IDX_NULL,
         };
 
         if (fname) {
@@ -4101,6 +4802,9 @@ int journal_file_open(
                         goto fail;
         }
 
+        if (template)
+                f->defer_post_change = template->defer_post_change;
+
         /* The file is opened now successfully, thus we take possession of any passed in fd. */
         f->close_fd = true;
 
@@ -4536,6 +5240,7 @@ static const char * const journal_object_type_table[] = {
         [OBJECT_FIELD_HASH_TABLE] = "field hash table",
         [OBJECT_ENTRY_ARRAY]      = "entry array",
         [OBJECT_TAG]              = "tag",
+        [OBJECT_COMPRESSION_DICTIONARY] = "compression dictionary",
 };
 
 DEFINE_STRING_TABLE_LOOKUP_TO_STRING(journal_object_type, ObjectType);
@@ -15,6 +15,7 @@
 #include "compress.h"
 #include "hashmap.h"
 #include "journal-def.h"
+#include "list.h"
 #include "mmap-cache.h"
 #include "sparse-endian.h"
 #include "time-util.h"
@@ -68,6 +69,11 @@ typedef struct JournalFile {
         bool close_fd:1;
         bool archive:1;
         bool strict_order:1;
+        /* If set, appending entries doesn't post the change, the caller takes care of that. For appending
+         * from a thread that doesn't run the event loop the post change timer is attached to. */
+        bool defer_post_change:1;
+        /* Not a bit field, as it is updated while another thread appends to the file */
+        bool post_change_pending;
 
         direction_t last_direction;
         LocationType location_type;
@@ -95,6 +101,10 @@ typedef struct JournalFile {
 
         OrderedHashmap *chain_cache;
 
+        /* The sidecar index of an archived file, see journal-index.h. Loaded on first use. */
+        struct JournalIndex *index;
+        bool index_loaded;
+
         pthread_t offline_thread;
         volatile OfflineState offline_state;
 
@@ -105,6 +115,15 @@ typedef struct JournalFile {
         void *compress_buffer;
 #endif
 
+        /* The dictionary DATA objects are compressed with if HEADER_INCOMPATIBLE_ZSTD_DICTIONARY is set,
+         * loaded on first use. Until it has been written, payloads are collected to train it from. */
+        CompressDictionary *compress_dictionary;
+        uint8_t *dictionary_samples;
+        size_t dictionary_samples_size;
+        size_t *dictionary_sample_sizes;
+        size_t n_dictionary_samples;
+        bool dictionary_failed;
+
 #if HAVE_GCRYPT
         gcry_md_hd_t hmac;
         bool hmac_running;
@@ -129,6 +148,17 @@ typedef struct JournalFile {
         uint64_t newest_realtime_usec;
         unsigned newest_boot_id_prioq_idx;
         usec_t newest_mtime;
+
+        /* Index in the 'merge_prioq' of sd_journal, while the file has a candidate entry for the next step */
+        unsigned merge_prioq_idx;
+
+        /* Linked into 'merge_poll' of sd_journal, while the file has no candidate but might get one */
+        bool merge_poll_linked;
+        LIST_FIELDS(struct JournalFile, merge_poll);
+
+        /* The file range we already requested to be read ahead, if SD_JOURNAL_PARALLEL is used */
+        uint64_t prefetch_begin;
+        uint64_t prefetch_end;
 } JournalFile;
 
 typedef enum JournalFileFlags {
@@ -206,12 +236,17 @@ static inline bool VALID_EPOCH(uint64_t u) {
 #define JOURNAL_HEADER_COMPACT(h) \
         FLAGS_SET(le32toh((h)->incompatible_flags), HEADER_INCOMPATIBLE_COMPACT)
 
+#define JOURNAL_HEADER_ZSTD_DICTIONARY(h) \
+        FLAGS_SET(le32toh((h)->incompatible_flags), HEADER_INCOMPATIBLE_ZSTD_DICTIONARY)
+
 int journal_file_move_to_object(JournalFile *f, ObjectType type, uint64_t offset, Object **ret);
 int journal_file_read_object_header(JournalFile *f, ObjectType type, uint64_t offset, Object *ret);
 
 int journal_file_tail_end_by_pread(JournalFile *f, uint64_t *ret_offset);
 int journal_file_tail_end_by_mmap(JournalFile *f, uint64_t *ret_offset);
 
+int journal_file_preallocate(JournalFile *f, uint64_t headroom);
+
 static inline uint64_t journal_file_entry_item_object_offset(JournalFile *f, Object *o, size_t i) {
         assert(f);
         assert(o);
@@ -237,6 +272,8 @@ int journal_file_data_payload(
                 void **ret_data,
                 size_t *ret_size);
 
+int journal_file_get_compress_dictionary(JournalFile *f, CompressDictionary **ret);
+
 static inline size_t journal_file_data_payload_offset(JournalFile *f) {
         return JOURNAL_HEADER_COMPACT(f->header)
                         ? offsetof(Object, data.compact.payload)
@@ -275,6 +312,21 @@ int journal_file_append_entry(
                 Object **ret_object,
                 uint64_t *ret_offset);
 
+typedef struct JournalFileAppendEntry {
+        const dual_timestamp *ts;   /* NULL for the current time */
+        const sd_id128_t *boot_id;  /* NULL for the current boot */
+        const struct iovec *iovec;
+        size_t n_iovec;
+} JournalFileAppendEntry;
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const JournalFileAppendEntry entries[],
+                size_t n_entries,
+                uint64_t *seqnum,
+                sd_id128_t *seqnum_id,
+                size_t *ret_n_appended);
+
 int journal_file_find_data_object(JournalFile *f, const void *data, uint64_t size, Object **ret_object, uint64_t *ret_offset);
 int journal_file_find_data_object_with_hash(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret_object, uint64_t *ret_offset);
 
@@ -287,6 +339,7 @@ int journal_file_next_entry(JournalFile *f, uint64_t p, direction_t direction, O
 
 int journal_file_next_entry_for_data(JournalFile *f, Object *d, direction_t direction, Object **ret_object, uint64_t *ret_offset);
 
+int journal_file_move_to_entry_by_index(JournalFile *f, uint64_t i, Object **ret_object, uint64_t *ret_offset);
 int journal_file_move_to_entry_by_offset(JournalFile *f, uint64_t p, direction_t direction, Object **ret_object, uint64_t *ret_offset);
 int journal_file_move_to_entry_by_seqnum(JournalFile *f, uint64_t seqnum, direction_t direction, Object **ret_object, uint64_t *ret_offset);
 int journal_file_move_to_entry_by_realtime(JournalFile *f, uint64_t realtime, direction_t direction, Object **ret_object, uint64_t *ret_offset);
@@ -309,6 +362,7 @@ JournalFile* journal_initiate_close(JournalFile *f, Set *deferred_closes);
 int journal_file_dispose(int dir_fd, const char *fname);
 
 void journal_file_post_change(JournalFile *f);
+void journal_file_schedule_post_change(JournalFile *f);
 int journal_file_enable_post_change_timer(JournalFile *f, sd_event *e, usec_t t);
 
 void journal_reset_metrics(JournalMetrics *m);
@@ -0,0 +1,822 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fs-util.h"
+#include "io-util.h"
+#include "journal-index.h"
+#include "path-util.h"
+#include "prioq.h"
+#include "sort-util.h"
+#include "sparse-endian.h"
+#include "stat-util.h"
+#include "string-util.h"
+#include "tmpfile-util.h"
+#include "unaligned.h"
+
+/* Upper bound on the number of realtime buckets per file. The bucket width is picked so that the whole
+ * realtime range of the file fits into this many buckets, but never smaller than one second. */
+#define JOURNAL_INDEX_BUCKETS_MAX 4096U
+#define JOURNAL_INDEX_BUCKET_USEC_MIN USEC_PER_SEC
+
+/* How many DATA objects to record, and how many entries they need to reference at least to be worth it.
+ * Bisecting the entry array chain of a rarely used DATA object is cheap anyway. */
+#define JOURNAL_INDEX_DATA_MAX 256U
+#define JOURNAL_INDEX_DATA_MIN_ENTRIES 16U
+
+/* How many boots to summarize per file at most. Files with more boots than this are not indexed. */
+#define JOURNAL_INDEX_BOOTS_MAX 1024U
+
+/* How many entry array items to read at once when walking the entry array chain. The buffer for this is
+ * allocated once per index build, and is also used for reading the data hash table. */
+#define JOURNAL_INDEX_READ_ITEMS 4096U
+#define JOURNAL_INDEX_READ_SIZE (JOURNAL_INDEX_READ_ITEMS * sizeof(uint64_t))
+
+static const char signature[] = { 'L', 'P', 'K', 'S', 'H', 'I', 'D', 'X' };
+
+typedef struct JournalIndexHeader {
+        uint8_t signature[8];
+        le64_t header_size;
+        sd_id128_t file_id;
+        sd_id128_t seqnum_id;
+        le64_t n_entries;
+        le64_t head_entry_seqnum;
+        le64_t tail_entry_seqnum;
+        le64_t head_entry_realtime;
+        le64_t tail_entry_realtime;
+        le64_t bucket_usec;
+        le64_t n_buckets;
+        le64_t n_data;
+        le64_t n_boots;
+} _packed_ JournalIndexHeader;
+
+/* The header is followed by n_buckets little-endian 64-bit entry array indexes, one per bucket, each
+ * referring to the first entry whose realtime timestamp falls into the bucket or a later one. These are
+ * followed by n_data JournalIndexData records, ordered by offset, and n_boots JournalIndexBoot records,
+ * ordered by the first entry of each boot. */
+typedef struct JournalIndexData {
+        le64_t offset;
+        le64_t n_entries;
+        le64_t head_realtime;
+        le64_t tail_realtime;
+} _packed_ JournalIndexData;
+
+typedef struct JournalIndexBoot {
+        sd_id128_t boot_id;
+        le64_t head_seqnum;
+        le64_t tail_seqnum;
+        le64_t head_realtime;
+        le64_t tail_realtime;
+} _packed_ JournalIndexBoot;
+
+typedef struct IndexData {
+        uint64_t offset;
+        uint64_t n_entries;
+        uint64_t head_realtime;
+        uint64_t tail_realtime;
+} IndexData;
+
+struct JournalIndex {
+        uint64_t n_entries;
+        uint64_t head_realtime;
+        uint64_t bucket_usec;
+
+        uint64_t *buckets;
+        size_t n_buckets;
+
+        IndexData *data;
+        size_t n_data;
+
+        JournalBootSummary *boots;
+        size_t n_boots;
+};
+
+JournalIndex* journal_index_free(JournalIndex *i) {
+        if (!i)
+                return NULL;
+
+        free(i->buckets);
+        free(i->data);
+        free(i->boots);
+        return mfree(i);
+}
+
+static int index_path(JournalFile *f, char **ret) {
+        char *p;
+
+        assert(f);
+        assert(ret);
+
+        /* Files passed in as fd have no useful path, hence there is no place to store the index next to it. */
+        if (!f->path || path_startswith(f->path, "/proc/self/fd"))
+                return -EADDRNOTAVAIL;
+
+        p = strjoin(f->path, JOURNAL_INDEX_SUFFIX);
+        if (!p)
+                return -ENOMEM;
+
+        *ret = p;
+        return 0;
+}
+
+static int read_entry_array_items(
+                JournalFile *f,
+                uint64_t offset,
+                uint64_t first,
+                size_t n,
+                uint64_t *ret) {
+
+        size_t sz;
+        ssize_t l;
+
+        assert(f);
+        assert(n <= JOURNAL_INDEX_READ_ITEMS);
+        assert(ret);
+
+        /* Reads n items starting at index 'first' from the entry array object at 'offset'. We use pread()
+         * here rather than the mmap cache, since we might be called from the offline thread. The items are
+         * read into 'ret' directly and converted in place. For compact files, convert from the back, so
+         * that no 32-bit item is overwritten before it was converted. */
+
+        sz = n * journal_file_entry_array_item_size(f);
+        l = pread(f->fd, ret, sz, offset + offsetof(Object, entry_array.items) + first * journal_file_entry_array_item_size(f));
+        if (l < 0)
+                return -errno;
+        if ((size_t) l != sz)
+                return -EIO;
+
+        if (JOURNAL_HEADER_COMPACT(f->header))
+                for (size_t k = n; k > 0; k--)
+                        ret[k - 1] = le32toh(((le32_t*) ret)[k - 1]);
+        else
+                for (size_t k = 0; k < n; k++)
+                        ret[k] = le64toh(ret[k]);
+
+        return 0;
+}
+
+static int add_boot(JournalBootSummary **boots, size_t *n_boots, const Object *o) {
+        JournalBootSummary *b = NULL;
+
+        assert(boots);
+        assert(n_boots);
+        assert(o);
+
+        /* Entries of one boot are usually stored contiguously, hence check the last boot first */
+        if (*n_boots > 0 && sd_id128_equal((*boots)[*n_boots - 1].boot_id, o->entry.boot_id))
+                b = *boots + *n_boots - 1;
+        else
+                FOREACH_ARRAY(i, *boots, *n_boots)
+                        if (sd_id128_equal(i->boot_id, o->entry.boot_id)) {
+                                b = i;
+                                break;
+                        }
+
+        if (!b) {
+                if (*n_boots >= JOURNAL_INDEX_BOOTS_MAX)
+                        return -E2BIG;
+
+                if (!GREEDY_REALLOC(*boots, *n_boots + 1))
+                        return -ENOMEM;
+
+                b = *boots + (*n_boots)++;
+                *b = (JournalBootSummary) {
+                        .boot_id = o->entry.boot_id,
+                        .head_seqnum = le64toh(o->entry.seqnum),
+                        .head_realtime = le64toh(o->entry.realtime),
+                };
+        }
+
+        b->tail_seqnum = le64toh(o->entry.seqnum);
+        b->tail_realtime = le64toh(o->entry.realtime);
+        return 0;
+}
+
+static int read_entry_realtime(JournalFile *f, uint64_t p, uint64_t *ret) {
+        Object o;
+        int r;
+
+        assert(f);
+        assert(ret);
+
+        r = journal_file_read_object_header(f, OBJECT_ENTRY, p, &o);
+        if (r < 0)
+                return r;
+
+        *ret = le64toh(o.entry.realtime);
+        return 0;
+}
+
+static int build_buckets(
+                JournalFile *f,
+                uint64_t head_realtime,
+                uint64_t bucket_usec,
+                uint64_t *buckets,
+                size_t n_buckets,
+                uint64_t *items,
+                JournalBootSummary **ret_boots,
+                size_t *ret_n_boots) {
+
+        _cleanup_free_ JournalBootSummary *boots = NULL;
+        uint64_t n, i = 0, last_realtime = 0;
+        size_t next_bucket = 0, n_boots = 0;
+        Object o;
+        int r;
+
+        assert(f);
+        assert(buckets);
+        assert(n_buckets > 0);
+        assert(items);
+        assert(ret_boots);
+        assert(ret_n_boots);
+
+        /* Since we look at every entry anyway, let's also summarize the boots contained in the file here */
+
+        n = le64toh(f->header->n_entries);
+
+        for (uint64_t a = le64toh(f->header->entry_array_offset); a != 0 && i < n; a = le64toh(o.entry_array.next_entry_array_offset)) {
+                uint64_t k;
+
+                r = journal_file_read_object_header(f, OBJECT_ENTRY_ARRAY, a, &o);
+                if (r < 0)
+                        return r;
+
+                k = journal_file_entry_array_n_items(f, &o);
+
+                for (uint64_t j = 0; j < k && i < n; ) {
+                        size_t m = MIN3(k - j, n - i, (uint64_t) JOURNAL_INDEX_READ_ITEMS);
+
+                        r = read_entry_array_items(f, a, j, m, items);
+                        if (r < 0)
+                                return r;
+
+                        for (size_t l = 0; l < m; l++, i++) {
+                                uint64_t realtime, b;
+                                Object e;
+
+                                r = journal_file_read_object_header(f, OBJECT_ENTRY, items[l], &e);
+                                if (r < 0)
+                                        return r;
+
+                                realtime = le64toh(e.entry.realtime);
+
+                                /* Realtime bisection only works if the timestamps are ordered. If they are
+                                 * not, then we cannot do better than the regular lookup either. */
+                                if (realtime < last_realtime || realtime < head_realtime)
+                                        return log_debug_errno(SYNTHETIC_ERRNO(ENOTRECOVERABLE),
+                                                               "Entries of %s are not ordered by realtime, not indexing.",
+                                                               f->path);
+                                last_realtime = realtime;
+
+                                b = MIN((realtime - head_realtime) / bucket_usec, (uint64_t) n_buckets - 1);
+                                while (next_bucket <= b)
+                                        buckets[next_bucket++] = i;
+
+                                r = add_boot(&boots, &n_boots, &e);
+                                if (r < 0)
+                                        return log_debug_errno(r, "Failed to summarize boots of %s, not indexing: %m", f->path);
+                        }
+
+                        j += m;
+                }
+        }
+
+        if (i != n)
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                       "Entry array of %s has fewer items than expected, not indexing.", f->path);
+
+        while (next_bucket < n_buckets)
+                buckets[next_bucket++] = n;
+
+        *ret_boots = TAKE_PTR(boots);
+        *ret_n_boots = n_boots;
+        return 0;
+}
+
+static int data_tail_entry(JournalFile *f, const Object *d, uint64_t *ret) {
+        uint64_t i;
+        Object o;
+        int r;
+
+        assert(f);
+        assert(d);
+        assert(ret);
+
+        /* The first entry is stored inline in the DATA object, the rest in the entry array chain. */
+        if (le64toh(d->data.n_entries) <= 1) {
+                *ret = le64toh(d->data.entry_offset);
+                return 0;
+        }
+
+        i = le64toh(d->data.n_entries) - 2;
+
+        for (uint64_t a = le64toh(d->data.entry_array_offset); a != 0; a = le64toh(o.entry_array.next_entry_array_offset)) {
+                uint64_t k;
+
+                r = journal_file_read_object_header(f, OBJECT_ENTRY_ARRAY, a, &o);
+                if (r < 0)
+                        return r;
+
+                k = journal_file_entry_array_n_items(f, &o);
+                if (i < k)
+                        return read_entry_array_items(f, a, i, 1, ret);
+
+                i -= k;
+        }
+
+        return -EBADMSG;
+}
+
+static int index_data_compare(const IndexData *a, const IndexData *b) {
+        return CMP(a->n_entries, b->n_entries);
+}
+
+static int index_data_offset_compare(const IndexData *a, const IndexData *b) {
+        return CMP(a->offset, b->offset);
+}
+
+static int build_data(JournalFile *f, HashItem *items, IndexData **ret, size_t *ret_n) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        _cleanup_free_ IndexData *data = NULL;
+        uint64_t p, sz;
+        size_t n_data = 0;
+        ssize_t n = SSIZE_MAX;
+        int r;
+
+        assert(f);
+        assert(items);
+        assert(ret);
+        assert(ret_n);
+
+        /* Find the DATA objects referenced by the most entries, keeping the JOURNAL_INDEX_DATA_MAX best
+         * candidates in a min-heap keyed by n_entries. */
+
+        data = new(IndexData, JOURNAL_INDEX_DATA_MAX);
+        if (!data)
+                return -ENOMEM;
+
+        q = prioq_new((compare_func_t) index_data_compare);
+        if (!q)
+                return -ENOMEM;
+
+        p = le64toh(f->header->data_hash_table_offset);
+        sz = le64toh(f->header->data_hash_table_size);
+
+        for (uint64_t i = p; i < p + sz && n > 0; i += n) {
+                size_t m = MIN(JOURNAL_INDEX_READ_SIZE, p + sz - i);
+
+                n = pread(f->fd, items, m, i);
+                if (n < 0)
+                        return -errno;
+
+                /* Let's ignore any partial hash items by rounding down to the nearest multiple of HashItem. */
+                n -= n % sizeof(HashItem);
+
+                for (size_t j = 0; j < (size_t) n / sizeof(HashItem); j++) {
+                        Object o;
+
+                        for (uint64_t d = le64toh(items[j].head_hash_offset); d != 0; d = le64toh(o.data.next_hash_offset)) {
+                                IndexData *slot;
+                                uint64_t k;
+
+                                r = journal_file_read_object_header(f, OBJECT_DATA, d, &o);
+                                if (r < 0)
+                                        return r;
+
+                                k = le64toh(o.data.n_entries);
+                                if (k < JOURNAL_INDEX_DATA_MIN_ENTRIES)
+                                        continue;
+
+                                if (n_data < JOURNAL_INDEX_DATA_MAX)
+                                        slot = data + n_data++;
+                                else {
+                                        slot = prioq_peek(q);
+                                        if (slot->n_entries >= k)
+                                                continue;
+
+                                        assert_se(prioq_pop(q) == slot);
+                                }
+
+                                *slot = (IndexData) {
+                                        .offset = d,
+                                        .n_entries = k,
+                                };
+
+                                r = prioq_put(q, slot, NULL);
+                                if (r < 0)
+                                        return r;
+                        }
+                }
+        }
+
+        /* Now determine the realtime range for the selected objects */
+        FOREACH_ARRAY(i, data, n_data) {
+                uint64_t tail;
+                Object o;
+
+                r = journal_file_read_object_header(f, OBJECT_DATA, i->offset, &o);
+                if (r < 0)
+                        return r;
+
+                r = read_entry_realtime(f, le64toh(o.data.entry_offset), &i->head_realtime);
+                if (r < 0)
+                        return r;
+
+                r = data_tail_entry(f, &o, &tail);
+                if (r < 0)
+                        return r;
+
+                r = read_entry_realtime(f, tail, &i->tail_realtime);
+                if (r < 0)
+                        return r;
+        }
+
+        typesafe_qsort(data, n_data, index_data_offset_compare);
+
+        *ret = TAKE_PTR(data);
+        *ret_n = n_data;
+        return 0;
+}
+
+int journal_index_build(JournalFile *f) {
+        _cleanup_free_ JournalBootSummary *boots = NULL;
+        _cleanup_free_ uint64_t *buckets = NULL;
+        _cleanup_free_ IndexData *data = NULL;
+        _cleanup_free_ uint64_t *items = NULL;
+        _cleanup_(unlink_and_freep) char *tmp = NULL;
+        _cleanup_free_ char *path = NULL;
+        _cleanup_free_ void *buf = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        uint64_t head_realtime, tail_realtime, bucket_usec;
+        size_t n_buckets, n_data = 0, n_boots = 0, sz;
+        JournalIndexHeader *h;
+        uint8_t *q;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* This only uses pread() to access the journal file, and hence may be called from the offline
+         * thread, without touching the (not thread-safe) mmap cache. */
+
+        r = index_path(f, &path);
+        if (r < 0)
+                return r;
+
+        if (le64toh(f->header->n_entries) == 0)
+                return 0;
+
+        head_realtime = le64toh(f->header->head_entry_realtime);
+        tail_realtime = le64toh(f->header->tail_entry_realtime);
+        if (!VALID_REALTIME(head_realtime) || !VALID_REALTIME(tail_realtime) || tail_realtime < head_realtime)
+                return log_debug_errno(SYNTHETIC_ERRNO(ENOTRECOVERABLE),
+                                       "Realtime range of %s is invalid, not indexing.", f->path);
+
+        bucket_usec = MAX(DIV_ROUND_UP(tail_realtime - head_realtime + 1, JOURNAL_INDEX_BUCKETS_MAX),
+                          JOURNAL_INDEX_BUCKET_USEC_MIN);
+        n_buckets = (tail_realtime - head_realtime) / bucket_usec + 1;
+
+        buckets = new(uint64_t, n_buckets);
+        if (!buckets)
+                return -ENOMEM;
+
+        items = malloc(JOURNAL_INDEX_READ_SIZE);
+        if (!items)
+                return -ENOMEM;
+
+        r = build_buckets(f, head_realtime, bucket_usec, buckets, n_buckets, items, &boots, &n_boots);
+        if (r < 0)
+                return r;
+
+        r = build_data(f, (HashItem*) items, &data, &n_data);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to collect DATA objects of %s: %m", f->path);
+
+        sz = sizeof(JournalIndexHeader) + n_buckets * sizeof(le64_t) + n_data * sizeof(JournalIndexData) +
+                n_boots * sizeof(JournalIndexBoot);
+        buf = malloc0(sz);
+        if (!buf)
+                return -ENOMEM;
+
+        h = buf;
+        memcpy(h->signature, signature, sizeof(signature));
+        h->header_size = htole64(sizeof(JournalIndexHeader));
+        h->file_id = f->header->file_id;
+        h->seqnum_id = f->header->seqnum_id;
+        h->n_entries = f->header->n_entries;
+        h->head_entry_seqnum = f->header->head_entry_seqnum;
+        h->tail_entry_seqnum = f->header->tail_entry_seqnum;
+        h->head_entry_realtime = htole64(head_realtime);
+        h->tail_entry_realtime = htole64(tail_realtime);
+        h->bucket_usec = htole64(bucket_usec);
+        h->n_buckets = htole64(n_buckets);
+        h->n_data = htole64(n_data);
+        h->n_boots = htole64(n_boots);
+
+        q = (uint8_t*) buf + sizeof(JournalIndexHeader);
+        for (size_t i = 0; i < n_buckets; i++, q += sizeof(le64_t))
+                unaligned_write_le64(q, buckets[i]);
+
+        FOREACH_ARRAY(i, data, n_data) {
+                JournalIndexData d = {
+                        .offset = htole64(i->offset),
+                        .n_entries = htole64(i->n_entries),
+                        .head_realtime = htole64(i->head_realtime),
+                        .tail_realtime = htole64(i->tail_realtime),
+                };
+
+                q = mempcpy(q, &d, sizeof(d));
+        }
+
+        FOREACH_ARRAY(i, boots, n_boots) {
+                JournalIndexBoot b = {
+                        .boot_id = i->boot_id,
+                        .head_seqnum = htole64(i->head_seqnum),
+                        .tail_seqnum = htole64(i->tail_seqnum),
+                        .head_realtime = htole64(i->head_realtime),
+                        .tail_realtime = htole64(i->tail_realtime),
+                };
+
+                q = mempcpy(q, &b, sizeof(b));
+        }
+
+        fd = open_tmpfile_linkable(path, O_WRONLY|O_CLOEXEC, &tmp);
+        if (fd < 0)
+                return log_debug_errno(fd, "Failed to create journal index %s: %m", path);
+
+        if (fchmod(fd, f->mode & 0666) < 0)
+                return log_debug_errno(errno, "Failed to set access mode of journal index %s: %m", path);
+
+        r = loop_write(fd, buf, sz);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to write journal index %s: %m", path);
+
+        r = link_tmpfile(fd, tmp, path, LINK_TMPFILE_REPLACE);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to move journal index %s into place: %m", path);
+
+        tmp = mfree(tmp);
+
+        log_debug("Wrote journal index %s with %zu realtime buckets of %s, %zu DATA objects and %zu boots.",
+                  path, n_buckets, FORMAT_TIMESPAN(bucket_usec, 0), n_data, n_boots);
+
+        return 1;
+}
+
+int journal_index_load(JournalFile *f, JournalIndex **ret) {
+        _cleanup_(journal_index_freep) JournalIndex *i = NULL;
+        _cleanup_free_ char *path = NULL;
+        _cleanup_free_ void *buf = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        uint64_t n_buckets, n_data, n_boots, n_entries, last = 0;
+        const JournalIndexHeader *h;
+        const uint8_t *q;
+        struct stat st;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(ret);
+
+        r = index_path(f, &path);
+        if (r < 0)
+                return r;
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        r = stat_verify_regular(&st);
+        if (r < 0)
+                return r;
+
+        if ((uint64_t) st.st_size < sizeof(JournalIndexHeader))
+                return -EBADMSG;
+
+        /* Refuse anything that is larger than what we would ever write */
+        if ((uint64_t) st.st_size > sizeof(JournalIndexHeader) +
+                                    JOURNAL_INDEX_BUCKETS_MAX * sizeof(le64_t) +
+                                    JOURNAL_INDEX_DATA_MAX * sizeof(JournalIndexData) +
+                                    JOURNAL_INDEX_BOOTS_MAX * sizeof(JournalIndexBoot))
+                return -EFBIG;
+
+        buf = malloc(st.st_size);
+        if (!buf)
+                return -ENOMEM;
+
+        r = loop_read_exact(fd, buf, st.st_size, false);
+        if (r < 0)
+                return r;
+
+        h = buf;
+        n_entries = le64toh(h->n_entries);
+        n_buckets = le64toh(h->n_buckets);
+        n_data = le64toh(h->n_data);
+        n_boots = le64toh(h->n_boots);
+
+        if (memcmp(h->signature, signature, sizeof(signature)) != 0 ||
+            le64toh(h->header_size) != sizeof(JournalIndexHeader) ||
+            n_buckets == 0 || n_buckets > JOURNAL_INDEX_BUCKETS_MAX ||
+            n_data > JOURNAL_INDEX_DATA_MAX ||
+            n_boots == 0 || n_boots > JOURNAL_INDEX_BOOTS_MAX ||
+            le64toh(h->bucket_usec) < JOURNAL_INDEX_BUCKET_USEC_MIN ||
+            (uint64_t) st.st_size != sizeof(JournalIndexHeader) + n_buckets * sizeof(le64_t) +
+                                     n_data * sizeof(JournalIndexData) + n_boots * sizeof(JournalIndexBoot))
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Journal index %s is invalid, ignoring.", path);
+
+        /* Make sure this index actually describes the journal file as it is now. */
+        if (!sd_id128_equal(h->file_id, f->header->file_id) ||
+            !sd_id128_equal(h->seqnum_id, f->header->seqnum_id) ||
+            n_entries != le64toh(f->header->n_entries) ||
+            h->head_entry_seqnum != f->header->head_entry_seqnum ||
+            h->tail_entry_seqnum != f->header->tail_entry_seqnum ||
+            h->head_entry_realtime != f->header->head_entry_realtime ||
+            h->tail_entry_realtime != f->header->tail_entry_realtime)
+                return log_debug_errno(SYNTHETIC_ERRNO(ESTALE), "Journal index %s is out of date, ignoring.", path);
+
+        i = new(JournalIndex, 1);
+        if (!i)
+                return -ENOMEM;
+
+        *i = (JournalIndex) {
+                .n_entries = n_entries,
+                .head_realtime = le64toh(h->head_entry_realtime),
+                .bucket_usec = le64toh(h->bucket_usec),
+                .n_buckets = n_buckets,
+                .n_data = n_data,
+                .n_boots = n_boots,
+        };
+
+        i->buckets = new(uint64_t, n_buckets);
+        if (!i->buckets)
+                return -ENOMEM;
+
+        q = (const uint8_t*) buf + sizeof(JournalIndexHeader);
+        for (size_t k = 0; k < n_buckets; k++, q += sizeof(le64_t)) {
+                i->buckets[k] = unaligned_read_le64(q);
+
+                if (i->buckets[k] < last || i->buckets[k] > n_entries)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Journal index %s has invalid buckets, ignoring.", path);
+
+                last = i->buckets[k];
+        }
+
+        if (n_data > 0) {
+                i->data = new(IndexData, n_data);
+                if (!i->data)
+                        return -ENOMEM;
+        }
+
+        last = 0;
+        for (size_t k = 0; k < n_data; k++, q += sizeof(JournalIndexData)) {
+                JournalIndexData d;
+
+                memcpy(&d, q, sizeof(d));
+
+                i->data[k] = (IndexData) {
+                        .offset = le64toh(d.offset),
+                        .n_entries = le64toh(d.n_entries),
+                        .head_realtime = le64toh(d.head_realtime),
+                        .tail_realtime = le64toh(d.tail_realtime),
+                };
+
+                if (i->data[k].offset <= last)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Journal index %s has unordered DATA objects, ignoring.", path);
+
+                last = i->data[k].offset;
+        }
+
+        i->boots = new(JournalBootSummary, n_boots);
+        if (!i->boots)
+                return -ENOMEM;
+
+        for (size_t k = 0; k < n_boots; k++, q += sizeof(JournalIndexBoot)) {
+                JournalIndexBoot b;
+
+                memcpy(&b, q, sizeof(b));
+
+                i->boots[k] = (JournalBootSummary) {
+                        .boot_id = b.boot_id,
+                        .head_seqnum = le64toh(b.head_seqnum),
+                        .tail_seqnum = le64toh(b.tail_seqnum),
+                        .head_realtime = le64toh(b.head_realtime),
+                        .tail_realtime = le64toh(b.tail_realtime),
+                };
+
+                if (i->boots[k].head_seqnum > i->boots[k].tail_seqnum ||
+                    i->boots[k].head_realtime > i->boots[k].tail_realtime)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Journal index %s has invalid boots, ignoring.", path);
+        }
+
+        *ret = TAKE_PTR(i);
+        return 0;
+}
+
+int journal_index_unlink(int dir_fd, const char *fname) {
+        const char *p;
+
+        assert(dir_fd >= 0 || dir_fd == AT_FDCWD);
+        assert(fname);
+
+        p = strjoina(fname, JOURNAL_INDEX_SUFFIX);
+        if (unlinkat(dir_fd, p, 0) < 0 && errno != ENOENT)
+                return -errno;
+
+        return 0;
+}
+
+int journal_index_move_to_entry_by_realtime(
+                JournalFile *f,
+                JournalIndex *i,
+                uint64_t realtime,
+                direction_t direction,
+                Object **ret_object,
+                uint64_t *ret_offset) {
+
+        uint64_t left, right;
+        int r;
+
+        assert(f);
+        assert(i);
+
+        /* Finds the same entry as journal_file_move_to_entry_by_realtime(), but only bisects the entries
+         * of the bucket the timestamp falls into. Entries before the bucket are all older than the
+         * timestamp, entries after it are all newer. */
+
+        if (realtime < i->head_realtime)
+                left = right = 0;
+        else {
+                uint64_t b;
+
+                b = (realtime - i->head_realtime) / i->bucket_usec;
+                if (b >= i->n_buckets)
+                        left = right = i->n_entries;
+                else {
+                        left = i->buckets[b];
+                        right = b + 1 < i->n_buckets ? i->buckets[b + 1] : i->n_entries;
+                }
+        }
+
+        /* Find the first entry in [left, right) that is newer than the timestamp (or equal to it, when
+         * going downwards). If there's none, 'right' is the answer. */
+        while (left < right) {
+                uint64_t m = left + (right - left) / 2;
+                Object *o;
+
+                r = journal_file_move_to_entry_by_index(f, m, &o, NULL);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -EBADMSG;
+
+                if (direction == DIRECTION_DOWN ? le64toh(o->entry.realtime) >= realtime
+                                                : le64toh(o->entry.realtime) > realtime)
+                        right = m;
+                else
+                        left = m + 1;
+        }
+
+        if (direction == DIRECTION_DOWN) {
+                if (left >= i->n_entries)
+                        return 0;
+        } else {
+                if (left == 0)
+                        return 0;
+
+                left--;
+        }
+
+        return journal_file_move_to_entry_by_index(f, left, ret_object, ret_offset);
+}
+
+size_t journal_index_get_boots(JournalIndex *i, const JournalBootSummary **ret) {
+        assert(i);
+        assert(ret);
+
+        *ret = i->boots;
+        return i->n_boots;
+}
+
+bool journal_index_data_may_match(JournalIndex *i, uint64_t data_offset, uint64_t realtime, direction_t direction) {
+        IndexData *d, key = {
+                .offset = data_offset,
+        };
+
+        assert(i);
+
+        /* Returns false if the DATA object is known to be referenced only by entries before (or after)
+         * the specified timestamp, so that there's no point in bisecting its entry array chain. */
+
+        d = typesafe_bsearch(&key, i->data, i->n_data, index_data_offset_compare);
+        if (!d)
+                return true;
+
+        return direction == DIRECTION_DOWN ? d->tail_realtime >= realtime : d->head_realtime <= realtime;
+}
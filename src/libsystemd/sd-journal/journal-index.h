@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stdbool.h>
+
+#include "journal-file.h"
+#include "macro.h"
+
+/* A journal index is an optional sidecar file "<file>.journal.idx" that is written next to a journal file
+ * when it is archived. It maps coarse realtime buckets to entry array indexes, and records the realtime
+ * range covered by the most frequently referenced DATA objects of the file, as well as the first and last
+ * entry of each boot contained in the file. Readers use it to skip match terms that cannot yield any
+ * entries in the requested direction, to bisect only a small window of the entry array when seeking by
+ * realtime, and to enumerate boots without looking at the entries. The index only contains information
+ * that can be recalculated from the journal file itself, and is ignored if it does not match the journal
+ * file it is stored next to. */
+
+#define JOURNAL_INDEX_SUFFIX ".idx"
+
+typedef struct JournalIndex JournalIndex;
+
+typedef struct JournalBootSummary {
+        sd_id128_t boot_id;
+        uint64_t head_seqnum;
+        uint64_t tail_seqnum;
+        uint64_t head_realtime;
+        uint64_t tail_realtime;
+} JournalBootSummary;
+
+JournalIndex* journal_index_free(JournalIndex *i);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalIndex*, journal_index_free);
+
+int journal_index_build(JournalFile *f);
+int journal_index_load(JournalFile *f, JournalIndex **ret);
+int journal_index_unlink(int dir_fd, const char *fname);
+
+int journal_index_move_to_entry_by_realtime(
+                JournalFile *f,
+                JournalIndex *i,
+                uint64_t realtime,
+                direction_t direction,
+                Object **ret_object,
+                uint64_t *ret_offset);
+
+size_t journal_index_get_boots(JournalIndex *i, const JournalBootSummary **ret);
+
+bool journal_index_data_may_match(JournalIndex *i, uint64_t data_offset, uint64_t realtime, direction_t direction);
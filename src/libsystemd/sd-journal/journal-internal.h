@@ -11,7 +11,9 @@
 #include "hashmap.h"
 #include "journal-def.h"
 #include "journal-file.h"
+#include "journal-prefetch.h"
 #include "list.h"
+#include "prioq.h"
 #include "set.h"
 
 #define JOURNAL_FILES_MAX 7168u
@@ -21,6 +23,7 @@
 typedef struct Match Match;
 typedef struct Location Location;
 typedef struct Directory Directory;
+typedef struct DataFieldsCacheEntry DataFieldsCacheEntry;
 
 typedef enum MatchType {
         MATCH_DISCRETE,
@@ -68,6 +71,13 @@ struct Directory {
         unsigned last_seen_generation;
 };
 
+#define DATA_FIELDS_CACHE_SIZE 1024U
+
+struct DataFieldsCacheEntry {
+        JournalFile *file;
+        uint64_t offset;
+};
+
 struct sd_journal {
         int toplevel_fd;
 
@@ -76,9 +86,12 @@ struct sd_journal {
         char *namespace;
 
         OrderedHashmap *files;
-        IteratedCache *files_cache;
         MMapCache *mmap;
         Hashmap *newest_by_boot_id; /* key: boot_id, value: prioq, ordered by monotonic timestamp of last update */
+        Prioq *merge_prioq; /* files with a candidate entry for the next step in merge_direction, best first */
+        LIST_HEAD(JournalFile, merge_poll); /* files without candidate that need to be checked for new entries */
+        direction_t merge_direction;
+        JournalPrefetch *prefetch; /* only with SD_JOURNAL_PARALLEL */
 
         Location current_location;
 
@@ -98,6 +111,9 @@ struct sd_journal {
         char *unique_field;
         JournalFile *unique_file;
         uint64_t unique_offset;
+        /* Hashes of the values returned so far, each with a file containing the value */
+        Set *unique_values;
+        uint8_t unique_hash_key[16];
 
         /* Iterating through known fields */
         JournalFile *fields_file;
@@ -114,12 +130,20 @@ struct sd_journal {
                                     removed, and there were no more
                                     files, so sd_j_enumerate_unique
                                     will return a value equal to 0. */
+        bool unique_values_incomplete:1; /* Not all values returned so far are in unique_values */
         bool fields_file_lost:1;
         bool has_runtime_files:1;
         bool has_persistent_files:1;
+        bool merge_prioq_invalid:1; /* boot ordering changed, merge_prioq needs to be rebuilt */
 
         size_t data_threshold;
 
+        /* Projection for sd_journal_enumerate_data(): only data objects of these fields are returned */
+        Set *data_fields;
+        /* Compressed data objects found not to match the projection, so that they are not decompressed
+         * again when the next entry references them */
+        DataFieldsCacheEntry *data_fields_cache;
+
         Hashmap *directories_by_path;
         Hashmap *directories_by_wd;
 
@@ -129,6 +153,14 @@ struct sd_journal {
 char *journal_make_match_string(sd_journal *j);
 void journal_print_header(sd_journal *j);
 
+typedef struct BootId {
+        sd_id128_t id;
+        usec_t first_usec;
+        usec_t last_usec;
+} BootId;
+
+int journal_get_boots(sd_journal *j, BootId **ret_boots, size_t *ret_n_boots);
+
 #define JOURNAL_FOREACH_DATA_RETVAL(j, data, l, retval)                     \
         for (sd_journal_restart_data(j); ((retval) = sd_journal_enumerate_data((j), &(data), &(l))) > 0; )
 
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "journal-prefetch.h"
+#include "macro.h"
+
+#define PREFETCH_WORKERS_MAX 4U
+#define PREFETCH_QUEUE_MAX 64U
+
+typedef struct PrefetchRequest {
+        int fd;
+        uint64_t offset;
+        uint64_t size;
+} PrefetchRequest;
+
+struct JournalPrefetch {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        pthread_t workers[PREFETCH_WORKERS_MAX];
+        unsigned n_workers;
+        unsigned n_idle;
+
+        /* Ring buffer of pending requests */
+        PrefetchRequest queue[PREFETCH_QUEUE_MAX];
+        unsigned queue_head;
+        unsigned n_queued;
+
+        bool dead;
+};
+
+int journal_prefetch_new(JournalPrefetch **ret) {
+        _cleanup_free_ JournalPrefetch *p = NULL;
+        int r;
+
+        assert(ret);
+
+        p = new0(JournalPrefetch, 1);
+        if (!p)
+                return -ENOMEM;
+
+        r = pthread_mutex_init(&p->mutex, NULL);
+        if (r > 0)
+                return -r;
+
+        r = pthread_cond_init(&p->cond, NULL);
+        if (r > 0) {
+                (void) pthread_mutex_destroy(&p->mutex);
+                return -r;
+        }
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+JournalPrefetch* journal_prefetch_free(JournalPrefetch *p) {
+        if (!p)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        p->dead = true;
+        assert_se(pthread_cond_broadcast(&p->cond) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        for (unsigned i = 0; i < p->n_workers; i++)
+                (void) pthread_join(p->workers[i], NULL);
+
+        /* Requests nobody got around to anymore */
+        for (unsigned i = 0; i < p->n_queued; i++)
+                safe_close(p->queue[(p->queue_head + i) % PREFETCH_QUEUE_MAX].fd);
+
+        (void) pthread_cond_destroy(&p->cond);
+        (void) pthread_mutex_destroy(&p->mutex);
+
+        return mfree(p);
+}
+
+static void* prefetch_worker(void *userdata) {
+        JournalPrefetch *p = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "journal-prefetch");
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        for (;;) {
+                PrefetchRequest req;
+
+                while (!p->dead && p->n_queued == 0) {
+                        p->n_idle++;
+                        assert_se(pthread_cond_wait(&p->cond, &p->mutex) == 0);
+                        p->n_idle--;
+                }
+
+                if (p->dead)
+                        break;
+
+                req = p->queue[p->queue_head];
+                p->queue_head = (p->queue_head + 1) % PREFETCH_QUEUE_MAX;
+                p->n_queued--;
+
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+                /* This only populates the page cache, hence failures are not interesting to anyone */
+                (void) readahead(req.fd, req.offset, req.size);
+                safe_close(req.fd);
+
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        return NULL;
+}
+
+static int prefetch_start_worker(JournalPrefetch *p) {
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(p);
+        assert(p->n_workers < PREFETCH_WORKERS_MAX);
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        /* No signals in the helper threads, please */
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&p->workers[p->n_workers], NULL, prefetch_worker, p);
+        if (r == 0)
+                p->n_workers++;
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+        if (k > 0)
+                return -k;
+
+        return 0;
+}
+
+int journal_prefetch_queue(JournalPrefetch *p, int fd, uint64_t offset, uint64_t size) {
+        _cleanup_close_ int copy = -EBADF;
+        bool need_worker;
+        int r;
+
+        assert(p);
+        assert(fd >= 0);
+
+        if (size == 0)
+                return 0;
+
+        /* The journal file might be closed before the request is processed, hence hand a copy of the fd to
+         * the helper thread, which will close it when done. */
+        copy = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+        if (copy < 0)
+                return -errno;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        if (p->n_queued >= PREFETCH_QUEUE_MAX) {
+                /* We are too far behind anyway, drop the request */
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+                return 0;
+        }
+
+        p->queue[(p->queue_head + p->n_queued) % PREFETCH_QUEUE_MAX] = (PrefetchRequest) {
+                .fd = TAKE_FD(copy),
+                .offset = offset,
+                .size = size,
+        };
+        p->n_queued++;
+
+        need_worker = p->n_queued > p->n_idle && p->n_workers < PREFETCH_WORKERS_MAX;
+
+        assert_se(pthread_cond_signal(&p->cond) == 0);
+
+        r = need_worker ? prefetch_start_worker(p) : 0;
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        if (r < 0 && p->n_workers == 0)
+                /* Not a single helper thread? Then the request is stuck in the queue until we are freed,
+                 * which is harmless. Let the caller know though. */
+                return r;
+
+        return 1;
+}
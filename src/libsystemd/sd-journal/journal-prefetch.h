@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <inttypes.h>
+
+#include "macro.h"
+
+/* A small pool of helper threads that read ahead file ranges into the page cache, so that the subsequent
+ * accesses through the mmap cache of the reading thread don't block on disk I/O. The helper threads never
+ * touch any journal objects (the mmap cache is not thread-safe), they merely issue readahead() on
+ * duplicated file descriptors. Requests are hints: if the queue is full they are silently dropped. */
+
+typedef struct JournalPrefetch JournalPrefetch;
+
+int journal_prefetch_new(JournalPrefetch **ret);
+JournalPrefetch* journal_prefetch_free(JournalPrefetch *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalPrefetch*, journal_prefetch_free);
+
+int journal_prefetch_queue(JournalPrefetch *p, int fd, uint64_t offset, uint64_t size);
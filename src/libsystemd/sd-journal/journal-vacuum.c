@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -11,12 +13,17 @@
 #include "fd-util.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "hashmap.h"
 #include "journal-def.h"
 #include "journal-file.h"
+#include "journal-index.h"
 #include "journal-internal.h"
 #include "journal-vacuum.h"
+#include "journal-verify.h"
+#include "set.h"
 #include "sort-util.h"
 #include "string-util.h"
+#include "strv.h"
 #include "time-util.h"
 #include "xattr-util.h"
 
@@ -29,8 +36,28 @@ typedef struct vacuum_info {
         sd_id128_t seqnum_id;
         uint64_t seqnum;
         bool have_seqnum;
+
+        ino_t ino;
+        bool empty;
 } vacuum_info;
 
+struct JournalVacuumState {
+        /* Archived files whose information will not change anymore, by file name. Only accessed by the
+         * calling thread. */
+        Hashmap *files;
+
+        /* Files being deleted by the background thread. Owned by the thread while it runs. */
+        pthread_t thread;
+        bool thread_started;
+        bool thread_done; /* accessed atomically */
+
+        int dir_fd;
+        char *directory;
+        vacuum_info *unlink_list;
+        size_t n_unlink_list;
+        bool verbose;
+};
+
 static int vacuum_info_compare(const vacuum_info *a, const vacuum_info *b) {
         int r;
 
@@ -58,6 +85,21 @@ static void vacuum_info_array_free(vacuum_info *list, size_t n) {
         free(list);
 }
 
+static vacuum_info* vacuum_info_free(vacuum_info *i) {
+        if (!i)
+                return NULL;
+
+        free(i->filename);
+        return mfree(i);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(vacuum_info*, vacuum_info_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                vacuum_info_hash_ops,
+                char, string_hash_func, string_compare_func,
+                vacuum_info, vacuum_info_free);
+
 static void patch_realtime(
                 int fd,
                 const char *fn,
@@ -94,12 +136,15 @@ static void patch_realtime(
                 *realtime = x;
 }
 
-static int journal_file_empty(int dir_fd, const char *name) {
+static int journal_file_empty(int dir_fd, const char *name, bool *ret_final) {
         _cleanup_close_ int fd = -EBADF;
         struct stat st;
         le64_t n_entries;
+        uint8_t state;
         ssize_t n;
 
+        assert(ret_final);
+
         fd = openat(dir_fd, name, O_RDONLY|O_CLOEXEC|O_NOFOLLOW|O_NONBLOCK|O_NOATIME);
         if (fd < 0) {
                 /* Maybe failed due to O_NOATIME and lack of privileges? */
@@ -112,8 +157,10 @@ static int journal_file_empty(int dir_fd, const char *name) {
                 return -errno;
 
         /* If an offline file doesn't even have a header we consider it empty */
-        if (st.st_size < (off_t) sizeof(Header))
+        if (st.st_size < (off_t) sizeof(Header)) {
+                *ret_final = false;
                 return 1;
+        }
 
         /* If the number of entries is empty, we consider it empty, too */
         n = pread(fd, &n_entries, sizeof(n_entries), offsetof(Header, n_entries));
@@ -122,31 +169,272 @@ static int journal_file_empty(int dir_fd, const char *name) {
         if (n != sizeof(n_entries))
                 return -EIO;
 
+        /* Right after rotation, the offline thread might still be truncating the file. Only once it is
+         * marked as archived its size stays the same. */
+        n = pread(fd, &state, sizeof(state), offsetof(Header, state));
+        if (n < 0)
+                return -errno;
+        if (n != sizeof(state))
+                return -EIO;
+
+        *ret_final = state == STATE_ARCHIVED;
         return le64toh(n_entries) <= 0;
 }
 
-int journal_directory_vacuum(
+static int vacuum_unlink_one(int dir_fd, const char *directory, const vacuum_info *i, bool verbose) {
+        int r;
+
+        assert(i);
+
+        r = unlinkat_deallocate(dir_fd, i->filename, 0);
+        if (r < 0) {
+                if (r != -ENOENT)
+                        log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
+                                                    "Failed to delete %sarchived journal %s/%s: %m",
+                                                    i->empty ? "empty " : "", directory, i->filename);
+                return r;
+        }
+
+        (void) journal_index_unlink(dir_fd, i->filename);
+        (void) journal_verify_checkpoint_unlink(dir_fd, i->filename);
+
+        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted %sarchived journal %s/%s (%s).",
+                 i->empty ? "empty " : "", directory, i->filename, FORMAT_BYTES(i->usage));
+        return 0;
+}
+
+static void* vacuum_unlink_thread(void *userdata) {
+        JournalVacuumState *s = ASSERT_PTR(userdata);
+        uint64_t freed = 0;
+
+        (void) pthread_setname_np(pthread_self(), "journal-vacuum");
+
+        FOREACH_ARRAY(i, s->unlink_list, s->n_unlink_list)
+                if (vacuum_unlink_one(s->dir_fd, s->directory, i, s->verbose) >= 0)
+                        freed += i->usage;
+
+        log_full(s->verbose ? LOG_INFO : LOG_DEBUG, "Deleting done, freed %s of archived journals from %s.",
+                 FORMAT_BYTES(freed), s->directory);
+
+        __atomic_store_n(&s->thread_done, true, __ATOMIC_RELEASE);
+        return NULL;
+}
+
+static void vacuum_state_join(JournalVacuumState *s) {
+        assert(s);
+
+        if (s->thread_started) {
+                (void) pthread_join(s->thread, NULL);
+                s->thread_started = false;
+        }
+
+        vacuum_info_array_free(s->unlink_list, s->n_unlink_list);
+        s->unlink_list = NULL;
+        s->n_unlink_list = 0;
+        s->directory = mfree(s->directory);
+        s->dir_fd = safe_close(s->dir_fd);
+}
+
+static int vacuum_state_start_thread(JournalVacuumState *s) {
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(s);
+        assert(!s->thread_started);
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        /* No signals in the deletion thread, please */
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        s->thread_done = false;
+
+        r = pthread_create(&s->thread, NULL, vacuum_unlink_thread, s);
+        if (r == 0)
+                s->thread_started = true;
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+        if (k > 0)
+                return -k;
+
+        return 0;
+}
+
+int journal_vacuum_state_new(JournalVacuumState **ret) {
+        JournalVacuumState *s;
+
+        assert(ret);
+
+        s = new(JournalVacuumState, 1);
+        if (!s)
+                return -ENOMEM;
+
+        *s = (JournalVacuumState) {
+                .dir_fd = -EBADF,
+        };
+
+        *ret = s;
+        return 0;
+}
+
+JournalVacuumState* journal_vacuum_state_free(JournalVacuumState *s) {
+        if (!s)
+                return NULL;
+
+        /* Let's wait for the deletions to finish, so that nobody sees them half-done */
+        vacuum_state_join(s);
+
+        hashmap_free(s->files);
+        return mfree(s);
+}
+
+bool journal_vacuum_state_busy(JournalVacuumState *s) {
+        return s && s->thread_started && !__atomic_load_n(&s->thread_done, __ATOMIC_ACQUIRE);
+}
+
+int journal_vacuum_state_get_usage(JournalVacuumState *s, const char *filename, ino_t ino, uint64_t *ret) {
+        vacuum_info *i;
+
+        assert(filename);
+        assert(ret);
+
+        /* Returns the disk usage of an archived file as determined by the last vacuuming run, if the file
+         * is still the same. */
+
+        if (!s)
+                return 0;
+
+        i = hashmap_get(s->files, filename);
+        if (!i || i->ino != ino)
+                return 0;
+
+        *ret = i->usage;
+        return 1;
+}
+
+static int vacuum_list_add(vacuum_info **list, size_t *n_list, const vacuum_info *i) {
+        char *fn;
+
+        assert(list);
+        assert(n_list);
+        assert(i);
+
+        fn = strdup(i->filename);
+        if (!fn)
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(*list, *n_list + 1)) {
+                free(fn);
+                return -ENOMEM;
+        }
+
+        (*list)[(*n_list)++] = (vacuum_info) {
+                .filename = fn,
+                .usage = i->usage,
+                .seqnum = i->seqnum,
+                .realtime = i->realtime,
+                .seqnum_id = i->seqnum_id,
+                .have_seqnum = i->have_seqnum,
+                .ino = i->ino,
+                .empty = i->empty,
+        };
+
+        return 0;
+}
+
+static int vacuum_cache_add(Hashmap **files, const vacuum_info *i) {
+        _cleanup_(vacuum_info_freep) vacuum_info *c = NULL;
+        int r;
+
+        assert(files);
+        assert(i);
+
+        c = newdup(vacuum_info, i, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->filename = strdup(i->filename);
+        if (!c->filename)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(files, &vacuum_info_hash_ops, c->filename, c);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(c);
+        return 0;
+}
+
+static void remove_stale_sidecars(int dir_fd, const char *directory, char **sidecars, Set *journals) {
+        STRV_FOREACH(i, sidecars) {
+                _cleanup_free_ char *j = NULL;
+                const char *suffix;
+
+                /* Remove sidecar files whose journal file is gone. They are tiny, hence don't account for
+                 * them otherwise. */
+
+                suffix = endswith(*i, JOURNAL_INDEX_SUFFIX) ?: endswith(*i, JOURNAL_VERIFY_CHECKPOINT_SUFFIX);
+                assert(suffix);
+
+                j = strndup(*i, suffix - *i);
+                if (!j) {
+                        log_oom_debug();
+                        return;
+                }
+
+                if (set_contains(journals, j))
+                        continue;
+
+                if (faccessat(dir_fd, j, F_OK, AT_SYMLINK_NOFOLLOW) < 0 && errno == ENOENT &&
+                    unlinkat(dir_fd, *i, 0) >= 0)
+                        log_debug("Deleted stale journal sidecar file %s/%s.", directory, *i);
+        }
+}
+
+int journal_directory_vacuum_full(
                 const char *directory,
                 uint64_t max_use,
                 uint64_t n_max_files,
                 usec_t max_retention_usec,
+                JournalVacuumState *state,
                 usec_t *oldest_usec,
                 bool verbose) {
 
         uint64_t sum = 0, freed = 0, n_active_files = 0;
-        size_t n_list = 0, i;
+        size_t n_list = 0, n_unlink_list = 0, i;
+        _cleanup_hashmap_free_ Hashmap *files = NULL;
+        _cleanup_set_free_ Set *journals = NULL;
+        _cleanup_strv_free_ char **sidecars = NULL;
         _cleanup_closedir_ DIR *d = NULL;
-        vacuum_info *list = NULL;
+        vacuum_info *list = NULL, *unlink_list = NULL;
         usec_t retention_limit = 0;
         int r;
 
         CLEANUP_ARRAY(list, n_list, vacuum_info_array_free);
+        CLEANUP_ARRAY(unlink_list, n_unlink_list, vacuum_info_array_free);
 
         assert(directory);
 
         if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
                 return 0;
 
+        /* With a state object, the information about archived files is remembered between invocations, so
+         * that they don't have to be looked at again, as long as the directory still contains the same inode
+         * under the same name. The files are then deleted in a background thread. Until it is done, further
+         * vacuuming requests are ignored, since the disk usage is still in flux. */
+        if (state) {
+                if (journal_vacuum_state_busy(state)) {
+                        log_debug("Still deleting journal files from %s, not vacuuming again.", state->directory);
+                        return 0;
+                }
+
+                vacuum_state_join(state);
+        }
+
         if (max_retention_usec > 0)
                 retention_limit = usec_sub_unsigned(now(CLOCK_REALTIME), max_retention_usec);
 
@@ -158,11 +446,49 @@ int journal_directory_vacuum(
                 unsigned long long seqnum = 0, realtime;
                 _cleanup_free_ char *p = NULL;
                 sd_id128_t seqnum_id;
-                bool have_seqnum;
+                bool have_seqnum, final;
+                vacuum_info *cached;
                 uint64_t size;
                 struct stat st;
                 size_t q;
 
+                q = strlen(de->d_name);
+
+                if (endswith(de->d_name, ".journal" JOURNAL_INDEX_SUFFIX) ||
+                    endswith(de->d_name, ".journal" JOURNAL_VERIFY_CHECKPOINT_SUFFIX)) {
+                        r = strv_extend(&sidecars, de->d_name);
+                        if (r < 0)
+                                return r;
+
+                        continue;
+                }
+
+                if (state) {
+                        r = set_put_strdup(&journals, de->d_name);
+                        if (r < 0)
+                                return r;
+
+                        cached = hashmap_remove(state->files, de->d_name);
+                        if (cached) {
+                                _cleanup_(vacuum_info_freep) vacuum_info *c = cached;
+
+                                /* Reuse what we learnt about the file last time, if it is still the same */
+                                if (c->ino == de->d_ino) {
+                                        r = vacuum_list_add(&list, &n_list, c);
+                                        if (r < 0)
+                                                return r;
+
+                                        r = hashmap_ensure_put(&files, &vacuum_info_hash_ops, c->filename, c);
+                                        if (r < 0)
+                                                return r;
+
+                                        TAKE_PTR(c);
+                                        sum += list[n_list - 1].usage;
+                                        continue;
+                                }
+                        }
+                }
+
                 if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
                         log_debug_errno(errno, "Failed to stat file %s while vacuuming, ignoring: %m", de->d_name);
                         continue;
@@ -173,8 +499,6 @@ int journal_directory_vacuum(
 
                 size = 512UL * (uint64_t) st.st_blocks;
 
-                q = strlen(de->d_name);
-
                 if (endswith(de->d_name, ".journal")) {
 
                         /* Vacuum archived files. Active files are
@@ -251,46 +575,55 @@ int journal_directory_vacuum(
                         continue;
                 }
 
-                r = journal_file_empty(dirfd(d), p);
+                r = journal_file_empty(dirfd(d), p, &final);
                 if (r < 0) {
                         log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", p);
                         continue;
                 }
-                if (r > 0) {
-                        /* Always vacuum empty non-online files. */
 
-                        r = unlinkat_deallocate(dirfd(d), p, 0);
-                        if (r >= 0) {
+                vacuum_info info = {
+                        .filename = p,
+                        .usage = size,
+                        .seqnum = seqnum,
+                        .realtime = realtime,
+                        .seqnum_id = seqnum_id,
+                        .have_seqnum = have_seqnum,
+                        .ino = de->d_ino,
+                        .empty = r > 0,
+                };
 
-                                log_full(verbose ? LOG_INFO : LOG_DEBUG,
-                                         "Deleted empty archived journal %s/%s (%s).", directory, p, FORMAT_BYTES(size));
+                if (info.empty) {
+                        /* Always vacuum empty non-online files. */
 
+                        if (state) {
+                                r = vacuum_list_add(&unlink_list, &n_unlink_list, &info);
+                                if (r < 0)
+                                        return r;
+                        } else if (vacuum_unlink_one(dirfd(d), directory, &info, verbose) >= 0)
                                 freed += size;
-                        } else if (r != -ENOENT)
-                                log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
-                                                            "Failed to delete empty archived journal %s/%s: %m",
-                                                            directory, p);
 
                         continue;
                 }
 
                 patch_realtime(dirfd(d), p, &st, &realtime);
+                info.realtime = realtime;
 
-                if (!GREEDY_REALLOC(list, n_list + 1))
-                        return -ENOMEM;
+                /* Corrupted files are not written to anymore once they got renamed */
+                if (state && (final || !have_seqnum)) {
+                        r = vacuum_cache_add(&files, &info);
+                        if (r < 0)
+                                return r;
+                }
 
-                list[n_list++] = (vacuum_info) {
-                        .filename = TAKE_PTR(p),
-                        .usage = size,
-                        .seqnum = seqnum,
-                        .realtime = realtime,
-                        .seqnum_id = seqnum_id,
-                        .have_seqnum = have_seqnum,
-                };
+                r = vacuum_list_add(&list, &n_list, &info);
+                if (r < 0)
+                        return r;
 
                 sum += size;
         }
 
+        remove_stale_sidecars(dirfd(d), directory, sidecars, journals);
+
         typesafe_qsort(list, n_list, vacuum_info_compare);
 
         for (i = 0; i < n_list; i++) {
@@ -303,28 +636,66 @@ int journal_directory_vacuum(
                     (n_max_files <= 0 || left <= n_max_files))
                         break;
 
-                r = unlinkat_deallocate(dirfd(d), list[i].filename, 0);
-                if (r >= 0) {
-                        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).",
-                                 directory, list[i].filename, FORMAT_BYTES(list[i].usage));
-                        freed += list[i].usage;
+                if (state) {
+                        /* The file is going away, no need to remember it. If deleting it fails, we'll look
+                         * at it again next time. */
+                        vacuum_info_free(hashmap_remove(files, list[i].filename));
 
-                        if (list[i].usage < sum)
-                                sum -= list[i].usage;
-                        else
-                                sum = 0;
+                        r = vacuum_list_add(&unlink_list, &n_unlink_list, list + i);
+                        if (r < 0)
+                                return r;
+                } else {
+                        r = vacuum_unlink_one(dirfd(d), directory, list + i, verbose);
+                        if (r < 0)
+                                continue;
 
-                } else if (r != -ENOENT)
-                        log_ratelimit_warning_errno(r, JOURNAL_LOG_RATELIMIT,
-                                                    "Failed to delete archived journal %s/%s: %m",
-                                                    directory, list[i].filename);
+                        freed += list[i].usage;
+                }
+
+                if (list[i].usage < sum)
+                        sum -= list[i].usage;
+                else
+                        sum = 0;
         }
 
         if (oldest_usec && i < n_list && (*oldest_usec == 0 || list[i].realtime < *oldest_usec))
                 *oldest_usec = list[i].realtime;
 
-        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.",
-                 FORMAT_BYTES(freed), directory);
+        if (!state) {
+                log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.",
+                         FORMAT_BYTES(freed), directory);
+                return 0;
+        }
+
+        hashmap_free(state->files);
+        state->files = TAKE_PTR(files);
+
+        if (n_unlink_list == 0) {
+                log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, nothing to delete from %s.", directory);
+                return 0;
+        }
+
+        state->dir_fd = fcntl(dirfd(d), F_DUPFD_CLOEXEC, 3);
+        if (state->dir_fd < 0)
+                return -errno;
+
+        state->directory = strdup(directory);
+        if (!state->directory)
+                return -ENOMEM;
+
+        state->unlink_list = TAKE_PTR(unlink_list);
+        state->n_unlink_list = TAKE_GENERIC(n_unlink_list, size_t, 0);
+        state->verbose = verbose;
+
+        r = vacuum_state_start_thread(state);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to start thread for deleting journal files, deleting them synchronously: %m");
+                (void) vacuum_unlink_thread(state);
+                return 0;
+        }
+
+        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, deleting %zu archived journals from %s in the background.",
+                 state->n_unlink_list, directory);
 
         return 0;
 }
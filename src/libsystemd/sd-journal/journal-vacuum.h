@@ -3,7 +3,30 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <sys/types.h>
 
+#include "macro.h"
 #include "time-util.h"
 
-int journal_directory_vacuum(const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
+/* Remembers the archived files of a directory between vacuuming runs, and deletes files in the background */
+typedef struct JournalVacuumState JournalVacuumState;
+
+int journal_vacuum_state_new(JournalVacuumState **ret);
+JournalVacuumState* journal_vacuum_state_free(JournalVacuumState *s);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalVacuumState*, journal_vacuum_state_free);
+
+bool journal_vacuum_state_busy(JournalVacuumState *s);
+int journal_vacuum_state_get_usage(JournalVacuumState *s, const char *filename, ino_t ino, uint64_t *ret);
+
+int journal_directory_vacuum_full(
+                const char *directory,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                JournalVacuumState *state,
+                usec_t *oldest_usec,
+                bool verbose);
+
+static inline int journal_directory_vacuum(const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose) {
+        return journal_directory_vacuum_full(directory, max_use, n_max_files, max_retention_usec, NULL, oldest_usec, verbose);
+}
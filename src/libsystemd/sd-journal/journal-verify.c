@@ -1,8 +1,11 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "alloc-util.h"
@@ -10,15 +13,43 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
+#include "io-util.h"
 #include "journal-authenticate.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-verify.h"
 #include "lookup3.h"
 #include "macro.h"
+#include "path-util.h"
+#include "sparse-endian.h"
+#include "stat-util.h"
+#include "string-util.h"
 #include "terminal-util.h"
 #include "tmpfile-util.h"
 
+/* How many DATA object offsets a hash verification thread takes at once */
+#define VERIFY_HASH_BATCH 1024U
+
+static const char checkpoint_signature[] = { 'L', 'P', 'K', 'S', 'H', 'V', 'F', 'Y' };
+
+/* A verification checkpoint is an optional sidecar file "<file>.journal.verified", written after a sealed
+ * journal file was verified successfully with the verification key. It records the last tag object that
+ * was verified. When verifying the file again with JOURNAL_VERIFY_CHECKPOINT, the payload hashes of the
+ * DATA objects up to that tag are not calculated again (which means decompressing them), provided the tag
+ * is still there, unchanged. The checkpoint itself is not authenticated in any way, hence all the other
+ * checks, in particular the HMACs of all tags, are still done for the whole file. As the HMACs cover the
+ * DATA objects, including the stored hashes, a modified payload is still detected, just not by its hash
+ * anymore. */
+typedef struct JournalVerifyCheckpoint {
+        uint8_t signature[8];
+        le64_t header_size;
+        sd_id128_t file_id;
+        le64_t tag_offset;
+        le64_t tag_seqnum;
+        le64_t tag_epoch;
+        uint8_t tag[TAG_LENGTH];
+} _packed_ JournalVerifyCheckpoint;
+
 static void draw_progress(uint64_t p, usec_t *last_usec) {
         unsigned n, i, j, k;
         usec_t z, x;
@@ -109,7 +140,7 @@ static void flush_progress(void) {
                 log_error_errno(error, OFSfmt": " _fmt, (uint64_t)_offset, ##__VA_ARGS__); \
         } while (0)
 
-static int hash_payload(JournalFile *f, Object *o, uint64_t offset, const uint8_t *src, uint64_t size, uint64_t *res_hash) {
+static int hash_payload(JournalFile *f, Object *o, const uint8_t *src, uint64_t size, uint64_t *res_hash) {
         Compression c;
         int r;
 
@@ -117,19 +148,26 @@ static int hash_payload(JournalFile *f, Object *o, uint64_t offset, const uint8_
         assert(src);
         assert(res_hash);
 
+        /* This doesn't log, as it is called from the hash verification threads too */
+
         c = COMPRESSION_FROM_OBJECT(o);
         if (c < 0)
                 return -EBADMSG;
         if (c != COMPRESSION_NONE) {
                 _cleanup_free_ void *b = NULL;
+                CompressDictionary *d = NULL;
                 size_t b_size;
 
-                r = decompress_blob(c, src, size, &b, &b_size, 0);
-                if (r < 0) {
-                        error_errno(offset, r, "%s decompression failed: %m",
-                                    compression_to_string(c));
+                if (c == COMPRESSION_ZSTD) {
+                        r = journal_file_get_compress_dictionary(f, &d);
+                        if (r < 0)
+                                return r;
+
+                        r = decompress_blob_zstd_with_dictionary(d, src, size, &b, &b_size, 0);
+                } else
+                        r = decompress_blob(c, src, size, &b, &b_size, 0);
+                if (r < 0)
                         return r;
-                }
 
                 *res_hash = journal_file_hash_data(f, b, b_size);
         } else
@@ -138,14 +176,32 @@ static int hash_payload(JournalFile *f, Object *o, uint64_t offset, const uint8_
         return 0;
 }
 
-static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o) {
+static int data_hash_verify(JournalFile *f, Object *o, uint64_t *ret_hash) {
+        int r;
+
+        assert(f);
+        assert(o);
+        assert(o->object.type == OBJECT_DATA);
+        assert(ret_hash);
+
+        r = hash_payload(f, o, journal_file_data_payload_field(f, o),
+                         le64toh(o->object.size) - journal_file_data_payload_offset(f),
+                         ret_hash);
+        if (r < 0)
+                return r;
+
+        return *ret_hash == le64toh(o->data.hash) ? 0 : -EBADMSG;
+}
+
+static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o, bool check_data_hash) {
         assert(f);
         assert(offset);
         assert(o);
 
         /* This does various superficial tests about the length an
          * possible field values. It does not follow any references to
-         * other objects. */
+         * other objects. The hash of DATA objects is only checked if
+         * check_data_hash is set, otherwise the caller takes care of it. */
 
         if ((o->object.flags & _OBJECT_COMPRESSED_MASK) != 0 &&
             o->object.type != OBJECT_DATA) {
@@ -176,16 +232,17 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         return -EBADMSG;
                 }
 
-                h1 = le64toh(o->data.hash);
-                r = hash_payload(f, o, offset, journal_file_data_payload_field(f, o),
-                                 le64toh(o->object.size) - journal_file_data_payload_offset(f),
-                                 &h2);
-                if (r < 0)
-                        return r;
-
-                if (h1 != h2) {
-                        error(offset, "Invalid hash (%08" PRIx64 " vs. %08" PRIx64 ")", h1, h2);
-                        return -EBADMSG;
+                if (check_data_hash) {
+                        h1 = le64toh(o->data.hash);
+                        r = data_hash_verify(f, o, &h2);
+                        if (r == -EBADMSG) {
+                                error(offset, "Invalid hash (%08" PRIx64 " vs. %08" PRIx64 ")", h1, h2);
+                                return r;
+                        }
+                        if (r < 0) {
+                                error_errno(offset, r, "Failed to hash payload: %m");
+                                return r;
+                        }
                 }
 
                 if (!VALID64(le64toh(o->data.next_hash_offset)) ||
@@ -216,11 +273,13 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 }
 
                 h1 = le64toh(o->field.hash);
-                r = hash_payload(f, o, offset, o->field.payload,
+                r = hash_payload(f, o, o->field.payload,
                                  le64toh(o->object.size) - offsetof(Object, field.payload),
                                  &h2);
-                if (r < 0)
+                if (r < 0) {
+                        error_errno(offset, r, "Failed to hash payload: %m");
                         return r;
+                }
 
                 if (h1 != h2) {
                         error(offset, "Invalid hash (%08" PRIx64 " vs. %08" PRIx64 ")", h1, h2);
@@ -376,6 +435,17 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         return -EBADMSG;
                 }
 
+                break;
+
+        case OBJECT_COMPRESSION_DICTIONARY:
+                if (le64toh(o->object.size) <= offsetof(Object, compression_dictionary.payload)) {
+                        error(offset,
+                              "Bad compression dictionary size (<= %zu): %"PRIu64,
+                              offsetof(Object, compression_dictionary.payload),
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
                 break;
         }
 
@@ -809,18 +879,362 @@ static int verify_hash_table(
         return 0;
 }
 
-int journal_file_verify(
+static int checkpoint_path(JournalFile *f, char **ret) {
+        char *p;
+
+        assert(f);
+        assert(ret);
+
+        /* Files passed in as fd have no useful path, hence there is no place to store the checkpoint next to it. */
+        if (!f->path || path_startswith(f->path, "/proc/self/fd"))
+                return -EADDRNOTAVAIL;
+
+        p = strjoin(f->path, JOURNAL_VERIFY_CHECKPOINT_SUFFIX);
+        if (!p)
+                return -ENOMEM;
+
+        *ret = p;
+        return 0;
+}
+
+static int checkpoint_load(JournalFile *f, uint64_t *ret_offset) {
+        _cleanup_free_ char *path = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        JournalVerifyCheckpoint c;
+        uint64_t offset;
+        struct stat st;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(ret_offset);
+
+        r = checkpoint_path(f, &path);
+        if (r < 0)
+                return r;
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        r = stat_verify_regular(&st);
+        if (r < 0)
+                return r;
+
+        if ((uint64_t) st.st_size != sizeof(c))
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Verification checkpoint %s is invalid, ignoring.", path);
+
+        r = loop_read_exact(fd, &c, sizeof(c), false);
+        if (r < 0)
+                return r;
+
+        offset = le64toh(c.tag_offset);
+
+        if (memcmp(c.signature, checkpoint_signature, sizeof(checkpoint_signature)) != 0 ||
+            le64toh(c.header_size) != sizeof(c) ||
+            !VALID64(offset) ||
+            offset < le64toh(f->header->header_size) ||
+            offset > le64toh(f->header->tail_object_offset))
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Verification checkpoint %s is invalid, ignoring.", path);
+
+        /* Make sure the checkpoint describes this file, and the tag it refers to is still the same */
+        if (!sd_id128_equal(c.file_id, f->header->file_id))
+                return log_debug_errno(SYNTHETIC_ERRNO(ESTALE), "Verification checkpoint %s is out of date, ignoring.", path);
+
+        r = journal_file_move_to_object(f, OBJECT_TAG, offset, &o);
+        if (r < 0)
+                return log_debug_errno(r, "Verification checkpoint %s refers to an invalid tag, ignoring: %m", path);
+
+        if (o->tag.seqnum != c.tag_seqnum ||
+            o->tag.epoch != c.tag_epoch ||
+            memcmp(o->tag.tag, c.tag, TAG_LENGTH) != 0)
+                return log_debug_errno(SYNTHETIC_ERRNO(ESTALE), "Verification checkpoint %s is out of date, ignoring.", path);
+
+        log_debug("Using verification checkpoint %s at tag %"PRIu64".", path, le64toh(c.tag_seqnum));
+
+        *ret_offset = offset;
+        return 0;
+}
+
+#if HAVE_GCRYPT
+static int checkpoint_save(JournalFile *f, uint64_t offset) {
+        _cleanup_(unlink_and_freep) char *tmp = NULL;
+        _cleanup_free_ char *path = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        JournalVerifyCheckpoint c;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(offset > 0);
+
+        r = checkpoint_path(f, &path);
+        if (r < 0)
+                return r;
+
+        r = journal_file_move_to_object(f, OBJECT_TAG, offset, &o);
+        if (r < 0)
+                return r;
+
+        c = (JournalVerifyCheckpoint) {
+                .header_size = htole64(sizeof(c)),
+                .file_id = f->header->file_id,
+                .tag_offset = htole64(offset),
+                .tag_seqnum = o->tag.seqnum,
+                .tag_epoch = o->tag.epoch,
+        };
+        memcpy(c.signature, checkpoint_signature, sizeof(checkpoint_signature));
+        memcpy(c.tag, o->tag.tag, TAG_LENGTH);
+
+        fd = open_tmpfile_linkable(path, O_WRONLY|O_CLOEXEC, &tmp);
+        if (fd < 0)
+                return log_debug_errno(fd, "Failed to create verification checkpoint %s: %m", path);
+
+        if (fchmod(fd, f->mode & 0666) < 0)
+                return log_debug_errno(errno, "Failed to set access mode of verification checkpoint %s: %m", path);
+
+        r = loop_write(fd, &c, sizeof(c));
+        if (r < 0)
+                return log_debug_errno(r, "Failed to write verification checkpoint %s: %m", path);
+
+        r = link_tmpfile(fd, tmp, path, LINK_TMPFILE_REPLACE);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to move verification checkpoint %s into place: %m", path);
+
+        tmp = mfree(tmp);
+
+        log_debug("Wrote verification checkpoint %s at tag %"PRIu64".", path, le64toh(c.tag_seqnum));
+        return 0;
+}
+#endif
+
+int journal_verify_checkpoint_unlink(int dir_fd, const char *fname) {
+        const char *p;
+
+        assert(dir_fd >= 0 || dir_fd == AT_FDCWD);
+        assert(fname);
+
+        p = strjoina(fname, JOURNAL_VERIFY_CHECKPOINT_SUFFIX);
+        if (unlinkat(dir_fd, p, 0) < 0 && errno != ENOENT)
+                return -errno;
+
+        return 0;
+}
+
+typedef struct VerifyHashContext {
+        const char *path;
+        int fd;                 /* the journal file */
+        int data_fd;            /* the sorted offsets of all DATA objects */
+        uint64_t n_data;
+        uint64_t skip_before;   /* DATA objects before this offset are covered by the checkpoint */
+
+        uint64_t next;          /* index of the next batch of DATA objects, taken atomically */
+        bool failed;
+
+        /* The first bad DATA object any of the threads found */
+        pthread_mutex_t mutex;
+        uint64_t failed_offset;
+        uint64_t failed_hash;           /* as stored in the object */
+        uint64_t failed_hash_payload;   /* as calculated from the payload */
+        int failed_error;
+} VerifyHashContext;
+
+static void verify_hash_fail(VerifyHashContext *c, uint64_t offset, uint64_t hash, uint64_t hash_payload, int error) {
+        assert(c);
+        assert(error < 0);
+
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+
+        if (!c->failed || offset < c->failed_offset) {
+                c->failed_offset = offset;
+                c->failed_hash = hash;
+                c->failed_hash_payload = hash_payload;
+                c->failed_error = error;
+        }
+
+        __atomic_store_n(&c->failed, true, __ATOMIC_RELAXED);
+
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+}
+
+static void* verify_hash_thread(void *userdata) {
+        VerifyHashContext *c = ASSERT_PTR(userdata);
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_(journal_file_closep) JournalFile *f = NULL;
+        _cleanup_close_ int fd = -EBADF;
+        int r;
+
+        (void) pthread_setname_np(pthread_self(), "journal-verify");
+
+        /* The mmap cache is not thread-safe, hence every thread maps the file on its own */
+        m = mmap_cache_new();
+        if (!m) {
+                verify_hash_fail(c, 0, 0, 0, -ENOMEM);
+                return NULL;
+        }
+
+        fd = fd_reopen(c->fd, O_RDONLY|O_CLOEXEC);
+        if (fd < 0) {
+                verify_hash_fail(c, 0, 0, 0, fd);
+                return NULL;
+        }
+
+        r = journal_file_open(fd, c->path, O_RDONLY, 0, 0, 0, NULL, m, NULL, &f);
+        if (r < 0) {
+                verify_hash_fail(c, 0, 0, 0, r);
+                return NULL;
+        }
+        TAKE_FD(fd);
+
+        while (!__atomic_load_n(&c->failed, __ATOMIC_RELAXED)) {
+                uint64_t batch[VERIFY_HASH_BATCH], i;
+                size_t n;
+                ssize_t l;
+
+                i = __atomic_fetch_add(&c->next, VERIFY_HASH_BATCH, __ATOMIC_RELAXED);
+                if (i >= c->n_data)
+                        break;
+
+                n = MIN(c->n_data - i, (uint64_t) VERIFY_HASH_BATCH);
+                l = pread(c->data_fd, batch, n * sizeof(uint64_t), i * sizeof(uint64_t));
+                if (l < 0) {
+                        verify_hash_fail(c, 0, 0, 0, -errno);
+                        break;
+                }
+                if ((size_t) l != n * sizeof(uint64_t)) {
+                        verify_hash_fail(c, 0, 0, 0, -EIO);
+                        break;
+                }
+
+                FOREACH_ARRAY(q, batch, n) {
+                        uint64_t h = 0;
+                        Object *o;
+
+                        if (*q < c->skip_before)
+                                continue;
+
+                        r = journal_file_move_to_object(f, OBJECT_DATA, *q, &o);
+                        if (r < 0) {
+                                verify_hash_fail(c, *q, 0, 0, r);
+                                break;
+                        }
+
+                        r = data_hash_verify(f, o, &h);
+                        if (r < 0) {
+                                verify_hash_fail(c, *q, le64toh(o->data.hash), h, r);
+                                break;
+                        }
+                }
+        }
+
+        return NULL;
+}
+
+static int verify_data_hashes(
+                JournalFile *f,
+                int data_fd, uint64_t n_data,
+                uint64_t skip_before,
+                unsigned n_threads,
+                uint64_t *ret_offset) {
+
+        VerifyHashContext c = {
+                .path = f->path,
+                .fd = f->fd,
+                .data_fd = data_fd,
+                .n_data = n_data,
+                .skip_before = skip_before,
+        };
+        pthread_t threads[JOURNAL_VERIFY_THREADS_MAX];
+        sigset_t ss, saved_ss;
+        unsigned n_started = 0;
+        int r, k;
+
+        assert(f);
+        assert(data_fd >= 0);
+        assert(n_threads > 0);
+        assert(ret_offset);
+
+        /* The offsets of the DATA objects were collected in the first pass already, now check their hashes
+         * in a couple of threads, which is where most of the time goes for large files, as the payload needs
+         * to be decompressed and hashed. */
+
+        n_threads = MIN3(n_threads, (unsigned) JOURNAL_VERIFY_THREADS_MAX, (unsigned) DIV_ROUND_UP(n_data, VERIFY_HASH_BATCH));
+        if (n_threads == 0)
+                return 0;
+
+        r = pthread_mutex_init(&c.mutex, NULL);
+        if (r > 0)
+                return -r;
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        /* No signals in the verification threads, please */
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0) {
+                r = -r;
+                goto finish;
+        }
+
+        for (; n_started < n_threads; n_started++) {
+                r = pthread_create(threads + n_started, NULL, verify_hash_thread, &c);
+                if (r > 0)
+                        break;
+        }
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+
+        /* If not all threads could be started, make the others give up quickly */
+        if (r > 0)
+                __atomic_store_n(&c.failed, true, __ATOMIC_RELAXED);
+
+        for (unsigned i = 0; i < n_started; i++)
+                (void) pthread_join(threads[i], NULL);
+
+        if (r > 0) {
+                r = -r;
+                goto finish;
+        }
+        if (k > 0) {
+                r = -k;
+                goto finish;
+        }
+
+        r = 0;
+        if (c.failed) {
+                r = c.failed_error;
+                *ret_offset = c.failed_offset;
+
+                if (c.failed_offset == 0)
+                        log_error_errno(r, "Failed to verify hashes of data objects: %m");
+                else if (r == -EBADMSG)
+                        error(c.failed_offset, "Invalid hash (%08" PRIx64 " vs. %08" PRIx64 ")",
+                              c.failed_hash, c.failed_hash_payload);
+                else
+                        error_errno(c.failed_offset, r, "Failed to hash payload: %m");
+        }
+
+finish:
+        (void) pthread_mutex_destroy(&c.mutex);
+        return r;
+}
+
+int journal_file_verify_full(
                 JournalFile *f,
                 const char *key,
-                usec_t *first_contained, usec_t *last_validated, usec_t *last_contained,
-                bool show_progress) {
+                JournalVerifyFlags flags,
+                unsigned n_threads,
+                usec_t *first_contained, usec_t *last_validated, usec_t *last_contained) {
+        bool show_progress = FLAGS_SET(flags, JOURNAL_VERIFY_SHOW_PROGRESS);
         int r;
         Object *o;
-        uint64_t p = 0, last_epoch = 0, last_tag_realtime = 0, last_sealed_realtime = 0;
+        uint64_t p = 0, last_epoch = 0, last_tag_realtime = 0, last_sealed_realtime = 0, checkpoint_offset = 0;
 
         uint64_t entry_seqnum = 0, entry_monotonic = 0, entry_realtime = 0;
         sd_id128_t entry_boot_id = {};  /* Unnecessary initialization to appease gcc */
-        bool entry_seqnum_set = false, entry_monotonic_set = false, entry_realtime_set = false, found_main_entry_array = false;
+        bool entry_seqnum_set = false, entry_monotonic_set = false, entry_realtime_set = false, found_main_entry_array = false, found_compression_dictionary = false;
         uint64_t n_objects = 0, n_entries = 0, n_data = 0, n_fields = 0, n_data_hash_tables = 0, n_field_hash_tables = 0, n_entry_arrays = 0, n_tags = 0;
         usec_t last_usec = 0;
         _cleanup_close_ int data_fd = -EBADF, entry_fd = -EBADF, entry_array_fd = -EBADF;
@@ -832,7 +1246,7 @@ int journal_file_verify(
         MMapCache *m;
 
 #if HAVE_GCRYPT
-        uint64_t last_tag = 0;
+        uint64_t last_tag = 0, last_verified_tag = 0;
 #endif
         assert(f);
 
@@ -849,6 +1263,10 @@ int journal_file_verify(
         } else if (JOURNAL_HEADER_SEALED(f->header))
                 return -ENOKEY;
 
+        /* Checkpoints are only written for sealed files, once the tags were verified with the key */
+        if (FLAGS_SET(flags, JOURNAL_VERIFY_CHECKPOINT) && key && JOURNAL_HEADER_SEALED(f->header))
+                (void) checkpoint_load(f, &checkpoint_offset);
+
         r = var_tmp_dir(&tmp_dir);
         if (r < 0) {
                 log_error_errno(r, "Failed to determine temporary directory: %m");
@@ -953,7 +1371,8 @@ int journal_file_verify(
 
                 n_objects++;
 
-                r = journal_file_object_verify(f, p, o);
+                /* With threads, the DATA hashes are checked after this pass, see verify_data_hashes() */
+                r = journal_file_object_verify(f, p, o, n_threads == 0 && p >= checkpoint_offset);
                 if (r < 0) {
                         error_errno(p, r, "Invalid object contents: %m");
                         goto fail;
@@ -1193,6 +1612,8 @@ int journal_file_verify(
                                 }
 
                                 f->hmac_running = false;
+
+                                last_verified_tag = p;
                                 last_tag_realtime = rt;
                                 last_sealed_realtime = entry_realtime;
                         }
@@ -1204,6 +1625,23 @@ int journal_file_verify(
 
                         n_tags++;
                         break;
+
+                case OBJECT_COMPRESSION_DICTIONARY:
+                        if (!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header)) {
+                                error(p, "Compression dictionary object in file without dictionary compression");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        if (found_compression_dictionary ||
+                            p != le64toh(f->header->compression_dictionary_offset)) {
+                                error(p, "Compression dictionary object not referenced by header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        found_compression_dictionary = true;
+                        break;
                 }
 
                 if (p == le64toh(f->header->tail_object_offset)) {
@@ -1222,6 +1660,16 @@ int journal_file_verify(
                 goto fail;
         }
 
+        if (JOURNAL_HEADER_CONTAINS(f->header, compression_dictionary_offset) &&
+            le64toh(f->header->compression_dictionary_offset) != 0 &&
+            !found_compression_dictionary) {
+                error(offsetof(Header, compression_dictionary_offset),
+                      "Compression dictionary pointer dead (%"PRIu64")",
+                      le64toh(f->header->compression_dictionary_offset));
+                r = -EBADMSG;
+                goto fail;
+        }
+
         if (n_objects != le64toh(f->header->n_objects)) {
                 error(offsetof(Header, n_objects),
                       "Object number mismatch (%"PRIu64" != %"PRIu64")",
@@ -1332,6 +1780,12 @@ int journal_file_verify(
                 goto fail;
         }
 
+        if (n_threads > 0) {
+                r = verify_data_hashes(f, fileno(data_fp), n_data, checkpoint_offset, n_threads, &p);
+                if (r < 0)
+                        goto fail;
+        }
+
         /* Second iteration: we follow all objects referenced from the
          * two entry points: the object hash table and the entry
          * array. We also check that everything referenced (directly
@@ -1361,6 +1815,11 @@ int journal_file_verify(
         if (show_progress)
                 flush_progress();
 
+#if HAVE_GCRYPT
+        if (FLAGS_SET(flags, JOURNAL_VERIFY_CHECKPOINT) && last_verified_tag > 0)
+                (void) checkpoint_save(f, last_verified_tag);
+#endif
+
         mmap_cache_fd_free(cache_data_fd);
         mmap_cache_fd_free(cache_entry_fd);
         mmap_cache_fd_free(cache_entry_array_fd);
@@ -3,4 +3,27 @@
 
 #include "journal-file.h"
 
-int journal_file_verify(JournalFile *f, const char *key, usec_t *first_contained, usec_t *last_validated, usec_t *last_contained, bool show_progress);
+/* Suffix of the sidecar file a verification checkpoint is stored in, next to the journal file */
+#define JOURNAL_VERIFY_CHECKPOINT_SUFFIX ".verified"
+
+#define JOURNAL_VERIFY_THREADS_MAX 64U
+
+typedef enum JournalVerifyFlags {
+        JOURNAL_VERIFY_SHOW_PROGRESS = 1 << 0,
+        /* Skip the DATA payload hashes a checkpoint of an earlier verification covers, and store a new
+         * checkpoint afterwards. Only has an effect on sealed files that are verified with the key. */
+        JOURNAL_VERIFY_CHECKPOINT    = 1 << 1,
+} JournalVerifyFlags;
+
+int journal_file_verify_full(
+                JournalFile *f,
+                const char *key,
+                JournalVerifyFlags flags,
+                unsigned n_threads,
+                usec_t *first_contained, usec_t *last_validated, usec_t *last_contained);
+
+static inline int journal_file_verify(JournalFile *f, const char *key, usec_t *first_contained, usec_t *last_validated, usec_t *last_contained, bool show_progress) {
+        return journal_file_verify_full(f, key, show_progress ? JOURNAL_VERIFY_SHOW_PROGRESS : 0, 0, first_contained, last_validated, last_contained);
+}
+
+int journal_verify_checkpoint_unlink(int dir_fd, const char *fname);
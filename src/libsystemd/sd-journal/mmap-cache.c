@@ -7,6 +7,7 @@
 #include "alloc-util.h"
 #include "errno-util.h"
 #include "fd-util.h"
+#include "format-util.h"
 #include "hashmap.h"
 #include "list.h"
 #include "log.h"
@@ -37,9 +38,28 @@ struct Window {
         LIST_HEAD(Context, contexts);
 };
 
+typedef enum AccessPattern {
+        ACCESS_PATTERN_UNKNOWN,
+        ACCESS_PATTERN_FORWARD,
+        ACCESS_PATTERN_BACKWARD,
+        ACCESS_PATTERN_RANDOM,
+} AccessPattern;
+
 struct Context {
         Window *window;
 
+        /* The window this context used before it had to switch to another one. Only used for comparison,
+         * never dereferenced. */
+        MMapFileDescriptor *last_fd;
+        uint64_t last_offset;
+        uint64_t last_size;
+
+        /* The access pattern windows are currently sized for, and the one seen n_candidate times in a row
+         * most recently */
+        AccessPattern pattern;
+        AccessPattern candidate;
+        unsigned n_candidate;
+
         LIST_FIELDS(Context, by_window);
 };
 
@@ -55,7 +75,7 @@ struct MMapCache {
         unsigned n_ref;
         unsigned n_windows;
 
-        unsigned n_context_cache_hit, n_window_list_hit, n_missed;
+        MMapCacheStats stats;
 
         Hashmap *fds;
 
@@ -70,10 +90,21 @@ struct MMapCache {
 #if ENABLE_DEBUG_MMAP_CACHE
 /* Tiny windows increase mmap activity and the chance of exposing unsafe use. */
 # define WINDOW_SIZE (page_size())
+# define WINDOW_SIZE_SEQUENTIAL (page_size())
+# define WINDOW_SIZE_RANDOM (page_size())
 #else
 # define WINDOW_SIZE (8ULL*1024ULL*1024ULL)
+/* Streaming through a file (e.g. when exporting it) is faster with fewer, larger windows, and random
+ * accesses (e.g. bisecting or looking up data objects by hash) waste less memory with small ones. */
+# define WINDOW_SIZE_SEQUENTIAL (32ULL*1024ULL*1024ULL)
+# define WINDOW_SIZE_RANDOM (1ULL*1024ULL*1024ULL)
 #endif
 
+/* Number of window switches in a row in the same direction (or in no particular direction) before we
+ * consider the access pattern of a context as sequential (or random) */
+#define PATTERN_SEQUENTIAL_MIN 2U
+#define PATTERN_RANDOM_MIN 4U
+
 MMapCache* mmap_cache_new(void) {
         MMapCache *m;
 
@@ -89,8 +120,10 @@ static void window_unlink(Window *w) {
 
         assert(w);
 
-        if (w->ptr)
+        if (w->ptr) {
                 munmap(w->ptr, w->size);
+                w->cache->stats.n_mapped_bytes -= w->size;
+        }
 
         if (w->fd)
                 LIST_REMOVE(by_fd, w->fd->windows, w);
@@ -168,6 +201,7 @@ static Window *window_add(MMapCache *m, MMapFileDescriptor *f, bool keep_always,
                 /* Reuse an existing one */
                 w = m->last_unused;
                 window_unlink(w);
+                m->stats.n_evicted++;
         }
 
         *w = (Window) {
@@ -180,6 +214,7 @@ static Window *window_add(MMapCache *m, MMapFileDescriptor *f, bool keep_always,
         };
 
         LIST_PREPEND(by_fd, f->windows, w);
+        m->stats.n_mapped_bytes += size;
 
         return w;
 }
@@ -258,6 +293,7 @@ static int make_room(MMapCache *m) {
                 return 0;
 
         window_free(m->last_unused);
+        m->stats.n_evicted++;
         return 1;
 }
 
@@ -292,7 +328,7 @@ static int try_context(
         c->window->keep_always = c->window->keep_always || keep_always;
 
         *ret = (uint8_t*) c->window->ptr + (offset - c->window->offset);
-        f->cache->n_context_cache_hit++;
+        f->cache->stats.n_context_cache_hit++;
 
         return 1;
 }
@@ -329,7 +365,7 @@ static int find_mmap(
         found->keep_always = found->keep_always || keep_always;
 
         *ret = (uint8_t*) found->ptr + (offset - found->offset);
-        f->cache->n_window_list_hit++;
+        f->cache->stats.n_window_list_hit++;
 
         return 1;
 }
@@ -360,6 +396,86 @@ static int mmap_try_harder(MMapFileDescriptor *f, void *addr, int flags, uint64_
         return 0;
 }
 
+static void window_advise(Window *w, AccessPattern pattern, struct stat *st) {
+        uint64_t next;
+
+        assert(w);
+
+        /* Pass our idea of the access pattern on to the kernel, so that its readahead logic does the right
+         * thing. All of these are just hints, hence ignore any failures. */
+
+        switch (pattern) {
+
+        case ACCESS_PATTERN_FORWARD:
+                w->cache->stats.n_sequential++;
+
+                (void) madvise(w->ptr, w->size, MADV_SEQUENTIAL);
+
+                /* Also start reading in the window after this one, so that it is (hopefully) in memory by
+                 * the time we get there. */
+                next = w->offset + w->size;
+                if (!st || next < (uint64_t) st->st_size)
+                        (void) posix_fadvise(w->fd->fd, next, w->size, POSIX_FADV_WILLNEED);
+                break;
+
+        case ACCESS_PATTERN_BACKWARD:
+                w->cache->stats.n_sequential++;
+
+                /* The kernel's readahead only ever goes forward, hence explicitly ask for the whole window */
+                (void) madvise(w->ptr, w->size, MADV_WILLNEED);
+                break;
+
+        case ACCESS_PATTERN_RANDOM:
+                w->cache->stats.n_random++;
+
+                (void) madvise(w->ptr, w->size, MADV_RANDOM);
+                break;
+
+        default:
+                ;
+        }
+}
+
+static void context_update_pattern(Context *c, MMapFileDescriptor *f, uint64_t offset) {
+        AccessPattern p;
+
+        assert(c);
+        assert(f);
+
+        /* Called whenever a context has to switch to a different window. If the new offset is right after
+         * (or right before) the window used previously, we are probably going through the file
+         * sequentially, otherwise this is a random access. */
+
+        if (c->last_fd != f || c->last_size == 0)
+                p = ACCESS_PATTERN_UNKNOWN;
+        else if (offset >= c->last_offset + c->last_size &&
+                 offset < c->last_offset + 2 * c->last_size)
+                p = ACCESS_PATTERN_FORWARD;
+        else if (offset < c->last_offset &&
+                 offset + c->last_size >= c->last_offset)
+                p = ACCESS_PATTERN_BACKWARD;
+        else
+                p = ACCESS_PATTERN_RANDOM;
+
+        if (p == ACCESS_PATTERN_UNKNOWN) {
+                c->pattern = c->candidate = ACCESS_PATTERN_UNKNOWN;
+                c->n_candidate = 0;
+                return;
+        }
+
+        if (p == c->candidate)
+                c->n_candidate++;
+        else {
+                c->candidate = p;
+                c->n_candidate = 1;
+        }
+
+        /* Only switch to a different window size once we saw the same pattern a couple of times in a row,
+         * so that the occasional seek doesn't throw us off. */
+        if (c->n_candidate >= (p == ACCESS_PATTERN_RANDOM ? PATTERN_RANDOM_MIN : PATTERN_SEQUENTIAL_MIN))
+                c->pattern = p;
+}
+
 static int add_mmap(
                 MMapFileDescriptor *f,
                 Context *c,
@@ -385,18 +501,41 @@ static int add_mmap(
         wsize = size + (offset - woffset);
         wsize = PAGE_ALIGN(wsize);
 
-        if (wsize < WINDOW_SIZE) {
-                uint64_t delta;
+        switch (c->pattern) {
 
-                delta = PAGE_ALIGN((WINDOW_SIZE - wsize) / 2);
+        case ACCESS_PATTERN_FORWARD:
+                /* Map the area following the requested one, we'll need it next */
+                if (wsize < WINDOW_SIZE_SEQUENTIAL)
+                        wsize = WINDOW_SIZE_SEQUENTIAL;
+                break;
 
-                if (delta > offset)
-                        woffset = 0;
-                else
-                        woffset -= delta;
+        case ACCESS_PATTERN_BACKWARD:
+                /* Map the area preceding the requested one */
+                if (wsize < WINDOW_SIZE_SEQUENTIAL) {
+                        uint64_t delta = WINDOW_SIZE_SEQUENTIAL - wsize;
 
-                wsize = WINDOW_SIZE;
-        }
+                        woffset = delta > woffset ? 0 : woffset - delta;
+                        wsize = WINDOW_SIZE_SEQUENTIAL;
+                }
+                break;
+
+        default: {
+                uint64_t window_size = c->pattern == ACCESS_PATTERN_RANDOM ? WINDOW_SIZE_RANDOM : WINDOW_SIZE;
+
+                if (wsize < window_size) {
+                        uint64_t delta;
+
+                        delta = PAGE_ALIGN((window_size - wsize) / 2);
+
+                        if (delta > offset)
+                                woffset = 0;
+                        else
+                                woffset -= delta;
+
+                        wsize = window_size;
+                }
+                break;
+        }}
 
         if (st) {
                 /* Memory maps that are larger then the files
@@ -420,6 +559,8 @@ static int add_mmap(
 
         context_attach_window(f->cache, c, w);
 
+        window_advise(w, c->pattern, st);
+
         *ret = (uint8_t*) w->ptr + (offset - w->offset);
 
         return 1;
@@ -455,21 +596,42 @@ int mmap_cache_fd_get(
         if (r != 0)
                 return r;
 
+        context_update_pattern(c, f, offset);
+
         /* Search for a matching mmap */
         r = find_mmap(f, c, keep_always, offset, size, ret);
-        if (r != 0)
+        if (r == 0) {
+                f->cache->stats.n_missed++;
+
+                /* Create a new mmap */
+                r = add_mmap(f, c, keep_always, offset, size, st, ret);
+        }
+        if (r <= 0)
                 return r;
 
-        f->cache->n_missed++;
+        c->last_fd = f;
+        c->last_offset = c->window->offset;
+        c->last_size = c->window->size;
 
-        /* Create a new mmap */
-        return add_mmap(f, c, keep_always, offset, size, st, ret);
+        return r;
+}
+
+void mmap_cache_get_stats(MMapCache *m, MMapCacheStats *ret) {
+        assert(m);
+        assert(ret);
+
+        *ret = m->stats;
+        ret->n_windows = m->n_windows;
 }
 
 void mmap_cache_stats_log_debug(MMapCache *m) {
         assert(m);
 
-        log_debug("mmap cache statistics: %u context cache hit, %u window list hit, %u miss", m->n_context_cache_hit, m->n_window_list_hit, m->n_missed);
+        log_debug("mmap cache statistics: %u context cache hit, %u window list hit, %u miss, %u evicted, "
+                  "%u sequential, %u random, %u windows, %s mapped",
+                  m->stats.n_context_cache_hit, m->stats.n_window_list_hit, m->stats.n_missed,
+                  m->stats.n_evicted, m->stats.n_sequential, m->stats.n_random, m->n_windows,
+                  FORMAT_BYTES(m->stats.n_mapped_bytes));
 }
 
 static void mmap_cache_process_sigbus(MMapCache *m) {
@@ -581,6 +743,10 @@ void mmap_cache_fd_free(MMapFileDescriptor *f) {
         while (f->windows)
                 window_free(f->windows);
 
+        for (unsigned i = 0; i < MMAP_CACHE_MAX_CONTEXTS; i++)
+                if (f->cache->contexts[i].last_fd == f)
+                        f->cache->contexts[i].last_fd = NULL;
+
         if (f->cache) {
                 assert_se(hashmap_remove(f->cache->fds, FD_TO_PTR(f->fd)));
                 f->cache = mmap_cache_unref(f->cache);
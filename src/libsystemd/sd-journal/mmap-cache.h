@@ -1,15 +1,27 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 #pragma once
 
+#include <inttypes.h>
 #include <stdbool.h>
 #include <sys/stat.h>
 
 /* One context per object type, plus one of the header, plus one "additional" one */
-#define MMAP_CACHE_MAX_CONTEXTS 9
+#define MMAP_CACHE_MAX_CONTEXTS 10
 
 typedef struct MMapCache MMapCache;
 typedef struct MMapFileDescriptor MMapFileDescriptor;
 
+typedef struct MMapCacheStats {
+        unsigned n_context_cache_hit;
+        unsigned n_window_list_hit;
+        unsigned n_missed;
+        unsigned n_evicted;    /* windows unmapped to make room for new ones */
+        unsigned n_sequential; /* windows mapped for sequential access */
+        unsigned n_random;     /* windows mapped for random access */
+        unsigned n_windows;
+        uint64_t n_mapped_bytes;
+} MMapCacheStats;
+
 MMapCache* mmap_cache_new(void);
 MMapCache* mmap_cache_ref(MMapCache *m);
 MMapCache* mmap_cache_unref(MMapCache *m);
@@ -27,6 +39,7 @@ MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd, int prot);
 MMapCache* mmap_cache_fd_cache(MMapFileDescriptor *f);
 void mmap_cache_fd_free(MMapFileDescriptor *f);
 
+void mmap_cache_get_stats(MMapCache *m, MMapCacheStats *ret);
 void mmap_cache_stats_log_debug(MMapCache *m);
 
 bool mmap_cache_fd_got_sigbus(MMapFileDescriptor *f);
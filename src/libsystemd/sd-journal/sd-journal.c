@@ -29,15 +29,19 @@
 #include "io-util.h"
 #include "journal-def.h"
 #include "journal-file.h"
+#include "journal-index.h"
 #include "journal-internal.h"
 #include "list.h"
 #include "lookup3.h"
+#include "memory-util.h"
 #include "nulstr-util.h"
 #include "origin-id.h"
 #include "path-util.h"
 #include "prioq.h"
 #include "process-util.h"
+#include "random-util.h"
 #include "replace-var.h"
+#include "sort-util.h"
 #include "stat-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -95,6 +99,43 @@ static int journal_put_error(sd_journal *j, int r, const char *path) {
         return 0;
 }
 
+static void merge_poll_add(sd_journal *j, JournalFile *f) {
+        assert(j);
+        assert(f);
+
+        if (f->merge_poll_linked)
+                return;
+
+        LIST_PREPEND(merge_poll, j->merge_poll, f);
+        f->merge_poll_linked = true;
+}
+
+static void merge_poll_remove(sd_journal *j, JournalFile *f) {
+        assert(j);
+        assert(f);
+
+        if (!f->merge_poll_linked)
+                return;
+
+        LIST_REMOVE(merge_poll, j->merge_poll, f);
+        f->merge_poll_linked = false;
+}
+
+static void merge_prioq_flush(sd_journal *j) {
+        JournalFile *f;
+
+        assert(j);
+
+        while ((f = prioq_pop(j->merge_prioq)))
+                f->merge_prioq_idx = PRIOQ_IDX_NULL;
+
+        /* Everything needs to be looked at again */
+        ORDERED_HASHMAP_FOREACH(f, j->files)
+                merge_poll_add(j, f);
+
+        j->merge_prioq_invalid = false;
+}
+
 static void detach_location(sd_journal *j) {
         JournalFile *f;
 
@@ -103,6 +144,8 @@ static void detach_location(sd_journal *j) {
         j->current_file = NULL;
         j->current_field = 0;
 
+        merge_prioq_flush(j);
+
         ORDERED_HASHMAP_FOREACH(f, j->files)
                 journal_file_reset_location(f);
 }
@@ -412,46 +455,19 @@ _public_ void sd_journal_flush_matches(sd_journal *j) {
         detach_location(j);
 }
 
-static int journal_file_find_newest_for_boot_id(
-                sd_journal *j,
-                sd_id128_t id,
-                JournalFile **ret) {
-
-        JournalFile *prev = NULL;
-        int r;
+static JournalFile* journal_file_find_newest_for_boot_id(sd_journal *j, sd_id128_t id) {
+        Prioq *q;
 
         assert(j);
-        assert(ret);
-
-        /* Before we use it, let's refresh the timestamp from the header, and reshuffle our prioq
-         * accordingly. We do this only a bunch of times, to not be caught in some update loop. */
-        for (unsigned n_tries = 0;; n_tries++) {
-                JournalFile *f;
-                Prioq *q;
 
-                q = hashmap_get(j->newest_by_boot_id, &id);
-                if (!q)
-                        return log_debug_errno(SYNTHETIC_ERRNO(ENODATA),
-                                               "Requested delta for boot ID %s, but we have no information about that boot ID.", SD_ID128_TO_STRING(id));
-
-                assert_se(f = prioq_peek(q)); /* we delete hashmap entries once the prioq is empty, so this must hold */
-
-                if (f == prev || n_tries >= 5) {
-                        /* This was already the best answer in the previous run, or we tried too often, use it */
-                        *ret = f;
-                        return 0;
-                }
-
-                prev = f;
+        /* This only uses the timestamps we read last time, see journal_file_read_tail_timestamp(). It is
+         * called while the merge queue is reordered, and hence must not change anything. */
 
-                /* Let's read the journal file's current timestamp once, before we return it, maybe it has changed. */
-                r = journal_file_read_tail_timestamp(j, f);
-                if (r < 0)
-                        return log_debug_errno(r, "Failed to read tail timestamp while trying to find newest journal file for boot ID %s.", SD_ID128_TO_STRING(id));
+        q = hashmap_get(j->newest_by_boot_id, &id);
+        if (!q)
+                return NULL;
 
-                /* Refreshing the timestamp we read might have reshuffled the prioq, hence let's check the
-                 * prioq again and only use the information once we reached an equilibrium or hit a limit */
-        }
+        return ASSERT_PTR(prioq_peek(q)); /* we delete hashmap entries once the prioq is empty, so this must hold */
 }
 
 static int compare_boot_ids(sd_journal *j, sd_id128_t a, sd_id128_t b) {
@@ -460,8 +476,9 @@ static int compare_boot_ids(sd_journal *j, sd_id128_t a, sd_id128_t b) {
         assert(j);
 
         /* Try to find the newest open journal file for the two boot ids */
-        if (journal_file_find_newest_for_boot_id(j, a, &x) < 0 ||
-            journal_file_find_newest_for_boot_id(j, b, &y) < 0)
+        x = journal_file_find_newest_for_boot_id(j, a);
+        y = journal_file_find_newest_for_boot_id(j, b);
+        if (!x || !y)
                 return 0;
 
         /* Only compare the boot id timestamps if they originate from the same machine. If they are from
@@ -532,6 +549,58 @@ static int compare_with_location(
         return 0;
 }
 
+static bool location_is_realtime_seek(sd_journal *j, JournalFile *f) {
+        assert(j);
+        assert(f);
+
+        /* Returns true if the current location will be resolved by realtime in the specified file, i.e.
+         * neither the seqnum nor the monotonic timestamp take precedence. */
+
+        if (j->current_location.type != LOCATION_SEEK || !j->current_location.realtime_set)
+                return false;
+
+        if (j->current_location.seqnum_set && sd_id128_equal(j->current_location.seqnum_id, f->header->seqnum_id))
+                return false;
+
+        return !j->current_location.monotonic_set;
+}
+
+static JournalIndex* journal_file_get_index(JournalFile *f) {
+        int r;
+
+        assert(f);
+
+        /* Sidecar indexes are only written when archiving, and only describe files that are not modified
+         * anymore. Try to load it once, and silently fall back to the regular lookups if that fails. */
+
+        if (f->index_loaded)
+                return f->index;
+
+        if (f->header->state != STATE_ARCHIVED || journal_file_writable(f))
+                return NULL;
+
+        f->index_loaded = true;
+
+        r = journal_index_load(f, &f->index);
+        if (r < 0 && r != -ENOENT)
+                log_debug_errno(r, "Failed to load journal index of %s, ignoring: %m", f->path);
+
+        return f->index;
+}
+
+static bool journal_file_realtime_out_of_range(JournalFile *f, uint64_t realtime, direction_t direction) {
+        assert(f);
+
+        /* If all entries in the file are older (or newer) than the timestamp we are looking for, there's
+         * no need to look into its entry arrays at all. */
+
+        if (le64toh(f->header->n_entries) == 0)
+                return true;
+
+        return direction == DIRECTION_DOWN ? le64toh(f->header->tail_entry_realtime) < realtime
+                                           : le64toh(f->header->head_entry_realtime) > realtime;
+}
+
 static int next_for_match(
                 sd_journal *j,
                 Match *m,
@@ -675,8 +744,15 @@ static int find_location_for_match(
                         if (r < 0)
                                 return r;
                 }
-                if (j->current_location.realtime_set)
+                if (j->current_location.realtime_set) {
+                        JournalIndex *idx;
+
+                        idx = journal_file_get_index(f);
+                        if (idx && !journal_index_data_may_match(idx, dp, j->current_location.realtime, direction))
+                                return 0;
+
                         return journal_file_move_to_entry_by_realtime_for_data(f, d, j->current_location.realtime, direction, ret, offset);
+                }
 
                 return journal_file_next_entry_for_data(f, d, direction, ret, offset);
 
@@ -751,6 +827,10 @@ static int find_location_with_matches(
         assert(ret);
         assert(offset);
 
+        if (location_is_realtime_seek(j, f) &&
+            journal_file_realtime_out_of_range(f, j->current_location.realtime, direction))
+                return 0;
+
         if (!j->level0) {
                 /* No matches is simple */
 
@@ -765,8 +845,20 @@ static int find_location_with_matches(
                         if (r != -ENOENT)
                                 return r;
                 }
-                if (j->current_location.realtime_set)
+                if (j->current_location.realtime_set) {
+                        JournalIndex *idx;
+
+                        idx = journal_file_get_index(f);
+                        if (idx) {
+                                r = journal_index_move_to_entry_by_realtime(f, idx, j->current_location.realtime, direction, ret, offset);
+                                if (r >= 0)
+                                        return r;
+
+                                log_debug_errno(r, "Failed to look up entry in journal index of %s, ignoring: %m", f->path);
+                        }
+
                         return journal_file_move_to_entry_by_realtime(f, j->current_location.realtime, direction, ret, offset);
+                }
 
                 return journal_file_next_entry(f, 0, direction, ret, offset);
         } else
@@ -806,8 +898,6 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         assert(j);
         assert(f);
 
-        (void) journal_file_read_tail_timestamp(j, f);
-
         n_entries = le64toh(f->header->n_entries);
 
         /* If we hit EOF before, we don't need to look into this file again
@@ -877,8 +967,8 @@ static int compare_locations(sd_journal *j, JournalFile *af, JournalFile *bf) {
         assert(af->header);
         assert(bf);
         assert(bf->header);
-        assert(af->location_type == LOCATION_SEEK);
-        assert(bf->location_type == LOCATION_SEEK);
+        assert(IN_SET(af->location_type, LOCATION_SEEK, LOCATION_DISCRETE));
+        assert(IN_SET(bf->location_type, LOCATION_SEEK, LOCATION_DISCRETE));
 
         /* If contents, timestamps and seqnum match, these entries are identical. */
         if (sd_id128_equal(af->current_boot_id, bf->current_boot_id) &&
@@ -917,46 +1007,216 @@ static int compare_locations(sd_journal *j, JournalFile *af, JournalFile *bf) {
         return CMP(af->current_xor_hash, bf->current_xor_hash);
 }
 
+static int merge_prioq_compare(const void *a, const void *b, void *userdata) {
+        sd_journal *j = ASSERT_PTR(userdata);
+        int r;
+
+        r = compare_locations(j, (JournalFile*) a, (JournalFile*) b);
+        return j->merge_direction == DIRECTION_DOWN ? r : -r;
+}
+
+#define PREFETCH_WINDOW (4U * 1024U * 1024U)
+
+static void journal_file_prefetch(sd_journal *j, JournalFile *f, direction_t direction) {
+        uint64_t begin, end, offset;
+        bool inside;
+
+        assert(j);
+        assert(f);
+
+        if (!j->prefetch)
+                return;
+
+        /* Asks the helper threads to read the region of the file ahead of the current entry into memory,
+         * whenever we got closer than half a window to the end of what we requested before. Entries and
+         * the data objects they reference are mostly appended in order, hence this is where the following
+         * reads will go to. */
+
+        offset = f->current_offset;
+        inside = offset >= f->prefetch_begin && offset < f->prefetch_end;
+
+        if (direction == DIRECTION_DOWN) {
+                if (inside && f->prefetch_end - offset >= PREFETCH_WINDOW / 2)
+                        return;
+
+                begin = inside ? f->prefetch_end : offset;
+                end = MIN(offset + PREFETCH_WINDOW, (uint64_t) f->last_stat.st_size);
+                if (begin >= end)
+                        return;
+
+                if (!inside)
+                        f->prefetch_begin = begin;
+                f->prefetch_end = end;
+        } else {
+                if (inside && offset - f->prefetch_begin >= PREFETCH_WINDOW / 2)
+                        return;
+
+                begin = offset > PREFETCH_WINDOW ? offset - PREFETCH_WINDOW : 0;
+                end = inside ? f->prefetch_begin : offset;
+                if (begin >= end)
+                        return;
+
+                if (!inside)
+                        f->prefetch_end = end;
+                f->prefetch_begin = begin;
+        }
+
+        (void) journal_prefetch_queue(j->prefetch, f->fd, begin, end - begin);
+}
+
+static bool merge_file_is_quiescent(sd_journal *j, JournalFile *f) {
+        assert(j);
+        assert(f);
+
+        switch (f->header->state) {
+
+        case STATE_ARCHIVED:
+                return true;
+
+        case STATE_OFFLINE:
+                /* Only if we'll learn about changes via inotify */
+                return j->inotify_fd >= 0;
+
+        default:
+                return false;
+        }
+}
+
+static bool merge_candidate_is_current(sd_journal *j, JournalFile *f, direction_t direction) {
+        int k;
+
+        assert(j);
+        assert(f);
+
+        /* Checks whether the candidate of the file is not beyond the current location, i.e. is the entry
+         * we returned last, as stored in another file too. */
+
+        if (f->location_type != LOCATION_SEEK)
+                return true;
+
+        if (j->current_location.type != LOCATION_DISCRETE)
+                return false;
+
+        k = compare_with_location(j, f, &j->current_location, j->current_file);
+        return direction == DIRECTION_DOWN ? k <= 0 : k >= 0;
+}
+
+static int merge_prioq_advance(sd_journal *j, JournalFile *f, direction_t direction) {
+        uint64_t offset;
+        int r;
+
+        assert(j);
+        assert(f);
+
+        /* Moves the candidate of the specified file beyond the current location, and updates its position
+         * in the merge queue accordingly. Returns > 0 if the file still has a candidate, 0 if it was
+         * dropped from the queue, either because it hit EOF or was removed. */
+
+        offset = f->current_offset;
+
+        r = next_beyond_location(j, f, direction);
+        if (r < 0) {
+                log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                remove_file_real(j, f); /* this also drops it from the queue */
+                return 0;
+        }
+        if (r == 0) {
+                f->location_type = direction == DIRECTION_DOWN ? LOCATION_TAIL : LOCATION_HEAD;
+                (void) prioq_remove(j->merge_prioq, f, &f->merge_prioq_idx);
+                f->merge_prioq_idx = PRIOQ_IDX_NULL;
+
+                /* Files that can be appended to at any time are checked for new entries on each step.
+                 * Archived files never change, and offline files are only written to again after
+                 * journald reopened them, which sd_journal_process() notices, see add_any_file(). Hence
+                 * don't look at them again until then. */
+                if (merge_file_is_quiescent(j, f))
+                        merge_poll_remove(j, f);
+                else
+                        merge_poll_add(j, f);
+                return 0;
+        }
+
+        if (f->merge_prioq_idx == PRIOQ_IDX_NULL) {
+                r = prioq_put(j->merge_prioq, f, &f->merge_prioq_idx);
+                if (r < 0)
+                        return r;
+        } else if (f->current_offset != offset)
+                prioq_reshuffle(j->merge_prioq, f, &f->merge_prioq_idx);
+
+        merge_poll_remove(j, f);
+
+        journal_file_prefetch(j, f, direction);
+        return 1;
+}
+
+static void merge_refresh_tail_timestamps(sd_journal *j) {
+        assert(j);
+
+        if (j->current_file)
+                (void) journal_file_read_tail_timestamp(j, j->current_file);
+
+        LIST_FOREACH(merge_poll, f, j->merge_poll)
+                (void) journal_file_read_tail_timestamp(j, f);
+}
+
 static int real_journal_next(sd_journal *j, direction_t direction) {
-        JournalFile *new_file = NULL;
-        unsigned n_files;
-        const void **files;
+        JournalFile *new_file;
         Object *o;
         int r;
 
         assert_return(j, -EINVAL);
         assert_return(!journal_origin_changed(j), -ECHILD);
 
-        r = iterated_cache_get(j->files_cache, NULL, &files, &n_files);
-        if (r < 0)
-                return r;
+        /* All files that have a candidate entry beyond the current location are kept in a priority queue,
+         * ordered by compare_locations(). Hence, for each step we only have to advance the file whose entry
+         * we returned last, instead of comparing the candidates of all files with each other. Files without
+         * candidate that might still get new entries are kept in the 'merge_poll' list, and are checked on
+         * every step. If the direction changed, or the order of boots might have changed, we start from
+         * scratch. */
 
-        for (unsigned i = 0; i < n_files; i++) {
-                JournalFile *f = (JournalFile *)files[i];
-                bool found;
+        if (!j->merge_prioq) {
+                j->merge_prioq = prioq_new_r(merge_prioq_compare, j);
+                if (!j->merge_prioq)
+                        return -ENOMEM;
+        }
 
-                r = next_beyond_location(j, f, direction);
-                if (r < 0) {
-                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
-                        remove_file_real(j, f);
-                        continue;
-                } else if (r == 0) {
-                        f->location_type = direction == DIRECTION_DOWN ? LOCATION_TAIL : LOCATION_HEAD;
-                        continue;
-                }
+        /* Refresh the tail timestamps of the files we are going to advance before touching the queue, as
+         * this might change the order of boots, see compare_boot_ids(). */
+        merge_refresh_tail_timestamps(j);
 
-                if (!new_file)
-                        found = true;
-                else {
-                        int k;
+        if (j->merge_direction != direction || j->merge_prioq_invalid) {
+                merge_prioq_flush(j);
+                j->merge_direction = direction;
 
-                        k = compare_locations(j, f, new_file);
+                /* All files are advanced now. The queue is empty, hence there's nothing to invalidate. */
+                merge_refresh_tail_timestamps(j);
+                j->merge_prioq_invalid = false;
+        }
 
-                        found = direction == DIRECTION_DOWN ? k < 0 : k > 0;
-                }
+        /* First, move the file we picked last time beyond its previous entry, so that all files in the
+         * queue point to a candidate again. */
+        if (j->current_file &&
+            j->current_file->merge_prioq_idx != PRIOQ_IDX_NULL &&
+            j->current_file->location_type == LOCATION_DISCRETE) {
+                r = merge_prioq_advance(j, j->current_file, direction);
+                if (r < 0)
+                        return r;
+        }
 
-                if (found)
-                        new_file = f;
+        LIST_FOREACH(merge_poll, f, j->merge_poll) {
+                r = merge_prioq_advance(j, f, direction);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Candidates that are identical to the current location (i.e. the same entry stored in multiple
+         * files) need to be skipped over, hence advance the best file until that's not the case anymore. */
+        while ((new_file = prioq_peek(j->merge_prioq)) &&
+               merge_candidate_is_current(j, new_file, direction)) {
+
+                r = merge_prioq_advance(j, new_file, direction);
+                if (r < 0)
+                        return r;
         }
 
         if (!new_file)
@@ -1440,6 +1700,10 @@ static int add_any_file(
 
                                 f->last_seen_generation = j->generation;
                                 (void) journal_file_read_tail_timestamp(j, f);
+
+                                /* It might have new entries, if we stopped looking at it */
+                                if (f->merge_prioq_idx == PRIOQ_IDX_NULL)
+                                        merge_poll_add(j, f);
                                 return 0;
                         }
 
@@ -1477,6 +1741,7 @@ static int add_any_file(
         TAKE_FD(our_fd); /* the fd is now owned by the JournalFile object */
 
         f->last_seen_generation = j->generation;
+        merge_poll_add(j, f);
 
         track_file_disposition(j, f);
         check_network(j, f->fd);
@@ -1554,6 +1819,10 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
                 j->current_field = 0;
         }
 
+        (void) prioq_remove(j->merge_prioq, f, &f->merge_prioq_idx);
+        f->merge_prioq_idx = PRIOQ_IDX_NULL;
+        merge_poll_remove(j, f);
+
         if (j->unique_file == f) {
                 /* Jump to the next unique_file or NULL if that one was last */
                 j->unique_file = ordered_hashmap_next(j->files, j->unique_file->path);
@@ -1569,6 +1838,17 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
                         j->fields_file_lost = true;
         }
 
+        /* The remembered unique values point to files containing them. Forget them, the files enumerated
+         * before are looked at instead from now on. */
+        if (!set_isempty(j->unique_values)) {
+                j->unique_values = set_free(j->unique_values);
+                j->unique_values_incomplete = true;
+        }
+
+        /* The cache is keyed by the file object, which might be reused for a different file */
+        if (j->data_fields_cache)
+                memzero(j->data_fields_cache, DATA_FIELDS_CACHE_SIZE * sizeof(DataFieldsCacheEntry));
+
         journal_file_unlink_newest_by_bood_id(j, f);
         (void) journal_file_close(f);
 
@@ -2043,10 +2323,12 @@ static sd_journal *journal_new(int flags, const char *path, const char *namespac
         if (!j->files)
                 return NULL;
 
-        j->files_cache = ordered_hashmap_iterated_cache_new(j->files);
         j->directories_by_path = hashmap_new(&path_hash_ops);
         j->mmap = mmap_cache_new();
-        if (!j->files_cache || !j->directories_by_path || !j->mmap)
+        if (!j->directories_by_path || !j->mmap)
+                return NULL;
+
+        if (FLAGS_SET(flags, SD_JOURNAL_PARALLEL) && journal_prefetch_new(&j->prefetch) < 0)
                 return NULL;
 
         return TAKE_PTR(j);
@@ -2058,7 +2340,8 @@ static sd_journal *journal_new(int flags, const char *path, const char *namespac
          SD_JOURNAL_SYSTEM |                            \
          SD_JOURNAL_CURRENT_USER |                      \
          SD_JOURNAL_ALL_NAMESPACES |                    \
-         SD_JOURNAL_INCLUDE_DEFAULT_NAMESPACE)
+         SD_JOURNAL_INCLUDE_DEFAULT_NAMESPACE |         \
+         SD_JOURNAL_PARALLEL)
 
 _public_ int sd_journal_open_namespace(sd_journal **ret, const char *namespace, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -2128,7 +2411,8 @@ _public_ int sd_journal_open_container(sd_journal **ret, const char *machine, in
 
 #define OPEN_DIRECTORY_ALLOWED_FLAGS                    \
         (SD_JOURNAL_OS_ROOT |                           \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER )
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         SD_JOURNAL_PARALLEL)
 
 _public_ int sd_journal_open_directory(sd_journal **ret, const char *path, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -2153,12 +2437,15 @@ _public_ int sd_journal_open_directory(sd_journal **ret, const char *path, int f
         return 0;
 }
 
+#define OPEN_FILES_ALLOWED_FLAGS                        \
+        (SD_JOURNAL_PARALLEL)
+
 _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
         int r;
 
         assert_return(ret, -EINVAL);
-        assert_return(flags == 0, -EINVAL);
+        assert_return((flags & ~OPEN_FILES_ALLOWED_FLAGS) == 0, -EINVAL);
 
         j = journal_new(flags, NULL, NULL);
         if (!j)
@@ -2180,7 +2467,8 @@ _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int fla
         (SD_JOURNAL_OS_ROOT |                           \
          SD_JOURNAL_SYSTEM |                            \
          SD_JOURNAL_CURRENT_USER |                      \
-         SD_JOURNAL_TAKE_DIRECTORY_FD)
+         SD_JOURNAL_TAKE_DIRECTORY_FD |                 \
+         SD_JOURNAL_PARALLEL)
 
 _public_ int sd_journal_open_directory_fd(sd_journal **ret, int fd, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -2225,7 +2513,7 @@ _public_ int sd_journal_open_files_fd(sd_journal **ret, int fds[], unsigned n_fd
 
         assert_return(ret, -EINVAL);
         assert_return(n_fds > 0, -EBADF);
-        assert_return(flags == 0, -EINVAL);
+        assert_return((flags & ~OPEN_FILES_ALLOWED_FLAGS) == 0, -EINVAL);
 
         j = journal_new(flags, NULL, NULL);
         if (!j)
@@ -2281,8 +2569,13 @@ _public_ void sd_journal_close(sd_journal *j) {
 
         sd_journal_flush_matches(j);
 
+        /* Stop the helper threads first, they might still be reading from the files */
+        journal_prefetch_free(j->prefetch);
+
+        merge_prioq_flush(j);
+        prioq_free(j->merge_prioq);
+
         ordered_hashmap_free_with_destructor(j->files, journal_file_close);
-        iterated_cache_free(j->files_cache);
 
         while ((d = hashmap_first(j->directories_by_path)))
                 remove_directory(j, d);
@@ -2309,11 +2602,82 @@ _public_ void sd_journal_close(sd_journal *j) {
         free(j->prefix);
         free(j->namespace);
         free(j->unique_field);
+        set_free(j->unique_values);
         free(j->fields_buffer);
+        set_free(j->data_fields);
+        free(j->data_fields_cache);
         free(j);
 }
 
+typedef struct BootOrderKey {
+        bool set;
+        sd_id128_t machine_id;
+        uint64_t realtime_usec;
+} BootOrderKey;
+
+static BootOrderKey boot_order_key(sd_journal *j, sd_id128_t id) {
+        JournalFile *f;
+
+        assert(j);
+
+        /* What compare_boot_ids() orders the boot by */
+
+        f = journal_file_find_newest_for_boot_id(j, id);
+        if (!f)
+                return (BootOrderKey) {};
+
+        return (BootOrderKey) {
+                .set = true,
+                .machine_id = f->newest_machine_id,
+                .realtime_usec = f->newest_realtime_usec,
+        };
+}
+
+static void boot_order_check(sd_journal *j, sd_id128_t id, const BootOrderKey *old) {
+        BootOrderKey new;
+        uint64_t a, b;
+        Prioq *q;
+
+        assert(j);
+        assert(old);
+
+        /* The merge queue has to be rebuilt only if the order of boots actually changed. For a live journal
+         * file the newest timestamp changes all the time, but this usually only moves the newest boot
+         * further away from the others. */
+
+        new = boot_order_key(j, id);
+
+        if (old->set == new.set &&
+            (!new.set || (sd_id128_equal(old->machine_id, new.machine_id) && old->realtime_usec == new.realtime_usec)))
+                return;
+
+        if (!old->set || !new.set || !sd_id128_equal(old->machine_id, new.machine_id)) {
+                j->merge_prioq_invalid = true;
+                return;
+        }
+
+        /* The boot moved from one timestamp to another. Only if it passed (or reached) another boot of the
+         * same machine on the way, comparisons came out differently before. */
+        a = MIN(old->realtime_usec, new.realtime_usec);
+        b = MAX(old->realtime_usec, new.realtime_usec);
+
+        HASHMAP_FOREACH(q, j->newest_by_boot_id) {
+                JournalFile *f = ASSERT_PTR(prioq_peek(q));
+
+                if (sd_id128_equal(f->newest_boot_id, id) ||
+                    !sd_id128_equal(f->newest_machine_id, new.machine_id))
+                        continue;
+
+                if (f->newest_realtime_usec >= a && f->newest_realtime_usec <= b) {
+                        j->merge_prioq_invalid = true;
+                        return;
+                }
+        }
+}
+
 static void journal_file_unlink_newest_by_bood_id(sd_journal *j, JournalFile *f) {
+        BootOrderKey old;
+        sd_id128_t id;
         JournalFile *nf;
         Prioq *p;
 
@@ -2323,6 +2687,9 @@ static void journal_file_unlink_newest_by_bood_id(sd_journal *j, JournalFile *f)
         if (f->newest_boot_id_prioq_idx == PRIOQ_IDX_NULL) /* not linked currently, hence this is a NOP */
                 return;
 
+        id = f->newest_boot_id;
+        old = boot_order_key(j, id);
+
         assert_se(p = hashmap_get(j->newest_by_boot_id, &f->newest_boot_id));
         assert_se(prioq_remove(p, f, &f->newest_boot_id_prioq_idx) > 0);
 
@@ -2338,6 +2705,9 @@ static void journal_file_unlink_newest_by_bood_id(sd_journal *j, JournalFile *f)
         }
 
         f->newest_boot_id_prioq_idx = PRIOQ_IDX_NULL;
+
+        /* The order of boots might have changed, see compare_boot_ids() */
+        boot_order_check(j, id, &old);
 }
 
 static int journal_file_newest_monotonic_compare(const void *a, const void *b) {
@@ -2393,6 +2763,7 @@ static int journal_file_reshuffle_newest_by_boot_id(sd_journal *j, JournalFile *
 
 static int journal_file_read_tail_timestamp(sd_journal *j, JournalFile *f) {
         uint64_t offset, mo, rt;
+        BootOrderKey old;
         sd_id128_t id;
         ObjectType type;
         Object *o;
@@ -2474,6 +2845,8 @@ static int journal_file_read_tail_timestamp(sd_journal *j, JournalFile *f) {
         if (!sd_id128_equal(f->newest_boot_id, id))
                 journal_file_unlink_newest_by_bood_id(j, f);
 
+        old = boot_order_key(j, id);
+
         f->newest_boot_id = id;
         f->newest_monotonic_usec = mo;
         f->newest_realtime_usec = rt;
@@ -2481,9 +2854,13 @@ static int journal_file_read_tail_timestamp(sd_journal *j, JournalFile *f) {
         f->newest_mtime = timespec_load(&f->last_stat.st_mtim);
 
         r = journal_file_reshuffle_newest_by_boot_id(j, f);
-        if (r < 0)
+        if (r < 0) {
+                /* We don't know anymore how this file orders, play safe */
+                j->merge_prioq_invalid = true;
                 return r;
+        }
 
+        boot_order_check(j, id, &old);
         return 0;
 }
 
@@ -2671,6 +3048,65 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
         return -ENOENT;
 }
 
+static bool data_fields_contain(Set *fields, const void *data, size_t size) {
+        const char *eq;
+
+        /* Field names are at most 64 characters long */
+        eq = memchr(data, '=', MIN(size, 64U + 1));
+        if (!eq)
+                return false;
+
+        return set_contains(fields, strndupa_safe(data, eq - (const char*) data));
+}
+
+static int data_payload_projected(sd_journal *j, JournalFile *f, uint64_t p, void **ret_data, size_t *ret_size) {
+        DataFieldsCacheEntry *e;
+        Compression c;
+        Object *o;
+        void *d;
+        size_t l;
+        int r;
+
+        assert(j);
+        assert(f);
+
+        /* Like journal_file_data_payload(), but returns 0 if the data object is not part of the projection
+         * set with sd_journal_set_data_fields(). Data objects carry no reference to their field, hence we
+         * have to look at the start of the payload. That's cheap for uncompressed objects, but compressed
+         * ones need to be decompressed first. Since the same data objects are usually referenced by many
+         * entries, remember the compressed objects we rejected, so that we don't decompress them again. */
+
+        if (!j->data_fields)
+                return journal_file_data_payload(f, NULL, p, NULL, 0, j->data_threshold, ret_data, ret_size);
+
+        e = j->data_fields_cache + (p / 8) % DATA_FIELDS_CACHE_SIZE;
+        if (e->file == f && e->offset == p)
+                return 0;
+
+        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+        if (r < 0)
+                return r;
+
+        c = COMPRESSION_FROM_OBJECT(o);
+
+        r = journal_file_data_payload(f, o, p, NULL, 0, j->data_threshold, &d, &l);
+        if (r <= 0)
+                return r;
+
+        if (!data_fields_contain(j->data_fields, d, l)) {
+                if (c != COMPRESSION_NONE)
+                        *e = (DataFieldsCacheEntry) {
+                                .file = f,
+                                .offset = p,
+                        };
+                return 0;
+        }
+
+        *ret_data = d;
+        *ret_size = l;
+        return 1;
+}
+
 _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t *size) {
         JournalFile *f;
         Object *o;
@@ -2698,14 +3134,15 @@ _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t
                 size_t l;
 
                 p = journal_file_entry_item_object_offset(f, o, j->current_field);
-                r = journal_file_data_payload(f, NULL, p, NULL, 0, j->data_threshold, &d, &l);
+                r = data_payload_projected(j, f, p, &d, &l);
                 if (IN_SET(r, -EADDRNOTAVAIL, -EBADMSG)) {
                         log_debug_errno(r, "Entry item %"PRIu64" data object is bad, skipping over it: %m", j->current_field);
                         goto next;
                 }
                 if (r < 0)
                         return r;
-                assert(r > 0);
+                if (r == 0) /* Not part of the projection */
+                        goto next;
 
                 *data = d;
                 *size = l;
@@ -3106,6 +3543,183 @@ void journal_print_header(sd_journal *j) {
         }
 }
 
+static int journal_file_summarize_boots(JournalFile *f, JournalBootSummary **ret, size_t *ret_n) {
+        _cleanup_free_ JournalBootSummary *boots = NULL;
+        uint64_t n_entries, n_found = 0;
+        size_t n_boots = 0;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(ret);
+        assert(ret_n);
+
+        /* Without an index, let's look at the DATA objects of the _BOOT_ID= field instead: the first and
+         * last entries referencing each of them are the first and last entries of the boot. Entries are
+         * linked into the main entry array before they are linked to their DATA objects, hence read the
+         * number of entries first, so that entries that are added concurrently don't make us give up. */
+
+        n_entries = le64toh(READ_NOW(f->header->n_entries));
+
+        r = journal_file_find_field_object(f, "_BOOT_ID", STRLEN("_BOOT_ID"), &o, NULL);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -ENODATA;
+
+        for (uint64_t p = le64toh(o->field.head_data_offset); p != 0; p = le64toh(o->data.next_field_offset)) {
+                char t[SD_ID128_STRING_MAX];
+                JournalBootSummary b;
+                void *d;
+                size_t l;
+
+                r = journal_file_data_payload(f, NULL, p, "_BOOT_ID", STRLEN("_BOOT_ID"), 0, &d, &l);
+                if (r < 0)
+                        return r;
+                if (r == 0 || l != STRLEN("_BOOT_ID=") + SD_ID128_STRING_MAX - 1)
+                        return -EBADMSG;
+
+                memcpy(t, (const char*) d + STRLEN("_BOOT_ID="), SD_ID128_STRING_MAX - 1);
+                t[SD_ID128_STRING_MAX - 1] = 0;
+
+                b = (JournalBootSummary) {};
+
+                r = sd_id128_from_string(t, &b.boot_id);
+                if (r < 0)
+                        return r;
+
+                /* journal_file_data_payload() may clear or overwrite cached object. */
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+
+                r = journal_file_next_entry_for_data(f, o, DIRECTION_DOWN, &o, NULL);
+                if (r < 0)
+                        return r;
+                if (r > 0) {
+                        b.head_seqnum = le64toh(o->entry.seqnum);
+                        b.head_realtime = le64toh(o->entry.realtime);
+
+                        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                        if (r < 0)
+                                return r;
+
+                        n_found += le64toh(o->data.n_entries);
+
+                        r = journal_file_next_entry_for_data(f, o, DIRECTION_UP, &o, NULL);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                return -EBADMSG;
+
+                        b.tail_seqnum = le64toh(o->entry.seqnum);
+                        b.tail_realtime = le64toh(o->entry.realtime);
+
+                        if (!GREEDY_REALLOC(boots, n_boots + 1))
+                                return -ENOMEM;
+
+                        boots[n_boots++] = b;
+                }
+
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+        }
+
+        /* If some entries carry no _BOOT_ID= field, we can't tell from the DATA objects alone. */
+        if (n_found < n_entries)
+                return -ENODATA;
+
+        *ret = TAKE_PTR(boots);
+        *ret_n = n_boots;
+        return 0;
+}
+
+static int boot_summary_compare_id(const JournalBootSummary *a, const JournalBootSummary *b) {
+        return memcmp(&a->boot_id, &b->boot_id, sizeof(sd_id128_t));
+}
+
+static int boot_id_compare(const BootId *a, const BootId *b) {
+        int r;
+
+        r = CMP(a->first_usec, b->first_usec);
+        if (r != 0)
+                return r;
+
+        return memcmp(&a->id, &b->id, sizeof(sd_id128_t));
+}
+
+int journal_get_boots(sd_journal *j, BootId **ret_boots, size_t *ret_n_boots) {
+        _cleanup_free_ JournalBootSummary *summaries = NULL;
+        _cleanup_free_ BootId *boots = NULL;
+        size_t n_summaries = 0, n_boots = 0;
+        JournalFile *f;
+        int r;
+
+        assert(j);
+        assert(ret_boots);
+        assert(ret_n_boots);
+
+        /* Collects the boots of all files, without looking at their entries one by one. This uses the boot
+         * summaries stored in the indexes of archived files, and the _BOOT_ID= DATA objects otherwise.
+         * Matches are not taken into account. Returns the boots ordered by their first entry. */
+
+        ORDERED_HASHMAP_FOREACH(f, j->files) {
+                _cleanup_free_ JournalBootSummary *file_boots = NULL;
+                const JournalBootSummary *b;
+                JournalIndex *idx;
+                size_t n;
+
+                if (le64toh(f->header->n_entries) == 0)
+                        continue;
+
+                idx = journal_file_get_index(f);
+                if (idx)
+                        n = journal_index_get_boots(idx, &b);
+                else {
+                        r = journal_file_summarize_boots(f, &file_boots, &n);
+                        if (r < 0)
+                                return log_debug_errno(r, "Failed to summarize boots of %s: %m", f->path);
+
+                        b = file_boots;
+                }
+
+                if (!GREEDY_REALLOC(summaries, n_summaries + n))
+                        return -ENOMEM;
+
+                memcpy_safe(summaries + n_summaries, b, n * sizeof(JournalBootSummary));
+                n_summaries += n;
+        }
+
+        /* Merge the summaries of the same boot from different files */
+        typesafe_qsort(summaries, n_summaries, boot_summary_compare_id);
+
+        FOREACH_ARRAY(s, summaries, n_summaries) {
+                if (n_boots > 0 && sd_id128_equal(boots[n_boots - 1].id, s->boot_id)) {
+                        BootId *b = boots + n_boots - 1;
+
+                        b->first_usec = MIN(b->first_usec, s->head_realtime);
+                        b->last_usec = MAX(b->last_usec, s->tail_realtime);
+                        continue;
+                }
+
+                if (!GREEDY_REALLOC(boots, n_boots + 1))
+                        return -ENOMEM;
+
+                boots[n_boots++] = (BootId) {
+                        .id = s->boot_id,
+                        .first_usec = s->head_realtime,
+                        .last_usec = s->tail_realtime,
+                };
+        }
+
+        typesafe_qsort(boots, n_boots, boot_id_compare);
+
+        *ret_boots = TAKE_PTR(boots);
+        *ret_n_boots = n_boots;
+        return 0;
+}
+
 _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *ret) {
         JournalFile *f;
         uint64_t sum = 0;
@@ -3135,6 +3749,38 @@ _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *ret) {
         return 0;
 }
 
+/* sd_journal_enumerate_unique() remembers the hashes of at most this many values it returned. If there are
+ * more, further candidates are looked up in the files enumerated before. */
+#define UNIQUE_VALUES_MAX (512U * 1024U)
+
+typedef struct UniqueValue {
+        uint64_t hash;
+        JournalFile *file; /* A file that contains the value */
+} UniqueValue;
+
+static void unique_value_hash_func(const UniqueValue *v, struct siphash *state) {
+        siphash24_compress(&v->hash, sizeof(v->hash), state);
+}
+
+static int unique_value_compare_func(const UniqueValue *x, const UniqueValue *y) {
+        return CMP(x->hash, y->hash);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(unique_value_hash_ops, UniqueValue,
+                                            unique_value_hash_func, unique_value_compare_func, free);
+
+static void reset_unique(sd_journal *j) {
+        assert(j);
+
+        j->unique_file = NULL;
+        j->unique_offset = 0;
+        j->unique_file_lost = false;
+
+        j->unique_values = set_free(j->unique_values);
+        j->unique_values_incomplete = false;
+        random_bytes(j->unique_hash_key, sizeof(j->unique_hash_key));
+}
+
 _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         int r;
 
@@ -3147,17 +3793,137 @@ _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         if (r < 0)
                 return r;
 
-        j->unique_file = NULL;
-        j->unique_offset = 0;
-        j->unique_file_lost = false;
+        reset_unique(j);
+
+        return 0;
+}
+
+static int unique_find_in_file(sd_journal *j, JournalFile *of, const void *data, size_t size, uint64_t hash, Object **ret) {
+        assert(j);
+        assert(j->unique_file);
+        assert(of);
+
+        /* Skip this file it didn't have any fields indexed */
+        if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
+                return 0;
+
+        /* We can reuse the hash from our current file only on old-style journal files without keyed hashes.
+         * On new-style files we have to calculate the hash anew, to take the per-file hash seed into
+         * consideration. */
+        if (!JOURNAL_HEADER_KEYED_HASH(j->unique_file->header) && !JOURNAL_HEADER_KEYED_HASH(of->header))
+                return journal_file_find_data_object_with_hash(of, data, size, hash, ret, NULL);
+
+        return journal_file_find_data_object(of, data, size, ret, NULL);
+}
+
+static void unique_remember(sd_journal *j, uint64_t h) {
+        UniqueValue *v;
+        int r;
+
+        assert(j);
+
+        /* If we can't remember the value, it will be looked up in the files before, like any value that
+         * isn't known once we gave up on remembering all of them */
+
+        if (set_size(j->unique_values) >= UNIQUE_VALUES_MAX) {
+                if (!j->unique_values_incomplete)
+                        log_debug("More than %u distinct values of field %s, not remembering further values.",
+                                  UNIQUE_VALUES_MAX, j->unique_field);
+
+                j->unique_values_incomplete = true;
+                return;
+        }
+
+        v = new(UniqueValue, 1);
+        if (!v) {
+                j->unique_values_incomplete = true;
+                return;
+        }
+
+        *v = (UniqueValue) {
+                .hash = h,
+                .file = j->unique_file,
+        };
+
+        r = set_ensure_consume(&j->unique_values, &unique_value_hash_ops, v);
+        if (r < 0)
+                j->unique_values_incomplete = true;
+}
+
+static int unique_seen(sd_journal *j, const void *data, size_t size, uint64_t hash) {
+        UniqueValue *v;
+        JournalFile *of;
+        uint64_t h;
+        int r;
+
+        assert(j);
+        assert(j->unique_file);
+
+        /* Checks whether we returned a value before. Values are remembered by their hash, together with a
+         * file that contains them, hence only that file needs to be checked to rule out hash collisions,
+         * instead of every file enumerated before. A value is contained at most once in every file, hence
+         * a hit in the current file is necessarily a collision. */
+
+        h = siphash24(data, size, j->unique_hash_key);
+
+        v = set_get(j->unique_values, &(UniqueValue) { .hash = h });
+        if (v) {
+                if (v->file != j->unique_file) {
+                        r = unique_find_in_file(j, v->file, data, size, hash, NULL);
+                        if (r != 0)
+                                return r;
+                }
+        } else if (!j->unique_values_incomplete) {
+                unique_remember(j, h);
+                return 0;
+        }
+
+        /* A hash collision, or we don't know all values returned so far. Look at the files before. */
+        ORDERED_HASHMAP_FOREACH(of, j->files) {
+                if (of == j->unique_file)
+                        break;
+
+                r = unique_find_in_file(j, of, data, size, hash, NULL);
+                if (r != 0)
+                        return r;
+        }
+
+        if (!v)
+                unique_remember(j, h);
+
+        return 0;
+}
+
+static int unique_count(sd_journal *j, const void *data, size_t size, uint64_t hash, uint64_t n_entries, uint64_t *ret) {
+        int r;
 
+        assert(j);
+        assert(j->unique_file);
+        assert(ret);
+
+        /* The value is new, hence none of the files before contain it. Add up the entries referencing it in
+         * the files after. */
+
+        for (JournalFile *of = ordered_hashmap_next(j->files, j->unique_file->path); of;
+             of = ordered_hashmap_next(j->files, of->path)) {
+                Object *o;
+
+                r = unique_find_in_file(j, of, data, size, hash, &o);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        n_entries += le64toh(o->data.n_entries);
+        }
+
+        *ret = n_entries;
         return 0;
 }
 
-_public_ int sd_journal_enumerate_unique(
+static int enumerate_unique(
                 sd_journal *j,
                 const void **ret_data,
-                size_t *ret_size) {
+                size_t *ret_size,
+                uint64_t *ret_n_entries) {
 
         size_t k;
 
@@ -3179,11 +3945,10 @@ _public_ int sd_journal_enumerate_unique(
         }
 
         for (;;) {
-                JournalFile *of;
+                uint64_t hash, n_entries;
                 Object *o;
                 void *odata;
                 size_t ol;
-                bool found;
                 int r;
 
                 /* Proceed to next data object in the field's linked list */
@@ -3225,6 +3990,9 @@ _public_ int sd_journal_enumerate_unique(
                                                j->unique_offset,
                                                o->object.type, OBJECT_DATA);
 
+                hash = le64toh(o->data.hash);
+                n_entries = le64toh(o->data.n_entries);
+
                 r = journal_file_data_payload(j->unique_file, o, j->unique_offset, NULL, 0,
                                               j->data_threshold, &odata, &ol);
                 if (r < 0)
@@ -3244,35 +4012,19 @@ _public_ int sd_journal_enumerate_unique(
                                                j->unique_offset,
                                                j->unique_field);
 
-                /* OK, now let's see if we already returned this data object by checking if it exists in the
-                 * earlier traversed files. */
-                found = false;
-                ORDERED_HASHMAP_FOREACH(of, j->files) {
-                        if (of == j->unique_file)
-                                break;
-
-                        /* Skip this file it didn't have any fields indexed */
-                        if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
-                                continue;
+                /* OK, now let's see if we already returned this data object */
+                r = unique_seen(j, odata, ol, hash);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        continue;
 
-                        /* We can reuse the hash from our current file only on old-style journal files
-                         * without keyed hashes. On new-style files we have to calculate the hash anew, to
-                         * take the per-file hash seed into consideration. */
-                        if (!JOURNAL_HEADER_KEYED_HASH(j->unique_file->header) && !JOURNAL_HEADER_KEYED_HASH(of->header))
-                                r = journal_file_find_data_object_with_hash(of, odata, ol, le64toh(o->data.hash), NULL, NULL);
-                        else
-                                r = journal_file_find_data_object(of, odata, ol, NULL, NULL);
+                if (ret_n_entries) {
+                        r = unique_count(j, odata, ol, hash, n_entries, ret_n_entries);
                         if (r < 0)
                                 return r;
-                        if (r > 0) {
-                                found = true;
-                                break;
-                        }
                 }
 
-                if (found)
-                        continue;
-
                 *ret_data = odata;
                 *ret_size = ol;
 
@@ -3280,6 +4032,21 @@ _public_ int sd_journal_enumerate_unique(
         }
 }
 
+_public_ int sd_journal_enumerate_unique(sd_journal *j, const void **ret_data, size_t *ret_size) {
+        return enumerate_unique(j, ret_data, ret_size, NULL);
+}
+
+_public_ int sd_journal_enumerate_unique_with_count(
+                sd_journal *j,
+                const void **ret_data,
+                size_t *ret_size,
+                uint64_t *ret_n_entries) {
+
+        assert_return(ret_n_entries, -EINVAL);
+
+        return enumerate_unique(j, ret_data, ret_size, ret_n_entries);
+}
+
 _public_ int sd_journal_enumerate_available_unique(sd_journal *j, const void **data, size_t *size) {
         for (;;) {
                 int r;
@@ -3298,9 +4065,7 @@ _public_ void sd_journal_restart_unique(sd_journal *j) {
         if (!j || journal_origin_changed(j))
                 return;
 
-        j->unique_file = NULL;
-        j->unique_offset = 0;
-        j->unique_file_lost = false;
+        reset_unique(j);
 }
 
 _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
@@ -3530,6 +4295,37 @@ _public_ int sd_journal_set_data_threshold(sd_journal *j, size_t sz) {
         return 0;
 }
 
+_public_ int sd_journal_set_data_fields(sd_journal *j, char **fields) {
+        _cleanup_set_free_ Set *s = NULL;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_origin_changed(j), -ECHILD);
+
+        STRV_FOREACH(field, fields) {
+                if (!journal_field_valid(*field, SIZE_MAX, true))
+                        return -EINVAL;
+
+                r = set_put_strdup(&s, *field);
+                if (r < 0)
+                        return r;
+        }
+
+        if (s && !j->data_fields_cache) {
+                j->data_fields_cache = new(DataFieldsCacheEntry, DATA_FIELDS_CACHE_SIZE);
+                if (!j->data_fields_cache)
+                        return -ENOMEM;
+        }
+
+        /* Data objects rejected by the old projection might be part of the new one */
+        if (j->data_fields_cache)
+                memzero(j->data_fields_cache, DATA_FIELDS_CACHE_SIZE * sizeof(DataFieldsCacheEntry));
+
+        set_free(j->data_fields);
+        j->data_fields = TAKE_PTR(s);
+        return 0;
+}
+
 _public_ int sd_journal_get_data_threshold(sd_journal *j, size_t *sz) {
         assert_return(j, -EINVAL);
         assert_return(!journal_origin_changed(j), -ECHILD);
@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "io-util.h"
+#include "journal-file.h"
+#include "journal-index.h"
+#include "journal-internal.h"
+#include "mmap-cache.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+#define N_ENTRIES 5000U
+
+static usec_t entry_realtime(unsigned i) {
+        /* One entry per second, with an hour long gap after every hundred entries */
+        return 1600000000 * USEC_PER_SEC + i * USEC_PER_SEC + (i / 100) * USEC_PER_HOUR;
+}
+
+static void append_entries(JournalFile *f, unsigned from, unsigned to) {
+        sd_id128_t boot_id;
+
+        assert_se(sd_id128_randomize(&boot_id) >= 0);
+
+        for (unsigned i = from; i < to; i++) {
+                _cleanup_free_ char *m = NULL;
+                struct iovec iovec[3];
+                dual_timestamp ts = {
+                        .realtime = entry_realtime(i),
+                        .monotonic = i + 1,
+                };
+
+                assert_se(asprintf(&m, "MESSAGE=%u", i) >= 0);
+
+                iovec[0] = IOVEC_MAKE_STRING(m);
+                iovec[1] = IOVEC_MAKE_STRING("COMMON=yes");
+                iovec[2] = IOVEC_MAKE_STRING(i < N_ENTRIES / 2 ? "HALF=first" : "HALF=second");
+
+                assert_se(journal_file_append_entry(f, &ts, &boot_id, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL, NULL) >= 0);
+        }
+}
+
+static void test_lookup_one(JournalFile *f, JournalIndex *i, uint64_t realtime, direction_t direction) {
+        uint64_t p = 0, q = 0;
+        int r, k;
+
+        r = journal_file_move_to_entry_by_realtime(f, realtime, direction, NULL, &p);
+        k = journal_index_move_to_entry_by_realtime(f, i, realtime, direction, NULL, &q);
+
+        assert_se(r >= 0);
+        assert_se(k == r);
+        if (r > 0)
+                assert_se(p == q);
+}
+
+TEST(journal_index) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_(journal_index_freep) JournalIndex *i = NULL;
+        _cleanup_(journal_file_closep) JournalFile *f = NULL;
+        _cleanup_free_ char *fn = NULL, *idx = NULL;
+        uint64_t first, second;
+
+        assert_se(mkdtemp_malloc("/var/tmp/journal-index-XXXXXX", &t) >= 0);
+        assert_se(fn = path_join(t, "test.journal"));
+        assert_se(idx = strjoin(fn, JOURNAL_INDEX_SUFFIX));
+
+        assert_se(m = mmap_cache_new());
+
+        assert_se(journal_file_open(-EBADF, fn, O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0644, UINT64_MAX, NULL, m, NULL, &f) >= 0);
+
+        /* Nothing to index yet */
+        assert_se(journal_index_build(f) == 0);
+        assert_se(access(idx, F_OK) < 0 && errno == ENOENT);
+
+        append_entries(f, 0, N_ENTRIES);
+
+        assert_se(journal_index_build(f) > 0);
+        assert_se(journal_index_load(f, &i) >= 0);
+
+        /* The indexed lookup must yield the same results as the bisection of the whole entry array */
+        for (unsigned k = 0; k < N_ENTRIES; k += 7) {
+                usec_t u = entry_realtime(k);
+
+                for (direction_t d = DIRECTION_UP; d <= DIRECTION_DOWN; d++) {
+                        test_lookup_one(f, i, u - 1, d);
+                        test_lookup_one(f, i, u, d);
+                        test_lookup_one(f, i, u + 1, d);
+                        test_lookup_one(f, i, u + USEC_PER_MINUTE, d);
+                }
+        }
+
+        for (direction_t d = DIRECTION_UP; d <= DIRECTION_DOWN; d++) {
+                test_lookup_one(f, i, 1, d);
+                test_lookup_one(f, i, entry_realtime(0), d);
+                test_lookup_one(f, i, entry_realtime(N_ENTRIES - 1), d);
+                test_lookup_one(f, i, entry_realtime(N_ENTRIES - 1) + 1, d);
+                test_lookup_one(f, i, entry_realtime(N_ENTRIES) + USEC_PER_YEAR, d);
+        }
+
+        /* Frequently used DATA objects are recorded with their realtime range */
+        assert_se(journal_file_find_data_object(f, "HALF=first", STRLEN("HALF=first"), NULL, &first) > 0);
+        assert_se(journal_file_find_data_object(f, "HALF=second", STRLEN("HALF=second"), NULL, &second) > 0);
+
+        assert_se(journal_index_data_may_match(i, first, entry_realtime(0), DIRECTION_DOWN));
+        assert_se(journal_index_data_may_match(i, first, entry_realtime(N_ENTRIES / 2 - 1), DIRECTION_DOWN));
+        assert_se(!journal_index_data_may_match(i, first, entry_realtime(N_ENTRIES / 2), DIRECTION_DOWN));
+        assert_se(journal_index_data_may_match(i, first, entry_realtime(N_ENTRIES / 2), DIRECTION_UP));
+
+        assert_se(journal_index_data_may_match(i, second, entry_realtime(N_ENTRIES - 1), DIRECTION_DOWN));
+        assert_se(!journal_index_data_may_match(i, second, entry_realtime(N_ENTRIES / 2 - 1), DIRECTION_UP));
+        assert_se(journal_index_data_may_match(i, second, entry_realtime(N_ENTRIES / 2), DIRECTION_UP));
+
+        /* Unknown DATA objects may always match */
+        assert_se(journal_index_data_may_match(i, 8, entry_realtime(N_ENTRIES), DIRECTION_DOWN));
+
+        /* Once the file is modified, the index must not be used anymore */
+        i = journal_index_free(i);
+        append_entries(f, N_ENTRIES, N_ENTRIES + 1);
+        assert_se(journal_index_load(f, &i) == -ESTALE);
+
+        assert_se(journal_index_unlink(AT_FDCWD, fn) >= 0);
+        assert_se(access(idx, F_OK) < 0 && errno == ENOENT);
+        assert_se(journal_index_load(f, &i) == -ENOENT);
+}
+
+static void append_boot(JournalFile *f, sd_id128_t boot_id, unsigned from, unsigned to, bool with_field) {
+        _cleanup_free_ char *b = NULL;
+
+        assert_se(b = strjoin("_BOOT_ID=", SD_ID128_TO_STRING(boot_id)));
+
+        for (unsigned i = from; i < to; i++) {
+                struct iovec iovec[2];
+                size_t n = 0;
+                dual_timestamp ts = {
+                        .realtime = entry_realtime(i),
+                        .monotonic = i + 1,
+                };
+
+                iovec[n++] = IOVEC_MAKE_STRING("MESSAGE=boot");
+                if (with_field)
+                        iovec[n++] = IOVEC_MAKE_STRING(b);
+
+                assert_se(journal_file_append_entry(f, &ts, &boot_id, iovec, n, NULL, NULL, NULL, NULL) >= 0);
+        }
+}
+
+static void check_boots(sd_journal *j, const sd_id128_t *ids, const unsigned *first, const unsigned *last, size_t n) {
+        _cleanup_free_ BootId *boots = NULL;
+        size_t n_boots;
+
+        assert_se(journal_get_boots(j, &boots, &n_boots) >= 0);
+        assert_se(n_boots == n);
+
+        for (size_t k = 0; k < n; k++) {
+                assert_se(sd_id128_equal(boots[k].id, ids[k]));
+                assert_se(boots[k].first_usec == entry_realtime(first[k]));
+                assert_se(boots[k].last_usec == entry_realtime(last[k]));
+        }
+}
+
+TEST(boot_summary) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_(journal_index_freep) JournalIndex *i = NULL;
+        _cleanup_(journal_file_closep) JournalFile *f = NULL, *g = NULL;
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ char *fn = NULL, *gn = NULL, *archived = NULL;
+        _cleanup_free_ BootId *boots = NULL;
+        const JournalBootSummary *b;
+        sd_id128_t ids[4];
+        size_t n_boots;
+
+        assert_se(mkdtemp_malloc("/var/tmp/journal-index-XXXXXX", &t) >= 0);
+        assert_se(fn = path_join(t, "one.journal"));
+        assert_se(gn = path_join(t, "two.journal"));
+
+        for (size_t k = 0; k < ELEMENTSOF(ids); k++)
+                assert_se(sd_id128_randomize(ids + k) >= 0);
+
+        assert_se(m = mmap_cache_new());
+
+        /* The first file lacks the _BOOT_ID= field, hence only its index tells which boots it contains */
+        assert_se(journal_file_open(-EBADF, fn, O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0644, UINT64_MAX, NULL, m, NULL, &f) >= 0);
+        append_boot(f, ids[0], 0, 100, false);
+        append_boot(f, ids[1], 100, 300, false);
+        append_boot(f, ids[2], 300, 350, false);
+
+        /* The second one continues the last boot of the first one and adds another one */
+        assert_se(journal_file_open(-EBADF, gn, O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0644, UINT64_MAX, NULL, m, NULL, &g) >= 0);
+        append_boot(g, ids[2], 350, 400, true);
+        append_boot(g, ids[3], 400, 410, true);
+
+        assert_se(journal_file_archive(f, NULL) >= 0);
+        assert_se(archived = strdup(f->path));
+        assert_se(journal_index_build(f) > 0);
+        assert_se(journal_index_load(f, &i) >= 0);
+
+        assert_se(journal_index_get_boots(i, &b) == 3);
+        assert_se(sd_id128_equal(b[1].boot_id, ids[1]));
+        assert_se(b[1].head_seqnum == 101);
+        assert_se(b[1].tail_seqnum == 300);
+        assert_se(b[1].head_realtime == entry_realtime(100));
+        assert_se(b[1].tail_realtime == entry_realtime(299));
+
+        /* Only the managed journal files of journald take care of this when going offline */
+        f->header->state = STATE_ARCHIVED;
+
+        f = journal_file_close(f);
+        g = journal_file_close(g);
+
+        assert_se(sd_journal_open_files(&j, STRV_MAKE_CONST(archived, gn), 0) >= 0);
+        check_boots(j, ids, (const unsigned[]) { 0, 100, 300, 400 }, (const unsigned[]) { 99, 299, 399, 409 }, 4);
+        sd_journal_close(TAKE_PTR(j));
+
+        /* Without the index there's no way to tell quickly */
+        assert_se(journal_index_unlink(AT_FDCWD, archived) >= 0);
+        assert_se(sd_journal_open_files(&j, STRV_MAKE_CONST(archived, gn), 0) >= 0);
+        assert_se(journal_get_boots(j, &boots, &n_boots) == -ENODATA);
+        sd_journal_close(TAKE_PTR(j));
+
+        /* The second file alone can be summarized from its DATA objects */
+        assert_se(sd_journal_open_files(&j, STRV_MAKE_CONST(gn), 0) >= 0);
+        check_boots(j, ids + 2, (const unsigned[]) { 350, 400 }, (const unsigned[]) { 399, 409 }, 2);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fd-util.h"
+#include "io-util.h"
+#include "journal-def.h"
+#include "journal-index.h"
+#include "journal-vacuum.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+
+#define N_FILES 10U
+#define FILE_SIZE (64U * 1024U)
+
+static sd_id128_t seqnum_id;
+
+static char* archived_name(unsigned i) {
+        char *fn;
+
+        assert_se(asprintf(&fn, "system@%s-%016x-%016" PRIx64 ".journal",
+                           SD_ID128_TO_STRING(seqnum_id), i * 100 + 1,
+                           now(CLOCK_REALTIME) - (N_FILES - i) * USEC_PER_HOUR) >= 0);
+        return fn;
+}
+
+static void write_file(int dir_fd, const char *fn, uint64_t n_entries) {
+        _cleanup_close_ int fd = -EBADF;
+        _cleanup_free_ void *buf = NULL;
+        Header *h;
+
+        /* Vacuuming only looks at the header, hence that's all we need to fill in */
+        assert_se(buf = malloc0(FILE_SIZE));
+        h = buf;
+        memcpy(h->signature, HEADER_SIGNATURE, sizeof(h->signature));
+        h->state = STATE_ARCHIVED;
+        h->n_entries = htole64(n_entries);
+
+        assert_se((fd = openat(dir_fd, fn, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)) >= 0);
+        assert_se(loop_write(fd, buf, FILE_SIZE) >= 0);
+        assert_se(fsync(fd) >= 0);
+}
+
+static bool file_exists(int dir_fd, const char *fn) {
+        return faccessat(dir_fd, fn, F_OK, AT_SYMLINK_NOFOLLOW) >= 0;
+}
+
+static void wait_for_state(JournalVacuumState *s) {
+        while (journal_vacuum_state_busy(s))
+                usleep_safe(USEC_PER_MSEC);
+}
+
+static void test_vacuum_one(bool with_state) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_(journal_vacuum_state_freep) JournalVacuumState *s = NULL;
+        _cleanup_close_ int dir_fd = -EBADF;
+        char *names[N_FILES] = {};
+        _cleanup_free_ char *idx = NULL;
+        struct stat st;
+        uint64_t usage;
+
+        log_info("/* %s(%s) */", __func__, yes_no(with_state));
+
+        assert_se(mkdtemp_malloc("/var/tmp/journal-vacuum-XXXXXX", &t) >= 0);
+        assert_se((dir_fd = open(t, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) >= 0);
+
+        if (with_state)
+                assert_se(journal_vacuum_state_new(&s) >= 0);
+
+        for (unsigned i = 0; i < N_FILES; i++) {
+                names[i] = archived_name(i);
+                write_file(dir_fd, names[i], 1);
+        }
+
+        /* An active file and an unrelated file are never touched */
+        write_file(dir_fd, "system.journal", 1);
+        write_file(dir_fd, "unrelated", 1);
+
+        /* The active file counts against the limit on the number of files, too */
+        assert_se(journal_directory_vacuum_full(t, 0, N_FILES - 3, 0, s, NULL, true) >= 0);
+        wait_for_state(s);
+
+        for (unsigned i = 0; i < N_FILES; i++)
+                assert_se(file_exists(dir_fd, names[i]) == (i >= 4));
+        assert_se(file_exists(dir_fd, "system.journal"));
+        assert_se(file_exists(dir_fd, "unrelated"));
+
+        /* The remaining archived files are remembered, as long as they are not replaced */
+        assert_se(fstatat(dir_fd, names[4], &st, 0) >= 0);
+        assert_se(journal_vacuum_state_get_usage(s, names[4], st.st_ino, &usage) == with_state);
+        if (with_state)
+                assert_se(usage == (uint64_t) st.st_blocks * 512U);
+        assert_se(journal_vacuum_state_get_usage(s, names[4], st.st_ino + 1, &usage) == 0);
+        assert_se(journal_vacuum_state_get_usage(s, "system.journal", st.st_ino, &usage) == 0);
+
+        /* A file that is replaced by an empty one is looked at again and deleted, sidecar files of deleted
+         * journal files are removed too */
+        assert_se(unlinkat(dir_fd, names[5], 0) >= 0);
+        write_file(dir_fd, names[5], 0);
+        assert_se(idx = strjoin(names[0], JOURNAL_INDEX_SUFFIX));
+        write_file(dir_fd, idx, 0);
+
+        assert_se(journal_directory_vacuum_full(t, 0, N_FILES, 0, s, NULL, true) >= 0);
+        wait_for_state(s);
+
+        for (unsigned i = 0; i < N_FILES; i++)
+                assert_se(file_exists(dir_fd, names[i]) == (i >= 4 && i != 5));
+        assert_se(!file_exists(dir_fd, idx));
+
+        /* Now by disk usage: only two archived files fit next to the active file */
+        assert_se(journal_directory_vacuum_full(t, 3 * FILE_SIZE + FILE_SIZE / 2, 0, 0, s, NULL, true) >= 0);
+        wait_for_state(s);
+
+        for (unsigned i = 0; i < N_FILES; i++)
+                assert_se(file_exists(dir_fd, names[i]) == (i >= 8));
+
+        /* And by age */
+        assert_se(journal_directory_vacuum_full(t, 0, 0, USEC_PER_HOUR + USEC_PER_HOUR / 2, s, NULL, true) >= 0);
+        wait_for_state(s);
+
+        for (unsigned i = 0; i < N_FILES; i++)
+                assert_se(file_exists(dir_fd, names[i]) == (i >= 9));
+
+        assert_se(file_exists(dir_fd, "system.journal"));
+        assert_se(file_exists(dir_fd, "unrelated"));
+
+        for (unsigned i = 0; i < N_FILES; i++)
+                free(names[i]);
+}
+
+TEST(vacuum) {
+        test_vacuum_one(false);
+        test_vacuum_one(true);
+}
+
+static int intro(void) {
+        assert_se(sd_id128_randomize(&seqnum_id) >= 0);
+        return EXIT_SUCCESS;
+}
+
+DEFINE_TEST_MAIN_WITH_INTRO(LOG_DEBUG, intro);
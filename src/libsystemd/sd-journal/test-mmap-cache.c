@@ -11,7 +11,9 @@
 #include "tmpfile-util.h"
 
 int main(int argc, char *argv[]) {
-        MMapFileDescriptor *fx;
+        MMapFileDescriptor *fx, *fy, *fz;
+        MMapCacheStats stats;
+        struct stat st;
         int x, y, z, r;
         char px[] = "/tmp/testmmapXXXXXXX", py[] = "/tmp/testmmapYXXXXXX", pz[] = "/tmp/testmmapZXXXXXX";
         MMapCache *m;
@@ -55,6 +57,37 @@ int main(int argc, char *argv[]) {
         assert_se((uint8_t*) p + 1 == (uint8_t*) q);
 
         mmap_cache_fd_free(fx);
+
+        /* Going through a file sequentially should result in a few large windows */
+        assert_se(ftruncate(y, 128ULL*1024ULL*1024ULL) >= 0);
+        assert_se(fstat(y, &st) >= 0);
+        assert_se(fy = mmap_cache_add_fd(m, y, PROT_READ));
+
+        for (uint64_t offset = 0; offset < (uint64_t) st.st_size; offset += 512ULL*1024ULL)
+                assert_se(mmap_cache_fd_get(fy, 2, false, offset, 16, &st, &p) > 0);
+
+        mmap_cache_get_stats(m, &stats);
+        assert_se(stats.n_sequential >= 3);
+#if !ENABLE_DEBUG_MMAP_CACHE
+        assert_se(stats.n_missed <= 2 + 8);
+#endif
+
+        mmap_cache_fd_free(fy);
+
+        /* Jumping around should result in small windows */
+        assert_se(ftruncate(z, 128ULL*1024ULL*1024ULL) >= 0);
+        assert_se(fstat(z, &st) >= 0);
+        assert_se(fz = mmap_cache_add_fd(m, z, PROT_READ));
+
+        for (uint64_t i = 0; i < 16; i++)
+                assert_se(mmap_cache_fd_get(fz, 3, false, (i * 37ULL*1024ULL*1024ULL) % st.st_size, 16, &st, &p) > 0);
+
+        mmap_cache_get_stats(m, &stats);
+        assert_se(stats.n_random > 0);
+
+        mmap_cache_stats_log_debug(m);
+
+        mmap_cache_fd_free(fz);
         mmap_cache_unref(m);
 
         safe_close(x);
@@ -22,6 +22,9 @@ enum {
         IMPORTER_STATE_DATA_START,  /* reading binary data header */
         IMPORTER_STATE_DATA,        /* reading binary data */
         IMPORTER_STATE_DATA_FINISH, /* expecting newline */
+        IMPORTER_STATE_FRAME_HEADER, /* framed format: waiting for the entry header */
+        IMPORTER_STATE_FRAME_SIZE,  /* framed format: reading the size of the next field */
+        IMPORTER_STATE_FRAME_DATA,  /* framed format: reading a field */
         IMPORTER_STATE_EOF,         /* done */
 };
 
@@ -114,7 +117,8 @@ static int get_line(JournalImporter *imp, char **line, size_t *size) {
 static int fill_fixed_size(JournalImporter *imp, void **data, size_t size) {
 
         assert(imp);
-        assert(IN_SET(imp->state, IMPORTER_STATE_DATA_START, IMPORTER_STATE_DATA, IMPORTER_STATE_DATA_FINISH));
+        assert(IN_SET(imp->state, IMPORTER_STATE_DATA_START, IMPORTER_STATE_DATA, IMPORTER_STATE_DATA_FINISH,
+                      IMPORTER_STATE_FRAME_HEADER, IMPORTER_STATE_FRAME_SIZE, IMPORTER_STATE_FRAME_DATA));
         assert(size <= DATA_SIZE_MAX);
         assert(imp->offset <= imp->filled);
         assert(imp->filled <= MALLOC_SIZEOF_SAFE(imp->buf));
@@ -278,9 +282,133 @@ static int process_special_field(JournalImporter *imp, char *line) {
         return 0;
 }
 
+static int get_frame_header(JournalImporter *imp) {
+        uint64_t realtime, monotonic;
+        uint8_t *header;
+        int r;
+
+        assert(imp);
+        assert(imp->state == IMPORTER_STATE_FRAME_HEADER);
+
+        r = fill_fixed_size(imp, (void**) &header, JOURNAL_FRAME_HEADER_SIZE);
+        if (r <= 0)
+                return r;
+
+        /* Zero means the timestamp is not known, as if the field was missing in the export format */
+        realtime = unaligned_read_le64(header);
+        if (realtime != 0 && !VALID_REALTIME(realtime))
+                return log_warning_errno(SYNTHETIC_ERRNO(ERANGE),
+                                         "Realtime timestamp out of range: %"PRIu64, realtime);
+
+        monotonic = unaligned_read_le64(header + 8);
+        if (monotonic != 0 && !VALID_MONOTONIC(monotonic))
+                return log_warning_errno(SYNTHETIC_ERRNO(ERANGE),
+                                         "Monotonic timestamp out of range: %"PRIu64, monotonic);
+
+        imp->ts.realtime = realtime;
+        imp->ts.monotonic = monotonic;
+        memcpy(&imp->boot_id, header + 16, sizeof(sd_id128_t));
+
+        return 1;
+}
+
+static int process_frame_field(JournalImporter *imp, char *data, size_t size) {
+        const char *sep;
+        char buf[64];
+
+        assert(imp);
+        assert(data);
+        assert(size > 0);
+
+        sep = memchr(data, '=', size);
+        if (!sep || !journal_field_valid(data, sep - data, true)) {
+                log_debug("Ignoring invalid field: \"%s\"",
+                          cellescape(buf, sizeof buf, strndupa_safe(data, MIN(size, sizeof buf))));
+                return 0;
+        }
+
+        /* The entry metadata is carried in the frame header, there are no dunder fields to process */
+        if (startswith(data, "__")) {
+                log_notice("Unknown dunder field %s, ignoring.", cellescape(buf, sizeof buf, strndupa_safe(data, sep - data)));
+                return 0;
+        }
+
+        return iovw_put(&imp->iovw, data, size);
+}
+
+static int process_framed_data(JournalImporter *imp) {
+        void *data;
+        int r;
+
+        switch (imp->state) {
+
+        case IMPORTER_STATE_FRAME_HEADER:
+                r = get_frame_header(imp);
+                if (r < 0)
+                        return r;
+                if (r == 0) {
+                        imp->state = IMPORTER_STATE_EOF;
+                        return 0;
+                }
+
+                imp->state = IMPORTER_STATE_FRAME_SIZE;
+                return 0; /* continue */
+
+        case IMPORTER_STATE_FRAME_SIZE:
+                assert(imp->data_size == 0);
+
+                r = fill_fixed_size(imp, &data, sizeof(uint64_t));
+                if (r < 0)
+                        return r;
+                if (r == 0) {
+                        imp->state = IMPORTER_STATE_EOF;
+                        return 0;
+                }
+
+                imp->data_size = unaligned_read_le64(data);
+                if (imp->data_size == 0) {
+                        log_trace("Received end of frame, event is ready");
+                        imp->state = IMPORTER_STATE_FRAME_HEADER;
+                        return 1;
+                }
+                if (imp->data_size > DATA_SIZE_MAX)
+                        return log_warning_errno(SYNTHETIC_ERRNO(EINVAL),
+                                                 "Stream declares field with size %zu > DATA_SIZE_MAX = %u",
+                                                 imp->data_size, DATA_SIZE_MAX);
+
+                imp->state = IMPORTER_STATE_FRAME_DATA;
+                return 0; /* continue */
+
+        case IMPORTER_STATE_FRAME_DATA:
+                assert(imp->data_size > 0);
+
+                r = fill_fixed_size(imp, &data, imp->data_size);
+                if (r < 0)
+                        return r;
+                if (r == 0) {
+                        imp->state = IMPORTER_STATE_EOF;
+                        return 0;
+                }
+
+                r = process_frame_field(imp, data, imp->data_size);
+                if (r < 0)
+                        return r;
+
+                imp->data_size = 0;
+                imp->state = IMPORTER_STATE_FRAME_SIZE;
+                return 0; /* continue */
+
+        default:
+                assert_not_reached();
+        }
+}
+
 int journal_importer_process_data(JournalImporter *imp) {
         int r;
 
+        if (IN_SET(imp->state, IMPORTER_STATE_FRAME_HEADER, IMPORTER_STATE_FRAME_SIZE, IMPORTER_STATE_FRAME_DATA))
+                return process_framed_data(imp);
+
         switch (imp->state) {
         case IMPORTER_STATE_LINE: {
                 char *line, *sep;
@@ -477,6 +605,14 @@ void journal_importer_drop_iovw(JournalImporter *imp) {
         }
 }
 
+void journal_importer_set_framed(JournalImporter *imp) {
+        assert(imp);
+        assert(imp->state == IMPORTER_STATE_LINE);
+        assert(imp->offset == 0);
+
+        imp->state = IMPORTER_STATE_FRAME_HEADER;
+}
+
 bool journal_importer_eof(const JournalImporter *imp) {
         return imp->state == IMPORTER_STATE_EOF;
 }
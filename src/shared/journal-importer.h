@@ -25,6 +25,10 @@
 /* The maximum number of fields in an entry */
 #define ENTRY_FIELD_COUNT_MAX 1024u
 
+/* The framed format starts each entry with the realtime and monotonic timestamps as 64-bit little endian
+ * integers, followed by the boot ID. See docs/JOURNAL_EXPORT_FORMATS.md. */
+#define JOURNAL_FRAME_HEADER_SIZE (8U + 8U + 16U)
+
 typedef struct JournalImporter {
         int fd;
         bool passive_fd;
@@ -53,6 +57,7 @@ int journal_importer_process_data(JournalImporter *);
 int journal_importer_push_data(JournalImporter *, const char *data, size_t size);
 void journal_importer_drop_iovw(JournalImporter *);
 bool journal_importer_eof(const JournalImporter *);
+void journal_importer_set_framed(JournalImporter *);
 
 static inline size_t journal_importer_bytes_remaining(const JournalImporter *imp) {
         return imp->filled;
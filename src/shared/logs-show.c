@@ -1434,6 +1434,49 @@ int show_journal_entry(
         return r;
 }
 
+int journal_set_data_fields_for_output(sd_journal *j, OutputMode mode, const Set *output_fields) {
+        _cleanup_strv_free_ char **fields = NULL;
+        const char *field;
+        int r;
+
+        assert(j);
+        assert(mode >= 0);
+        assert(mode < _OUTPUT_MODE_MAX);
+
+        /* Tells sd-journal which fields show_journal_entry() is going to look at when enumerating the data of
+         * an entry, so that the others are skipped over without being decompressed and copied. Fields that
+         * are looked up with sd_journal_get_data() don't need to be listed here. */
+
+        if (IN_SET(mode, OUTPUT_SHORT, OUTPUT_SHORT_FULL, OUTPUT_SHORT_ISO, OUTPUT_SHORT_ISO_PRECISE,
+                   OUTPUT_SHORT_PRECISE, OUTPUT_SHORT_MONOTONIC, OUTPUT_SHORT_DELTA, OUTPUT_SHORT_UNIX,
+                   OUTPUT_WITH_UNIT)) {
+                /* Keep in sync with the fields parsed by output_short() */
+                fields = strv_new("_PID", "_COMM", "MESSAGE", "PRIORITY", "_TRANSPORT", "_HOSTNAME",
+                                  "SYSLOG_PID", "SYSLOG_IDENTIFIER", "CONFIG_FILE", "_SYSTEMD_UNIT",
+                                  "_SYSTEMD_USER_UNIT", "DOCUMENTATION");
+                if (!fields)
+                        return -ENOMEM;
+
+        } else if (mode == OUTPUT_CAT) {
+                /* output_cat() looks up its fields explicitly */
+
+        } else if (!set_isempty(output_fields)) {
+                SET_FOREACH(field, output_fields) {
+                        r = strv_extend(&fields, field);
+                        if (r < 0)
+                                return r;
+                }
+        } else
+                return sd_journal_set_data_fields(j, NULL);
+
+        /* Used by get_display_timestamp() for all modes */
+        r = strv_extend_strv(&fields, STRV_MAKE("_SOURCE_REALTIME_TIMESTAMP", "_SOURCE_MONOTONIC_TIMESTAMP"), false);
+        if (r < 0)
+                return r;
+
+        return sd_journal_set_data_fields(j, fields);
+}
+
 static int maybe_print_begin_newline(FILE *f, OutputFlags *flags) {
         assert(f);
         assert(flags);
@@ -1470,6 +1513,10 @@ int show_journal(
         assert(mode >= 0);
         assert(mode < _OUTPUT_MODE_MAX);
 
+        r = journal_set_data_fields_for_output(j, mode, /* output_fields= */ NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to set journal data fields: %m");
+
         if (how_many == UINT_MAX)
                 need_seek = true;
         else {
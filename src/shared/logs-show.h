@@ -24,6 +24,8 @@ int show_journal_entry(
                 bool *ellipsized,
                 dual_timestamp *previous_display_ts,
                 sd_id128_t *previous_boot_id);
+int journal_set_data_fields_for_output(sd_journal *j, OutputMode mode, const Set *output_fields);
+
 int show_journal(
                 FILE *f,
                 sd_journal *j,
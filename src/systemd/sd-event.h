@@ -19,6 +19,7 @@
 
 #include <inttypes.h>
 #include <signal.h>
+#include <stdio.h>
 #include <sys/epoll.h>
 #include <sys/inotify.h>
 #include <sys/signalfd.h>
@@ -68,6 +69,11 @@ enum {
         SD_EVENT_PRIORITY_IDLE = 100
 };
 
+enum {
+        SD_EVENT_BACKEND_EPOLL,
+        SD_EVENT_BACKEND_IO_URING
+};
+
 #define SD_EVENT_SIGNAL_PROCMASK (1 << 30)
 
 typedef int (*sd_event_handler_t)(sd_event_source *s, void *userdata);
@@ -80,6 +86,8 @@ typedef int (*sd_event_child_handler_t)(sd_event_source *s, const siginfo_t *si,
 typedef void* sd_event_child_handler_t;
 #endif
 typedef int (*sd_event_inotify_handler_t)(sd_event_source *s, const struct inotify_event *event, void *userdata);
+typedef int (*sd_event_offload_work_t)(void *userdata);
+typedef int (*sd_event_offload_handler_t)(sd_event_source *s, int result, void *userdata);
 typedef _sd_destroy_t sd_event_destroy_t;
 
 int sd_event_default(sd_event **e);
@@ -100,6 +108,7 @@ int sd_event_add_defer(sd_event *e, sd_event_source **s, sd_event_handler_t call
 int sd_event_add_post(sd_event *e, sd_event_source **s, sd_event_handler_t callback, void *userdata);
 int sd_event_add_exit(sd_event *e, sd_event_source **s, sd_event_handler_t callback, void *userdata);
 int sd_event_add_memory_pressure(sd_event *e, sd_event_source **s, sd_event_handler_t callback, void *userdata);
+int sd_event_add_offload(sd_event *e, sd_event_source **s, sd_event_offload_work_t work, sd_event_offload_handler_t callback, void *userdata);
 
 int sd_event_prepare(sd_event *e);
 int sd_event_wait(sd_event *e, uint64_t usec);
@@ -118,6 +127,13 @@ int sd_event_set_watchdog(sd_event *e, int b);
 int sd_event_get_watchdog(sd_event *e);
 int sd_event_get_iteration(sd_event *e, uint64_t *ret);
 int sd_event_set_signal_exit(sd_event *e, int b);
+int sd_event_set_dispatch_budget(sd_event *e, uint64_t usec);
+int sd_event_get_dispatch_budget(sd_event *e, uint64_t *ret);
+int sd_event_dump_statistics(sd_event *e, FILE *f);
+int sd_event_set_offload_threads(sd_event *e, unsigned n);
+int sd_event_get_offload_threads(sd_event *e, unsigned *ret);
+int sd_event_set_backend(sd_event *e, int backend);
+int sd_event_get_backend(sd_event *e);
 
 sd_event_source* sd_event_source_ref(sd_event_source *s);
 sd_event_source* sd_event_source_unref(sd_event_source *s);
@@ -174,6 +190,7 @@ int sd_event_source_get_ratelimit(sd_event_source *s, uint64_t *ret_interval_use
 int sd_event_source_is_ratelimited(sd_event_source *s);
 int sd_event_source_set_ratelimit_expire_callback(sd_event_source *s, sd_event_handler_t callback);
 int sd_event_source_leave_ratelimit(sd_event_source *s);
+int sd_event_source_get_statistics(sd_event_source *s, uint64_t *ret_n_dispatched, uint64_t *ret_dispatch_usec, uint64_t *ret_dispatch_max_usec, uint64_t *ret_pending_usec, uint64_t *ret_pending_max_usec);
 
 int sd_event_trim_memory(void);
 
@@ -268,6 +268,60 @@ static void test_lz4_decompress_partial(void) {
 }
 #endif
 
+#if HAVE_ZSTD
+static void test_zstd_dictionary(void) {
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL, *raw = NULL;
+        _cleanup_free_ size_t *sizes = NULL;
+        _cleanup_free_ char *samples = NULL;
+        _cleanup_free_ void *dictionary = NULL, *buf = NULL;
+        const char *message = "MESSAGE=Started Session 4711 of User lennart.";
+        char compressed[512];
+        size_t n = 0, dictionary_size, compressed_size, plain_size;
+
+        log_info("/* %s */", __func__);
+
+        /* Too few samples to train from */
+        assert_se(compress_dictionary_train(message, (size_t[]) { strlen(message) }, 1, 4096,
+                                            &dictionary, &dictionary_size) == -EINVAL);
+
+        assert_se(sizes = new(size_t, 2000));
+        for (unsigned i = 0; i < 2000; i++) {
+                _cleanup_free_ char *t = NULL;
+
+                assert_se(asprintf(&t, "MESSAGE=%s Session %u of User user%u.", i % 2 ? "Started" : "Stopped", i, i % 17) >= 0);
+                assert_se(strextend(&samples, t));
+                sizes[n++] = strlen(t);
+        }
+
+        assert_se(compress_dictionary_train(samples, sizes, n, 4096, &dictionary, &dictionary_size) >= 0);
+        assert_se(dictionary_size > 0 && dictionary_size <= 4096);
+        assert_se(compress_dictionary_new(dictionary, dictionary_size, &d) >= 0);
+        assert_se(compress_dictionary_id(d) != 0);
+
+        /* Raw content is not accepted as dictionary, as it has no ID */
+        assert_se(compress_dictionary_new(message, strlen(message), &raw) == -EBADMSG);
+
+        assert_se(compress_blob_zstd_with_dictionary(d, message, strlen(message), compressed, sizeof(compressed), &compressed_size) >= 0);
+        log_info("ZSTD with dictionary: %zu → %zu", strlen(message), compressed_size);
+        assert_se(compressed_size < strlen(message));
+
+        assert_se(decompress_blob_zstd_with_dictionary(d, compressed, compressed_size, &buf, &plain_size, 0) >= 0);
+        assert_se(memcmp_nn(buf, plain_size, message, strlen(message)) == 0);
+
+        /* The frame refers to the dictionary, which has to be available */
+        assert_se(decompress_blob_zstd(compressed, compressed_size, &buf, &plain_size, 0) == -EBADMSG);
+        assert_se(decompress_startswith_zstd(compressed, compressed_size, &buf, "MESSAGE", 7, '=') == -EBADMSG);
+
+        assert_se(decompress_startswith_zstd_with_dictionary(d, compressed, compressed_size, &buf, "MESSAGE", 7, '=') > 0);
+        assert_se(decompress_startswith_zstd_with_dictionary(d, compressed, compressed_size, &buf, "MESSAGE", 7, 'x') == 0);
+
+        /* Frames compressed without dictionary are decompressed without it, even if one is passed */
+        assert_se(compress_blob_zstd(message, strlen(message), compressed, sizeof(compressed), &compressed_size) >= 0);
+        assert_se(decompress_blob_zstd_with_dictionary(d, compressed, compressed_size, &buf, &plain_size, 0) >= 0);
+        assert_se(memcmp_nn(buf, plain_size, message, strlen(message)) == 0);
+}
+#endif
+
 int main(int argc, char *argv[]) {
 #if HAVE_COMPRESSION
         _unused_ const char text[] =
@@ -362,6 +416,8 @@ int main(int argc, char *argv[]) {
                              compress_stream_zstd, decompress_stream_zstd, srcfile);
 
         test_decompress_startswith_short("ZSTD", compress_blob_zstd, decompress_startswith_zstd);
+
+        test_zstd_dictionary();
 #else
         log_info("/* ZSTD test skipped */");
 #endif
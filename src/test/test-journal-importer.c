@@ -5,11 +5,13 @@
 #include <fcntl.h>
 
 #include "alloc-util.h"
+#include "fd-util.h"
 #include "log.h"
 #include "journal-importer.h"
 #include "path-util.h"
 #include "string-util.h"
 #include "tests.h"
+#include "unaligned.h"
 
 static void assert_iovec_entry(const struct iovec *iovec, const char* content) {
         assert_se(strlen(content) == iovec->iov_len);
@@ -68,4 +70,83 @@ TEST(bad_input) {
         assert_se(journal_importer_eof(&imp));
 }
 
+static size_t put_frame_header(uint8_t *p, uint64_t realtime, uint64_t monotonic, sd_id128_t boot_id) {
+        unaligned_write_le64(p, realtime);
+        unaligned_write_le64(p + 8, monotonic);
+        memcpy(p + 16, boot_id.bytes, sizeof(boot_id.bytes));
+
+        return JOURNAL_FRAME_HEADER_SIZE;
+}
+
+static size_t put_frame_field(uint8_t *p, const char *field, size_t size) {
+        unaligned_write_le64(p, size);
+        memcpy_safe(p + 8, field, size);
+
+        return 8 + size;
+}
+
+TEST(framed_parsing) {
+        _cleanup_(journal_importer_cleanup) JournalImporter imp = JOURNAL_IMPORTER_INIT(-1);
+        _cleanup_close_pair_ int fds[2] = PIPE_EBADF;
+        sd_id128_t boot_id = SD_ID128_MAKE(15,31,fd,22,ec,84,42,9e,85,ae,88,8b,12,fa,db,91);
+        uint8_t buf[512];
+        size_t n = 0;
+        int r;
+
+        /* Two entries, the first with a binary field and some fields that are to be ignored */
+        n += put_frame_header(buf + n, 1478389147837945, 12345, boot_id);
+        n += put_frame_field(buf + n, "_BOOT_ID=1531fd22ec84429e85ae888b12fadb91", STRLEN("_BOOT_ID=1531fd22ec84429e85ae888b12fadb91"));
+        n += put_frame_field(buf + n, "__CURSOR=s=whatever", STRLEN("__CURSOR=s=whatever"));
+        n += put_frame_field(buf + n, "MESSAGE=hello", STRLEN("MESSAGE=hello"));
+        n += put_frame_field(buf + n, "invalid=field", STRLEN("invalid=field"));
+        n += put_frame_field(buf + n, "BINARY=a\0b\n", STRLEN("BINARY=a") + 3);
+        n += put_frame_field(buf + n, NULL, 0);
+        n += put_frame_header(buf + n, 1478389147837946, 12346, boot_id);
+        n += put_frame_field(buf + n, "MESSAGE=world", STRLEN("MESSAGE=world"));
+        n += put_frame_field(buf + n, NULL, 0);
+        assert_se(n <= sizeof(buf));
+
+        /* Feed the data one byte at a time, so that every state has to wait for more input */
+        assert_se(pipe2(fds, O_CLOEXEC) >= 0);
+        imp.fd = fds[0];
+        imp.passive_fd = true;
+        journal_importer_set_framed(&imp);
+
+        for (size_t i = 0, entry = 0; i < n; i++) {
+                assert_se(journal_importer_push_data(&imp, (const char*) buf + i, 1) >= 0);
+
+                do
+                        r = journal_importer_process_data(&imp);
+                while (r == 0);
+
+                if (r == -EAGAIN)
+                        continue;
+                assert_se(r == 1);
+
+                assert_se(sd_id128_equal(imp.boot_id, boot_id));
+
+                if (entry++ == 0) {
+                        assert_se(imp.ts.realtime == 1478389147837945);
+                        assert_se(imp.ts.monotonic == 12345);
+
+                        assert_se(imp.iovw.count == 3);
+                        assert_iovec_entry(&imp.iovw.iovec[0], "_BOOT_ID=1531fd22ec84429e85ae888b12fadb91");
+                        assert_iovec_entry(&imp.iovw.iovec[1], "MESSAGE=hello");
+                        assert_se(imp.iovw.iovec[2].iov_len == STRLEN("BINARY=a") + 3);
+                        assert_se(memcmp(imp.iovw.iovec[2].iov_base, "BINARY=a\0b\n", STRLEN("BINARY=a") + 3) == 0);
+                } else {
+                        assert_se(i == n - 1);
+                        assert_se(imp.ts.realtime == 1478389147837946);
+                        assert_se(imp.ts.monotonic == 12346);
+
+                        assert_se(imp.iovw.count == 1);
+                        assert_iovec_entry(&imp.iovw.iovec[0], "MESSAGE=world");
+                }
+
+                journal_importer_drop_iovw(&imp);
+        }
+
+        assert_se(journal_importer_bytes_remaining(&imp) == 0);
+}
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
@@ -120,4 +120,40 @@ TEST(struct) {
         assert_se(set_isempty(s));
 }
 
+static int test_compare_r(const void *a, const void *b, void *userdata) {
+        const unsigned *values = ASSERT_PTR(userdata);
+
+        return CMP(values[PTR_TO_UINT(a)], values[PTR_TO_UINT(b)]);
+}
+
+TEST(userdata) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        unsigned values[SET_SIZE], idx[SET_SIZE], previous = 0;
+        void *p;
+
+        srand(0);
+
+        /* The queued items are mere indexes into a table of values that is only known to the comparison
+         * function via the userdata pointer. */
+        assert_se(q = prioq_new_r(test_compare_r, values));
+
+        for (unsigned i = 1; i < SET_SIZE; i++) {
+                values[i] = (unsigned) rand() + 1;
+                assert_se(prioq_put(q, UINT_TO_PTR(i), idx + i) >= 0);
+        }
+
+        /* Changing the value of an item requires a reshuffle */
+        values[SET_SIZE/2] = 0;
+        prioq_reshuffle(q, UINT_TO_PTR(SET_SIZE/2), idx + SET_SIZE/2);
+        assert_se(prioq_peek(q) == UINT_TO_PTR(SET_SIZE/2));
+
+        for (unsigned i = 1; i < SET_SIZE; i++) {
+                assert_se(p = prioq_pop(q));
+                assert_se(previous <= values[PTR_TO_UINT(p)]);
+                previous = values[PTR_TO_UINT(p)];
+        }
+
+        assert_se(prioq_isempty(q));
+}
+
 DEFINE_TEST_MAIN(LOG_INFO);
@@ -820,6 +820,34 @@ TEST(get_process_ppid) {
         }
 }
 
+TEST(get_process_start_time) {
+        uint64_t a, b;
+        pid_t pid;
+
+        assert_se(get_process_start_time(getpid_cached(), &a) >= 0);
+        assert_se(get_process_start_time(getpid_cached(), &b) >= 0);
+        assert_se(a == b);
+
+        assert_se(get_process_start_time(1, &b) >= 0);
+        assert_se(b <= a);
+
+        /* A child necessarily started at the same tick as us or later */
+        pid = fork();
+        assert_se(pid >= 0);
+        if (pid == 0) {
+                (void) pause();
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(get_process_start_time(pid, &b) >= 0);
+        assert_se(b >= a);
+
+        assert_se(kill(pid, SIGKILL) >= 0);
+        assert_se(wait_for_terminate(pid, NULL) >= 0);
+
+        assert_se(get_process_start_time(pid, NULL) == -ESRCH);
+}
+
 TEST(set_oom_score_adjust) {
         int a, b, r;
 